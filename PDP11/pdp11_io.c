@@ -249,8 +249,41 @@ return uba_last;
      trimmed to 18b.
    - In a Qbus configuration, the map is always disabled.
      Device addresses are trimmed to 22b.
+
+   M is an array of words, so the word routines copy each contiguous
+   run of memory with a single memcpy, on any host.
+*/
+
+#if !defined (UC15)
+
+/* Map a run of contiguous Unibus map pages - caller checks cpu_bme
+
+   Returns the number of bytes, from ba up to lim, that map to contiguous
+   main memory, or 0 if ba maps to NXM; *ma is the memory address of ba.
+   uba_last is left at the last word of the run.
 */
 
+static uint32 Map_Run (uint32 ba, uint32 lim, uint32 *ma)
+{
+uint32 lnt;
+
+*ma = Map_Addr (ba);                                    /* map start */
+if (!ADDR_IS_MEM (*ma))                                 /* NXM? */
+    return 0;
+lnt = UBM_PAGSIZE - UBM_GETOFF (ba);                    /* rest of page */
+while (((ba + lnt) < lim) &&                            /* more, contig? */
+       (Map_Addr (ba + lnt) == (*ma + lnt)))
+    lnt = lnt + UBM_PAGSIZE;
+if (lnt > (lim - ba))                                   /* limit to xfr */
+    lnt = lim - ba;
+if (!ADDR_IS_MEM (*ma + lnt - 1))                       /* runs into NXM? */
+    lnt = (uint32) MEMSIZE - *ma;
+Map_Addr (ba + lnt - 2);                                /* last word */
+return lnt;
+}
+
+#endif
+
 int32 Map_ReadB (uint32 ba, int32 bc, uint8 *buf)
 {
 uint32 alim, lim, ma;
@@ -296,6 +329,9 @@ else {                                                  /* physical */
 int32 Map_ReadW (uint32 ba, int32 bc, uint16 *buf)
 {
 uint32 alim, lim, ma;
+#if !defined (UC15)
+uint32 lnt;
+#endif
 
 /* I/O Page DMA only on Unibus systems */
 if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
@@ -315,12 +351,22 @@ if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
 ba = (ba & BUSMASK) & ~01;                              /* trim, align addr */
 lim = ba + (bc & ~01);
 if (cpu_bme) {                                          /* map enabled? */
+#if !defined (UC15)
+    for ( ; ba < lim; ba = ba + lnt) {                  /* by runs */
+        lnt = Map_Run (ba, lim, &ma);
+        if (lnt == 0)                                   /* NXM? err */
+            return (lim - ba);
+        memcpy (buf, &M[ma >> 1], lnt);
+        buf = buf + (lnt >> 1);
+        }
+#else
     for (; ba < lim; ba = ba + 2) {                     /* by words */
         ma = Map_Addr (ba);                             /* map addr */
         if (!ADDR_IS_MEM (ma))                          /* NXM? err */
             return (lim - ba);
         *buf++ = (uint16) RdMemW (ma);
         }
+#endif
     return 0;
     }
 else {                                                  /* physical */
@@ -329,9 +375,14 @@ else {                                                  /* physical */
     else if (ADDR_IS_MEM (ba))                          /* no, strt ok? */
         alim = MEMSIZE;
     else return bc;                                     /* no, err */
+#if !defined (UC15)
+    if (alim > ba)
+        memcpy (buf, &M[ba >> 1], alim - ba);
+#else
     for ( ; ba < alim; ba = ba + 2) {                   /* by words */
         *buf++ = (uint16) RdMemW (ba);
         }
+#endif
     return (lim - alim);
     }
 }
@@ -378,6 +429,9 @@ else {                                                  /* physical */
 int32 Map_WriteW (uint32 ba, int32 bc, const uint16 *buf)
 {
 uint32 alim, lim, ma;
+#if !defined (UC15)
+uint32 lnt;
+#endif
 
 /* I/O Page DMA only on Unibus systems */
 if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
@@ -395,12 +449,22 @@ if (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK))) {
 ba = (ba & BUSMASK) & ~01;                              /* trim, align addr */
 lim = ba + (bc & ~01);
 if (cpu_bme) {                                          /* map enabled? */
+#if !defined (UC15)
+    for ( ; ba < lim; ba = ba + lnt) {                  /* by runs */
+        lnt = Map_Run (ba, lim, &ma);
+        if (lnt == 0)                                   /* NXM? err */
+            return (lim - ba);
+        memcpy (&M[ma >> 1], buf, lnt);
+        buf = buf + (lnt >> 1);
+        }
+#else
     for (; ba < lim; ba = ba + 2) {                     /* by words */
         ma = Map_Addr (ba);                             /* map addr */
         if (!ADDR_IS_MEM (ma))                          /* NXM? err */
             return (lim - ba);
         WrMemW (ma, *buf++);
         }
+#endif
     return 0;
     }
 else {                                                  /* physical */
@@ -409,13 +473,59 @@ else {                                                  /* physical */
     else if (ADDR_IS_MEM (ba))                          /* no, strt ok? */
         alim = MEMSIZE;
     else return bc;                                     /* no, err */
+#if !defined (UC15)
+    if (alim > ba)
+        memcpy (&M[ba >> 1], buf, alim - ba);
+#else
     for ( ; ba < alim; ba = ba + 2) {                   /* by words */
         WrMemW (ba, *buf++);
         }
+#endif
     return (lim - alim);
     }
 }
 
+/* Direct access to a DMA buffer
+
+   Returns the host address of the memory that bus addresses ba through
+   ba + bc - 1 reach, if the whole buffer is contiguous main memory and
+   memory is in host byte order (i.e., can be read or written as a byte
+   stream); otherwise NULL, and the caller uses the Map_ routines.
+   wr is unused here; it is for adapters that track transfer direction.
+*/
+
+void *Map_Direct (uint32 ba, int32 bc, t_bool wr)
+{
+#if defined (UC15)
+return NULL;
+#else
+uint32 lim, ma;
+
+if (!sim_end || (bc <= 0) ||                            /* big endian? */
+    (UNIBUS && (ba >= (uint32)(IOPAGEBASE & UNIMASK)))) /* I/O page? */
+    return NULL;
+ba = ba & BUSMASK;                                      /* trim address */
+lim = ba + bc;
+if (cpu_bme) {                                          /* map enabled? */
+    if (Map_Run (ba, lim, &ma) != (uint32) bc)          /* not contig? */
+        return NULL;
+    }
+else {                                                  /* physical */
+    if (!ADDR_IS_MEM (lim - 1))                         /* NXM? */
+        return NULL;
+    ma = ba;
+    }
+return (void *) (((uint8 *) M) + ma);
+#endif
+}
+
+/* Direct access completion - nothing tracks memory writes here */
+
+void Map_DirectDone (void *buf, int32 bc)
+{
+return;
+}
+
 /* Build tables from device list */
 
 t_stat build_dib_tab (void)
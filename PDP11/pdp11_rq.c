@@ -158,8 +158,10 @@ extern int32 MMR2;
 
 #define UNIT_V_ONL      (DKUF_V_UF + 0)                 /* online */
 #define UNIT_V_ATP      (UNIT_V_ONL + 1)                /* attn pending */
+#define UNIT_V_ZCP      (UNIT_V_ATP + 1)                /* zero copy xfers */
 #define UNIT_ONL        (1 << UNIT_V_ONL)
 #define UNIT_ATP        (1 << UNIT_V_ATP)
+#define UNIT_ZCP        (1 << UNIT_V_ZCP)
 #define cpkt            us9                             /* current packet */
 #define pktq            us10                            /* packet queue */
 #define uf              buf                             /* settable unit flags */
@@ -168,6 +170,8 @@ extern int32 MMR2;
 #define io_status       u5                              /* io status from callback */
 #define io_complete     u6                              /* io completion flag */
 #define rqxb            up11                            /* xfer buffer */
+#define rqxp            up7                             /* zero copy buffer */
+#define rqdepth         u3                              /* async xfer depth */
 #define RQ_RMV(u)       ((u->drvtyp->flags & RQDF_RMV)? \
                         UF_RMV: 0)
 #define RQ_WPH(u)       (((u->drvtyp->flags & RQDF_RO) || \
@@ -991,6 +995,17 @@ int32 rq_itime4 = 10;                                   /* stage 4 */
 int32 rq_qtime = RQ_QTIME;                              /* queue time */
 int32 rq_xtime = RQ_XTIME;                              /* transfer time */
 
+#define RQ_XFR_NONE     0                               /* not started early */
+#define RQ_XFR_RUN      1                               /* in progress */
+#define RQ_XFR_DONE     2                               /* complete */
+
+struct rqxfr {                                          /* early transfer */
+    uint16              state;                          /* state */
+    uint16              wait;                           /* rq_svc waiting */
+    t_stat              status;                         /* completion status */
+    uint16              *buf;                           /* transfer buffer */
+    };
+
 typedef struct {
     uint32              cnum;                           /* ctrl number */
     uint32              sa;                             /* status, addr */
@@ -1013,6 +1028,7 @@ typedef struct {
     struct uq_ring      cq;                             /* cmd ring */
     struct uq_ring      rq;                             /* rsp ring */
     struct rqpkt        pak[RQ_NPKTS];                  /* packet queue */
+    struct rqxfr        xfr[RQ_NPKTS];                  /* early transfers */
     uint16              max_plug;                       /* highest unit plug number */
     } MSC;
 
@@ -1078,6 +1094,8 @@ t_stat rq_set_wlk (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat rq_set_ctype (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat rq_set_plug (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat rq_show_plug (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat rq_set_depth (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat rq_show_depth (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat rq_set_drives (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat rq_show_ctype (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat rq_show_wlk (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
@@ -1111,10 +1129,14 @@ t_bool rq_getdesc (MSC *cp, struct uq_ring *ring, uint32 *desc);
 t_bool rq_putdesc (MSC *cp, struct uq_ring *ring, uint32 desc);
 uint16 rq_rw_valid (MSC *cp, uint16 pkt, UNIT *uptr, uint16 cmd);
 t_bool rq_rw_end (MSC *cp, UNIT *uptr, uint16 flg, uint16 sts);
+void rq_issue (MSC *cp, UNIT *uptr);
+void rq_xfr_free (MSC *cp, UNIT *uptr, uint16 pkt);
 uint32 rq_map_ba (uint32 ba, uint32 ma);
 int32 rq_readb (uint32 ba, int32 bc, uint32 ma, uint8 *buf);
 int32 rq_readw (uint32 ba, int32 bc, uint32 ma, uint16 *buf);
 int32 rq_writew (uint32 ba, int32 bc, uint32 ma, uint16 *buf);
+void *rq_direct (uint32 ba, int32 bc, uint32 ma, t_bool wr);
+void rq_direct_done (void *buf, int32 bc);
 void rq_putr (MSC *cp, uint16 pkt, uint16 cmd, uint16 flg,
     uint16 sts, uint16 lnt, uint16 typ);
 void rq_putr_unit (MSC *cp, uint16 pkt, UNIT *uptr, uint16 lu, t_bool all);
@@ -1193,6 +1215,12 @@ MTAB rq_mod[] = {
         &rq_set_wlk, &rq_show_wlk, NULL, "Write enable disk drive" },
     { MTAB_XTD|MTAB_VUN,        1,  NULL, "LOCKED", 
         &rq_set_wlk, NULL, NULL, "Write lock disk drive"  },
+    { UNIT_ZCP, UNIT_ZCP, "zero copy", "ZEROCOPY",
+        NULL, NULL, NULL, "Transfer directly between disk and memory" },
+    { UNIT_ZCP, 0, NULL, "NOZEROCOPY",
+        NULL, NULL, NULL, "Transfer through the controller buffer" },
+    { MTAB_XTD|MTAB_VUN|MTAB_VALR|MTAB_NMO, 0, "ASYNCH", "ASYNCH=depth",
+        &rq_set_depth, &rq_show_depth, NULL, "Set number of concurrent transfers (1-32)" },
     { MTAB_XTD|MTAB_VDV|MTAB_NMO, RQ_SH_RI, "RINGS", NULL,
       NULL, &rq_show_ctrl, NULL, "Display command and response rings" },
     { MTAB_XTD|MTAB_VDV|MTAB_NMO, RQ_SH_FR, "FREEQ", NULL,
@@ -1815,6 +1843,7 @@ if ((uptr = rq_getucb (cp, lu))) {                      /* get unit */
         tpkt = uptr->cpkt;                              /* save match */
         uptr->cpkt = 0;                                 /* gonzo */
         sim_cancel (uptr);                              /* cancel unit */
+        rq_xfr_free (cp, uptr, tpkt);
         sim_activate (dptr->units + RQ_QUEUE, rq_qtime);
         }
     else if (uptr->pktq &&                              /* head of q? */
@@ -1833,6 +1862,7 @@ if ((uptr = rq_getucb (cp, lu))) {                      /* get unit */
         }
     if (tpkt) {                                         /* found target? */
         uint16 tcmd = GETP (tpkt, CMD_OPC, OPC);        /* get opcode */
+        rq_xfr_free (cp, uptr, tpkt);                   /* discard early xfer */
         rq_putr (cp, tpkt, tcmd | OP_END, 0, ST_ABO, RSP_LNT, UQ_TYP_SEQ);
         if (!rq_putpkt (cp, tpkt, TRUE))
             return ERR;
@@ -2098,6 +2128,7 @@ if ((uptr = rq_getucb (cp, lu))) {                      /* unit exist? */
 
         rq_enqt (cp, &tpktq, pkt);                      /* do later */
         uptr->pktq = tpktq;
+        rq_issue (cp, uptr);                            /* maybe start early */
         return OK;
         }
     sts = rq_rw_valid (cp, pkt, uptr, cmd);             /* validity checks */
@@ -2116,6 +2147,7 @@ if ((uptr = rq_getucb (cp, lu))) {                      /* unit exist? */
         sim_debug (DBG_TRC, rq_devmap[cp->cnum], "rq_rw - started\n");
         return OK;                                      /* done */
         }
+    rq_xfr_free (cp, uptr, pkt);                        /* discard early xfer */
     }
 else sts = ST_OFL;                                      /* offline */
 cp->pak[pkt].d[RW_BCL] = cp->pak[pkt].d[RW_BCH] = 0;    /* bad packet */
@@ -2176,6 +2208,133 @@ uptr->io_complete = 1;
 sim_activate_notbefore (uptr, uptr->iostarttime+rq_xtime);
 }
 
+/* Early transfer completion callback */
+
+void rq_xfr_done (UNIT *uptr, t_stat status, void *arg)
+{
+MSC *cp = rq_ctxmap[uptr->cnum];
+struct rqxfr *xp = (struct rqxfr *)arg;
+uint16 pkt = (uint16)(xp - cp->xfr);
+
+sim_debug (DBG_TRC, rq_devmap[cp->cnum], "rq_xfr_done(pkt=%d, status=%d)\n", pkt, status);
+
+xp->status = status;
+xp->state = RQ_XFR_DONE;
+if (xp->wait && (uptr->cpkt == pkt)) {                  /* rq_svc waiting? */
+    xp->wait = 0;
+    sim_activate_notbefore (uptr, uptr->iostarttime+rq_xtime);
+    }
+}
+
+/* Early transfer overlaps an earlier transfer it must follow? */
+
+t_bool rq_xfr_conflict (MSC *cp, UNIT *uptr, uint16 pkt, uint16 cmd)
+{
+uint32 lbn = GETP32 (pkt, RW_LBNL);
+uint32 end = lbn + ((GETP32 (pkt, RW_BCL) + (RQ_NUMBY - 1)) / RQ_NUMBY);
+uint32 tlbn, tend;
+uint16 tpkt, tcmd;
+
+for (tpkt = uptr->cpkt? uptr->cpkt: uptr->pktq; tpkt && (tpkt != pkt);
+     tpkt = (tpkt == uptr->cpkt)? uptr->pktq: cp->pak[tpkt].link) {
+    tcmd = GETP (tpkt, CMD_OPC, OPC);
+    if ((cmd == OP_RD) && (tcmd == OP_RD))              /* reads can pass reads */
+        continue;
+    tlbn = GETP32 (tpkt, RW_LBNL);
+    tend = tlbn + ((GETP32 (tpkt, RW_BCL) + (RQ_NUMBY - 1)) / RQ_NUMBY);
+    if ((lbn < tend) && (tlbn < end))                   /* overlap? */
+        return TRUE;
+    }
+return FALSE;
+}
+
+/* Start queued transfers early
+
+   With ASYNCH set greater than 1, reads and writes waiting in the unit's
+   packet queue are started ahead of their turn, so that the host has
+   several requests in progress at once.  A transfer started early keeps
+   its data in a buffer of its own until rq_svc reaches its packet, so
+   packets still complete, and reads still reach memory, in order.
+
+   Only transfers which fit in one buffer, pass the validity checks now,
+   and don't overlap an earlier write (or for a write, any earlier
+   transfer) are started.  Any other command in the queue stops the scan.
+
+   Write data is fetched from memory when the transfer is started.  MSCP
+   gives the controller the host buffer from the moment a command is
+   queued until its end message, and a real controller may DMA the data
+   at any time in between, so a host can't depend on a later copy.
+
+   The depth is applied to the disk here as well as at attach, since a
+   RESTORE which keeps the unit attached doesn't go through rq_attach. */
+
+void rq_issue (MSC *cp, UNIT *uptr)
+{
+uint32 depth = uptr->rqdepth;
+uint32 n, i, lbn, bc, ba, ma, wwc;
+uint16 pkt, cmd;
+struct rqxfr *xp;
+
+if ((depth <= 1) ||                                     /* one at a time? */
+    ((uptr->flags & UNIT_ATT) == 0))
+    return;
+sim_disk_set_async_depth (uptr, depth);                 /* no-op unless restored */
+if (sim_disk_get_async_depth (uptr) <= 1)               /* can't overlap? */
+    return;
+for (pkt = uptr->pktq, n = (uptr->cpkt != 0); pkt; pkt = cp->pak[pkt].link) {
+    if (cp->xfr[pkt].state != RQ_XFR_NONE)              /* count started */
+        n++;
+    }
+for (pkt = uptr->pktq; pkt && (n < depth); pkt = cp->pak[pkt].link) {
+    xp = &cp->xfr[pkt];
+    cmd = GETP (pkt, CMD_OPC, OPC);
+    if ((cmd != OP_RD) && (cmd != OP_WR))               /* not read or write? */
+        break;
+    if (xp->state != RQ_XFR_NONE)                       /* already started? */
+        continue;
+    lbn = GETP32 (pkt, RW_LBNL);
+    bc = GETP32 (pkt, RW_BCL);
+    ba = GETP32 (pkt, RW_BAL);
+    ma = GETP32 (pkt, RW_MAPL);
+    if ((bc == 0) || (bc > RQ_MAXFR) ||                 /* one buffer, valid? */
+        rq_rw_valid (cp, pkt, uptr, cmd) ||
+        rq_xfr_conflict (cp, uptr, pkt, cmd))           /* must wait? */
+        continue;
+    if (xp->buf == NULL) {
+        xp->buf = (uint16 *) malloc ((RQ_MAXFR >> 1) * sizeof (uint16));
+        if (xp->buf == NULL)
+            return;
+        }
+    wwc = ((bc + (RQ_NUMBY - 1)) & ~(RQ_NUMBY - 1)) >> 1;
+    if (cmd == OP_WR) {                                 /* write? */
+        if (rq_readw (ba, bc, ma, xp->buf))             /* fetch, nxm? */
+            continue;                                   /* do it in order */
+        for (i = (bc >> 1); i < wwc; i++)
+            xp->buf[i] = 0;
+        sim_disk_data_trace(uptr, (uint8 *)xp->buf, lbn, wwc << 1, "sim_disk_wrsect-WR", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
+        }
+    sim_debug (DBG_TRC, rq_devmap[cp->cnum], "rq_issue(pkt=%d, cmd=%s, lbn=%0X, bc=%0x)\n",
+               pkt, rq_cmdname[cp->pak[pkt].d[CMD_OPC]&0x3f], lbn, bc);
+    xp->state = RQ_XFR_RUN;
+    xp->wait = 0;
+    n++;
+    if (cmd == OP_WR)
+        sim_disk_wrsect_q (uptr, lbn, (uint8 *)xp->buf, NULL, (wwc << 1) / RQ_NUMBY, rq_xfr_done, xp);
+    else
+        sim_disk_rdsect_q (uptr, lbn, (uint8 *)xp->buf, NULL, (wwc << 1) / RQ_NUMBY, rq_xfr_done, xp);
+    }
+}
+
+/* Discard packet's early transfer */
+
+void rq_xfr_free (MSC *cp, UNIT *uptr, uint16 pkt)
+{
+if (cp->xfr[pkt].state == RQ_XFR_RUN)                   /* buffer in use? */
+    sim_disk_drain (uptr);
+cp->xfr[pkt].state = RQ_XFR_NONE;
+cp->xfr[pkt].wait = 0;
+}
+
 /* Map buffer address */
 
 uint32 rq_map_ba (uint32 ba, uint32 ma)
@@ -2270,6 +2429,49 @@ if (ba & RQ_MAPXFER) {                                  /* mapped xfer? */
 return Map_WriteW (ba & RQ_MAXQBADDR, bc, buf);         /* unmapped xfer */
 }
 
+/* Locate memory for a zero copy transfer
+
+   Returns the host address of the memory for bc bytes at ba, or NULL if
+   the transfer is not whole sectors, is not word aligned, or does not map
+   to contiguous main memory.  The caller then uses the transfer buffer.
+*/
+
+void *rq_direct (uint32 ba, int32 bc, uint32 ma, t_bool wr)
+{
+#if defined (MAP_DIRECT)
+#if defined (VM_VAX)                                    /* VAX version */
+int32 tbc;
+uint32 pba;
+#endif
+
+if ((bc % RQ_NUMBY) || (ba & 1))                        /* partial, odd? */
+    return NULL;
+#if defined (VM_VAX)
+if (ba & RQ_MAPXFER) {                                  /* mapped xfer? */
+    if (!(pba = rq_map_ba (ba, ma)))                    /* get physical ba */
+        return NULL;
+    for (tbc = 0x200 - (ba & VA_M_OFF); tbc < bc; tbc += 0x200) {
+        if (rq_map_ba (ba + tbc, ma) != (pba + tbc))    /* not contig? */
+            return NULL;
+        }
+    return Map_Direct (pba, bc, wr);
+    }
+#endif
+return Map_Direct (ba & RQ_MAXQBADDR, bc, wr);          /* unmapped xfer */
+#else
+return NULL;
+#endif
+}
+
+/* Zero copy read complete: memory behind the buffer has been written */
+
+void rq_direct_done (void *buf, int32 bc)
+{
+#if defined (MAP_DIRECT)
+Map_DirectDone (buf, bc);
+#endif
+}
+
 /* Unit service for data transfer commands */
 
 t_stat rq_svc (UNIT *uptr)
@@ -2314,7 +2516,26 @@ if ((cmd == OP_ERS) || (cmd == OP_WR)) {                /* write op? */
         }
     }
 
+if (!uptr->io_complete &&                               /* started early? */
+    (cp->xfr[pkt].state != RQ_XFR_NONE)) {
+    struct rqxfr *xp = &cp->xfr[pkt];
+    uint16 *tbuf;
+
+    if (xp->state == RQ_XFR_RUN) {                      /* still in progress? */
+        xp->wait = 1;                                   /* callback resumes */
+        return SCPE_OK;
+        }
+    tbuf = (uint16 *)uptr->rqxb;                        /* take its buffer */
+    uptr->rqxb = xp->buf;
+    xp->buf = tbuf;
+    xp->state = RQ_XFR_NONE;
+    uptr->rqxp = NULL;
+    uptr->io_status = xp->status;
+    uptr->io_complete = 1;                              /* on to bottom end */
+    }
+
 if (!uptr->io_complete) { /* Top End (I/O Initiation) Processing */
+    uptr->rqxp = NULL;
     if (cmd == OP_ERS) {                                /* erase? */
         wwc = ((tbc + (RQ_NUMBY - 1)) & ~(RQ_NUMBY - 1)) >> 1;
         memset (uptr->rqxb, 0, wwc * sizeof(uint16));   /* clr buf */
@@ -2322,6 +2543,13 @@ if (!uptr->io_complete) { /* Top End (I/O Initiation) Processing */
         err = sim_disk_wrsect_a (uptr, bl, (uint8 *)uptr->rqxb, NULL, (wwc << 1) / RQ_NUMBY, rq_io_complete);
         }
 
+    else if ((cmd == OP_WR) &&                          /* zero copy write? */
+             (uptr->flags & UNIT_ZCP) &&
+             (uptr->rqxp = rq_direct (ba, tbc, ma, FALSE))) {
+        sim_disk_data_trace(uptr, (uint8 *)uptr->rqxp, bl, tbc, "sim_disk_wrsect-WR", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
+        err = sim_disk_wrsect_a (uptr, bl, (uint8 *)uptr->rqxp, NULL, tbc / RQ_NUMBY, rq_io_complete);
+        }
+
     else if (cmd == OP_WR) {                            /* write? */
         t = rq_readw (ba, tbc, ma, (uint16 *)uptr->rqxb);/* fetch buffer */
         if ((abc = tbc - t)) {                          /* any xfer? */
@@ -2333,6 +2561,12 @@ if (!uptr->io_complete) { /* Top End (I/O Initiation) Processing */
             }
         }
 
+    else if ((cmd == OP_RD) &&                          /* zero copy read? */
+             (uptr->flags & UNIT_ZCP) &&
+             (uptr->rqxp = rq_direct (ba, tbc, ma, TRUE))) {
+        err = sim_disk_rdsect_a (uptr, bl, (uint8 *)uptr->rqxp, NULL, tbc / RQ_NUMBY, rq_io_complete);
+        }
+
     else {  /* OP_RD & OP_CMP */
         err = sim_disk_rdsect_a (uptr, bl, (uint8 *)uptr->rqxb, NULL, (tbc + RQ_NUMBY - 1) / RQ_NUMBY, rq_io_complete);
         }                                               /* end else read */
@@ -2344,6 +2578,14 @@ else { /* Bottom End (After I/O processing) */
     if (cmd == OP_ERS) {                                /* erase? */
         }
 
+    else if (uptr->rqxp) {                              /* zero copy? */
+        if (cmd == OP_RD) {                             /* read? */
+            sim_disk_data_trace(uptr, (uint8 *)uptr->rqxp, bl, tbc, "sim_disk_rdsect", DBG_DAT & rq_devmap[cp->cnum]->dctrl, DBG_REQ);
+            rq_direct_done (uptr->rqxp, tbc);           /* note memory written */
+            }
+        uptr->rqxp = NULL;
+        }
+
     else if (cmd == OP_WR) {                            /* write? */
         t = rq_readw (ba, tbc, ma, (uint16 *)uptr->rqxb);/* fetch buffer */
         abc = tbc - t;                                  /* any xfer? */
@@ -2419,6 +2661,7 @@ DEVICE *dptr = rq_devmap[uptr->cnum];
 sim_debug (DBG_TRC, rq_devmap[cp->cnum], "rq_rw_end\n");
 
 uptr->cpkt = 0;                                         /* done */
+rq_xfr_free (cp, uptr, pkt);
 PUTP32 (pkt, RW_BCL, bc - wbc);                         /* bytes processed */
 cp->pak[pkt].d[RW_WBAL] = 0;                            /* clear temps */
 cp->pak[pkt].d[RW_WBAH] = 0;
@@ -2431,8 +2674,10 @@ cp->pak[pkt].d[RW_WMPH] = 0;
 rq_putr (cp, pkt, cmd | OP_END, flg, sts, RW_LNT_D, UQ_TYP_SEQ); /* fill pkt */
 if (!rq_putpkt (cp, pkt, TRUE))                         /* send pkt */
     return ERR;
-if (uptr->pktq)                                         /* more to do? */
+if (uptr->pktq) {                                       /* more to do? */
     sim_activate (dptr->units + RQ_QUEUE, rq_qtime);    /* activate thread */
+    rq_issue (cp, uptr);                                /* maybe start early */
+    }
 return OK;
 }
 
@@ -2921,6 +3166,35 @@ fprintf (st, "UNIT=%d", uptr->unit_plug);
 return SCPE_OK;
 }
 
+/* Show async transfer depth */
+
+t_stat rq_show_depth (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+fprintf (st, "ASYNCH=%d\n", (uptr->rqdepth > 1)? uptr->rqdepth: 1);
+return SCPE_OK;
+}
+
+/* Set async transfer depth */
+
+t_stat rq_set_depth (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+uint32 depth;
+t_stat r;
+
+if (cptr == NULL)
+    return sim_messagef (SCPE_ARG, "Must specify ASYNCH=depth\n");
+depth = (uint32) get_uint (cptr, 10, RQ_NPKTS, &r);
+if ((r != SCPE_OK) || (depth < 1))
+    return sim_messagef (SCPE_ARG, "ASYNCH depth must be 1 to %d\n", RQ_NPKTS);
+if (uptr->flags & UNIT_ATT) {
+    r = sim_disk_set_async_depth (uptr, depth);
+    if (r != SCPE_OK)
+        return r;
+    }
+uptr->rqdepth = depth;
+return SCPE_OK;
+}
+
 /* Set unit plug */
 
 t_stat rq_set_plug (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
@@ -3019,6 +3293,8 @@ r = sim_disk_attach_ex (uptr, cptr, RQ_NUMBY, sizeof (uint16),
 if (r != SCPE_OK)
     return r;
 
+if (uptr->rqdepth > 1)                                  /* concurrent xfers? */
+    sim_disk_set_async_depth (uptr, uptr->rqdepth);
 if ((cp->csta == CST_UP) && sim_disk_isavailable (uptr))
     uptr->flags = uptr->flags | UNIT_ATP;
 return SCPE_OK;
@@ -3153,6 +3429,8 @@ for (i = 0; i < dptr->numunits; i++) {                  /* init units */
     if (uptr->rqxb == NULL)
         return SCPE_MEM;
     }
+for (i = 0; i < RQ_NPKTS; i++)                          /* no early xfers */
+    cp->xfr[i].state = cp->xfr[i].wait = RQ_XFR_NONE;
 for (i=cp->max_plug = 0; i < (dptr->numunits - 2); i++)
     if ((0 == (dptr->units[i].flags & UNIT_DIS)) && (dptr->units[i].unit_plug > cp->max_plug))
         cp->max_plug = (uint16)dptr->units[i].unit_plug;
@@ -3414,6 +3692,15 @@ fprintf (st, "disk in either MB (1000000 bytes) or logical block numbers (LBN's,
 fprintf (st, "each), or binary MB (1024*1024 bytes).  The minimum size is 5MB; the maximum\n");
 fprintf (st, "size is 2GB without extended file support, 1TB with extended file support.\n\n");
 fprintf (st, "The %s controllers support the BOOT command.\n\n", dptr->name);
+fprintf (st, "With ZEROCOPY set, a read or write of whole sectors to a buffer that maps\n");
+fprintf (st, "to contiguous memory transfers directly between the disk and memory,\n");
+fprintf (st, "without passing through the controller's transfer buffer.  Other transfers,\n");
+fprintf (st, "and all transfers on big endian hosts, use the transfer buffer.\n\n");
+fprintf (st, "With asynchronous I/O enabled (SET ASYNCH), ASYNCH=n lets a unit have up\n");
+fprintf (st, "to n reads and writes in progress on the host at once.  Queued transfers\n");
+fprintf (st, "that don't overlap earlier ones are started ahead of their turn, but are\n");
+fprintf (st, "still completed to the host in the order they were issued.  The default,\n");
+fprintf (st, "ASYNCH=1, performs one transfer at a time.\n\n");
 fprint_show_help (st, dptr);
 fprint_reg_help (st, dptr);
 fprintf (st, "\nWhile VMS is not timing sensitive, most of the BSD-derived operating systems\n");
@@ -276,6 +276,8 @@ t_stat xq_show_sanity (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
 t_stat xq_set_sanity (UNIT* uptr, int32 val, CONST char* cptr, void* desc);
 t_stat xq_show_throttle (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
 t_stat xq_set_throttle (UNIT* uptr, int32 val, CONST char* cptr, void* desc);
+t_stat xq_show_write_queue (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
+t_stat xq_set_write_queue (UNIT* uptr, int32 val, CONST char* cptr, void* desc);
 t_stat xq_show_lockmode (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
 t_stat xq_set_lockmode (UNIT* uptr, int32 val, CONST char* cptr, void* desc);
 t_stat xq_show_poll (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
@@ -319,7 +321,8 @@ struct xq_device    xqa = {
   ETH_THROT_DEFAULT_TIME,                   /* ms throttle window */
   ETH_THROT_DEFAULT_BURST,                  /* packet packet burst in throttle window */
   ETH_THROT_DISABLED_DELAY,                 /* throttle disabled */
-  XQ_STARTUP_DELAY                          /* instructions to delay when starting the receiver */
+  XQ_STARTUP_DELAY,                         /* instructions to delay when starting the receiver */
+  ETH_WRITE_RING_SIZE                       /* transmit queue depth */
   };
 
 struct xq_device    xqb = {
@@ -335,7 +338,8 @@ struct xq_device    xqb = {
   ETH_THROT_DEFAULT_TIME,                   /* ms throttle window */
   ETH_THROT_DEFAULT_BURST,                  /* packet packet burst in throttle window */
   ETH_THROT_DISABLED_DELAY,                 /* throttle disabled */
-  XQ_STARTUP_DELAY                          /* instructions to delay when starting the receiver */
+  XQ_STARTUP_DELAY,                         /* instructions to delay when starting the receiver */
+  ETH_WRITE_RING_SIZE                       /* transmit queue depth */
   };
 
 /* SIMH device structures */
@@ -420,6 +424,7 @@ REG xqa_reg[] = {
   { GRDATA ( THR_TIME, xqa.throttle_time, XQ_RDX, 32, 0), REG_HRO},
   { GRDATA ( THR_BURST, xqa.throttle_burst, XQ_RDX, 32, 0), REG_HRO},
   { GRDATA ( THR_DELAY, xqa.throttle_delay, XQ_RDX, 32, 0), REG_HRO},
+  { GRDATA ( WRQ_DEPTH, xqa.write_queue, XQ_RDX, 32, 0), REG_HRO},
   { GRDATAD ( START_DELAY, xqa.startup_delay,  XQ_RDX, 32, 0, "instruction delay before receiver starts"), REG_FIT },
   { NULL },
 };
@@ -484,6 +489,7 @@ REG xqb_reg[] = {
   { GRDATA ( THR_TIME, xqb.throttle_time, XQ_RDX, 32, 0), REG_HRO},
   { GRDATA ( THR_BURST, xqb.throttle_burst, XQ_RDX, 32, 0), REG_HRO},
   { GRDATA ( THR_DELAY, xqb.throttle_delay, XQ_RDX, 32, 0), REG_HRO},
+  { GRDATA ( WRQ_DEPTH, xqb.write_queue, XQ_RDX, 32, 0), REG_HRO},
   { GRDATAD ( START_DELAY, xqb.startup_delay,  XQ_RDX, 32, 0, "instruction delay before receiver starts"), REG_FIT },
   { NULL },
 };
@@ -514,6 +520,8 @@ MTAB xq_mod[] = {
     &xq_set_sanity, &xq_show_sanity, NULL, "Sanity timer" },
   { MTAB_XTD|MTAB_VDV|MTAB_VALR, 0, "THROTTLE", "THROTTLE=DISABLED|TIME=n{;BURST=n{;DELAY=n}}",
     &xq_set_throttle, &xq_show_throttle, NULL, "Display transmit throttle configuration" },
+  { MTAB_XTD|MTAB_VDV|MTAB_VALR, 0, "WRITEQUEUE", "WRITEQUEUE=n",
+    &xq_set_write_queue, &xq_show_write_queue, NULL, "Display transmit queue depth" },
   { MTAB_XTD|MTAB_VDV|MTAB_VALR, 0, "DEQNALOCK", "DEQNALOCK={ON|OFF}",
     &xq_set_lockmode, &xq_show_lockmode, NULL, "DEQNA-Lock mode" },
   { MTAB_XTD|MTAB_VDV,           0, "LEDS", NULL,
@@ -951,6 +959,31 @@ t_stat xq_set_throttle (UNIT* uptr, int32 val, CONST char* cptr, void* desc)
   return SCPE_OK;
 }
 
+t_stat xq_show_write_queue (FILE* st, UNIT* uptr, int32 val, CONST void* desc)
+{
+  CTLR* xq = xq_unit2ctlr(uptr);
+
+  fprintf(st, "writequeue=%d", xq->var->write_queue);
+  return SCPE_OK;
+}
+
+t_stat xq_set_write_queue (UNIT* uptr, int32 val, CONST char* cptr, void* desc)
+{
+  CTLR* xq = xq_unit2ctlr(uptr);
+  uint32 newval;
+  t_stat r;
+
+  if (!cptr) return SCPE_ARG;
+  newval = (uint32)get_uint (cptr, 10, ETH_WRITE_RING_MAX, &r);
+  if ((r != SCPE_OK) || (newval == 0)) return SCPE_ARG;
+  if (xq->var->etherface) {
+    r = eth_set_write_queue (xq->var->etherface, newval);
+    if (r != SCPE_OK) return r;
+    }
+  xq->var->write_queue = newval;
+  return SCPE_OK;
+}
+
 t_stat xq_show_lockmode (FILE* st, UNIT* uptr, int32 val, CONST void* desc)
 {
   CTLR* xq = xq_unit2ctlr(uptr);
@@ -2894,6 +2927,7 @@ t_stat xq_attach(UNIT* uptr, CONST char* cptr)
     return status;
   }
   eth_set_throttle (xq->var->etherface, xq->var->throttle_time, xq->var->throttle_burst, xq->var->throttle_delay);
+  eth_set_write_queue (xq->var->etherface, xq->var->write_queue);
   if (xq->var->poll == 0) {
     status = eth_set_async(xq->var->etherface, xq->var->coalesce_latency_ticks);
     if (status != SCPE_OK) {
@@ -3295,6 +3329,17 @@ const char helpString[] =
     " the TIME gap that will cause a delay in sending subsequent packets.\n"
     " DELAY specifies the number of milliseconds which a throttled packet will\n"
     " be delayed prior to its transmission.\n"
+    "\n"
+     /****************************************************************************/
+    "3 WRITEQUEUE\n"
+    " Frames sent by the simulated device are queued for transmission by a\n"
+    " separate thread.  The number of frames which can be waiting is set with:\n"
+    "\n"
+    "+sim> SET %D WRITEQUEUE=n\n"
+    "\n"
+    " n is rounded up to a power of 2 and defaults to 512.  Frames sent while\n"
+    " the queue is full are dropped.  The queue size, high water mark and the\n"
+    " number of dropped frames are displayed by SHOW ETHERNET.\n"
     "\n"
      /****************************************************************************/
     "2 Attach\n"
@@ -269,6 +269,7 @@ struct xq_device {
   uint32            throttle_burst;                     /* packets passed with throttle_time which trigger throttling */
   uint32            throttle_delay;                     /* ms to delay when throttling.  0 disables throttling */
   uint32            startup_delay;                      /* instructions to delay when starting the receiver */
+  uint32            write_queue;                        /* transmit queue depth */
                                                         /*- initialized values - DO NOT MOVE */
 
                                                         /* I/O register storage */
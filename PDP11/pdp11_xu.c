@@ -117,6 +117,8 @@ t_stat xu_show_type (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
 t_stat xu_set_type (UNIT* uptr, int32 val, CONST char* cptr, void* desc);
 t_stat xu_show_throttle (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
 t_stat xu_set_throttle (UNIT* uptr, int32 val, CONST char* cptr, void* desc);
+t_stat xu_show_write_queue (FILE* st, UNIT* uptr, int32 val, CONST void* desc);
+t_stat xu_set_write_queue (UNIT* uptr, int32 val, CONST char* cptr, void* desc);
 int32 xu_int (void);
 t_stat xu_ex (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw);
 t_stat xu_dep (t_value val, t_addr addr, UNIT *uptr, int32 sw);
@@ -150,7 +152,8 @@ struct xu_device    xua = {
   XU_T_DELUA,                               /* type */
   ETH_THROT_DEFAULT_TIME,                   /* ms throttle window */
   ETH_THROT_DEFAULT_BURST,                  /* packet packet burst in throttle window */
-  ETH_THROT_DISABLED_DELAY                  /* throttle disabled */
+  ETH_THROT_DISABLED_DELAY,                 /* throttle disabled */
+  ETH_WRITE_RING_SIZE                       /* transmit queue depth */
   };
 
 MTAB xu_mod[] = {
@@ -170,6 +173,8 @@ MTAB xu_mod[] = {
     &xu_set_type, &xu_show_type, NULL, "Display the controller type" },
   { MTAB_XTD|MTAB_VDV|MTAB_VALR, 0, "THROTTLE", "THROTTLE=DISABLED|TIME=n{;BURST=n{;DELAY=n}}",
     &xu_set_throttle, &xu_show_throttle, NULL, "Display transmit throttle configuration" },
+  { MTAB_XTD|MTAB_VDV|MTAB_VALR, 0, "WRITEQUEUE", "WRITEQUEUE=n",
+    &xu_set_write_queue, &xu_show_write_queue, NULL, "Display transmit queue depth" },
   { 0 },
 };
 
@@ -209,6 +214,7 @@ REG xua_reg[] = {
   { GRDATA ( THR_TIME, xua.throttle_time, XU_RDX, 32, 0), REG_HRO},
   { GRDATA ( THR_BURST, xua.throttle_burst, XU_RDX, 32, 0), REG_HRO},
   { GRDATA ( THR_DELAY, xua.throttle_delay, XU_RDX, 32, 0), REG_HRO},
+  { GRDATA ( WRQ_DEPTH, xua.write_queue, XU_RDX, 32, 0), REG_HRO},
   { NULL }  };
 
 DEBTAB xu_debug[] = {
@@ -247,7 +253,8 @@ struct xu_device    xub = {
   XU_T_DELUA,                               /* type */
   ETH_THROT_DEFAULT_TIME,                   /* ms throttle window */
   ETH_THROT_DEFAULT_BURST,                  /* packet packet burst in throttle window */
-  ETH_THROT_DISABLED_DELAY                  /* throttle disabled */
+  ETH_THROT_DISABLED_DELAY,                 /* throttle disabled */
+  ETH_WRITE_RING_SIZE                       /* transmit queue depth */
   };
 
 REG xub_reg[] = {
@@ -286,6 +293,7 @@ REG xub_reg[] = {
   { GRDATA ( THR_TIME, xub.throttle_time, XU_RDX, 32, 0), REG_HRO},
   { GRDATA ( THR_BURST, xub.throttle_burst, XU_RDX, 32, 0), REG_HRO},
   { GRDATA ( THR_DELAY, xub.throttle_delay, XU_RDX, 32, 0), REG_HRO},
+  { GRDATA ( WRQ_DEPTH, xub.write_queue, XU_RDX, 32, 0), REG_HRO},
   { NULL }  };
 
 DEVICE xub_dev = {
@@ -519,6 +527,31 @@ t_stat xu_set_throttle (UNIT* uptr, int32 val, CONST char* cptr, void* desc)
   return SCPE_OK;
 }
 
+t_stat xu_show_write_queue (FILE* st, UNIT* uptr, int32 val, CONST void* desc)
+{
+  CTLR* xu = xu_unit2ctlr(uptr);
+
+  fprintf(st, "writequeue=%d", xu->var->write_queue);
+  return SCPE_OK;
+}
+
+t_stat xu_set_write_queue (UNIT* uptr, int32 val, CONST char* cptr, void* desc)
+{
+  CTLR* xu = xu_unit2ctlr(uptr);
+  uint32 newval;
+  t_stat r;
+
+  if (!cptr) return SCPE_ARG;
+  newval = (uint32)get_uint (cptr, 10, ETH_WRITE_RING_MAX, &r);
+  if ((r != SCPE_OK) || (newval == 0)) return SCPE_ARG;
+  if (xu->var->etherface) {
+    r = eth_set_write_queue (xu->var->etherface, newval);
+    if (r != SCPE_OK) return r;
+    }
+  xu->var->write_queue = newval;
+  return SCPE_OK;
+}
+
 /*============================================================================*/
 
 void upd_stat16(uint16* stat, uint16 add)
@@ -1766,6 +1799,7 @@ t_stat xu_attach(UNIT* uptr, CONST char* cptr)
     return status;
   }
   eth_set_throttle (xu->var->etherface, xu->var->throttle_time, xu->var->throttle_burst, xu->var->throttle_delay);
+  eth_set_write_queue (xu->var->etherface, xu->var->write_queue);
   if (SCPE_OK != eth_check_address_conflict (xu->var->etherface, &xu->var->mac)) {
     eth_close(xu->var->etherface);
     free(tptr);
@@ -1993,6 +2027,17 @@ const char helpString[] =
     " the TIME gap that will cause a delay in sending subsequent packets.\n"
     " DELAY specifies the number of milliseconds which a throttled packet will\n"
     " be delayed prior to its transmission.\n"
+    "\n"
+     /****************************************************************************/
+    "3 WRITEQUEUE\n"
+    " Frames sent by the simulated device are queued for transmission by a\n"
+    " separate thread.  The number of frames which can be waiting is set with:\n"
+    "\n"
+    "+sim> SET %D WRITEQUEUE=n\n"
+    "\n"
+    " n is rounded up to a power of 2 and defaults to 512.  Frames sent while\n"
+    " the queue is full are dropped.  The queue size, high water mark and the\n"
+    " number of dropped frames are displayed by SHOW ETHERNET.\n"
     "\n"
      /****************************************************************************/
     "2 Attach\n"
@@ -119,6 +119,7 @@ struct xu_device {
   uint32            throttle_time;                      /* ms burst time window */
   uint32            throttle_burst;                     /* packets passed with throttle_time which trigger throttling */
   uint32            throttle_delay;                     /* ms to delay when throttling.  0 disables throttling */
+  uint32            write_queue;                        /* transmit queue depth */
                                                         /*- initialized values - DO NOT MOVE */
 
                                                         /* I/O register storage */
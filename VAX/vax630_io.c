@@ -526,6 +526,7 @@ if (qba_map_addr (qa, &ma)) {                           /* in map? */
             M[ma >> 2] = (M[ma >> 2] & ~(BMASK << sc)) |
                 ((dat & BMASK) << sc);
             }
+        MEM_WRITE (ma);
         }                                               /* end if mem */
     else
         mem_err = 1;
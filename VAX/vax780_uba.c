@@ -197,6 +197,7 @@ void uba_adap_clr_int ();
 void uba_set_dpr (uint32 ua, t_bool wr);
 void uba_ubpdn (int32 time);
 t_bool uba_map_addr (uint32 ua, uint32 *ma);
+t_bool uba_map_addr_c (uint32 ua, uint32 *ma);
 t_stat uba_show_virt (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat uba_show_map (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 
@@ -608,6 +609,12 @@ return vec;
    Map_ReadW    -       fetch word buffer from memory
    Map_WriteB   -       store byte buffer into memory
    Map_WriteW   -       store word buffer into memory
+   Map_Direct   -       address of memory for a contiguous buffer
+   Map_DirectDone -     note stores into a direct buffer
+
+   On little endian hosts, the byte order of M matches Unibus memory, so
+   the word routines copy each mapped page with a single memcpy, whatever
+   its alignment.
 */
 
 int32 Map_ReadB (uint32 ba, int32 bc, uint8 *buf)
@@ -658,7 +665,10 @@ for (i = 0; i < bc; i = i + pbc) {                      /* loop by pages */
         pbc = bc - i;
     if (DEBUG_PRI (uba_dev, UBA_DEB_XFR))
         fprintf (sim_deb, ">>UBA: 16b read, ma = %X, bc = %X\n", ma, pbc);
-    if ((ma | pbc) & 1) {                               /* aligned word? */
+    if (sim_end) {                                      /* little endian? */
+        memcpy (((uint8 *) buf) + i, ((uint8 *) M) + ma, pbc);
+        }
+    else if ((ma | pbc) & 1) {                          /* aligned word? */
         for (j = 0; j < pbc; ma++, j++) {               /* no, do by bytes */
             if ((i + j) & 1) {                          /* odd byte? */
                 *buf = (*buf & BMASK) | (ReadB (ma) << 8);
@@ -733,7 +743,11 @@ for (i = 0; i < bc; i = i + pbc) {                      /* loop by pages */
         pbc = bc - i;
     if (DEBUG_PRI (uba_dev, UBA_DEB_XFR))
         fprintf (sim_deb, ">>UBA: 16b write, ma = %X, bc = %X\n", ma, pbc);
-    if ((ma | pbc) & 1) {                               /* aligned word? */
+    if (sim_end) {                                      /* little endian? */
+        memcpy (((uint8 *) M) + ma, ((const uint8 *) buf) + i, pbc);
+        MEM_WRITE_RUN (ma, pbc);
+        }
+    else if ((ma | pbc) & 1) {                          /* aligned word? */
         for (j = 0; j < pbc; ma++, j++) {               /* no, bytes */
             if ((i + j) & 1) {
                 WriteB (ma, (*buf >> 8) & BMASK);
@@ -760,6 +774,61 @@ for (i = 0; i < bc; i = i + pbc) {                      /* loop by pages */
 return 0;
 }
 
+/* Direct access to a mapped buffer
+
+   Returns the host address of the memory that Unibus addresses ba through
+   ba + bc - 1 map to, if the whole buffer is valid, contiguous main
+   memory and memory is in host byte order; otherwise NULL, and the caller
+   uses the Map_ routines.  No map errors are reported.  The data path
+   registers are updated as if the transfer had been done; wr gives its
+   direction.  A caller which stores into the buffer calls Map_DirectDone
+   once it has finished.
+*/
+
+void *Map_Direct (uint32 ba, int32 bc, t_bool wr)
+{
+int32 i, pbc;
+uint32 ma, sma;
+
+ba = ba & UBADDRMASK;                                   /* mask UB addr */
+if (!sim_end || (bc <= 0))                              /* big endian? */
+    return NULL;
+for (i = 0, sma = 0; i < bc; i = i + pbc) {             /* loop by pages */
+    if (!uba_map_addr_c (ba + i, &ma) || !ADDR_IS_MEM (ma))
+        return NULL;                                    /* inv or NXM? */
+    if (i == 0)                                         /* first page? */
+        sma = ma;
+    else if (ma != (sma + i))                           /* not contig? */
+        return NULL;
+    pbc = VA_PAGSIZE - VA_GETOFF (ma);                  /* left in page */
+    if (pbc > (bc - i))                                 /* limit to rem xfr */
+        pbc = bc - i;
+    }
+if (!ADDR_IS_MEM (sma + bc - 1))                        /* end NXM? */
+    return NULL;
+for (i = 0; i < bc; i = i + pbc) {                      /* set dp regs */
+    pbc = VA_PAGSIZE - VA_GETOFF (sma + i);
+    if (pbc > (bc - i))
+        pbc = bc - i;
+    uba_set_dpr (ba + i + pbc - L_WORD, wr);
+    }
+return (void *) (((uint8 *) M) + sma);
+}
+
+/* Direct access completion
+
+   Called once the caller has finished storing into a buffer returned by
+   Map_Direct, which may be well after Map_Direct if the transfer is
+   asynchronous.  Records the write for decoded instruction and dirty page
+   tracking; no map or data path register is touched.
+*/
+
+void Map_DirectDone (void *buf, int32 bc)
+{
+if ((buf != NULL) && (bc > 0))
+    MEM_WRITE_RUN ((uint32) (((uint8 *) buf) - ((uint8 *) M)), bc);
+}
+
 /* Map an address via the translation map */
 
 t_bool uba_map_addr (uint32 ua, uint32 *ma)
@@ -233,8 +233,53 @@
                         r = arl; \
                         rh = arh
 
+/* Decoded instruction cache
+
+   The cache records the istream items (opcode, specifier bytes,
+   displacements, immediates and branch displacements) consumed by the
+   specifier decoder, keyed by virtual PC, current mode and mapping state.
+   On a hit, GET_ISTR replays the recorded items instead of going through
+   the prefetch buffer.  The decoder itself still runs, so operand reads,
+   register side effects and faults are unchanged.
+
+   An entry is only used if the page that get_istr would fetch from is the
+   recorded physical page, and no write has touched that page since the
+   entry was recorded (cpu_dcache_pgen is bumped by every physical write).
+   The source page is taken from the prefetch state or, if a translation
+   is needed, from a TB hit, so TB flushes invalidate entries implicitly.
+   At the end of a replay the prefetch state is set to what get_istr would
+   have left, so the following instructions see the same istream.
+   Instructions that cross a page, or are restarted with PSL<fpd> set,
+   are not cached.
+*/
+
+#define DC_MAXVAL       32                              /* max istream items */
+#define DC_DFLT         4096                            /* default entries */
+#define DC_MAX          (1u << 20)                      /* max entries */
+#define DC_OFF          0                               /* not caching */
+#define DC_REC          1                               /* recording */
+#define DC_PLAY         2                               /* replaying */
+#define DC_HASH(x)      (((uint32) (x) ^ ((uint32) (x) >> 16)) & dcache_mask)
+#define DC_CTX          (0x100 | (PSL_GETCUR (PSL) << 1) | (mapen != 0))
+
+typedef struct {
+    uint32              pc;                             /* virtual PC */
+    uint32              ctx;                            /* mode/mapen, 0 = inv */
+    uint32              pfn;                            /* physical page */
+    uint32              gen;                            /* page generation */
+    int32               ppcd;                           /* final ppc offset */
+    uint8               ibcnt;                          /* final prefetch count */
+    uint8               nval;                           /* # istream items */
+    uint8               lnt[DC_MAXVAL];                 /* item lengths */
+    int32               val[DC_MAXVAL];                 /* item values */
+    } DCENT;
+
+#undef GET_ISTR
+#define GET_ISTR(d,l)   d = (dc_mode? dcache_istr (l, acc): get_istr (l, acc))
+
 
 uint32 *M = NULL;                                       /* memory */
+static MAPFILE *cpu_memfile = NULL;                     /* file backing memory */
 int32 R[16];                                            /* registers */
 int32 STK[5];                                           /* stack pointers */
 int32 PSL;                                              /* PSL */
@@ -267,6 +312,17 @@ int32 cpu_astop = 0;
 int32 mchk_va, mchk_ref;                                /* mem ref param */
 int32 ibufl, ibufh;                                     /* prefetch buf */
 int32 ibcnt, ppc;                                       /* prefetch ctl */
+DCENT *dcache = NULL;                                   /* decode cache */
+uint32 dcache_mask = 0;                                 /* decode cache mask */
+uint32 *cpu_dcache_pgen = NULL;                         /* page write gens */
+uint8 cpu_mem_dirty[MAXMEMSIZE_X >> VA_N_OFF];          /* pages written since snapshot */
+static DCENT *dc_ent = NULL;                            /* current entry */
+static int32 dc_mode = DC_OFF;                          /* cache state */
+static int32 dc_n = 0;                                  /* item index */
+static uint32 dc_pfn, dc_gen;                           /* page being recorded */
+static t_uint64 dcache_hits = 0;                        /* replays */
+static t_uint64 dcache_misses = 0;                      /* recordings */
+static t_uint64 dcache_fills = 0;                       /* entries committed */
 uint32 cpu_idle_mask =                                  /* idle mask */
 #if defined (VAX_411) || defined (VAX_412)
                        VAX_IDLE_INFOSERVER;
@@ -320,6 +376,10 @@ t_bool cpu_is_pc_a_subroutine_call (t_addr **ret_addrs);
 t_stat cpu_ex (t_value *vptr, t_addr exta, UNIT *uptr, int32 sw);
 t_stat cpu_dep (t_value val, t_addr exta, UNIT *uptr, int32 sw);
 t_stat cpu_set_size (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_set_memfile (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_show_memfile (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+t_stat cpu_set_dcache (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+t_stat cpu_show_dcache (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat cpu_set_hist (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat cpu_show_hist (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat cpu_show_virt (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
@@ -330,6 +390,10 @@ t_stat cpu_show_instruction_set (FILE *st, UNIT *uptr, int32 val, CONST void *de
 const char *cpu_description (DEVICE *dptr);
 int32 cpu_get_vsw (int32 sw);
 static SIM_INLINE int32 get_istr (int32 lnt, int32 acc);
+static SIM_INLINE int32 dcache_src_pfn (void);
+static int32 dcache_istr (int32 lnt, int32 acc);
+static void dcache_commit (void);
+static void dcache_flush (void);
 int32 ReadOcta (int32 va, int32 *opnd, int32 j, int32 acc);
 t_bool cpu_show_opnd (FILE *st, InstHistory *h, int32 line);
 t_stat cpu_show_hist_records (FILE *st, t_bool do_header, int32 start, int32 count);
@@ -433,6 +497,18 @@ MTAB cpu_mod[] = {
     { MTAB_XTD|MTAB_VDV, 0, "IDLE", "IDLE{=VMS|ULTRIX|ULTRIX-1.X|ULTRIXOLD|NETBSD|NETBSDOLD|OPENBSD|OPENBSDOLD|QUASIJARUS|32V|ELN|MDM|INFOSERVER}{:n}", &cpu_set_idle, &cpu_show_idle, NULL, "Display idle detection mode" },
     { MTAB_XTD|MTAB_VDV, 0, NULL, "NOIDLE", &sim_clr_idle, NULL, NULL,  "Disables idle detection" },
     MEM_MODIFIERS,   /* Model specific memory modifiers from vaxXXX_defs.h */
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_VALR|MTAB_NC, 1, "MEMFILE", "MEMFILE=file",
+      &cpu_set_memfile, &cpu_show_memfile, NULL, "Map memory onto a file (SET -P for a private copy)" },
+    { MTAB_XTD|MTAB_VDV, 0, NULL, "NOMEMFILE",
+      &cpu_set_memfile, NULL, NULL, "Use allocated memory" },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_VALO, 1, "DECODECACHE", "DECODECACHE{=n}",
+      &cpu_set_dcache, &cpu_show_dcache, NULL, "Enable/Display decoded instruction cache" },
+    { MTAB_XTD|MTAB_VDV, 0, NULL, "NODECACHE",
+      &cpu_set_dcache, NULL, NULL, "Disable decoded instruction cache" },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_VALR, 0, "TBSIZE", "TBSIZE=n{:ways}",
+      &tb_set_size, &tb_show_size, NULL, "Set/Display translation buffer size and associativity" },
+    { MTAB_XTD|MTAB_VDV|MTAB_NMO, 0, "TBSTATS", NULL,
+      NULL, &tb_show_stats, NULL, "Display translation buffer statistics" },
     { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_SHP|MTAB_NC, 0, "HISTORY", "HISTORY=n",
       &cpu_set_hist, &cpu_show_hist, NULL, "Enable/Display instruction history" },
     { MTAB_XTD|MTAB_VDV|MTAB_NMO|MTAB_SHP, 0, "VIRTUAL", NULL,
@@ -516,6 +592,7 @@ set_map_reg ();                                         /* set map reg */
 GET_CUR;                                                /* set access mask */
 SET_IRQL;                                               /* eval interrupts */
 FLUSH_ISTR;                                             /* clear prefetch */
+dcache_flush ();                                        /* mem may have changed */
 
 abortval = setjmp (save_env);                           /* set abort hdlr */
 if (abortval > 0) {                                     /* sim stop? */
@@ -728,6 +805,27 @@ for ( ;; ) {
 
     sim_interval = sim_interval - (1 + (extra_bytes>>5));/* count instr */
     extra_bytes = 0;                                    /* digest string count */
+    dc_mode = DC_OFF;
+    if (dcache && ((PSL & PSL_FPD) == 0)) {             /* decode cache on? */
+        int32 pfn = dcache_src_pfn ();                  /* istream page */
+        if ((pfn >= 0) && ADDR_IS_MEM ((uint32) pfn << VA_N_OFF)) {
+            dc_ent = &dcache[DC_HASH (PC)];
+            dc_n = 0;
+            if ((dc_ent->pc == (uint32) PC) && (dc_ent->ctx == DC_CTX) &&
+                (dc_ent->pfn == (uint32) pfn) &&
+                (dc_ent->gen == cpu_dcache_pgen[pfn])) {
+                dc_mode = DC_PLAY;                      /* hit, replay */
+                dcache_hits++;
+                }
+            else {                                      /* miss, record */
+                dc_ent->ctx = 0;
+                dc_pfn = (uint32) pfn;
+                dc_gen = cpu_dcache_pgen[pfn];
+                dc_mode = DC_REC;
+                dcache_misses++;
+                }
+            }
+        }
     GET_ISTR (opc, L_BYTE);                             /* get opcode */
     if (opc == 0xFD) {                                  /* 2 byte op? */
         GET_ISTR (opc, L_BYTE);                         /* get second byte */
@@ -1558,6 +1656,18 @@ for ( ;; ) {
             }                                           /* end for */
         }                                               /* end if not FPD */
 
+    if (dc_mode == DC_PLAY) {                           /* replayed? */
+        ibcnt = dc_ent->ibcnt;                          /* set prefetch state */
+        ppc = (dc_ent->ppcd < 0)? -1: (int32) (dc_ent->pfn << VA_N_OFF) + dc_ent->ppcd;
+        if (ibcnt)
+            ibufl = M[(ppc - 4) >> 2];
+        dc_mode = DC_OFF;
+        }
+    else if (dc_mode == DC_REC) {                       /* recorded? */
+        dcache_commit ();
+        dc_mode = DC_OFF;
+        }
+
 /* Optionally record instruction history */
 
     if (hst_lnt) {
@@ -3232,6 +3342,83 @@ if ((bo + lnt) >= 4) {                                  /* retire ibufl? */
 return val;
 }
 
+/* Decoded instruction cache routines
+
+   dcache_src_pfn returns the physical page that get_istr would fetch the
+   next instruction from without a TB fill, or -1 if that is unknown (TB
+   miss) or the prefetch buffer no longer matches memory.
+*/
+
+static SIM_INLINE int32 dcache_src_pfn (void)
+{
+int32 vpn;
+TLBENT xpte;
+
+if (ibcnt) {                                            /* buffered lw? */
+    if (ADDR_IS_MEM (ppc - 4) && (ibufl == (int32) M[(ppc - 4) >> 2]))
+        return (ppc - 4) >> VA_N_OFF;
+    return -1;
+    }
+if ((ppc >= 0) && VA_GETOFF (ppc))                      /* valid phys PC? */
+    return ppc >> VA_N_OFF;
+if (mapen == 0)
+    return (PC & PAMASK) >> VA_N_OFF;
+vpn = VA_GETVPN (PC);
+xpte = tb_lookup (PC, vpn);
+if (xpte.pte & RD)                                      /* as in get_istr */
+    return (xpte.pte & TLB_PFN) >> VA_N_OFF;
+return -1;
+}
+
+/* Fetch an istream item while the cache is active: replay a recorded
+   item, or fetch and record one (abandoning the entry if it does not fit)
+*/
+
+static int32 dcache_istr (int32 lnt, int32 acc)
+{
+int32 val;
+
+if (dc_mode == DC_PLAY) {
+    PC = PC + dc_ent->lnt[dc_n];
+    return dc_ent->val[dc_n++];
+    }
+val = get_istr (lnt, acc);
+if (dc_n < DC_MAXVAL) {
+    dc_ent->lnt[dc_n] = (uint8) lnt;
+    dc_ent->val[dc_n++] = val;
+    }
+else dc_mode = DC_OFF;
+return val;
+}
+
+/* Commit a recorded entry, with the prefetch state get_istr left */
+
+static void dcache_commit (void)
+{
+if ((VA_GETVPN (fault_PC) != VA_GETVPN (PC - 1)) ||     /* crosses page? */
+    (cpu_dcache_pgen[dc_pfn] != dc_gen))                /* page written? */
+    return;
+dc_ent->pc = (uint32) fault_PC;
+dc_ent->pfn = dc_pfn;
+dc_ent->gen = dc_gen;
+dc_ent->ibcnt = (uint8) ibcnt;
+dc_ent->ppcd = (ppc < 0)? -1: ppc - (int32) (dc_pfn << VA_N_OFF);
+dc_ent->nval = (uint8) dc_n;
+dc_ent->ctx = DC_CTX;
+dcache_fills++;
+}
+
+static void dcache_flush (void)
+{
+uint32 i;
+
+if (dcache) {
+    for (i = 0; i <= dcache_mask; i++)
+        dcache[i].ctx = 0;
+    }
+dc_mode = DC_OFF;
+}
+
 /* Read octaword specifier */
 
 int32 ReadOcta (int32 va, int32 *opnd, int32 j, int32 acc)
@@ -3340,6 +3527,7 @@ SISR = 0;
 ASTLVL = 4;
 mapen = 0;
 FLUSH_ISTR;                             /* init I-stream */
+dcache_flush ();
 if (M == NULL) {                        /* first time init? */
     vax_init();
     sim_brk_types = sim_brk_dflt = SWMASK ('E');
@@ -3354,6 +3542,7 @@ if (M == NULL) {                        /* first time init? */
     M = (uint32 *) calloc (((uint32) MEMSIZE) >> 2, sizeof (uint32));
     if (M == NULL)
         return SCPE_MEM;
+    sim_set_unit_dirty_map (&cpu_unit, cpu_mem_dirty, VA_N_OFF);
     auto_config(NULL, 0);               /* do an initial auto configure */
     }
 return build_dib_tab ();
@@ -3465,19 +3654,159 @@ for (i = val; i < MEMSIZE; i = i + 4)
     mc = mc | M[i >> 2];
 if ((mc != 0) && !get_yn ("Really truncate memory [N]?", FALSE))
     return SCPE_OK;
+if ((cpu_memfile != NULL) && !sim_memfile_shared (cpu_memfile))
+    return sim_messagef (SCPE_NOFNC, "Can't change the size of a private memory file\n");
 nM = (uint32 *) calloc (uval >> 2, sizeof (uint32));
 if (nM == NULL)
     return SCPE_MEM;
 clim = (uint32)((uval < MEMSIZE)? uval: MEMSIZE);
 for (i = 0; i < clim; i = i + 4)
     nM[i >> 2] = M[i >> 2];
+if (cpu_memfile != NULL) {                              /* resize the memory file */
+    MAPFILE *mf;
+    void *addr;
+    t_bool loaded;
+    char *name = strdup (sim_memfile_name (cpu_memfile));
+    t_stat r;
+
+    sim_set_unit_memfile (&cpu_unit, NULL);
+    sim_memfile_close (cpu_memfile);
+    cpu_memfile = NULL;
+    r = sim_memfile_open (name, uval, TRUE, &mf, &addr, &loaded);
+    free (name);
+    M = nM;                                             /* keep contents either way */
+    MEMSIZE = uval;
+    memset (cpu_mem_dirty, 1, sizeof (cpu_mem_dirty));
+    if (r == SCPE_OK) {
+        memcpy (addr, nM, uval);
+        free (nM);
+        M = (uint32 *)addr;
+        cpu_memfile = mf;
+        sim_set_unit_memfile (&cpu_unit, mf);
+        }
+    reset_all (0);
+    return r;
+    }
 free (M);
 M = nM;
 MEMSIZE = uval; 
+memset (cpu_mem_dirty, 1, sizeof (cpu_mem_dirty));
 reset_all (0);
 return SCPE_OK;
 }
 
+/* Memory file
+
+   SET CPU MEMFILE=file maps memory onto file.  A file of exactly the memory
+   size supplies the memory contents, otherwise the file is sized to match
+   and the current memory is copied into it.  SET -P maps a private copy of
+   an existing file, so changes never reach the file.  SET CPU NOMEMFILE
+   copies memory back into allocated storage.
+*/
+
+t_stat cpu_set_memfile (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+MAPFILE *mf = NULL;
+void *addr = NULL;
+t_bool loaded;
+uint32 *nM;
+t_stat r;
+
+if (val) {                                              /* MEMFILE=file */
+    if ((cptr == NULL) || (*cptr == '\0'))
+        return SCPE_MISVAL;
+    r = sim_memfile_open (cptr, (size_t)MEMSIZE, (sim_switches & SWMASK ('P')) == 0, &mf, &addr, &loaded);
+    if (r != SCPE_OK)
+        return r;
+    nM = (uint32 *)addr;
+    if (!loaded)                                        /* new file gets current memory */
+        memcpy (nM, M, (size_t)MEMSIZE);
+    }
+else {                                                  /* NOMEMFILE */
+    if (cptr != NULL)
+        return SCPE_ARG;
+    if (cpu_memfile == NULL)
+        return SCPE_OK;
+    nM = (uint32 *) malloc ((size_t)MEMSIZE);
+    if (nM == NULL)
+        return SCPE_MEM;
+    memcpy (nM, M, (size_t)MEMSIZE);
+    }
+if (cpu_memfile != NULL) {                              /* release current memory */
+    sim_set_unit_memfile (&cpu_unit, NULL);
+    sim_memfile_close (cpu_memfile);
+    }
+else
+    free (M);
+M = nM;
+cpu_memfile = mf;
+memset (cpu_mem_dirty, 1, sizeof (cpu_mem_dirty));     /* contents may differ */
+return sim_set_unit_memfile (&cpu_unit, mf);
+}
+
+t_stat cpu_show_memfile (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+if (cpu_memfile == NULL)
+    fprintf (st, "no memory file\n");
+else
+    fprintf (st, "memory file=%s (%s)\n", sim_memfile_name (cpu_memfile),
+             sim_memfile_shared (cpu_memfile) ? "shared" : "private");
+return SCPE_OK;
+}
+
+/* Set/show decoded instruction cache */
+
+t_stat cpu_set_dcache (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+uint32 lnt = DC_DFLT;
+uint32 npg = (uint32) (MAXMEMSIZE_X >> VA_N_OFF);
+t_stat r;
+
+if (val && cptr) {
+    lnt = (uint32) get_uint (cptr, 10, DC_MAX, &r);
+    if ((r != SCPE_OK) || (lnt < 16) || (lnt & (lnt - 1)))
+        return sim_messagef (SCPE_ARG, "Decode cache size must be a power of 2 from 16 to %u\n", DC_MAX);
+    }
+else if (cptr)
+    return SCPE_ARG;
+free (dcache);
+dcache = NULL;
+dcache_mask = 0;
+free (cpu_dcache_pgen);
+cpu_dcache_pgen = NULL;
+dc_mode = DC_OFF;
+if (val == 0)
+    return SCPE_OK;
+dcache = (DCENT *) calloc (lnt, sizeof (DCENT));
+cpu_dcache_pgen = (uint32 *) calloc (npg, sizeof (uint32));
+if ((dcache == NULL) || (cpu_dcache_pgen == NULL)) {
+    free (dcache);
+    dcache = NULL;
+    free (cpu_dcache_pgen);
+    cpu_dcache_pgen = NULL;
+    return SCPE_MEM;
+    }
+dcache_mask = lnt - 1;
+dcache_hits = dcache_misses = dcache_fills = 0;
+return SCPE_OK;
+}
+
+t_stat cpu_show_dcache (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+if (dcache == NULL)
+    fprintf (st, "decode cache disabled\n");
+else {
+    double tot = (double) (dcache_hits + dcache_misses);
+
+    fprintf (st, "decode cache=%u entries, hits=%" LL_FMT "u, misses=%" LL_FMT "u, fills=%" LL_FMT "u",
+             dcache_mask + 1, dcache_hits, dcache_misses, dcache_fills);
+    if (tot > 0.0)
+        fprintf (st, " (%.1f%% hit)", (100.0 * dcache_hits) / tot);
+    fprintf (st, "\n");
+    }
+return SCPE_OK;
+}
+
 /* Virtual address translation */
 
 t_stat cpu_show_virt (FILE *of, UNIT *uptr, int32 val, CONST void *desc)
@@ -4036,6 +4365,20 @@ fprintf (st, "Consumption of prodigious amounts of disk space can be avoided, if
 fprintf (st, "-O switch is specified which will cause each buffer flush to overwrite\n");
 fprintf (st, "any previously output history.\n");
 fprintf (st, "The maximum length for the history is %d entries.\n\n", HIST_MAX);
+fprintf (st, "The CPU can cache the decoded istream of recently executed instructions,\n");
+fprintf (st, "so that hot loops skip the generic specifier fetch.  The cache is\n");
+fprintf (st, "invalidated by writes to the code page and by TB flushes, and is off by\n");
+fprintf (st, "default:\n\n");
+fprintf (st, "   sim> SET CPU DECODECACHE{=n}         enable cache, n entries (power of 2,\n");
+fprintf (st, "                                        default %d)\n", DC_DFLT);
+fprintf (st, "   sim> SET CPU NODECACHE               disable cache\n");
+fprintf (st, "   sim> SHOW CPU DECODECACHE            display size and hit statistics\n\n");
+fprintf (st, "The translation buffer size and associativity can be changed, and its\n");
+fprintf (st, "hit and flush statistics displayed:\n\n");
+fprintf (st, "   sim> SET CPU TBSIZE=n{:ways}         n entries per TB (power of 2, %d to\n", TB_MINSIZE);
+fprintf (st, "                                        %d), 1, 2 or 4 ways (default %d:1)\n", TB_MAXSIZE, VA_TBSIZE);
+fprintf (st, "   sim> SHOW CPU TBSIZE                 display TB size and associativity\n");
+fprintf (st, "   sim> SHOW CPU TBSTATS                display TB statistics\n\n");
 fprintf (st, "Different VAX systems implemented different VAX architecture instructions\n");
 fprintf (st, "in hardware with other instructions possibly emulated by software in the\n");
 fprintf (st, "system.  The instructions that a particular simulator implements can be\n");
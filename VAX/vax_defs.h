@@ -264,6 +264,8 @@ extern jmp_buf save_env;
 #define VA_N_TBI        12                              /* TB index size */
 #define VA_TBSIZE       (1u << VA_N_TBI)                /* TB size */
 #define VA_M_TBI        ((1u << VA_N_TBI) - 1)          /* TB index mask */
+#define TB_MINSIZE      64                              /* min TB size */
+#define TB_MAXSIZE      65536                           /* max TB size */
 #define VA_GETOFF(x)    ((x) & VA_M_OFF)
 #define VA_GETVPN(x)    (((x) >> VA_V_VPN) & VA_M_VPN)
 #define VA_GETTBI(x)    ((x) & VA_M_TBI)
@@ -698,6 +700,24 @@ enum opcodes {
 #define CMODE_JUMP(d)   do {PCQ_ENTRY; PC = (d); CHECK_FOR_IDLE_LOOP; } while (0)
 #define SETPC(d)        PC = (d), FLUSH_ISTR
 #define FLUSH_ISTR      ibcnt = 0, ppc = -1
+/* Physical memory writes: mark the page for incremental snapshots and
+   invalidate decoded instructions from it */
+
+#define MEM_WRITE(pa)   do { \
+                            uint32 _pg = ((uint32) (pa)) >> VA_N_OFF; \
+                            cpu_mem_dirty[_pg] = 1; \
+                            if (cpu_dcache_pgen) \
+                                cpu_dcache_pgen[_pg]++; \
+                            } while (0)
+#define MEM_WRITE_RUN(pa,lnt) do { \
+                            uint32 _pg = ((uint32) (pa)) >> VA_N_OFF; \
+                            uint32 _lp = (((uint32) (pa)) + (lnt) - 1) >> VA_N_OFF; \
+                            for ( ; _pg <= _lp; _pg++) { \
+                                cpu_mem_dirty[_pg] = 1; \
+                                if (cpu_dcache_pgen) \
+                                    cpu_dcache_pgen[_pg]++; \
+                                } \
+                            } while (0)
 
 /* Character string instructions */
 
@@ -885,6 +905,8 @@ extern int32 pcq[PCQ_SIZE];                             /* PC queue */
 extern int32 pcq_p;                                     /* PC queue ptr */
 extern int32 in_ie;                                     /* in exc, int */
 extern int32 ibcnt, ppc;                                /* prefetch ctl */
+extern uint32 *cpu_dcache_pgen;                         /* decode cache page gens */
+extern uint8 cpu_mem_dirty[];                           /* pages written since snapshot */
 extern int32 hlt_pin;                                   /* HLT pin intr */
 extern int32 mxpr_cc_vc;                                /* cc V & C bits from mtpr/mfpr operations */
 extern int32 mem_err;
@@ -588,6 +588,7 @@ if (ADDR_IS_MEM (ma)) {
         val = ((val & mask) << sc) | (t & ~(mask << sc));
         }
     M[ma >> 2] = val;
+    MEM_WRITE (ma);
     }
 else {
     cq_serr (ma);                                       /* error */
@@ -646,6 +647,7 @@ if (qba_map_addr (qa, &ma)) {                           /* in map? */
             M[ma >> 2] = (M[ma >> 2] & ~(BMASK << sc)) |
                 ((dat & BMASK) << sc);
             }
+        MEM_WRITE (ma);
         }                                               /* end if mem */
     else
         mem_err = 1;
@@ -758,8 +760,39 @@ return SCPE_OK;
    Map_ReadW    -       fetch word buffer from memory
    Map_WriteB   -       store byte buffer into memory
    Map_WriteW   -       store word buffer into memory
+   Map_Direct   -       address of memory for a contiguous buffer
+   Map_DirectDone -     note stores into a direct buffer
+
+   On little endian hosts, the byte order of M matches Qbus memory, so
+   the word routines copy each physically contiguous run of mapped pages
+   with a single memcpy.
+*/
+
+/* Map a run of contiguous Qbus pages
+
+   Returns the number of bytes, from qa up to bc, that map to contiguous
+   main memory, or 0 if qa itself is invalid or NXM; *ma is the memory
+   address of qa.  Only the first page reports map errors; a run stops
+   quietly at an invalid or discontiguous page, which is then reported
+   when the caller maps it as the start of the next run.
 */
 
+static int32 qba_map_run (uint32 qa, int32 bc, uint32 *ma)
+{
+int32 lnt;
+uint32 nma;
+
+if (!qba_map_addr (qa, ma))                             /* inv or NXM? */
+    return 0;
+lnt = VA_PAGSIZE - VA_GETOFF (qa);                      /* rest of page */
+while ((lnt < bc) &&                                    /* more, contig? */
+       qba_map_addr_c (qa + lnt, &nma) &&
+       (nma == (*ma + lnt)) &&
+       ADDR_IS_MEM (nma))
+    lnt = lnt + VA_PAGSIZE;
+return ((lnt < bc)? lnt: bc);
+}
+
 int32 Map_ReadB (uint32 ba, int32 bc, uint8 *buf)
 {
 int32 i;
@@ -794,11 +827,20 @@ return 0;
 
 int32 Map_ReadW (uint32 ba, int32 bc, uint16 *buf)
 {
-int32 i;
+int32 i, lnt;
 uint32 ma,dat;
 
 ba = ba & ~01;
 bc = bc & ~01;
+if (sim_end) {                                          /* little endian? */
+    for (i = 0; i < bc; i = i + lnt) {                  /* by runs */
+        lnt = qba_map_run (ba + i, bc - i, &ma);
+        if (lnt == 0)                                   /* inv or NXM? */
+            return (bc - i);
+        memcpy (((uint8 *) buf) + i, ((uint8 *) M) + ma, lnt);
+        }
+    return 0;
+    }
 if ((ba | bc) & 03) {                                   /* check alignment */
     for (i = ma = 0; i < bc; i = i + 2, buf++) {        /* by words */
         if ((ma & VA_M_OFF) == 0) {                     /* need map? */
@@ -858,11 +900,21 @@ return 0;
 
 int32 Map_WriteW (uint32 ba, int32 bc, const uint16 *buf)
 {
-int32 i;
+int32 i, lnt;
 uint32 ma, dat;
 
 ba = ba & ~01;
 bc = bc & ~01;
+if (sim_end) {                                          /* little endian? */
+    for (i = 0; i < bc; i = i + lnt) {                  /* by runs */
+        lnt = qba_map_run (ba + i, bc - i, &ma);
+        if (lnt == 0)                                   /* inv or NXM? */
+            return (bc - i);
+        memcpy (((uint8 *) M) + ma, ((const uint8 *) buf) + i, lnt);
+        MEM_WRITE_RUN (ma, lnt);
+        }
+    return 0;
+    }
 if ((ba | bc) & 03) {                                   /* check alignment */
     for (i = ma = 0; i < bc; i = i + 2, buf++) {        /* by words */
         if ((ma & VA_M_OFF) == 0) {                     /* need map? */
@@ -888,6 +940,44 @@ else {
 return 0;
 }
 
+/* Direct access to a mapped buffer
+
+   Returns the host address of the memory that Qbus addresses ba through
+   ba + bc - 1 map to, if the whole buffer is valid, contiguous main
+   memory and memory is in host byte order; otherwise NULL, and the caller
+   uses the Map_ routines.  No map errors are reported.  wr is unused
+   here; a caller which stores into the buffer calls Map_DirectDone once
+   it has finished.
+*/
+
+void *Map_Direct (uint32 ba, int32 bc, t_bool wr)
+{
+int32 lnt;
+uint32 ma;
+
+if (!sim_end || (bc <= 0) ||                            /* big endian? */
+    !qba_map_addr_c (ba, &ma) || !ADDR_IS_MEM (ma))     /* inv or NXM? */
+    return NULL;
+lnt = qba_map_run (ba, bc, &ma);
+if (lnt != bc)                                          /* not contig? */
+    return NULL;
+return (void *) (((uint8 *) M) + ma);
+}
+
+/* Direct access completion
+
+   Called once the caller has finished storing into a buffer returned by
+   Map_Direct, which may be well after Map_Direct if the transfer is
+   asynchronous.  Records the write for decoded instruction and dirty page
+   tracking; no map or data path register is touched.
+*/
+
+void Map_DirectDone (void *buf, int32 bc)
+{
+if ((buf != NULL) && (bc > 0))
+    MEM_WRITE_RUN ((uint32) (((uint8 *) buf) - ((uint8 *) M)), bc);
+}
+
 /* Memory examine via map (word only) */
 
 t_stat qba_ex (t_value *vptr, t_addr exta, UNIT *uptr, int32 sw)
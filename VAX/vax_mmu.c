@@ -47,6 +47,8 @@
         zap_tb_ent      -       clear TB entry
         chk_tb_ent      -       check TB entry
         set_map_reg     -       set up working map registers
+        tb_set_size     -       set TB size and associativity
+        tb_show_stats   -       show TB statistics
 */
 
 #include "vax_defs.h"
@@ -56,7 +58,18 @@
 int32 d_p0br, d_p0lr;                                   /* dynamic copies */
 int32 d_p1br, d_p1lr;                                   /* altered per ucode */
 int32 d_sbr, d_slr;
-TLBENT stlb[VA_TBSIZE], ptlb[VA_TBSIZE];
+TLBENT *stlb = NULL, *ptlb = NULL;                      /* system, process TB */
+uint32 tb_size = VA_TBSIZE;                             /* entries per TB */
+uint32 tb_set_mask = VA_M_TBI;                          /* set index mask */
+uint32 tb_ways = 1, tb_wshift = 0;                      /* associativity */
+int32 tb_ptag = 0;                                      /* process tag (ASID) */
+t_uint64 tb_hits = 0;                                   /* tag matches */
+t_uint64 tb_misses = 0;                                 /* tag mismatches */
+t_uint64 tb_fills = 0;                                  /* entries loaded */
+t_uint64 tb_evicts = 0;                                 /* valid entries replaced */
+t_uint64 tb_pflush = 0;                                 /* process TB flushes */
+t_uint64 tb_sflush = 0;                                 /* whole TB flushes */
+t_uint64 tb_inval = 0;                                  /* single entry flushes */
 static const int32 cvtacc[16] = { 0, 0,
     TLB_ACCW (KERN)+TLB_ACCR (KERN),
     TLB_ACCR (KERN),
@@ -83,7 +96,12 @@ static const int32 cvtacc[16] = { 0, 0,
 t_stat tlb_ex (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw);
 t_stat tlb_dep (t_value val, t_addr addr, UNIT *uptr, int32 sw);
 t_stat tlb_reset (DEVICE *dptr);
+t_stat tlb_set_msize (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 const char *tlb_description (DEVICE *dptr);
+static t_stat tb_alloc (uint32 size, uint32 ways);
+static TLBENT *tb_insert (TLBENT *tb, int32 vpn, int32 tag, int32 pte);
+static void tb_clear (TLBENT *tb);
+static void tb_fprint_size (FILE *st);
 
 TLBENT fill (uint32 va, int32 lnt, int32 acc, int32 *stat);
 extern int32 ReadIO (uint32 pa, int32 lnt);
@@ -106,6 +124,7 @@ UNIT tlb_unit[] = {
     };
 
 REG tlb_reg[] = {
+    { HRDATAD (PTAG, tb_ptag, 32, "process space tag"), REG_HRO },
     { NULL }
     };
 
@@ -113,7 +132,7 @@ DEVICE tlb_dev = {
     "TLB", tlb_unit, tlb_reg, NULL,
     2, 16, VA_N_TBI * 2, 1, 16, 32,
     &tlb_ex, &tlb_dep, &tlb_reset,
-    NULL, NULL, NULL, NULL, 0, 0, NULL, NULL, NULL, NULL, NULL, NULL, 
+    NULL, NULL, NULL, NULL, DEV_DYNM, 0, NULL, &tlb_set_msize, NULL, NULL, NULL, NULL, 
     &tlb_description
     };
 
@@ -141,7 +160,8 @@ DEVICE tlb_dev = {
 TLBENT fill (uint32 va, int32 lnt, int32 acc, int32 *stat)
 {
 int32 ptidx = (((uint32) va) >> 7) & ~03;
-int32 tlbpte, ptead, pte, tbi, vpn;
+int32 tlbpte, ptead, pte, vpn;
+TLBENT xpte;
 static TLBENT zero_pte = { 0, 0 };
 
 if (va & VA_S0) {                                       /* system space? */
@@ -163,9 +183,9 @@ else {
 #if !defined (VAX_620)
     if ((ptead & VA_S0) == 0)
         ABORT (STOP_PPTE);                              /* ppte must be sys */
-    vpn = VA_GETVPN (ptead);                            /* get vpn, tbi */
-    tbi = VA_GETTBI (vpn);
-    if (stlb[tbi].tag != vpn) {                         /* in sys tlb? */
+    vpn = VA_GETVPN (ptead);                            /* get vpn */
+    xpte = tb_lookup (ptead, vpn);
+    if (xpte.tag != vpn) {                              /* in sys tlb? */
         ptidx = ((uint32) ptead) >> 7;                  /* xlate like sys */
         if (ptidx >= d_slr)
             MM_ERR (PR_PLNV);
@@ -176,11 +196,10 @@ else {
 #endif
         if ((pte & PTE_V) == 0)                         /* spte TNV? */
             MM_ERR (PR_PTNV);
-        stlb[tbi].tag = vpn;                            /* set stlb tag */
-        stlb[tbi].pte = cvtacc[PTE_GETACC (pte)] |
-            ((pte << VA_N_OFF) & TLB_PFN);              /* set stlb data */
+        xpte = *tb_insert (stlb, vpn, vpn,              /* set stlb ent */
+            cvtacc[PTE_GETACC (pte)] | ((pte << VA_N_OFF) & TLB_PFN));
         }
-    ptead = (stlb[tbi].pte & TLB_PFN) | VA_GETOFF (ptead);
+    ptead = (xpte.pte & TLB_PFN) | VA_GETOFF (ptead);
 #endif
     }
 pte = ReadL (ptead);                                    /* read pte */
@@ -196,15 +215,36 @@ if (acc & TLB_WACC) {                                   /* write? */
     tlbpte = tlbpte | TLB_M;                            /* set M */
     }
 vpn = VA_GETVPN (va);
-tbi = VA_GETTBI (vpn);
-if ((va & VA_S0) == 0) {                                /* process space? */
-    ptlb[tbi].tag = vpn;                                /* store tlb ent */
-    ptlb[tbi].pte = tlbpte;
-    return ptlb[tbi];
+if ((va & VA_S0) == 0)                                  /* process space? */
+    return *tb_insert (ptlb, vpn, vpn | tb_ptag, tlbpte);
+return *tb_insert (stlb, vpn, vpn, tlbpte);             /* system space */
+}
+
+/* Insert an entry in its set
+
+   An existing entry for the tag is replaced; otherwise the oldest way
+   is evicted.  The new entry goes to way 0, so ways are kept in fill
+   order and lookups find recently filled entries first.
+*/
+
+static TLBENT *tb_insert (TLBENT *tb, int32 vpn, int32 tag, int32 pte)
+{
+TLBENT *set = &tb[((uint32) vpn & tb_set_mask) << tb_wshift];
+uint32 w;
+
+for (w = 0; w < (tb_ways - 1); w++) {                   /* find tag or victim */
+    if (set[w].tag == tag)
+        break;
     }
-stlb[tbi].tag = vpn;                                    /* system space */
-stlb[tbi].pte = tlbpte;                                 /* store tlb ent */
-return stlb[tbi];
+if ((set[w].tag != tag) && (set[w].tag != -1) &&        /* evicting valid ent? */
+    ((tb == stlb) || ((set[w].tag & ~VA_M_VPN) == tb_ptag)))
+    tb_evicts++;
+if (w)
+    memmove (&set[1], &set[0], w * sizeof (TLBENT));
+set[0].tag = tag;
+set[0].pte = pte;
+tb_fills++;
+return &set[0];
 }
 
 /* Utility routines */
@@ -219,28 +259,49 @@ d_p1lr = (P1LR << 2) + 0x800000;                        /* VA<30> >> 7 */
 d_slr = (SLR << 2) + 0x1000000;                         /* VA<31> >> 7 */
 }
 
-/* Zap process (0) or whole (1) tb */
+/* Zap process (0) or whole (1) tb
+
+   Process entries are tagged with tb_ptag, so the process TB is flushed
+   by advancing the tag; it is only cleared when the tag wraps.
+*/
 
 void zap_tb (int stb)
 {
-size_t i;
-
-for (i = 0; i < VA_TBSIZE; i++) {
-    ptlb[i].tag = ptlb[i].pte = -1;
-    if (stb)
-        stlb[i].tag = stlb[i].pte = -1;
+if (stb) {
+    tb_clear (stlb);
+    tb_clear (ptlb);
+    tb_ptag = 0;
+    tb_sflush++;
+    return;
     }
+tb_ptag = (tb_ptag + (1 << VA_N_VPN)) & ~VA_M_VPN & 0x7FFFFFFF;
+if (tb_ptag == 0)                                       /* tags wrapped? */
+    tb_clear (ptlb);
+tb_pflush++;
+}
+
+static void tb_clear (TLBENT *tb)
+{
+uint32 i;
+
+for (i = 0; i < tb_size; i++)
+    tb[i].tag = tb[i].pte = -1;
 }
 
 /* Zap single tb entry corresponding to va */
 
 void zap_tb_ent (uint32 va)
 {
-int32 tbi = VA_GETTBI (VA_GETVPN (va));
+int32 vpn = VA_GETVPN (va);
+int32 tag = (va & VA_S0)? vpn: vpn | tb_ptag;
+TLBENT *set = &((va & VA_S0)? stlb: ptlb)[((uint32) vpn & tb_set_mask) << tb_wshift];
+uint32 w;
 
-if (va & VA_S0)
-    stlb[tbi].tag = stlb[tbi].pte = -1;
-else ptlb[tbi].tag = ptlb[tbi].pte = -1;
+for (w = 0; w < tb_ways; w++) {
+    if (set[w].tag == tag)
+        set[w].tag = set[w].pte = -1;
+    }
+tb_inval++;
 }
 
 /* Check for tlb entry corresponding to va */
@@ -248,12 +309,14 @@ else ptlb[tbi].tag = ptlb[tbi].pte = -1;
 t_bool chk_tb_ent (uint32 va)
 {
 int32 vpn = VA_GETVPN (va);
-int32 tbi = VA_GETTBI (vpn);
-TLBENT xpte;
+int32 tag = (va & VA_S0)? vpn: vpn | tb_ptag;
+TLBENT *set = &((va & VA_S0)? stlb: ptlb)[((uint32) vpn & tb_set_mask) << tb_wshift];
+uint32 w;
 
-xpte = (va & VA_S0)? stlb[tbi]: ptlb[tbi];
-if (xpte.tag == vpn)
-    return TRUE;
+for (w = 0; w < tb_ways; w++) {
+    if (set[w].tag == tag)
+        return TRUE;
+    }
 return FALSE;
 }
 
@@ -264,7 +327,7 @@ t_stat tlb_ex (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw)
 int32 tlbn = uptr - tlb_unit;
 uint32 idx = (uint32) addr >> 1;
 
-if (idx >= VA_TBSIZE)
+if (idx >= tb_size)
     return SCPE_NXM;
 if (addr & 1)
     *vptr = ((uint32) (tlbn? stlb[idx].pte: ptlb[idx].pte));
@@ -279,7 +342,7 @@ t_stat tlb_dep (t_value val, t_addr addr, UNIT *uptr, int32 sw)
 int32 tlbn = uptr - tlb_unit;
 uint32 idx = (uint32) addr >> 1;
 
-if (idx >= VA_TBSIZE)
+if (idx >= tb_size)
     return SCPE_NXM;
 if (addr & 1) {
     if (tlbn) stlb[idx].pte = (int32) val;
@@ -296,10 +359,114 @@ return SCPE_OK;
 
 t_stat tlb_reset (DEVICE *dptr)
 {
-size_t i;
+if (stlb == NULL)                                       /* first time? */
+    return tb_alloc (tb_size, tb_ways);
+tb_clear (stlb);
+tb_clear (ptlb);
+tb_ptag = 0;
+return SCPE_OK;
+}
 
-for (i = 0; i < VA_TBSIZE; i++)
-    stlb[i].tag = ptlb[i].tag = stlb[i].pte = ptlb[i].pte = -1;
+/* Allocate the TBs; size is entries per TB */
+
+static t_stat tb_alloc (uint32 size, uint32 ways)
+{
+TLBENT *ns = (TLBENT *) malloc (size * sizeof (TLBENT));
+TLBENT *np = (TLBENT *) malloc (size * sizeof (TLBENT));
+uint32 i;
+
+if ((ns == NULL) || (np == NULL)) {
+    free (ns);
+    free (np);
+    return SCPE_MEM;
+    }
+free (stlb);
+free (ptlb);
+stlb = ns;
+ptlb = np;
+tb_size = size;
+tb_ways = ways;
+for (tb_wshift = 0; (1u << tb_wshift) < ways; tb_wshift++) ;
+tb_set_mask = (size / ways) - 1;
+tb_clear (stlb);
+tb_clear (ptlb);
+tb_ptag = 0;
+tb_hits = tb_misses = tb_fills = tb_evicts = 0;
+tb_pflush = tb_sflush = tb_inval = 0;
+for (i = 0; i < tlb_dev.numunits; i++)
+    tlb_unit[i].capac = size * 2;
+for (tlb_dev.awidth = 1; (1u << tlb_dev.awidth) < (size * 2); tlb_dev.awidth++) ;
+return SCPE_OK;
+}
+
+/* Set TB size (SET CPU TBSIZE=n{:ways}) */
+
+t_stat tb_set_size (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+char gbuf[CBUFSIZE];
+uint32 size, ways = 1;
+t_stat r;
+
+if ((cptr == NULL) || (*cptr == 0))
+    return SCPE_MISVAL;
+cptr = get_glyph (cptr, gbuf, ':');
+size = (uint32) get_uint (gbuf, 10, TB_MAXSIZE, &r);
+if ((r != SCPE_OK) || (size < TB_MINSIZE) || (size & (size - 1)))
+    return sim_messagef (SCPE_ARG, "TB size must be a power of 2 from %d to %d\n", TB_MINSIZE, TB_MAXSIZE);
+if (*cptr) {
+    ways = (uint32) get_uint (cptr, 10, 4, &r);
+    if ((r != SCPE_OK) || ((ways != 1) && (ways != 2) && (ways != 4)))
+        return sim_messagef (SCPE_ARG, "TB associativity must be 1, 2 or 4\n");
+    }
+return tb_alloc (size, ways);
+}
+
+static void tb_fprint_size (FILE *st)
+{
+if (tb_ways == 1)
+    fprintf (st, "TB=%u entries, direct mapped", tb_size);
+else fprintf (st, "TB=%u entries, %u-way", tb_size, tb_ways);
+}
+
+t_stat tb_show_size (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+tb_fprint_size (st);
+fprintf (st, "\n");
+return SCPE_OK;
+}
+
+/* Restore of a TB of a different size */
+
+t_stat tlb_set_msize (UNIT *uptr, int32 val, CONST char *cptr, void *desc)
+{
+uint32 size = ((uint32) val) / 2;
+
+if ((size < TB_MINSIZE) || (size > TB_MAXSIZE) || (size & (size - 1)) ||
+    (size < tb_ways))
+    return SCPE_ARG;
+if (size == tb_size)
+    return SCPE_OK;
+return tb_alloc (size, tb_ways);
+}
+
+/* Show TB statistics */
+
+t_stat tb_show_stats (FILE *st, UNIT *uptr, int32 val, CONST void *desc)
+{
+t_uint64 tot = tb_hits + tb_misses;
+
+tb_fprint_size (st);
+fprintf (st, ", process tag=%d\n", tb_ptag >> VA_N_VPN);
+fprintf (st, "  Hits:                %" LL_FMT "u", tb_hits);
+if (tot)
+    fprintf (st, " (%.2f%%)", (100.0 * (double) tb_hits) / (double) tot);
+fprintf (st, "\n");
+fprintf (st, "  Misses:              %" LL_FMT "u\n", tb_misses);
+fprintf (st, "  Fills:               %" LL_FMT "u\n", tb_fills);
+fprintf (st, "  Evictions:           %" LL_FMT "u\n", tb_evicts);
+fprintf (st, "  Process flushes:     %" LL_FMT "u\n", tb_pflush);
+fprintf (st, "  Full flushes:        %" LL_FMT "u\n", tb_sflush);
+fprintf (st, "  Entry invalidations: %" LL_FMT "u\n", tb_inval);
 return SCPE_OK;
 }
 
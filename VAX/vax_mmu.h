@@ -62,7 +62,11 @@ extern DEVICE cpu_dev;
 extern int32 mapen;                                     /* map enable */
 
 extern int32 mchk_va, mchk_ref;                         /* for mcheck */
-extern TLBENT stlb[VA_TBSIZE], ptlb[VA_TBSIZE];
+extern TLBENT *stlb, *ptlb;                             /* system, process TB */
+extern uint32 tb_set_mask;                              /* TB set index mask */
+extern uint32 tb_ways, tb_wshift;                       /* TB ways, log2 ways */
+extern int32 tb_ptag;                                   /* process tag (ASID) */
+extern t_uint64 tb_hits, tb_misses;                     /* TB statistics */
 
 static const int32 insert[4] = {
     0x00000000, 0x000000FF, 0x0000FFFF, 0x00FFFFFF
@@ -71,6 +75,9 @@ static const int32 insert[4] = {
 extern void zap_tb (int stb);
 extern void zap_tb_ent (uint32 va);
 extern t_bool chk_tb_ent (uint32 va);
+extern t_stat tb_set_size (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
+extern t_stat tb_show_size (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
+extern t_stat tb_show_stats (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 extern void set_map_reg (void);
 extern int32 ReadIO (uint32 pa, int32 lnt);
 extern void WriteIO (uint32 pa, int32 val, int32 lnt);
@@ -87,6 +94,40 @@ static SIM_INLINE void WriteB (uint32 pa, int32 val);
 static SIM_INLINE void WriteW (uint32 pa, int32 val);
 static SIM_INLINE void WriteL (uint32 pa, int32 val);
 
+/* Translation buffer lookup
+
+   The system and process TBs are tb_ways-way set associative, indexed by
+   the low bits of the vpn.  Process space tags include the current process
+   tag (tb_ptag), which zap_tb (0) advances instead of clearing the process
+   TB.  On a tag mismatch, an entry with access = 0 is returned, so the
+   caller's access check fails and it calls fill.
+*/
+
+static SIM_INLINE TLBENT tb_lookup (uint32 va, int32 vpn)
+{
+static const TLBENT tb_miss = { -1, 0 };
+TLBENT *set;
+int32 tag;
+uint32 w;
+
+if (va & VA_S0) {                                       /* system space? */
+    set = &stlb[((uint32) vpn & tb_set_mask) << tb_wshift];
+    tag = vpn;
+    }
+else {
+    set = &ptlb[((uint32) vpn & tb_set_mask) << tb_wshift];
+    tag = vpn | tb_ptag;
+    }
+for (w = 0; w < tb_ways; w++) {
+    if (set[w].tag == tag) {
+        tb_hits++;
+        return set[w];
+        }
+    }
+tb_misses++;
+return tb_miss;
+}
+
 /* Read and write virtual
 
    These routines logically fall into three phases:
@@ -118,7 +159,7 @@ static SIM_INLINE void WriteL (uint32 pa, int32 val);
 
 static SIM_INLINE int32 Read (uint32 va, int32 lnt, int32 acc)
 {
-int32 vpn, off, tbi, pa;
+int32 vpn, off, pa;
 int32 pa1, bo, sc, wl, wh;
 TLBENT xpte;
 
@@ -126,9 +167,8 @@ mchk_va = va;
 if (mapen) {                                            /* mapping on? */
     vpn = VA_GETVPN (va);                               /* get vpn, offset */
     off = VA_GETOFF (va);
-    tbi = VA_GETTBI (vpn);
-    xpte = (va & VA_S0)? stlb[tbi]: ptlb[tbi];          /* access tlb */
-    if (((xpte.pte & acc) == 0) || (xpte.tag != vpn) ||
+    xpte = tb_lookup (va, vpn);                         /* access tlb */
+    if (((xpte.pte & acc) == 0) ||
         ((acc & TLB_WACC) && ((xpte.pte & TLB_M) == 0)))
         xpte = fill (va, lnt, acc, NULL);               /* fill if needed */
     pa = (xpte.pte & TLB_PFN) | off;                    /* get phys addr */
@@ -146,9 +186,8 @@ if ((pa & (lnt - 1)) == 0) {                            /* aligned? */
     }
 if (mapen && ((uint32)(off + lnt) > VA_PAGSIZE)) {      /* cross page? */
     vpn = VA_GETVPN (va + lnt);                         /* vpn 2nd page */
-    tbi = VA_GETTBI (vpn);
-    xpte = (va & VA_S0)? stlb[tbi]: ptlb[tbi];          /* access tlb */
-    if (((xpte.pte & acc) == 0) || (xpte.tag != vpn) ||
+    xpte = tb_lookup (va, vpn);                         /* access tlb */
+    if (((xpte.pte & acc) == 0) ||
         ((acc & TLB_WACC) && ((xpte.pte & TLB_M) == 0)))
         xpte = fill (va + lnt, lnt, acc, NULL);         /* fill if needed */
     pa1 = ((xpte.pte & TLB_PFN) | VA_GETOFF (va + 4)) & ~03;
@@ -184,7 +223,7 @@ else {
 
 static SIM_INLINE void Write (uint32 va, int32 val, int32 lnt, int32 acc)
 {
-int32 vpn, off, tbi, pa;
+int32 vpn, off, pa;
 int32 pa1, bo, sc;
 TLBENT xpte;
 
@@ -192,9 +231,8 @@ mchk_va = va;
 if (mapen) {
     vpn = VA_GETVPN (va);
     off = VA_GETOFF (va);
-    tbi = VA_GETTBI (vpn);
-    xpte = (va & VA_S0)? stlb[tbi]: ptlb[tbi];          /* access tlb */
-    if (((xpte.pte & acc) == 0) || (xpte.tag != vpn) ||
+    xpte = tb_lookup (va, vpn);                         /* access tlb */
+    if (((xpte.pte & acc) == 0) ||
         ((xpte.pte & TLB_M) == 0))
         xpte = fill (va, lnt, acc, NULL);
     pa = (xpte.pte & TLB_PFN) | off;
@@ -216,9 +254,8 @@ if ((pa & (lnt - 1)) == 0) {                            /* aligned? */
     }
 if (mapen && ((uint32)(off + lnt) > VA_PAGSIZE)) {
     vpn = VA_GETVPN (va + 4);
-    tbi = VA_GETTBI (vpn);
-    xpte = (va & VA_S0)? stlb[tbi]: ptlb[tbi];          /* access tlb */
-    if (((xpte.pte & acc) == 0) || (xpte.tag != vpn) ||
+    xpte = tb_lookup (va, vpn);                         /* access tlb */
+    if (((xpte.pte & acc) == 0) ||
         ((xpte.pte & TLB_M) == 0))
         xpte = fill (va + lnt, lnt, acc, NULL);
     pa1 = ((xpte.pte & TLB_PFN) | VA_GETOFF (va + 4)) & ~03;
@@ -244,16 +281,15 @@ return;
 
 static SIM_INLINE int32 Test (uint32 va, int32 acc, int32 *status)
 {
-int32 vpn, off, tbi;
+int32 vpn, off;
 TLBENT xpte;
 
 *status = PR_OK;                                        /* assume ok */
 if (mapen) {                                            /* mapping on? */
     vpn = VA_GETVPN (va);                               /* get vpn, off */
     off = VA_GETOFF (va);
-    tbi = VA_GETTBI (vpn);
-    xpte = (va & VA_S0)? stlb[tbi]: ptlb[tbi];          /* access tlb */
-    if ((xpte.pte & acc) && (xpte.tag == vpn))          /* TB hit, acc ok? */ 
+    xpte = tb_lookup (va, vpn);                         /* access tlb */
+    if (xpte.pte & acc)                                 /* TB hit, acc ok? */ 
         return (xpte.pte & TLB_PFN) | off;
     xpte = fill (va, L_BYTE, acc, status);              /* fill TB */
     if (*status == PR_OK)
@@ -366,6 +402,7 @@ if (ADDR_IS_MEM (pa)) {
     int32 sc = (pa & 3) << 3;
     int32 mask = 0xFF << sc;
     M[id] = (M[id] & ~mask) | (val << sc);
+    MEM_WRITE (pa);
     }
 else {
     mchk_ref = REF_V;
@@ -383,6 +420,7 @@ if (ADDR_IS_MEM (pa)) {
     int32 id = pa >> 2;
     M[id] = (pa & 2)? (M[id] & 0xFFFF) | (val << 16):
         (M[id] & ~0xFFFF) | val;
+    MEM_WRITE (pa);
     }
 else {
     mchk_ref = REF_V;
@@ -396,8 +434,10 @@ return;
 
 static SIM_INLINE void WriteL (uint32 pa, int32 val)
 {
-if (ADDR_IS_MEM (pa))
+if (ADDR_IS_MEM (pa)) {
     M[pa >> 2] = val;
+    MEM_WRITE (pa);
+    }
 else {
     mchk_ref = REF_V;
     if (ADDR_IS_IO (pa))
@@ -410,8 +450,10 @@ return;
 
 static SIM_INLINE void WriteLP (uint32 pa, int32 val)
 {
-if (ADDR_IS_MEM (pa))
+if (ADDR_IS_MEM (pa)) {
     M[pa >> 2] = val;
+    MEM_WRITE (pa);
+    }
 else {
     mchk_va = pa;
     mchk_ref = REF_P;
@@ -439,6 +481,7 @@ if (ADDR_IS_MEM (pa)) {
     int32 bo = pa & 3;
     int32 sc = bo << 3;
     M[pa >> 2] = (M[pa >> 2] & ~(insert[lnt] << sc)) | ((val & insert[lnt]) << sc);
+    MEM_WRITE (pa);
     }
 else {
     mchk_ref = REF_V;
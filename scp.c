@@ -271,6 +271,10 @@
 #define SRBSIZ          1024                            /* save/restore buffer */
 #define SIM_BRK_INILNT  4096                            /* bpt tbl length */
 #define SIM_BRK_ALLTYP  0xFFFFFFFB
+#define SIM_BRK_MAP_V_PG 6                              /* log2 addresses per map bucket */
+#define SIM_BRK_MAPSIZE 4096                            /* breakpoint map buckets */
+#define SIM_BRK_MAPIDX(a) ((uint32)((a) >> SIM_BRK_MAP_V_PG) & (SIM_BRK_MAPSIZE - 1))
+#define SIM_BRK_TYPMASK ((1u << SIM_BKPT_V_SPC) - 1)    /* type bits of a test argument */
 #define UPDATE_SIM_TIME                                         \
     if (1) {                                                    \
         int32 _x;                                               \
@@ -536,6 +540,11 @@ t_stat sim_brk_clr (t_addr loc, int32 sw);
 t_stat sim_brk_clrall (int32 sw);
 t_stat sim_brk_show (FILE *st, t_addr loc, int32 sw);
 t_stat sim_brk_showall (FILE *st, int32 sw);
+t_stat sim_brk_set_range (t_addr lo, t_addr hi, int32 sw, int32 ncnt, CONST char *act);
+t_stat sim_brk_clr_range (t_addr lo, t_addr hi, int32 sw);
+t_stat sim_brk_show_range (FILE *st, t_addr lo, t_addr hi, int32 sw);
+t_stat sim_brk_show_entry (FILE *st, BRKTAB *bp, int32 sw);
+t_stat sim_brk_show_stats (FILE *st);
 CONST char *sim_brk_getact (char *buf, int32 size);
 BRKTAB *sim_brk_new (t_addr loc, uint32 btyp);
 char *sim_brk_clract (void);
@@ -548,6 +557,7 @@ SCHTAB *get_rsearch (CONST char *cptr, int32 radix, SCHTAB *schptr);
 SCHTAB *get_asearch (CONST char *cptr, int32 radix, SCHTAB *schptr);
 int32 test_search (t_value *val, SCHTAB *schptr);
 static const char *get_glyph_gen (const char *iptr, char *optr, char mchar, t_bool ws_match, t_bool uc, t_bool quote, char escape_char);
+static void _sim_free_unit_opts (void);
 typedef enum {
     SW_ERROR,           /* Parse Error */
     SW_BITMASK,         /* Bitmask Value or Not a switch */
@@ -602,12 +612,14 @@ void int_handler (int signal);
 t_stat set_prompt (int32 flag, CONST char *cptr);
 t_stat set_runlimit (int32 flag, CONST char *cptr);
 t_stat sim_set_asynch (int32 flag, CONST char *cptr);
+t_stat sim_set_queue (int32 flag, CONST char *cptr);
 static const char *_get_dbg_verb (uint32 dbits, DEVICE* dptr, UNIT *uptr);
 static t_stat sim_sanity_check_register_declarations (DEVICE **devices);
 static t_stat sim_device_unit_tests (const char *cptr);
 static void fix_writelock_mtab (DEVICE *dptr);
 static t_stat _sim_debug_flush (void);
 static const char *_get_runlimit (void);
+static void _sim_evq_rebuild (void);
 
 /* Global data */
 
@@ -649,6 +661,15 @@ BRKTAB **sim_brk_tab = NULL;
 int32 sim_brk_ent = 0;
 int32 sim_brk_lnt = 0;
 int32 sim_brk_ins = 0;
+static BRKTAB *sim_brk_rng = NULL;                  /* range breakpoints */
+static uint32 sim_brk_map[SIM_BRK_MAPSIZE];         /* types present per address bucket */
+static t_bool sim_brk_map_valid = FALSE;
+static t_uint64 sim_brk_stat_tests;                 /* sim_brk_test calls */
+static t_uint64 sim_brk_stat_filtered;              /*   resolved by the map alone */
+static t_uint64 sim_brk_stat_probes;                /* table search probes by tests */
+static t_uint64 sim_brk_probes;                     /* all table search probes */
+static t_uint64 sim_brk_stat_rprobes;               /* range entries examined */
+static t_uint64 sim_brk_stat_hits;                  /* matching breakpoints found */
 int32 sim_quiet = 0;
 int32 sim_show_message = 1;                         /* the message display status of the currently open do file */
 int32 sim_step = 0;
@@ -665,6 +686,8 @@ size_t *sim_sub_instr_off = NULL;   /* offsets in substitution buffer where orig
 static double sim_time;
 static uint32 sim_rtime;
 static int32 noqueue_time;
+static t_bool sim_evq_indexed = TRUE;                   /* indexed event queue engine selected */
+static t_bool sim_evq_valid = FALSE;                    /* index matches sim_clock_queue */
 volatile t_bool stop_cpu = FALSE;
 volatile t_bool sigterm_received = FALSE;
 static unsigned int sim_stop_sleep_ms = 250;
@@ -680,6 +703,7 @@ FILEREF *sim_deb_ref = NULL;                            /* debug file file refer
 int32 sim_deb_switches = 0;                             /* debug switches */
 size_t sim_deb_buffer_size = 0;                         /* debug memory buffer size */
 char *sim_deb_buffer = NULL;                            /* debug memory buffer */
+t_bool sim_deb_trace = FALSE;                           /* debug output is a binary trace */
 size_t sim_debug_buffer_offset = 0;                     /* debug memory buffer insertion offset */
 size_t sim_debug_buffer_inuse = 0;                      /* debug memory buffer inuse count */
 char *sim_prompt = NULL;                                /* prompt string */
@@ -817,6 +841,7 @@ const char *sim_savename = sim_name;      /* Simulator Name used in SAVE/RESTORE
 /* Tables and strings */
 
 const char save_vercur[] = "V4.0";
+const char save_ver41[] = "V4.1";                       /* snapshot (SAVE -C or -I) */
 const char save_ver40[] = "V4.0";
 const char save_ver35[] = "V3.5";
 const char save_ver32[] = "V3.2";
@@ -1073,6 +1098,18 @@ static const char simh_help1[] =
       " to a file.  This includes the contents of main memory and all registers,\n"
       " and the I/O connections of devices:\n\n"
       "++SAVE <filename>\n\n"
+      "4Switches\n"
+      " Switches select a snapshot format save file:\n\n"
+      "++-C      Compresses memory contents\n"
+      "++-I      Saves only memory which changed since the previous snapshot\n"
+      "\n"
+      " An incremental snapshot (-I) refers to the previous snapshot saved by\n"
+      " this simulator session, which must remain available to restore it.  If\n"
+      " no snapshot has been saved yet a full snapshot is written.  -C and -I\n"
+      " may be combined:\n\n"
+      "++SAVE -C base.sav\n"
+      "++SAVE -CI ckpt1.sav\n"
+      "++SAVE -CI ckpt2.sav\n\n"
 #define HLP_RESTORE     "*Commands Saving_and_Restoring_State RESTORE"
       "3RESTORE\n"
       " The RESTORE command (abbreviation REST, alternately GET) restores a\n"
@@ -1086,7 +1123,14 @@ static const char simh_help1[] =
       "\n"
       "4Notes:\n"
       " 1) SAVE file format compresses zeroes to minimize file size.\n"
-      " 2) The simulator can't restore active incoming telnet sessions to\n"
+      " 2) Restoring an incremental snapshot reads the unchanged memory from\n"
+      " the snapshots it is based on, so each of them must still be present.\n"
+      " 3) A SAVE -C or SAVE -I snapshot doesn't copy memory which is mapped onto\n"
+      " a shared memory file (SET CPU MEMFILE).  It flushes the memory file and\n"
+      " records its name, and RESTORE maps it again, so the memory file holds that\n"
+      " part of the saved state and must be preserved along with the snapshot.\n"
+      " A plain SAVE copies the memory contents into the save file.\n"
+      " 4) The simulator can't restore active incoming telnet sessions to\n"
       " multiplexer devices, but the listening ports will be restored across a\n"
       " save/restore.\n"
        /***************** 80 character line width template *************************/
@@ -1171,7 +1215,10 @@ static const char simh_help1[] =
       " (usually E for execution) is used.  If no address range is specified, the\n"
       " current PC is used.  As with EXAMINE and DEPOSIT, an address range may be a\n"
       " single address, a range of addresses low-high, or a relative range of\n"
-      " address/length.\n"
+      " address/length.\n\n"
+      " A range given without a repeat count is kept as a single range breakpoint\n"
+      " which matches any address within it.  A range given with a repeat count\n"
+      " sets a separate breakpoint, each with its own count, at every address.\n"
        /***************** 80 character line width template *************************/
       "5Displaying Breakpoints\n"
       " Currently set breakpoints can be displayed with the SHOW BREAK command:\n\n"
@@ -1179,12 +1226,17 @@ static const char simh_help1[] =
       " Locations with breakpoints of the specified type are displayed.\n\n"
       " The -C switch displays the selected breakpoint(s) formatted as commands\n"
       " which may be subsequently used to establish the same breakpoint(s).\n\n"
+      " The number of breakpoint tests the simulator has made, how many of them\n"
+      " were resolved by the breakpoint address map alone, and how many table\n"
+      " probes and hits occurred are displayed with:\n\n"
+      "++SHOW BREAK STATISTICS\n\n"
       "5Removing Breakpoints\n"
       " Breakpoints can be cleared by the NOBREAK or the SET NOBREAK commands.\n"
       "5Examples\n"
       "++BREAK                       set E break at current PC\n"
       "++BREAK -e 200                set E break at 200\n"
       "++BREAK 2000/2[2]             set E breaks at 2000,2001 with count = 2\n"
+      "++BREAK 1000-1FFF             set E range break from 1000 through 1FFF\n"
       "++BREAK 100;EX AC;D MQ 0      set E break at 100 with actions EX AC\n"
       "+++++++++and D MQ 0\n"
       "++BREAK 100;                  delete action on break at 100\n"
@@ -1483,6 +1535,14 @@ static const char simh_help1[] =
       " The buffered data is written to the specified destination file when\n"
       " control returns to the sim> prompt or every 30 seconds while the \n"
       " simulator is executing instructions.\n\n"
+      "5-C\n"
+      " The -C switch causes debug messages to be written to the debug file\n"
+      " as a compact binary trace.  Messages aren't formatted while the\n"
+      " simulator runs; the raw message arguments are queued and written to\n"
+      " the file by a separate thread.  The trace is rendered as text with:\n\n"
+      "++SHOW DEBUG DECODE <trace-file> {<text-file>}\n\n"
+      " Duplicate lines are not summarized in a decoded trace.  A binary trace\n"
+      " must be written to a file and can't be combined with -B.\n\n"
 #define HLP_SET_BREAK  "*Commands SET Breakpoints"
       "3Breakpoints\n"
       "+SET BREAK <list>            set breakpoints\n"
@@ -1565,6 +1625,10 @@ static const char simh_help1[] =
       "3Asynch\n"
       "+SET ASYNCH                  enable asynchronous I/O\n"
       "+SET NOASYNCH                disable asynchronous I/O\n"
+#define HLP_SET_QUEUE "*Commands SET Queue"
+      "3Queue\n"
+      "+SET QUEUE INDEXED           use the indexed event queue engine (default)\n"
+      "+SET QUEUE LINEAR            use linear scans of the event queue\n"
 #define HLP_SET_ENVIRON "*Commands SET Environment"
       "3Environment\n"
       "4Explicitily Changing a Variable\n"
@@ -1657,6 +1721,44 @@ static const char simh_help1[] =
       "+SET <unit> ENABLED          enable unit\n"
       "+SET <unit> DISABLED         disable unit\n"
       "+SET <unit> arg{,arg...}     set unit parameters (see show modifiers)\n"
+      "+SET <dev> CACHE{=size}      cache disk sectors, writing through to the\n"
+      "++++++++                     container (size in bytes, K or M, default 1M)\n"
+      "+SET <dev> WBCACHE{=size}    cache disk sectors, writing modified sectors\n"
+      "++++++++                     back when flushed, evicted, detached or saved\n"
+      "+SET <dev> NOCACHE           disable the disk sector cache\n"
+      "++++++++                     (CACHE, WBCACHE and NOCACHE also apply to\n"
+      "++++++++                     a single <unit>)\n"
+      "+SET <dev> COMPRESS          store whole clusters written to CLUSTER\n"
+      "++++++++                     format containers LZ4 compressed\n"
+      "+SET <dev> NOCOMPRESS        store clusters uncompressed\n"
+      "++++++++                     (COMPRESS and NOCOMPRESS also apply to\n"
+      "++++++++                     a single <unit>)\n"
+      "+SET <dev> MMAP              map SIMH and RAW format disk containers into\n"
+      "++++++++                     memory rather than reading and writing them\n"
+      "+SET <dev> NOMMAP            use file I/O for disk containers\n"
+      "++++++++                     (MMAP and NOMMAP also apply to a single <unit>)\n"
+      "+SET <dev> STATISTICS=RESET  zero the disk I/O statistics of the device's\n"
+      "++++++++                     units (or of a single <unit>)\n"
+      "+SET <dev> INDEX             index the records and tape marks of SIMH and\n"
+      "++++++++                     E11 format tape images, saved in <image>.mtidx,\n"
+      "++++++++                     so that spacing records and files seeks directly\n"
+      "+SET <dev> NOINDEX           read every record when spacing\n"
+      "++++++++                     (INDEX and NOINDEX also apply to a single <unit>\n"
+      "++++++++                     and take effect when it is next attached)\n"
+      "+SET <dev> PREFETCH          read the next tape record ahead while the\n"
+      "++++++++                     simulator handles the one just read (needs\n"
+      "++++++++                     SET ASYNCH)\n"
+      "+SET <dev> NOPREFETCH        read each record when it is requested\n"
+      "++++++++                     (PREFETCH and NOPREFETCH also apply to a single\n"
+      "++++++++                     <unit>)\n"
+      "+SET <unit> SNAPSHOT=name    take a named snapshot of an attached\n"
+      "++++++++                     CLUSTER format disk container\n"
+      "+SET <unit> REVERT=name      return the container to a snapshot\n"
+      "+SET <unit> NOSNAPSHOT=name  delete a snapshot\n"
+      "+SET <unit> OVERLAY=KEEP|DISCARD|MERGE\n"
+      "++++++++                     keep, delete or merge into the base container\n"
+      "++++++++                     the overlay of a unit attached with ATTACH -O\n"
+      "++++++++                     when the unit is detached\n"
       "+HELP <dev> SET              displays the device specific set commands\n"
       "++++++++                     available\n"
 #define HLP_NOAUTOSIZE  "*Commands SET NoAutosize"
@@ -1673,6 +1775,13 @@ static const char simh_help1[] =
       "+SET <unit> AUTOSIZE         enables disk autosizing for a specific\n"
       "++++++++                     unit in the simulator that supports\n"
       "++++++++                     different drive types or sizes\n"
+#define HLP_SET_DISK    "*Commands SET Disk_Probes"
+      "3Disk Probes\n"
+      "+SET DISK PROBE=fs{;fs...}   restricts the file systems looked for when\n"
+      "++++++++                     sizing an attached disk to those listed:\n"
+      "++++++++                     ODS2, ODS1, ULTRIX, ISO9660, RSTS, BSD211,\n"
+      "++++++++                     NETBSD, RT11, ALL or NONE\n"
+      "+SET DISK PROBE              looks for all known file systems\n"
 #define HLP_AUTOZAP     "*Commands SET Autozap"
       "3Autozap\n"
       "+SET AUTOZAP                 enables automatic metadata removal on\n"
@@ -1703,9 +1812,20 @@ static const char simh_help2[] =
       "+sh{ow} re{mote}              show remote console configuration\n"
       "+sh{ow} <dev> RADIX           show device display radix\n"
       "+sh{ow} <dev> DEBUG           show device debug flags\n"
+      "+sh{ow} deb{ug} DECODE <file> decode a binary debug trace\n"
       "+sh{ow} <dev> MODIFIERS       show device modifiers\n"
       "+sh{ow} <dev> NAMES           show device logical name\n"
       "+sh{ow} <dev> SHOW            show device SHOW commands\n"
+      "+sh{ow} <dev>|<unit> CACHE    show disk sector cache statistics\n"
+      "+sh{ow} <dev>|<unit> SNAPSHOTS show CLUSTER disk container snapshots\n"
+      "+sh{ow} <dev>|<unit> CHAIN    show VHD differencing disk chain layers\n"
+      "+sh{ow} <dev>|<unit> OVERLAY  show disk overlay files and activity\n"
+      "+sh{ow} {-C} <dev>|<unit> STATISTICS\n"
+      "++++++++                     show disk I/O counts and host service time\n"
+      "++++++++                     histograms (-C as comma separated values)\n"
+      "+sh{ow} <dev>|<unit> INDEX    show tape image index coverage and use\n"
+      "+sh{ow} <dev>|<unit> PREFETCH show tape request queue and read ahead use\n"
+      "+sh{ow} disk {PROBE}          show file systems probed when sizing disks\n"
       "+sh{ow} <dev> {arg,...}       show device parameters\n"
       "+sh{ow} <unit> {arg,...}      show unit parameters\n"
       "+sh{ow} ethernet              show ethernet devices\n"
@@ -1748,6 +1868,7 @@ static const char simh_help2[] =
 #define HLP_SHOW_RUNLIMIT       "*Commands SHOW"
 #define HLP_SHOW_SEND           "*Commands SHOW"
 #define HLP_SHOW_EXPECT         "*Commands SHOW"
+#define HLP_SHOW_DISK           "*Commands SHOW"
 #define HLP_HELP                "*Commands HELP"
        /***************** 80 character line width template *************************/
       "2HELP\n"
@@ -2824,6 +2945,7 @@ static CTAB set_glob_tab[] = {
     { "CLOCKS",     &sim_set_timers,            1, HLP_SET_CLOCK },
     { "ASYNCH",     &sim_set_asynch,            1, HLP_SET_ASYNCH },
     { "NOASYNCH",   &sim_set_asynch,            0, HLP_SET_ASYNCH },
+    { "QUEUE",      &sim_set_queue,             0, HLP_SET_QUEUE },
     { "ENVIRONMENT", &sim_set_environment,      1, HLP_SET_ENVIRON },
     { "ON",         &set_on,                    1, HLP_SET_ON },
     { "NOON",       &set_on,                    0, HLP_SET_ON },
@@ -2842,6 +2964,7 @@ static CTAB set_glob_tab[] = {
     { "AUTOSIZE",   &sim_disk_set_all_noautosize, 0, HLP_NOAUTOSIZE },
     { "AUTOZAP",    &sim_disk_set_all_autozap,  1, HLP_AUTOZAP },
     { "NOAUTOZAP",  &sim_disk_set_all_autozap,  0, HLP_AUTOZAP },
+    { "DISK",       &sim_disk_set_probe,        0, HLP_SET_DISK },
     { NULL,         NULL,                       0 }
     };
 
@@ -2856,6 +2979,18 @@ static C1TAB set_dev_tab[] = {
     { "NODEBUG",    &set_dev_debug,     0 },
     { "APPEND",     &set_unit_append,   0 },
     { "EOF",        &set_unit_append,   0 },
+    { "CACHE",      &sim_disk_set_cache, 0 },
+    { "WBCACHE",    &sim_disk_set_cache, DK_CACHE_WB },
+    { "NOCACHE",    &sim_disk_set_cache, DK_CACHE_OFF },
+    { "COMPRESS",   &sim_disk_set_compress, DK_COMPRESS },
+    { "NOCOMPRESS", &sim_disk_set_compress, 0 },
+    { "MMAP",       &sim_disk_set_mmap, DK_MMAP },
+    { "NOMMAP",     &sim_disk_set_mmap, 0 },
+    { "STATISTICS", &sim_disk_set_statistics, 0 },
+    { "INDEX",      &sim_tape_set_index, MT_INDEX },
+    { "NOINDEX",    &sim_tape_set_index, 0 },
+    { "PREFETCH",   &sim_tape_set_prefetch, MT_PREFETCH },
+    { "NOPREFETCH", &sim_tape_set_prefetch, 0 },
     { NULL,         NULL,               0 }
     };
 
@@ -2866,6 +3001,22 @@ static C1TAB set_unit_tab[] = {
     { "NODEBUG",    &set_dev_debug,     2+0 },
     { "APPEND",     &set_unit_append,   0 },
     { "EOF",        &set_unit_append,   0 },
+    { "CACHE",      &sim_disk_set_cache, DK_CACHE_UNIT },
+    { "WBCACHE",    &sim_disk_set_cache, DK_CACHE_UNIT|DK_CACHE_WB },
+    { "NOCACHE",    &sim_disk_set_cache, DK_CACHE_UNIT|DK_CACHE_OFF },
+    { "COMPRESS",   &sim_disk_set_compress, DK_COMPRESS_UNIT|DK_COMPRESS },
+    { "NOCOMPRESS", &sim_disk_set_compress, DK_COMPRESS_UNIT },
+    { "MMAP",       &sim_disk_set_mmap, DK_MMAP_UNIT|DK_MMAP },
+    { "NOMMAP",     &sim_disk_set_mmap, DK_MMAP_UNIT },
+    { "SNAPSHOT",   &sim_disk_set_snapshot, DK_SNAP_CREATE },
+    { "REVERT",     &sim_disk_set_snapshot, DK_SNAP_REVERT },
+    { "NOSNAPSHOT", &sim_disk_set_snapshot, DK_SNAP_DELETE },
+    { "OVERLAY",    &sim_disk_set_overlay, 0 },
+    { "STATISTICS", &sim_disk_set_statistics, DK_STATS_UNIT },
+    { "INDEX",      &sim_tape_set_index, MT_INDEX_UNIT|MT_INDEX },
+    { "NOINDEX",    &sim_tape_set_index, MT_INDEX_UNIT },
+    { "PREFETCH",   &sim_tape_set_prefetch, MT_PREFETCH_UNIT|MT_PREFETCH },
+    { "NOPREFETCH", &sim_tape_set_prefetch, MT_PREFETCH_UNIT },
     { NULL,         NULL,               0 }
     };
 
@@ -2903,6 +3054,7 @@ static SHTAB show_glob_tab[] = {
     { "ON",             &show_on,                  -1, HLP_SHOW_ON },
     { "DO",             &show_do,                   0, HLP_SHOW_DO },
     { "RUNLIMIT",       &show_runlimit,             0, HLP_SHOW_RUNLIMIT },
+    { "DISK",           &sim_disk_show_probe,       0, HLP_SHOW_DISK },
     { NULL,             NULL,                       0 }
     };
 
@@ -2912,11 +3064,25 @@ static SHTAB show_dev_tab[] = {
     { "MODIFIERS",  &show_dev_modifiers,        0 },
     { "NAMES",      &show_dev_logicals,         0 },
     { "SHOW",       &show_dev_show_commands,    0 },
+    { "CACHE",      &sim_disk_show_cache,       0 },
+    { "SNAPSHOTS",  &sim_disk_show_snapshots,   0 },
+    { "CHAIN",      &sim_disk_show_chain,       0 },
+    { "OVERLAY",    &sim_disk_show_overlay,     0 },
+    { "STATISTICS", &sim_disk_show_statistics,  0 },
+    { "INDEX",      &sim_tape_show_index,       0 },
+    { "PREFETCH",   &sim_tape_show_prefetch,    0 },
     { NULL,         NULL,                       0 }
     };
 
 static SHTAB show_unit_tab[] = {
     { "DEBUG",      &show_dev_debug,            1 },
+    { "CACHE",      &sim_disk_show_cache,       1 },
+    { "SNAPSHOTS",  &sim_disk_show_snapshots,   1 },
+    { "CHAIN",      &sim_disk_show_chain,       1 },
+    { "OVERLAY",    &sim_disk_show_overlay,     1 },
+    { "STATISTICS", &sim_disk_show_statistics,  1 },
+    { "INDEX",      &sim_tape_show_index,       1 },
+    { "PREFETCH",   &sim_tape_show_prefetch,    1 },
     { NULL, NULL, 0 }
     };
 
@@ -3431,6 +3597,7 @@ cleanup_and_exit:
 
 sim_debug (SIM_DBG_SHUTDOWN, &sim_scp_dev, "Shutting Down: Status = %d - %s\n", SCPE_BARE_STATUS (stat), sim_error_text (stat));
 detach_all (0, TRUE);                                   /* close files */
+_sim_free_unit_opts ();                                 /* release unit options */
 #ifdef USE_REALCONS
     realcons_disconnect(cpu_realcons) ;
 #endif
@@ -6387,6 +6554,27 @@ return sim_messagef (SCPE_NOFNC, "Asynchronous I/O is not available in this simu
 #endif
 }
 
+/* Set event queue engine routine */
+
+t_stat sim_set_queue (int32 flag, CONST char *cptr)
+{
+char gbuf[CBUFSIZE];
+
+if ((!cptr) || (*cptr == 0))                            /* now eol? */
+    return SCPE_2FARG;
+cptr = get_glyph (cptr, gbuf, 0);
+if (*cptr != 0)                                         /* now eol? */
+    return SCPE_2MARG;
+if (MATCH_CMD (gbuf, "INDEXED") == 0)
+    sim_evq_indexed = TRUE;
+else if (MATCH_CMD (gbuf, "LINEAR") == 0)
+    sim_evq_indexed = FALSE;
+else
+    return sim_messagef (SCPE_ARG, "Unknown event queue engine: %s\n", gbuf);
+_sim_evq_rebuild ();
+return sim_messagef (SCPE_OK, "%s event queue engine selected\n", sim_evq_indexed ? "Indexed" : "Linear");
+}
+
 /* Show asynch routine */
 
 t_stat sim_show_asynch (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
@@ -7928,6 +8116,8 @@ else {
 
     fprintf (st, "%s event queue status, time = %.0f, executing %s %s/sec\n",
              sim_name, sim_time, sim_fmt_numeric (inst_per_sec), sim_vm_interval_units);
+    fprintf (st, "  %s queue engine%s\n", sim_evq_indexed ? "Indexed" : "Linear",
+             (sim_evq_indexed && !sim_evq_valid) ? " (index pending rebuild)" : "");
     for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next) {
         if (uptr == &sim_step_unit)
             fprintf (st, "  Step timer");
@@ -7996,7 +8186,13 @@ return SCPE_OK;
 t_stat show_break (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
 {
 t_stat r;
+char gbuf[CBUFSIZE];
 
+if (cptr && (*cptr != 0)) {
+    if ((strlen (get_glyph (cptr, gbuf, 0)) == 0) &&    /* only argument? */
+        (strlen (gbuf) >= 4) && (MATCH_CMD (gbuf, "STATISTICS") == 0))
+        return sim_brk_show_stats (st);
+    }
 if (cptr && (*cptr != 0))
     r = ssh_break (st, cptr, 1);  /* more? */
 else
@@ -8709,6 +8905,16 @@ while (*cptr) {
                 return SCPE_ARG;
         }
     else {
+        if ((flg == SSH_ST) && (lo != hi) && (cnt == 0)) {
+            r = sim_brk_set_range (lo, hi, sim_switches, 0, aptr);
+            if (r != SCPE_OK)
+                return r;
+            continue;
+            }
+        if (flg == SSH_CL)
+            sim_brk_clr_range (lo, hi, sim_switches);
+        if (flg == SSH_SH)
+            sim_brk_show_range (st, lo, hi, sim_switches);
         for ( ; lo <= hi; lo = lo + 1) {
             r = ssh_break_one (st, flg, lo, cnt, aptr);
             if (r != SCPE_OK)
@@ -9604,9 +9810,641 @@ else
 }
 
 
+/* Memory file registry
+
+   A device which maps its memory onto a file (see sim_memfile_open) records
+   that here.  A snapshot (SAVE -C or -I) then only needs to flush a shared
+   memory file and note its name, and RESTORE maps the file again with
+   SET <dev> MEMFILE=<file>.  A plain SAVE copies the memory as usual.
+*/
+
+typedef struct SIM_UNIT_MAPFILE {
+    UNIT                *uptr;
+    MAPFILE             *mfile;
+    } SIM_UNIT_MAPFILE;
+
+static SIM_UNIT_MAPFILE *sim_unit_memfiles = NULL;
+static uint32 sim_unit_memfile_count = 0;
+
+t_stat sim_set_unit_memfile (UNIT *uptr, MAPFILE *mfile)
+{
+uint32 i;
+
+for (i = 0; i < sim_unit_memfile_count; i++)
+    if (sim_unit_memfiles[i].uptr == uptr)
+        break;
+if (mfile == NULL) {                                    /* remove? */
+    if (i < sim_unit_memfile_count)
+        sim_unit_memfiles[i] = sim_unit_memfiles[--sim_unit_memfile_count];
+    return SCPE_OK;
+    }
+if (i == sim_unit_memfile_count) {
+    SIM_UNIT_MAPFILE *nlist = (SIM_UNIT_MAPFILE *)realloc (sim_unit_memfiles, (i + 1) * sizeof (*nlist));
+
+    if (nlist == NULL)
+        return SCPE_MEM;
+    sim_unit_memfiles = nlist;
+    ++sim_unit_memfile_count;
+    }
+sim_unit_memfiles[i].uptr = uptr;
+sim_unit_memfiles[i].mfile = mfile;
+return SCPE_OK;
+}
+
+MAPFILE *sim_get_unit_memfile (UNIT *uptr)
+{
+uint32 i;
+
+for (i = 0; i < sim_unit_memfile_count; i++)
+    if (sim_unit_memfiles[i].uptr == uptr)
+        return sim_unit_memfiles[i].mfile;
+return NULL;
+}
+
+/* Dirty page registry
+
+   A device whose memory write paths mark the pages they change registers
+   its dirty map here: one byte per 2**shift address units, set non zero
+   by each write.  Writing a snapshot clears the map, so an incremental
+   SAVE only needs to read the pages marked since then.
+*/
+
+typedef struct SIM_UNIT_DIRTY {
+    UNIT                *uptr;
+    uint8               *map;
+    uint32              shift;
+    } SIM_UNIT_DIRTY;
+
+static SIM_UNIT_DIRTY *sim_unit_dirty = NULL;
+static uint32 sim_unit_dirty_count = 0;
+
+t_stat sim_set_unit_dirty_map (UNIT *uptr, uint8 *map, uint32 shift)
+{
+uint32 i;
+
+for (i = 0; i < sim_unit_dirty_count; i++)
+    if (sim_unit_dirty[i].uptr == uptr)
+        break;
+if (map == NULL) {                                      /* remove? */
+    if (i < sim_unit_dirty_count)
+        sim_unit_dirty[i] = sim_unit_dirty[--sim_unit_dirty_count];
+    return SCPE_OK;
+    }
+if (i == sim_unit_dirty_count) {
+    SIM_UNIT_DIRTY *nlist = (SIM_UNIT_DIRTY *)realloc (sim_unit_dirty, (i + 1) * sizeof (*nlist));
+
+    if (nlist == NULL)
+        return SCPE_MEM;
+    sim_unit_dirty = nlist;
+    ++sim_unit_dirty_count;
+    }
+sim_unit_dirty[i].uptr = uptr;
+sim_unit_dirty[i].map = map;
+sim_unit_dirty[i].shift = shift;
+return SCPE_OK;
+}
+
+static SIM_UNIT_DIRTY *_sim_get_unit_dirty (UNIT *uptr)
+{
+uint32 i;
+
+for (i = 0; i < sim_unit_dirty_count; i++)
+    if (sim_unit_dirty[i].uptr == uptr)
+        return &sim_unit_dirty[i];
+return NULL;
+}
+
+/* Unit option registry
+
+   Library modules (sim_disk, sim_tape) keep per unit settings which must
+   persist while a unit isn't attached in a record found here.  Each module
+   uses a tag of its own and the size of its record.  Records start out
+   zeroed and are released when the simulator exits.
+*/
+
+typedef struct SIM_UNIT_OPTS SIM_UNIT_OPTS;
+struct SIM_UNIT_OPTS {
+    UNIT                *uptr;
+    const char          *tag;
+    void                *opts;
+    SIM_UNIT_OPTS       *next;
+    };
+
+static SIM_UNIT_OPTS *sim_unit_opts = NULL;
+
+void *sim_get_unit_opts (UNIT *uptr, const char *tag, size_t size, t_bool create)
+{
+SIM_UNIT_OPTS *o;
+
+for (o = sim_unit_opts; o != NULL; o = o->next)
+    if ((o->uptr == uptr) && (strcmp (o->tag, tag) == 0))
+        return o->opts;
+if (!create)
+    return NULL;
+o = (SIM_UNIT_OPTS *)calloc (1, sizeof (*o));
+if (o == NULL)
+    return NULL;
+o->opts = calloc (1, size);
+if (o->opts == NULL) {
+    free (o);
+    return NULL;
+    }
+o->uptr = uptr;
+o->tag = tag;
+o->next = sim_unit_opts;
+sim_unit_opts = o;
+return o->opts;
+}
+
+static void _sim_free_unit_opts (void)
+{
+while (sim_unit_opts != NULL) {
+    SIM_UNIT_OPTS *o = sim_unit_opts;
+
+    sim_unit_opts = o->next;
+    free (o->opts);
+    free (o);
+    }
+}
+
+/* Snapshot support
+
+   SAVE -C and SAVE -I write V4.1 format save files.  These are identical
+   to V4.0 files except for an extra header line identifying the snapshot
+   (and the snapshot it is based on) and the encoding of memory-like units.
+   Memory is stored as pages of SNAP_PAGE words, each described by a tag
+   byte and a word count:
+
+        SNAP_ZERO       run of all zero words
+        SNAP_SAME       run of pages unchanged since the base snapshot
+        SNAP_RAW        one page of words in little endian order
+        SNAP_LZ4        one page, LZ4 compressed (preceded by its length)
+        SNAP_FILE       all of memory, which is in the named shared memory file
+
+   A 64 bit hash of each page is kept from the last snapshot written in this
+   session.  An incremental snapshot compares page hashes against that
+   snapshot and writes SNAP_SAME runs for pages which didn't change.  When
+   the device keeps a dirty map (see sim_set_unit_dirty_map) which was in
+   place for that snapshot, pages not marked since are known to be the same
+   and aren't read or hashed at all.
+
+   Restoring an incremental snapshot loads the pages it contains and then
+   walks back along the chain of base snapshots, reading (or seeking over)
+   only those pages which are still needed.
+*/
+
+#define SNAP_PAGE       SRBSIZ                          /* words per page */
+#define SNAP_ZERO       'Z'
+#define SNAP_SAME       'S'
+#define SNAP_RAW        'R'
+#define SNAP_LZ4        'C'
+#define SNAP_FILE       'F'
+#define SNAP_MAX_CHAIN  256                             /* base snapshot nesting limit */
+
+typedef struct SIM_SNAP_MEM {
+    UNIT                *uptr;                          /* memory unit */
+    t_addr              high;                           /* memory size */
+    uint32              words;                          /* words per page */
+    uint32              pages;                          /* page count */
+    t_uint64            *hash;                          /* page hashes (save) */
+    uint8               *need;                          /* pages still to load (restore) */
+    uint8               *dmap;                          /* dirty map cleared by this save */
+    uint32              dshift;
+    } SIM_SNAP_MEM;
+
+static SIM_SNAP_MEM *sim_snap_mem = NULL;               /* hashes of last snapshot */
+static uint32 sim_snap_mem_count = 0;
+static SIM_SNAP_MEM *sim_snap_new = NULL;               /* hashes of snapshot being saved */
+static uint32 sim_snap_new_count = 0;
+static SIM_SNAP_MEM *sim_snap_need = NULL;              /* pages needed from base snapshots */
+static uint32 sim_snap_need_count = 0;
+static t_uint64 sim_snap_id = 0;                        /* id of last snapshot */
+static char *sim_snap_path = NULL;                      /* file of last snapshot */
+static const char *sim_save_filename = NULL;            /* file being saved */
+static t_bool sim_rest_base = FALSE;                    /* restoring a base snapshot */
+static t_uint64 sim_rest_base_id = 0;                   /* expected base snapshot id */
+static int sim_rest_base_depth = 0;
+
+static void _sim_snap_free (SIM_SNAP_MEM **list, uint32 *count)
+{
+uint32 i;
+
+for (i = 0; i < *count; i++) {
+    free ((*list)[i].hash);
+    free ((*list)[i].need);
+    }
+free (*list);
+*list = NULL;
+*count = 0;
+}
+
+static SIM_SNAP_MEM *_sim_snap_find (SIM_SNAP_MEM *list, uint32 count, UNIT *uptr)
+{
+uint32 i;
+
+for (i = 0; i < count; i++)
+    if (list[i].uptr == uptr)
+        return &list[i];
+return NULL;
+}
+
+static SIM_SNAP_MEM *_sim_snap_add (SIM_SNAP_MEM **list, uint32 *count, DEVICE *dptr, UNIT *uptr, t_addr high, uint32 words)
+{
+SIM_SNAP_MEM *snap, *nlist;
+t_addr nwords = (high + dptr->aincr - 1) / dptr->aincr;
+
+if ((snap = _sim_snap_find (*list, *count, uptr)) != NULL)
+    return snap;
+nlist = (SIM_SNAP_MEM *)realloc (*list, (*count + 1) * sizeof (**list));
+if (nlist == NULL)
+    return NULL;
+*list = nlist;
+snap = &nlist[*count];
+memset (snap, 0, sizeof (*snap));
+snap->uptr = uptr;
+snap->high = high;
+snap->words = words;
+snap->pages = (uint32)((nwords + words - 1) / words);
+snap->hash = (t_uint64 *)calloc (snap->pages + 1, sizeof (*snap->hash));
+snap->need = (uint8 *)calloc (snap->pages + 1, sizeof (*snap->need));
+if ((snap->hash == NULL) || (snap->need == NULL)) {
+    free (snap->hash);
+    free (snap->need);
+    return NULL;
+    }
+++*count;
+return snap;
+}
+
+static t_uint64 _sim_snap_hash (const uint8 *buf, size_t len)
+{
+t_uint64 h = 0xCBF29CE484222325ULL ^ len;
+t_uint64 w;
+
+for ( ; len >= sizeof (w); buf += sizeof (w), len -= sizeof (w)) {
+    memcpy (&w, buf, sizeof (w));
+    h = (h ^ w) * 0x100000001B3ULL;
+    h ^= h >> 29;
+    }
+for ( ; len > 0; ++buf, --len)
+    h = (h ^ *buf) * 0x100000001B3ULL;
+return h ^ (h >> 32);
+}
+
+static t_uint64 _sim_snap_new_id (void)
+{
+static uint32 serial = 0;
+t_uint64 id = ((t_uint64)time (NULL) << 32) ^ ((t_uint64)sim_os_msec () << 12) ^ ++serial;
+
+id ^= (t_uint64)(size_t)&id;                            /* a bit more uniqueness */
+return (id == 0) ? 1 : id;
+}
+
+static t_bool _sim_snap_parse (const char *cptr, t_uint64 *id, t_uint64 *base_id, char *base, size_t base_size)
+{
+t_uint64 *v[2];
+int i, c;
+
+v[0] = id;
+v[1] = base_id;
+if (strncmp (cptr, "snapshot ", 9) != 0)
+    return TRUE;
+cptr += 9;
+for (i = 0; i < 2; i++) {
+    *v[i] = 0;
+    while (isxdigit (c = (unsigned char)*cptr)) {
+        *v[i] = (*v[i] << 4) | (isdigit (c) ? c - '0' : toupper (c) - 'A' + 10);
+        ++cptr;
+        }
+    if (*cptr == ' ')
+        ++cptr;
+    else
+        if ((*cptr != '\0') || (i == 0))               /* trailing blanks may be trimmed */
+            return TRUE;
+    }
+strlcpy (base, cptr, base_size);
+return (*id == 0) || ((*base_id != 0) && (*base == '\0'));
+}
+
+/* Clear a dirty map once the snapshot which depends on it is complete */
+
+static void _sim_snap_clean (SIM_SNAP_MEM *snap)
+{
+if ((snap->dmap != NULL) && (snap->high > 0))
+    memset (snap->dmap, 0, (size_t)(((snap->high - 1) >> snap->dshift) + 1));
+}
+
+static t_bool _sim_snap_dirty (SIM_SNAP_MEM *snap, t_addr start, t_addr end)
+{
+t_addr p;
+
+for (p = start >> snap->dshift; p <= (end >> snap->dshift); p++)
+    if (snap->dmap[p])
+        return TRUE;
+return FALSE;
+}
+
+static t_stat _sim_snap_save_mem (FILE *sfile, DEVICE *dptr, UNIT *uptr, t_addr high, t_bool incremental, t_bool compress)
+{
+SIM_SNAP_MEM *prev = incremental ? _sim_snap_find (sim_snap_mem, sim_snap_mem_count, uptr) : NULL;
+SIM_SNAP_MEM *snap;
+SIM_UNIT_DIRTY *dirty = _sim_get_unit_dirty (uptr);
+MAPFILE *mfile = sim_get_unit_memfile (uptr);
+size_t sz = SZ_D (dptr);
+size_t clen;
+uint8 *mbuf, *cbuf;
+uint32 page, words = SNAP_PAGE;
+int32 l, run = 0, clen32;
+int run_tag = 0, tag;
+t_addr k;
+t_value val;
+t_bool zeroflg;
+t_stat r = SCPE_OK;
+
+if (sim_memfile_shared (mfile)) {                       /* memory is the file? */
+    r = sim_memfile_sync (mfile);
+    if (r != SCPE_OK)
+        return r;
+    l = (int32)((high + dptr->aincr - 1) / dptr->aincr);
+    sim_fwrite (&words, sizeof (words), 1, sfile);
+    fputc (SNAP_FILE, sfile);
+    sim_fwrite (&l, sizeof (l), 1, sfile);
+    fprintf (sfile, "%s\n", sim_memfile_name (mfile));
+    return SCPE_OK;
+    }
+snap = _sim_snap_add (&sim_snap_new, &sim_snap_new_count, dptr, uptr, high, SNAP_PAGE);
+mbuf = (uint8 *)malloc (SNAP_PAGE * sz);
+cbuf = (uint8 *)malloc (SNAP_PAGE * sz);
+if ((snap == NULL) || (mbuf == NULL) || (cbuf == NULL)) {
+    free (mbuf);
+    free (cbuf);
+    return SCPE_MEM;
+    }
+if ((prev != NULL) && ((prev->high != high) || (prev->words != words)))
+    prev = NULL;                                        /* resized, save everything */
+if (dirty != NULL) {
+    snap->dmap = dirty->map;
+    snap->dshift = dirty->shift;
+    }
+if ((prev != NULL) && ((prev->dmap == NULL) ||          /* not tracked since? */
+    (prev->dmap != snap->dmap) || (prev->dshift != snap->dshift)))
+    dirty = NULL;
+sim_fwrite (&words, sizeof (words), 1, sfile);          /* page size */
+for (k = 0, page = 0; k < high; page++) {               /* loop thru pages */
+    if ((prev != NULL) && (dirty != NULL)) {
+        t_addr left = (high - k + dptr->aincr - 1) / dptr->aincr;
+
+        l = (int32)MIN (left, SNAP_PAGE);
+        if (!_sim_snap_dirty (snap, k, k + (l - 1) * dptr->aincr)) {
+            snap->hash[page] = prev->hash[page];        /* unwritten since */
+            k = k + l * dptr->aincr;
+            tag = SNAP_SAME;
+            if ((run != 0) && (tag != run_tag)) {
+                fputc (run_tag, sfile);
+                sim_fwrite (&run, sizeof (run), 1, sfile);
+                run = 0;
+                }
+            run_tag = tag;
+            run += l;
+            continue;
+            }
+        }
+    zeroflg = TRUE;
+    for (l = 0; (l < SNAP_PAGE) && (k < high); l++,
+         k = k + (dptr->aincr)) {
+        r = dptr->examine (&val, k, uptr, SIM_SW_REST);
+        if (r != SCPE_OK)
+            goto Done;
+        if (val)
+            zeroflg = FALSE;
+        SZ_STORE (sz, val, mbuf, l);
+        }
+    sim_buf_swap_data (mbuf, sz, l);                    /* to file byte order */
+    snap->hash[page] = _sim_snap_hash (mbuf, l * sz);
+    if (zeroflg)
+        tag = SNAP_ZERO;
+    else
+        if ((prev != NULL) && (prev->hash[page] == snap->hash[page]))
+            tag = SNAP_SAME;
+        else
+            tag = SNAP_RAW;
+    if ((run != 0) && (tag != run_tag)) {               /* end of a run? */
+        fputc (run_tag, sfile);
+        sim_fwrite (&run, sizeof (run), 1, sfile);
+        run = 0;
+        }
+    if (tag != SNAP_RAW) {                              /* extend run */
+        run_tag = tag;
+        run += l;
+        continue;
+        }
+    clen = compress ? sim_lz4_compress (mbuf, l * sz, cbuf, l * sz - 1) : 0;
+    fputc (clen ? SNAP_LZ4 : SNAP_RAW, sfile);
+    sim_fwrite (&l, sizeof (l), 1, sfile);
+    if (clen) {
+        clen32 = (int32)clen;
+        sim_fwrite (&clen32, sizeof (clen32), 1, sfile);
+        fwrite (cbuf, 1, clen, sfile);
+        }
+    else
+        fwrite (mbuf, sz, l, sfile);
+    }
+if (run != 0) {
+    fputc (run_tag, sfile);
+    sim_fwrite (&run, sizeof (run), 1, sfile);
+    }
+Done:
+free (mbuf);
+free (cbuf);
+return r;
+}
+
+static t_stat _sim_snap_rest_mem (FILE *rfile, DEVICE *dptr, UNIT *uptr, t_addr high)
+{
+SIM_SNAP_MEM *need;
+MAPFILE *mfile;
+size_t sz = SZ_D (dptr);
+size_t dlen;
+uint8 *mbuf = NULL, *cbuf = NULL;
+char path[CBUFSIZE], cmd[CBUFSIZE + 32];
+uint32 words, page, npages;
+int32 j, count, clen;
+int tag;
+t_addr k;
+t_value val;
+t_bool load;
+t_stat r = SCPE_IOERR;
+
+if ((sim_fread (&words, sizeof (words), 1, rfile) == 0) ||
+    (words == 0) || (words > 1024 * SNAP_PAGE))
+    return SCPE_IOERR;
+if (sim_rest_base) {
+    need = _sim_snap_find (sim_snap_need, sim_snap_need_count, uptr);
+    if ((need != NULL) && ((need->high != high) || (need->words != words))) {
+        sim_printf ("Base snapshot memory size mismatch: %s\n", sim_uname (uptr));
+        return SCPE_INCOMP;
+        }
+    }
+else
+    if ((need = _sim_snap_add (&sim_snap_need, &sim_snap_need_count, dptr, uptr, high, words)) == NULL)
+        return SCPE_MEM;
+mbuf = (uint8 *)malloc (words * sz);
+cbuf = (uint8 *)malloc (words * sz);
+if ((mbuf == NULL) || (cbuf == NULL)) {
+    r = SCPE_MEM;
+    goto Done;
+    }
+for (k = 0; k < high; ) {                               /* loop thru records */
+    tag = fgetc (rfile);
+    if ((tag == EOF) ||
+        (sim_fread (&count, sizeof (count), 1, rfile) == 0) ||
+        (count <= 0))
+        goto Done;
+    page = (uint32)((k / dptr->aincr) / words);
+    npages = ((uint32)count + words - 1) / words;
+    if ((need != NULL) && (page + npages > need->pages))
+        goto Done;
+    load = (!sim_rest_base) || ((need != NULL) && need->need[page]);
+    switch (tag) {
+        case SNAP_FILE:                                 /* memory in a memory file */
+            if (read_line (path, sizeof (path), rfile) == NULL)
+                goto Done;
+            if (sim_rest_base) {
+                if ((need != NULL) && (memchr (need->need + page, 1, npages) != NULL)) {
+                    sim_printf ("Base snapshot memory of %s is in memory file %s\n", sim_uname (uptr), path);
+                    r = SCPE_INCOMP;
+                    goto Done;
+                    }
+                }
+            else {
+                mfile = sim_get_unit_memfile (uptr);
+                if ((!sim_memfile_shared (mfile)) ||    /* not already mapped? */
+                    (strcmp (sim_memfile_name (mfile), path) != 0)) {
+                    snprintf (cmd, sizeof (cmd), "%s MEMFILE=%s", sim_dname (dptr), path);
+                    sim_switches = 0;
+                    set_cmd (0, cmd);
+                    mfile = sim_get_unit_memfile (uptr);
+                    if ((!sim_memfile_shared (mfile)) ||
+                        (strcmp (sim_memfile_name (mfile), path) != 0)) {
+                        sim_printf ("Can't map memory file %s for %s\n", path, sim_uname (uptr));
+                        r = SCPE_INCOMP;
+                        goto Done;
+                        }
+                    }
+                }
+            k = k + (t_addr)count * dptr->aincr;
+            if (need != NULL)
+                memset (need->need + page, 0, npages);
+            continue;
+        case SNAP_SAME:
+            if (!sim_rest_base)                         /* remember pages to get from base */
+                memset (need->need + page, 1, npages);
+            k = k + (t_addr)count * dptr->aincr;
+            continue;
+        case SNAP_ZERO:
+            break;
+        case SNAP_RAW:
+            if ((uint32)count > words)
+                goto Done;
+            if (!load) {
+                if (sim_fseeko (rfile, (t_offset)(count * sz), SEEK_CUR))
+                    goto Done;
+                break;
+                }
+            if (fread (mbuf, sz, count, rfile) != (size_t)count)
+                goto Done;
+            sim_buf_swap_data (mbuf, sz, count);
+            break;
+        case SNAP_LZ4:
+            if (((uint32)count > words) ||
+                (sim_fread (&clen, sizeof (clen), 1, rfile) == 0) ||
+                (clen <= 0) || ((size_t)clen > words * sz))
+                goto Done;
+            if (!load) {
+                if (sim_fseeko (rfile, (t_offset)clen, SEEK_CUR))
+                    goto Done;
+                break;
+                }
+            if ((fread (cbuf, 1, clen, rfile) != (size_t)clen) ||
+                sim_lz4_decompress (cbuf, clen, mbuf, count * sz, &dlen) ||
+                (dlen != count * sz))
+                goto Done;
+            sim_buf_swap_data (mbuf, sz, count);
+            break;
+        default:
+            goto Done;
+        }
+    for (j = 0; j < count; j++, k = k + (dptr->aincr)) {
+        if (sim_rest_base &&                            /* page not needed? */
+            ((need == NULL) || !need->need[page + j / words]))
+            continue;
+        if (tag == SNAP_ZERO)
+            val = 0;
+        else {
+            SZ_LOAD (sz, val, mbuf, j);
+            }
+        r = dptr->deposit (val, k, uptr, SIM_SW_REST);
+        if (r != SCPE_OK)
+            goto Done;
+        }
+    if (need != NULL)                                   /* these pages are done */
+        memset (need->need + page, 0, npages);
+    }
+r = SCPE_OK;
+Done:
+free (mbuf);
+free (cbuf);
+return r;
+}
+
+static uint32 _sim_snap_needed (void)
+{
+uint32 i, p, pages = 0;
+
+for (i = 0; i < sim_snap_need_count; i++)
+    for (p = 0; p < sim_snap_need[i].pages; p++)
+        pages += sim_snap_need[i].need[p];
+return pages;
+}
+
+static t_stat _sim_snap_rest_base (const char *path, t_uint64 id)
+{
+FILE *bfile;
+t_bool saved_base = sim_rest_base;
+t_uint64 saved_base_id = sim_rest_base_id;
+int32 saved_switches = sim_switches;
+double saved_time = sim_time;
+uint32 saved_rtime = sim_rtime;
+t_stat r;
+
+if (_sim_snap_needed () == 0)                           /* nothing left to load? */
+    return SCPE_OK;
+if (sim_rest_base_depth >= SNAP_MAX_CHAIN)
+    return sim_messagef (SCPE_INCOMP, "Snapshot chain too deep at %s\n", path);
+if ((bfile = sim_fopen (path, "rb")) == NULL)
+    return sim_messagef (SCPE_OPENERR, "Can't open base snapshot: %s\n", path);
+sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "base snapshot=%s, pages needed=%u\n", path, _sim_snap_needed ());
+sim_rest_base = TRUE;
+sim_rest_base_id = id;
+++sim_rest_base_depth;
+r = sim_rest (bfile);
+--sim_rest_base_depth;
+fclose (bfile);
+sim_rest_base = saved_base;
+sim_rest_base_id = saved_base_id;
+sim_switches = saved_switches;
+sim_time = saved_time;                                  /* base's times don't matter */
+sim_rtime = saved_rtime;
+if (r != SCPE_OK)
+    sim_printf ("Error restoring base snapshot %s\n", path);
+return r;
+}
+
 /* Save command
 
    sa[ve] filename              save state to specified file
+   sa[ve] -c filename           save compressed snapshot
+   sa[ve] -i filename           save incremental snapshot
 */
 
 t_stat save_cmd (int32 flag, CONST char *cptr)
@@ -9625,7 +10463,9 @@ if ((sfile = sim_fopen (gbuf, "r+b")) == NULL) {    /* try existing file */
     if ((sfile = sim_fopen (gbuf, "wb")) == NULL)   /* create new empty file */
         return SCPE_OPENERR;
     }
+sim_save_filename = gbuf;
 r = sim_save (sfile);
+sim_save_filename = NULL;
 fclose (sfile);
 return r;
 }
@@ -9643,15 +10483,50 @@ size_t sz;
 DEVICE *dptr;
 UNIT *uptr;
 REG *rptr;
+t_bool compress = ((sim_switches & SWMASK ('C')) != 0);
+t_bool incremental = ((sim_switches & SWMASK ('I')) != 0);
+t_bool snapshot = compress || incremental;             /* V4.1 only when asked for */
+t_uint64 snap_id = 0;
+char *fullpath = sim_save_filename ? sim_filepath_parts (sim_save_filename, "f") : NULL;
 
 #define WRITE_I(xx) sim_fwrite (&(xx), sizeof (xx), 1, sfile)
 
-sim_debug(SIM_DBG_SAVE, &sim_scp_dev, "sim_save ()\n");
+sim_debug(SIM_DBG_SAVE, &sim_scp_dev, "sim_save (compress=%d, incremental=%d)\n", compress, incremental);
+sim_flush_buffered_files (FALSE);                       /* write back cached disk data */
+_sim_snap_free (&sim_snap_new, &sim_snap_new_count);
+if ((sim_snap_path != NULL) && (fullpath != NULL) &&   /* overwriting last snapshot? */
+    (strcmp (fullpath, sim_snap_path) == 0)) {
+    if (incremental) {
+        free (fullpath);
+        return sim_messagef (SCPE_ARG, "An incremental snapshot can't replace its base: %s\n", sim_snap_path);
+        }
+    _sim_snap_free (&sim_snap_mem, &sim_snap_mem_count);
+    free (sim_snap_path);
+    sim_snap_path = NULL;
+    sim_snap_id = 0;
+    }
+if (incremental && (sim_snap_id == 0)) {
+    sim_messagef (SCPE_OK, "No previous snapshot, saving a full snapshot\n");
+    incremental = FALSE;
+    }
+for (i = 0; (dptr = sim_devices[i]) != NULL; i++) {  /* overlays restorable? */
+    for (j = 0; j < dptr->numunits; j++) {
+        t_bool kept;
+
+        uptr = dptr->units + j;
+        if ((sim_disk_overlay_name (uptr, &kept) != NULL) && !kept) {
+            free (fullpath);
+            return sim_messagef (SCPE_NOFNC, "%s: Can't save while its overlay is to be discarded or merged at detach, SET %s OVERLAY=KEEP first\n", sim_uname (uptr), sim_uname (uptr));
+            }
+        }
+    }
+if (snapshot)
+    snap_id = _sim_snap_new_id ();
 
 /* Don't make changes below without also changing save_vercur above */
 
 fprintf (sfile, "%s\n%s\n%s\n%s\n%s\n%.0f\n",
-    save_vercur,                                        /* [V2.5] save format */
+    snapshot ? save_ver41 : save_vercur,                /* [V2.5] save format */
     sim_savename,                                       /* sim name */
     sim_si64, sim_sa64, eth_capabilities(),             /* [V3.5] options */
     sim_time);                                          /* [V3.2] sim time */
@@ -9661,6 +10536,11 @@ fprintf (sfile, "git commit id: %8.8s\n", __STR(SIM_GIT_COMMIT_ID));
 #else
 fprintf (sfile, "git commit id: unknown\n");
 #endif
+if (snapshot)                                           /* [V4.1] snapshot identity */
+    fprintf (sfile, "snapshot %016" LL_FMT "X %016" LL_FMT "X %s\n",
+             (unsigned LL_TYPE)snap_id,
+             (unsigned LL_TYPE)(incremental ? sim_snap_id : 0),
+             incremental ? sim_snap_path : "");
 
 for (device_count = 0; sim_devices[device_count]; device_count++);/* count devices */
 for (i = 0; i < (device_count + sim_internal_device_count); i++) {/* loop thru devices */
@@ -9697,8 +10577,12 @@ for (i = 0; i < (device_count + sim_internal_device_count); i++) {/* loop thru d
         fprintf (sfile, "%.0f\n", uptr->usecs_remaining);/* [V4.0] remaining wait */
         WRITE_I (uptr->pos);
         if (uptr->flags & UNIT_ATT) {
+            if (sim_disk_overlay_name (uptr, NULL) != NULL) /* overlay ends at the next \001 */
+                fprintf (sfile, "\001Overlay=%s", sim_disk_overlay_name (uptr, NULL));
             if ((uptr->drvtyp != NULL) && (sim_disk_drive_type_set_string (uptr) != NULL))
                 fprintf (sfile, "\001DriveType=%s\001", sim_disk_drive_type_set_string (uptr));
+            else if (sim_disk_overlay_name (uptr, NULL) != NULL)
+                fputc ('\001', sfile);
             fputs (sim_attach_name (uptr), sfile);
             if ((uptr->flags & UNIT_BUF) &&             /* writable buffered */
                 uptr->hwmark &&                         /* files need to be */
@@ -9722,6 +10606,14 @@ for (i = 0; i < (device_count + sim_internal_device_count); i++) {/* loop thru d
              (dptr->examine != NULL) &&
              ((high = uptr->capac) != 0)) {             /* memory-like unit? */
             WRITE_I (high);                             /* [V2.5] write size */
+            if (snapshot) {                             /* [V4.1] paged memory */
+                r = _sim_snap_save_mem (sfile, dptr, uptr, high, incremental, compress);
+                if (r != SCPE_OK) {
+                    free (fullpath);
+                    return r;
+                    }
+                continue;
+                }
             sz = SZ_D (dptr);
             if ((mbuf = calloc (SRBSIZ, sz)) == NULL) {
                 fclose (sfile);
@@ -9782,6 +10674,20 @@ if (!ferror (sfile)) {
         return SCPE_IOERR;                              /* done! */
     sim_set_fsize (sfile, (t_addr)pos);                 /* truncate the save file */
     }
+if (snapshot && !ferror (sfile) && (fullpath != NULL)) {/* remember for next -I */
+    for (i = 0; i < sim_snap_new_count; i++)
+        _sim_snap_clean (&sim_snap_new[i]);
+    _sim_snap_free (&sim_snap_mem, &sim_snap_mem_count);
+    sim_snap_mem = sim_snap_new;
+    sim_snap_mem_count = sim_snap_new_count;
+    sim_snap_new = NULL;
+    sim_snap_new_count = 0;
+    free (sim_snap_path);
+    sim_snap_path = fullpath;
+    sim_snap_id = snap_id;
+    fullpath = NULL;
+    }
+free (fullpath);
 return (ferror (sfile))? SCPE_IOERR: SCPE_OK;           /* error during save? */
 }
 
@@ -9824,15 +10730,18 @@ t_addr k, high, old_capac;
 t_value val, max;
 t_stat r;
 size_t sz;
-t_bool v40, v35, v32;
+t_bool v41, v40, v35, v32;
 DEVICE *dptr;
 UNIT *uptr;
+UNIT base_unit;
 REG *rptr;
 struct stat rstat;
 t_bool force_restore = ((sim_switches & SWMASK ('F')) != 0);
-t_bool dont_detach_attach = ((sim_switches & SWMASK ('D')) != 0);
-t_bool suppress_warning = ((sim_switches & SWMASK ('Q')) != 0);
+t_bool dont_detach_attach = sim_rest_base || ((sim_switches & SWMASK ('D')) != 0);
+t_bool suppress_warning = sim_rest_base || ((sim_switches & SWMASK ('Q')) != 0);
 t_bool warned = FALSE;
+t_uint64 snap_id = 0, base_id = 0;
+char base_path[CBUFSIZE];
 
 sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "sim_rest (force=%d, dont_detach=%d, nowarnings=%d)\n", force_restore, dont_detach_attach, suppress_warning);
 sim_switches &= ~(SWMASK ('F') | SWMASK ('D') | SWMASK ('Q'));  /* remove digested switches */
@@ -9851,8 +10760,16 @@ if (fstat (fileno (rfile), &rstat)) {
     }
 READ_S (buf);                                           /* [V2.5+] read version */
 sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "version=%s\n", buf);
-v40 = v35 = v32 = FALSE;
-if (strcmp (buf, save_ver40) == 0)                      /* version 4.0? */
+v41 = v40 = v35 = v32 = FALSE;
+if (!sim_rest_base)                                     /* top level restore? */
+    _sim_snap_free (&sim_snap_need, &sim_snap_need_count);
+if (strcmp (buf, save_ver41) == 0)                      /* version 4.1? */
+    v41 = v40 = v35 = v32 = TRUE;
+else if (sim_rest_base) {                               /* base must be a snapshot */
+    sim_printf ("Base file is not a snapshot: %s\n", buf);
+    return SCPE_INCOMP;
+    }
+else if (strcmp (buf, save_ver40) == 0)                 /* version 4.0? */
     v40 = v35 = v32 = TRUE;
 else if (strcmp (buf, save_ver35) == 0)                 /* version 3.5? */
     v35 = v32 = TRUE;
@@ -9862,7 +10779,7 @@ else if (strcmp (buf, save_ver30) != 0) {               /* version 3.0? */
     sim_printf ("Invalid file version: %s\n", buf);
     return SCPE_INCOMP;
     }
-if ((strcmp (buf, save_ver40) != 0) && (!sim_quiet) && (!suppress_warning)) {
+if ((!v40) && (!sim_quiet) && (!suppress_warning)) {
     sim_printf ("warning - attempting to restore a saved simulator image in %s image format.\n", buf);
     warned = TRUE;
     }
@@ -9901,6 +10818,20 @@ if (v40) {
         }
 #endif
     }
+if (v41) {
+    READ_S (buf);                                       /* [V4.1] snapshot identity */
+    if (_sim_snap_parse (buf, &snap_id, &base_id, base_path, sizeof (base_path))) {
+        sim_printf ("Invalid snapshot header: %s\n", buf);
+        r = SCPE_INCOMP;
+        goto Cleanup_Return;
+        }
+    sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "snapshot=%016" LL_FMT "X, base=%016" LL_FMT "X %s\n", (unsigned LL_TYPE)snap_id, (unsigned LL_TYPE)base_id, base_path);
+    if (sim_rest_base && (snap_id != sim_rest_base_id)) {
+        sim_printf ("Base snapshot has been replaced since it was referenced\n");
+        r = SCPE_INCOMP;
+        goto Cleanup_Return;
+        }
+    }
 if (!dont_detach_attach)
     detach_all (0, 0);                                  /* Detach everything to start from a consistent state */
 else {
@@ -9931,19 +10862,22 @@ for ( ;; ) {                                            /* device loop */
     READ_S (buf);                                       /* [V3.0+] logical name */
     if (buf[0] != '\0')
         sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "logical name=%s\n", buf);
-    deassign_device (dptr);                             /* delete old name */
-    if ((buf[0] != 0) &&
-        ((r = assign_device (dptr, buf)) != SCPE_OK)) {
-        r = SCPE_INCOMP;
-        goto Cleanup_Return;
+    if (!sim_rest_base) {                               /* base only supplies memory */
+        deassign_device (dptr);                         /* delete old name */
+        if ((buf[0] != 0) &&
+            ((r = assign_device (dptr, buf)) != SCPE_OK)) {
+            r = SCPE_INCOMP;
+            goto Cleanup_Return;
+            }
         }
     READ_I (flg);                                       /* [V2.10+] ctlr flags */
     sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "DEVICE.flags=%0X\n", flg);
     if (!v32)
         flg = ((flg & DEV_UFMASK_31) << (DEV_V_UF - DEV_V_UF_31)) |
             (flg & ~DEV_UFMASK_31);                     /* [V3.2+] flags moved */
-    dptr->flags = (dptr->flags & ~DEV_RFLAGS) |         /* restore ctlr flags */
-         (flg & DEV_RFLAGS);
+    if (!sim_rest_base)
+        dptr->flags = (dptr->flags & ~DEV_RFLAGS) |     /* restore ctlr flags */
+             (flg & DEV_RFLAGS);
     for ( ;; ) {                                        /* unit loop */
         sim_switches = SIM_SW_REST;                     /* flag rstr, clr RO */
         READ_I (unitno);                                /* unit number */
@@ -9956,9 +10890,15 @@ for ( ;; ) {                                            /* device loop */
             }
         READ_I (time);                                  /* event time */
         uptr = (dptr->units) + unitno;
-        sim_cancel (uptr);
-        if (time > 0)
-            sim_activate (uptr, time - 1);
+        if (sim_rest_base) {                            /* base unit state is discarded */
+            memset (&base_unit, 0, sizeof (base_unit));
+            uptr = &base_unit;
+            }
+        else {
+            sim_cancel (uptr);
+            if (time > 0)
+                sim_activate (uptr, time - 1);
+            }
         READ_I (uptr->u3);                              /* device specific */
         READ_I (uptr->u4);
         READ_I (uptr->u5);                              /* [V3.0+] more dev spec */
@@ -9996,7 +10936,7 @@ for ( ;; ) {                                            /* device loop */
                 goto Cleanup_Return;
                 }
             }
-        if ((buf[0] != '\0') &&                         /* unit to be reattached? */
+        if ((buf[0] != '\0') && (!sim_rest_base) &&     /* unit to be reattached? */
             ((uptr->flags & UNIT_ATTABLE) ||            /*  and unit is attachable */
              (dptr->attach != NULL))) {                 /*    or VM attach routine provided? */
             uptr->flags = uptr->flags & ~UNIT_DIS;      /* ensure device is enabled */
@@ -10013,6 +10953,14 @@ for ( ;; ) {                                            /* device loop */
             ++attcnt;
             }
         READ_I (high);                                  /* memory capacity */
+        if (sim_rest_base) {                            /* [V4.1] base snapshot memory */
+            if (high > 0) {
+                r = _sim_snap_rest_mem (rfile, dptr, (dptr->units) + unitno, high);
+                if (r != SCPE_OK)
+                    goto Cleanup_Return;
+                }
+            continue;
+            }
         if (high > 0) {                                 /* [V2.5+] any memory? */
             if (((uptr->flags & (UNIT_FIX + UNIT_ATTABLE)) != UNIT_FIX) ||
                  (dptr->deposit == NULL)) {
@@ -10037,9 +10985,15 @@ for ( ;; ) {                                            /* device loop */
                     fprint_capac (sim_log, dptr, uptr);
                 sim_printf ("\n");
                 }
-            sz = SZ_D (dptr);                           /* allocate buffer */
-            if ((mbuf = realloc (mbuf, SRBSIZ * sz)) == NULL) {
-                r = SCPE_MEM;
+            if (v41) {                                  /* [V4.1] paged memory */
+                r = _sim_snap_rest_mem (rfile, dptr, uptr, high);
+                if (r != SCPE_OK)
+                    goto Cleanup_Return;
+                continue;
+                }
+            sz = SZ_D (dptr);                           /* allocate buffer */
+            if ((mbuf = realloc (mbuf, SRBSIZ * sz)) == NULL) {
+                r = SCPE_MEM;
                 goto Cleanup_Return;
                 }
             for (k = 0; k < high; ) {                   /* loop thru mem */
@@ -10094,10 +11048,13 @@ for ( ;; ) {                                            /* device loop */
         for (us = 0; us < depth; us++) {                /* loop thru values */
             if ((rptr->macro != NULL) && (memcmp (rptr->macro, "DBRDATA", 7) == 0)) {
                 READ_S (buf);
-                sscanf(buf, "%lf", (((double *)rptr->loc) + us));
+                if (!sim_rest_base)
+                    sscanf(buf, "%lf", (((double *)rptr->loc) + us));
                 continue;
                 }
             READ_I (val);                               /* read value */
+            if (sim_rest_base)                          /* base registers are discarded */
+                continue;
             if (val > max) {                            /* value ok? */
                 sim_printf ("Invalid register value: %s %s\n", sim_dname (dptr), buf);
                 }
@@ -10108,6 +11065,16 @@ for ( ;; ) {                                            /* device loop */
             }
         }                                               /* end register loop */
     }                                                   /* end device loop */
+if (base_id != 0) {                                     /* [V4.1] incremental snapshot? */
+    r = _sim_snap_rest_base (base_path, base_id);       /* load unchanged pages */
+    if (r != SCPE_OK)
+        goto Cleanup_Return;
+    }
+if ((!sim_rest_base) && (_sim_snap_needed () != 0)) {
+    sim_printf ("Snapshot chain is incomplete, %u pages missing\n", _sim_snap_needed ());
+    r = SCPE_INCOMP;
+    goto Cleanup_Return;
+    }
 /* Now that all of the register state has been imported, we can attach
    units which were originally attached.  Some of these attach operations
    may depend on the state of the device (in registers) to work correctly */
@@ -10115,24 +11082,28 @@ for (j=0, r = SCPE_OK; j<attcnt; j++) {
     if (!dont_detach_attach) {
         struct stat fstat;
         t_addr saved_pos;
-        char drivetype[CBUFSIZE], filename[CBUFSIZE], cmd[CBUFSIZE * 2];
+        char drivetype[CBUFSIZE], overlay[CBUFSIZE], filename[CBUFSIZE], cmd[CBUFSIZE * 2];
+        const char *fname = attnames[j];
 
-        if (0 != memcmp (attnames[j], "\001DriveType=", 11)) {
-            strlcpy (filename, attnames[j], sizeof (filename));
-            cmd[0] = drivetype[0] = '\0';
-            }
-        else {
-            const char *fname = get_glyph_gen (attnames[j] + 11, drivetype, '\001', FALSE, TRUE, FALSE, 0);
+        cmd[0] = drivetype[0] = overlay[0] = '\0';
+        if ((0 == memcmp (fname, "\001Overlay=", 9)) &&    /* base container with an overlay? */
+            (strchr (fname + 9, '\001') != NULL)) {
+            const char *oend = strchr (fname + 9, '\001');
 
-            strlcpy (filename, fname, sizeof (filename));
+            strlcpy (overlay, fname + 9, MIN (sizeof (overlay), (size_t)(oend - (fname + 9)) + 1));
+            fname = (0 == memcmp (oend, "\001DriveType=", 11)) ? oend : oend + 1;
+            }
+        if (0 == memcmp (fname, "\001DriveType=", 11)) {
+            fname = get_glyph_gen (fname + 11, drivetype, '\001', FALSE, TRUE, FALSE, 0);
             snprintf (cmd, sizeof (cmd), "%s %s", sim_uname (attunits[j]), drivetype);
             }
+        strlcpy (filename, fname, sizeof (filename));
         sim_debug (SIM_DBG_RESTORE, &sim_scp_dev, "ATTACHING=%s to %s%s%s\n", sim_uname (attunits[j]), filename, drivetype[0] ? " as " : "", drivetype);
         if (cmd[0])
             set_cmd (0, cmd);
         dptr = find_dev_from_unit (attunits[j]);
         if ((!force_restore) &&
-            (!stat(filename, &fstat)))
+            (!stat(overlay[0] ? overlay : filename, &fstat)))
             if (fstat.st_mtime > rstat.st_mtime + 30) {
                 att_r = SCPE_INCOMP;
                 sim_printf ("Error Attaching %s to %s - the restore state is %d seconds older than the attach file\n", sim_dname (dptr), attnames[j], (int)(fstat.st_mtime - rstat.st_mtime));
@@ -10141,6 +11112,11 @@ for (j=0, r = SCPE_OK; j<attcnt; j++) {
                 }
         saved_pos = attunits[j]->pos;
         sim_switches = attswitches[j];
+        if (overlay[0]) {                               /* reopen the existing overlay */
+            sim_switches |= SWMASK ('O') | SWMASK ('E');
+            snprintf (cmd, sizeof (cmd), "%s %s", overlay, filename);
+            strlcpy (filename, cmd, sizeof (filename));
+            }
         r = scp_attach_unit (dptr, attunits[j], filename);/* reattach unit */
         attunits[j]->pos = saved_pos;
         if (r != SCPE_OK) {
@@ -10167,6 +11143,8 @@ for (j=0, r = SCPE_OK; j<attcnt; j++) {
 r = att_r;          /* Complete ATTACH activity with the worst error (if any) while attaching */
 Cleanup_Return:
 free (mbuf);
+if (!sim_rest_base)
+    _sim_snap_free (&sim_snap_need, &sim_snap_need_count);
 for (j=0; j < attcnt; j++)
     free (attnames[j]);
 free (attnames);
@@ -13375,7 +14353,284 @@ return buf;
    The event queue is maintained in clock order; entry timeouts are
    RELATIVE to the time in the previous entry.
 
-   sim_process_event - process event
+   The linked list rooted at sim_clock_queue is walked directly by
+   sim_timer and by some simulators, so it always remains the authoritative
+   form of the queue.  By default (SET QUEUE INDEXED) it is shadowed by a
+   skip list whose express lanes locate the insertion point for a new entry
+   in O(log n), and a back pointer on each queued unit lets sim_cancel
+   remove an entry without a scan.  Each entry's key is the running sum of
+   the deltas, so entries due at the same time keep the FIFO order the
+   linear scan gives them.  The keys are only ordered while no delta after
+   the head is negative; an immediate (-1) activation in front of an
+   overdue head is the one operation that can break that, so it drops the
+   index and the index is rebuilt from the list once it is ordered again.
+   SET QUEUE LINEAR reverts to plain list scans.
+
+   Most entries join only the lowest express lanes, and those lanes are
+   kept in the unit.  An entry which joins more than SIM_EVQ_INLINE lanes
+   borrows a full set from a pool while it is indexed, so a taller index
+   doesn't make every UNIT larger.
+*/
+
+typedef struct SIM_EVQ_LANES SIM_EVQ_LANES;
+struct SIM_EVQ_LANES {
+    SIM_EVQ_NODE        *fwd[SIM_EVQ_LEVELS];           /* express lane successors (first) */
+    SIM_EVQ_NODE        *bwd[SIM_EVQ_LEVELS];           /* express lane predecessors */
+    SIM_EVQ_LANES       *next_free;                     /* pool linkage */
+    };
+
+static SIM_EVQ_LANES sim_evq_head_lanes;
+static SIM_EVQ_NODE sim_evq_head = {                    /* express lane list heads */
+    NULL, NULL, 0, 0, FALSE, SIM_EVQ_LEVELS, sim_evq_head_lanes.fwd, sim_evq_head_lanes.bwd};
+static SIM_EVQ_LANES *sim_evq_pool = NULL;              /* unused lanes of tall entries */
+static uint32 sim_evq_lent = 0;                         /* tall entries currently indexed */
+static uint32 sim_evq_gen = 0;                          /* index generation */
+static int32 sim_evq_top = 0;                           /* express lanes in use */
+static uint32 sim_evq_seed = 0x2545F491;                /* express lane level generator */
+
+#define EVQ_NODE(u) (&(u)->evq)
+
+/* Choose how many express lanes a new entry joins (p = 1/4 per lane) */
+
+static int32 _sim_evq_levels (void)
+{
+int32 levels = 0;
+
+sim_evq_seed ^= sim_evq_seed << 13;                     /* xorshift32 */
+sim_evq_seed ^= sim_evq_seed >> 17;
+sim_evq_seed ^= sim_evq_seed << 5;
+while (((sim_evq_seed >> (2 * levels)) & 3) == 0) {
+    if (++levels == SIM_EVQ_LEVELS)
+        break;
+    }
+return levels;
+}
+
+/* Return the index node embedded in a unit, initializing it on first
+   use.  A node whose owner doesn't match was never used by this unit or
+   came along when a simulator copied a UNIT structure. */
+
+static SIM_EVQ_NODE *_sim_evq_node (UNIT *uptr)
+{
+SIM_EVQ_NODE *node = EVQ_NODE (uptr);
+
+if (node->uptr != uptr) {
+    memset (node, 0, sizeof (*node));
+    node->uptr = uptr;
+    node->levels = _sim_evq_levels ();
+    node->fwd = &node->lane[0];
+    node->bwd = &node->lane[SIM_EVQ_INLINE];
+    }
+return node;
+}
+
+static t_bool _sim_evq_on_queue (UNIT *uptr)
+{
+SIM_EVQ_NODE *node = EVQ_NODE (uptr);
+
+return ((node->uptr == uptr) && node->queued && (node->gen == sim_evq_gen));
+}
+
+/* Lend a tall entry its express lanes as it joins the index.  If none
+   can be had, the entry settles for the lanes the unit holds. */
+
+static void _sim_evq_lend (SIM_EVQ_NODE *node)
+{
+SIM_EVQ_LANES *lanes;
+
+if ((node->levels <= SIM_EVQ_INLINE) || (node->fwd != &node->lane[0]))
+    return;
+lanes = sim_evq_pool;
+if (lanes != NULL)
+    sim_evq_pool = lanes->next_free;
+else
+    lanes = (SIM_EVQ_LANES *)malloc (sizeof (*lanes));
+if (lanes == NULL) {
+    node->levels = SIM_EVQ_INLINE;
+    return;
+    }
+node->fwd = lanes->fwd;
+node->bwd = lanes->bwd;
+++sim_evq_lent;
+}
+
+/* Return a tall entry's express lanes to the pool as it leaves the index */
+
+static void _sim_evq_return (SIM_EVQ_NODE *node)
+{
+SIM_EVQ_LANES *lanes = (SIM_EVQ_LANES *)node->fwd;
+
+if (node->fwd == &node->lane[0])
+    return;
+lanes->next_free = sim_evq_pool;
+sim_evq_pool = lanes;
+node->fwd = &node->lane[0];
+node->bwd = &node->lane[SIM_EVQ_INLINE];
+--sim_evq_lent;
+}
+
+/* Stop using the index.  Every indexed entry is still on the clock
+   queue, so that's where the borrowed lanes are collected from. */
+
+static void _sim_evq_drop (void)
+{
+UNIT *uptr;
+
+if (sim_evq_valid) {
+    for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next) {
+        if (_sim_evq_on_queue (uptr))
+            _sim_evq_return (EVQ_NODE (uptr));
+        }
+    }
+sim_evq_valid = FALSE;
+}
+
+/* Rebuild the index from the clock queue.  Leaves the index invalid if
+   the linear engine is selected or the queue isn't currently ordered. */
+
+static void _sim_evq_rebuild (void)
+{
+SIM_EVQ_NODE *update[SIM_EVQ_LEVELS];
+SIM_EVQ_NODE *node;
+UNIT *uptr, *prvptr = NULL;
+t_int64 key = 0;
+int32 i;
+
+_sim_evq_drop ();
+++sim_evq_gen;
+sim_evq_top = 0;
+for (i = 0; i < SIM_EVQ_LEVELS; i++) {
+    sim_evq_head.fwd[i] = NULL;
+    update[i] = &sim_evq_head;
+    }
+if (!sim_evq_indexed)
+    return;
+for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next) {
+    if ((uptr != sim_clock_queue) && (uptr->time < 0))  /* out of order? */
+        return;
+    }
+for (uptr = sim_clock_queue; uptr != QUEUE_LIST_END; uptr = uptr->next) {
+    node = _sim_evq_node (uptr);
+    key += uptr->time;
+    node->key = key;
+    node->prev = prvptr;
+    node->gen = sim_evq_gen;
+    node->queued = TRUE;
+    _sim_evq_lend (node);
+    if (node->levels > sim_evq_top)
+        sim_evq_top = node->levels;
+    for (i = 0; i < node->levels; i++) {
+        node->bwd[i] = update[i];
+        node->fwd[i] = NULL;
+        update[i]->fwd[i] = node;
+        update[i] = node;
+        }
+    prvptr = uptr;
+    }
+sim_evq_valid = TRUE;
+}
+
+/* Insert a unit into the indexed clock queue.  An event_time of -1 pushes
+   it at the head to run immediately, otherwise it follows every entry due
+   at or before the requested time.  Returns FALSE if the index can't
+   describe the result, in which case the caller uses the list engine. */
+
+static t_bool _sim_evq_insert (UNIT *uptr, int32 event_time)
+{
+SIM_EVQ_NODE *update[SIM_EVQ_LEVELS];
+SIM_EVQ_NODE *node, *x = &sim_evq_head;
+UNIT *prvptr = NULL, *cptr = sim_clock_queue;
+t_int64 now, key;
+int32 i;
+
+node = _sim_evq_node (uptr);
+if (sim_clock_queue == QUEUE_LIST_END)
+    now = 0;                                            /* rebase keys on empty queue */
+else
+    now = EVQ_NODE (sim_clock_queue)->key - sim_clock_queue->time;
+if (event_time == -1) {
+    if ((cptr != QUEUE_LIST_END) && (cptr->time < 0))   /* overdue head stays behind? */
+        return FALSE;
+    key = now;
+    event_time = 0;
+    for (i = 0; i < SIM_EVQ_LEVELS; i++)
+        update[i] = &sim_evq_head;
+    }
+else {
+    key = now + event_time;
+    for (i = SIM_EVQ_LEVELS - 1; i >= sim_evq_top; i--)
+        update[i] = &sim_evq_head;
+    for (i = sim_evq_top - 1; i >= 0; i--) {
+        while ((x->fwd[i] != NULL) && (x->fwd[i]->key <= key))
+            x = x->fwd[i];
+        update[i] = x;
+        }
+    if (x != &sim_evq_head) {
+        prvptr = x->uptr;
+        cptr = prvptr->next;
+        }
+    while ((cptr != QUEUE_LIST_END) && (EVQ_NODE (cptr)->key <= key)) {
+        prvptr = cptr;
+        cptr = cptr->next;
+        }
+    }
+if (prvptr == NULL) {                                   /* insert at head */
+    uptr->next = sim_clock_queue;
+    sim_clock_queue = uptr;
+    uptr->time = event_time;
+    }
+else {
+    uptr->next = cptr;                                  /* insert at prvptr */
+    prvptr->next = uptr;
+    uptr->time = (int32)(key - EVQ_NODE (prvptr)->key);
+    }
+if (cptr != QUEUE_LIST_END) {
+    EVQ_NODE (cptr)->prev = uptr;
+    cptr->time = (int32)(EVQ_NODE (cptr)->key - key);
+    }
+node->key = key;
+node->prev = prvptr;
+node->gen = sim_evq_gen;
+node->queued = TRUE;
+_sim_evq_lend (node);
+if (node->levels > sim_evq_top)
+    sim_evq_top = node->levels;
+for (i = 0; i < node->levels; i++) {
+    node->fwd[i] = update[i]->fwd[i];
+    node->bwd[i] = update[i];
+    if (node->fwd[i] != NULL)
+        node->fwd[i]->bwd[i] = node;
+    update[i]->fwd[i] = node;
+    }
+return TRUE;
+}
+
+/* Remove a unit from the indexed clock queue.  The successor's delta is
+   left for the caller, since dispatching the head doesn't adjust it. */
+
+static void _sim_evq_remove (UNIT *uptr)
+{
+SIM_EVQ_NODE *node = EVQ_NODE (uptr);
+UNIT *nptr = uptr->next;
+int32 i;
+
+for (i = 0; i < node->levels; i++) {
+    node->bwd[i]->fwd[i] = node->fwd[i];
+    if (node->fwd[i] != NULL)
+        node->fwd[i]->bwd[i] = node->bwd[i];
+    }
+if (node->prev == NULL)
+    sim_clock_queue = nptr;
+else
+    node->prev->next = nptr;
+if (nptr != QUEUE_LIST_END)
+    EVQ_NODE (nptr)->prev = node->prev;
+node->queued = FALSE;
+_sim_evq_return (node);
+uptr->next = NULL;
+}
+
+/* sim_process_event - process event
 
    Inputs:
         none
@@ -13427,8 +14682,12 @@ else
     sim_interval_catchup = 0;
 do {
     uptr = sim_clock_queue;                             /* get first */
-    sim_clock_queue = uptr->next;                       /* remove first */
-    uptr->next = NULL;                                  /* hygiene */
+    if (sim_evq_valid)
+        _sim_evq_remove (uptr);                         /* remove first */
+    else {
+        sim_clock_queue = uptr->next;                   /* remove first */
+        uptr->next = NULL;                              /* hygiene */
+        }
     uptr->time = 0;
     if (sim_clock_queue != QUEUE_LIST_END) {
         if (sim_interval_catchup < 0)
@@ -13449,7 +14708,8 @@ do {
         else
             reason = SCPE_OK;
         }
-    if (sim_interval_catchup < -1) {
+    if ((sim_interval_catchup < -1) &&
+        (sim_clock_queue != QUEUE_LIST_END)) {
         sim_interval_catchup += sim_clock_queue->time;
         sim_time += sim_clock_queue->time;
         sim_rtime += sim_clock_queue->time;
@@ -13519,6 +14779,17 @@ UPDATE_SIM_TIME;                                        /* update sim time */
 
 sim_debug (SIM_DBG_ACTIVATE, &sim_scp_dev, "Activating %s delay=%d\n", sim_uname (uptr), event_time);
 
+if (sim_evq_indexed) {
+    if (!sim_evq_valid)
+        _sim_evq_rebuild ();
+    if (sim_evq_valid) {
+        if (_sim_evq_insert (uptr, event_time)) {
+            sim_interval = sim_clock_queue->time;
+            return SCPE_OK;
+            }
+        _sim_evq_drop ();                               /* fall back to list engine */
+        }
+    }
 /* event_time being -1 is a special case which specifically pushes the */
 /* specified unit at the head of the event queue to run immediately */
 if (event_time == -1) {
@@ -13662,7 +14933,13 @@ UPDATE_SIM_TIME;                                        /* update sim time */
 sim_debug (SIM_DBG_EVENT, &sim_scp_dev, "Canceling Event for %s\n", sim_uname(uptr));
 nptr = QUEUE_LIST_END;
 
-if (sim_clock_queue == uptr) {
+if (sim_evq_valid) {
+    if (_sim_evq_on_queue (uptr)) {
+        nptr = uptr->next;
+        _sim_evq_remove (uptr);
+        }
+    }
+else if (sim_clock_queue == uptr) {
     nptr = sim_clock_queue = uptr->next;
     uptr->next = NULL;                                  /* hygiene */
     }
@@ -13844,6 +15121,16 @@ return cnt;
    is the bitwise OR of all the type fields).  A simulator need only check for
    a breakpoint of type X if bit SWMASK('X') is set in sim_brk_summ.
 
+   An address range without a repeat count is kept as a single range entry
+   (addr through end) on the sim_brk_rng list rather than as one table entry
+   per address.  Clearing part of a range trims or splits the entry.
+
+   sim_brk_map records, for each bucket of 2^SIM_BRK_MAP_V_PG addresses (the
+   address modulo the map size), the types of any point or range breakpoints
+   that fall in it.  sim_brk_test consults it first, so the common case of no
+   breakpoint at the tested address costs a single load.  The map is rebuilt
+   from the table on the next test after any breakpoint is cleared.
+
    The package contains the following public routines:
 
         sim_brk_init            initialize
@@ -13852,6 +15139,9 @@ return cnt;
         sim_brk_clrall          clear all breakpoints
         sim_brk_show            show breakpoint
         sim_brk_showall         show all breakpoints
+        sim_brk_set_range       set range breakpoint
+        sim_brk_clr_range       clear (part of) range breakpoints
+        sim_brk_show_stats      show breakpoint test statistics
         sim_brk_test            test for breakpoint
         sim_brk_npc             PC has been changed
         sim_brk_getact          get next action
@@ -13876,6 +15166,16 @@ for (i=0; i<sim_brk_lnt; i++) {
         bp = bpt;
         }
     }
+while (sim_brk_rng) {
+    BRKTAB *bpt = sim_brk_rng->next;
+
+    free (sim_brk_rng->act);
+    free (sim_brk_rng);
+    sim_brk_rng = bpt;
+    }
+sim_brk_map_valid = FALSE;
+sim_brk_stat_tests = sim_brk_stat_filtered = sim_brk_stat_hits = 0;
+sim_brk_stat_probes = sim_brk_stat_rprobes = 0;
 sim_brk_lnt = SIM_BRK_INILNT;
 sim_brk_tab = (BRKTAB **) realloc (sim_brk_tab, sim_brk_lnt*sizeof (BRKTAB*));
 if (sim_brk_tab == NULL)
@@ -13902,6 +15202,7 @@ lo = 0;                                                 /* initial bounds */
 hi = sim_brk_ent - 1;
 do {
     p = (lo + hi) >> 1;                                 /* probe */
+    ++sim_brk_probes;
     bp = sim_brk_tab[p];                                /* table addr */
     if (loc == bp->addr) {                              /* match? */
         sim_brk_ins = p;
@@ -13965,41 +15266,78 @@ bp->next = sim_brk_tab[sim_brk_ins];
 sim_brk_tab[sim_brk_ins] = bp;
 if (bp->next == NULL)
     sim_brk_ent += 1;
-bp->addr = loc;
+bp->addr = bp->end = loc;
 bp->typ = btyp;
 bp->cnt = 0;
 bp->act = NULL;
 for (i = 0; i < SIM_BKPT_N_SPC; i++)
     bp->time_fired[i] = -1.0;
+sim_brk_map[SIM_BRK_MAPIDX (loc)] |= btyp;
 return bp;
 }
 
-/* Set a breakpoint of type sw */
+/* Rebuild the breakpoint address map */
 
-t_stat sim_brk_set (t_addr loc, int32 sw, int32 ncnt, CONST char *act)
+static void sim_brk_map_build (void)
+{
+BRKTAB *bp;
+t_addr pg;
+int32 i;
+
+memset (sim_brk_map, 0, sizeof (sim_brk_map));
+for (i = 0; i < sim_brk_ent; i++) {
+    for (bp = sim_brk_tab[i]; bp; bp = bp->next)
+        sim_brk_map[SIM_BRK_MAPIDX (bp->addr)] |= bp->typ;
+    }
+for (bp = sim_brk_rng; bp; bp = bp->next) {
+    if (((bp->end >> SIM_BRK_MAP_V_PG) - (bp->addr >> SIM_BRK_MAP_V_PG)) >= SIM_BRK_MAPSIZE) {
+        for (i = 0; i < SIM_BRK_MAPSIZE; i++)           /* covers every bucket */
+            sim_brk_map[i] |= bp->typ;
+        continue;
+        }
+    for (pg = bp->addr >> SIM_BRK_MAP_V_PG; pg <= (bp->end >> SIM_BRK_MAP_V_PG); pg++)
+        sim_brk_map[pg & (SIM_BRK_MAPSIZE - 1)] |= bp->typ;
+    }
+sim_brk_map_valid = TRUE;
+}
+
+/* Recompute the breakpoint type summary */
+
+static void sim_brk_summarize (void)
 {
 BRKTAB *bp;
+int32 i;
+
+sim_brk_summ = 0;
+for (i = 0; i < sim_brk_ent; i++) {
+    for (bp = sim_brk_tab[i]; bp; bp = bp->next)
+        sim_brk_summ |= (bp->typ & ~BRK_TYP_TEMP);
+    }
+for (bp = sim_brk_rng; bp; bp = bp->next)
+    sim_brk_summ |= (bp->typ & ~BRK_TYP_TEMP);
+sim_brk_map_valid = FALSE;
+}
 
-if ((sw == 0) || (sw == BRK_TYP_DYN_STEPOVER))
-    sw |= sim_brk_dflt;
-if (~sim_brk_types & sw) {
+/* Validate the breakpoint type and action of a new breakpoint */
+
+static t_stat sim_brk_chktyp (int32 *sw, CONST char *act)
+{
+if ((*sw == 0) || (*sw == BRK_TYP_DYN_STEPOVER))
+    *sw |= sim_brk_dflt;
+if (~sim_brk_types & *sw) {
     char gbuf[CBUFSIZE];
 
-    return sim_messagef (SCPE_NOFNC, "Unknown breakpoint type; %s\n", put_switches(gbuf, sizeof(gbuf), sw & ~sim_brk_types));
+    return sim_messagef (SCPE_NOFNC, "Unknown breakpoint type; %s\n", put_switches(gbuf, sizeof(gbuf), *sw & ~sim_brk_types));
     }
-if ((sw & BRK_TYP_DYN_ALL) && act)                      /* can't specify an action with a dynamic breakpoint */
+if ((*sw & BRK_TYP_DYN_ALL) && act)                     /* can't specify an action with a dynamic breakpoint */
     return SCPE_ARG;
-bp = sim_brk_fnd (loc);                                 /* loc present? */
-if (!bp)                                                /* no, allocate */
-    bp = sim_brk_new (loc, sw);
-else {
-    while (bp && (bp->typ != (uint32)sw))
-        bp = bp->next;
-    if (!bp)
-        bp = sim_brk_new (loc, sw);
-    }
-if (!bp)                                                /* still no? mem err */
-    return SCPE_MEM;
+return SCPE_OK;
+}
+
+/* Attach a count and action to a new or existing breakpoint */
+
+static t_stat sim_brk_setcntact (BRKTAB *bp, int32 sw, int32 ncnt, CONST char *act)
+{
 bp->cnt = ncnt;                                         /* set count */
 if ((!(sw & BRK_TYP_DYN_ALL)) &&                        /* Not Dynamic and */
     (bp->act != NULL) && (act != NULL)) {               /* replace old action? */
@@ -14017,6 +15355,58 @@ sim_brk_summ = sim_brk_summ | (sw & ~BRK_TYP_TEMP);
 return SCPE_OK;
 }
 
+/* Set a breakpoint of type sw */
+
+t_stat sim_brk_set (t_addr loc, int32 sw, int32 ncnt, CONST char *act)
+{
+BRKTAB *bp;
+t_stat r;
+
+if ((r = sim_brk_chktyp (&sw, act)) != SCPE_OK)
+    return r;
+bp = sim_brk_fnd (loc);                                 /* loc present? */
+if (!bp)                                                /* no, allocate */
+    bp = sim_brk_new (loc, sw);
+else {
+    while (bp && (bp->typ != (uint32)sw))
+        bp = bp->next;
+    if (!bp)
+        bp = sim_brk_new (loc, sw);
+    }
+if (!bp)                                                /* still no? mem err */
+    return SCPE_MEM;
+return sim_brk_setcntact (bp, sw, ncnt, act);
+}
+
+/* Set a range breakpoint of type sw covering lo through hi */
+
+t_stat sim_brk_set_range (t_addr lo, t_addr hi, int32 sw, int32 ncnt, CONST char *act)
+{
+BRKTAB *bp, **bpp;
+t_stat r;
+int32 i;
+
+if ((r = sim_brk_chktyp (&sw, act)) != SCPE_OK)
+    return r;
+for (bpp = &sim_brk_rng; (bp = *bpp) != NULL; bpp = &bp->next) {
+    if ((bp->addr == lo) && (bp->end == hi) && (bp->typ == (uint32)sw))
+        break;                                          /* existing range */
+    }
+if (bp == NULL) {                                       /* append new range */
+    bp = (BRKTAB *)calloc (1, sizeof (*bp));
+    if (bp == NULL)
+        return SCPE_MEM;
+    bp->addr = lo;
+    bp->end = hi;
+    bp->typ = sw;
+    for (i = 0; i < SIM_BKPT_N_SPC; i++)
+        bp->time_fired[i] = -1.0;
+    *bpp = bp;
+    sim_brk_map_valid = FALSE;
+    }
+return sim_brk_setcntact (bp, sw, ncnt, act);
+}
+
 /* Clear a breakpoint */
 
 t_stat sim_brk_clr (t_addr loc, int32 sw)
@@ -14050,17 +15440,77 @@ if (sim_brk_tab[sim_brk_ins] == NULL) {                 /* erased entry */
     for (i = sim_brk_ins; i < sim_brk_ent; i++)         /* shuffle remaining entries */
         sim_brk_tab[i] = sim_brk_tab[i+1];
     }
-sim_brk_summ = 0;                                       /* recalc summary */
-for (i = 0; i < sim_brk_ent; i++) {
-    bp = sim_brk_tab[i];
-    while (bp) {
-        sim_brk_summ |= (bp->typ & ~BRK_TYP_TEMP);
-        bp = bp->next;
+sim_brk_summarize ();                                   /* recalc summary */
+return SCPE_OK;
+}
+
+/* Clear lo through hi from range breakpoints of type sw, trimming or
+   splitting any range which only partially overlaps */
+
+t_stat sim_brk_clr_range (t_addr lo, t_addr hi, int32 sw)
+{
+BRKTAB *bp, **bpp, *nbp;
+
+if (sw == 0)
+    sw = SIM_BRK_ALLTYP;
+for (bpp = &sim_brk_rng; (bp = *bpp) != NULL; ) {
+    if ((bp->typ != (bp->typ & sw)) ||                  /* other types or */
+        (hi < bp->addr) || (lo > bp->end)) {            /* no overlap? */
+        bpp = &bp->next;
+        continue;
+        }
+    if ((lo <= bp->addr) && (hi >= bp->end)) {          /* covers entire range? */
+        *bpp = bp->next;
+        free (bp->act);
+        free (bp);
+        continue;
+        }
+    if ((lo > bp->addr) && (hi < bp->end)) {            /* hole in the middle? */
+        nbp = (BRKTAB *)malloc (sizeof (*nbp));
+        if (nbp == NULL)
+            return SCPE_MEM;
+        *nbp = *bp;
+        nbp->addr = hi + 1;
+        if (bp->act != NULL) {
+            nbp->act = (char *)calloc (CBUFSIZE+1, sizeof (char));
+            if (nbp->act == NULL) {
+                free (nbp);
+                return SCPE_MEM;
+                }
+            strlcpy (nbp->act, bp->act, CBUFSIZE);
+            }
+        bp->end = lo - 1;
+        bp->next = nbp;
+        bpp = &nbp->next;
+        continue;
         }
+    if (lo <= bp->addr)                                 /* trim the front */
+        bp->addr = hi + 1;
+    else                                                /* trim the back */
+        bp->end = lo - 1;
+    bpp = &bp->next;
     }
+sim_brk_summarize ();
 return SCPE_OK;
 }
 
+/* Delete one range breakpoint entry in its entirety */
+
+static void sim_brk_del_range (BRKTAB *bp)
+{
+BRKTAB **bpp;
+
+for (bpp = &sim_brk_rng; *bpp != NULL; bpp = &(*bpp)->next) {
+    if (*bpp == bp) {
+        *bpp = bp->next;
+        free (bp->act);
+        free (bp);
+        break;
+        }
+    }
+sim_brk_summarize ();
+}
+
 /* Clear all breakpoints */
 
 t_stat sim_brk_clrall (int32 sw)
@@ -14076,14 +15526,46 @@ for (i = 0; i < sim_brk_ent;) {
         (loc == sim_brk_tab[i]->addr))
         ++i;
     }
-return SCPE_OK;
+return sim_brk_clr_range (0, (t_addr)-1, sw);
 }
 
 /* Show a breakpoint */
 
+static void sim_brk_show_addr (FILE *st, DEVICE *dptr, BRKTAB *bp)
+{
+if (sim_vm_fprint_addr)
+    sim_vm_fprint_addr (st, dptr, bp->addr);
+else fprint_val (st, bp->addr, dptr->aradix, dptr->awidth, PV_LEFT);
+if (bp->end != bp->addr) {
+    fprintf (st, "-");
+    if (sim_vm_fprint_addr)
+        sim_vm_fprint_addr (st, dptr, bp->end);
+    else fprint_val (st, bp->end, dptr->aradix, dptr->awidth, PV_LEFT);
+    }
+}
+
 t_stat sim_brk_show (FILE *st, t_addr loc, int32 sw)
 {
 BRKTAB *bp = sim_brk_fnd_ex (loc, sw & (~SWMASK ('C')), FALSE, 0);
+
+return sim_brk_show_entry (st, bp, sw);
+}
+
+/* Show range breakpoints overlapping lo through hi */
+
+t_stat sim_brk_show_range (FILE *st, t_addr lo, t_addr hi, int32 sw)
+{
+BRKTAB *bp;
+
+for (bp = sim_brk_rng; bp; bp = bp->next) {
+    if ((hi >= bp->addr) && (lo <= bp->end))
+        sim_brk_show_entry (st, bp, sw);
+    }
+return SCPE_OK;
+}
+
+t_stat sim_brk_show_entry (FILE *st, BRKTAB *bp, int32 sw)
+{
 DEVICE *dptr;
 int32 i, any;
 
@@ -14097,9 +15579,7 @@ if (dptr == NULL)
 if (sw & SWMASK ('C'))
     fprintf (st, "SET BREAK ");
 else {
-    if (sim_vm_fprint_addr)
-        sim_vm_fprint_addr (st, dptr, loc);
-    else fprint_val (st, loc, dptr->aradix, dptr->awidth, PV_LEFT);
+    sim_brk_show_addr (st, dptr, bp);
     fprintf (st, ":\t");
     }
 for (i = any = 0; i < 26; i++) {
@@ -14116,9 +15596,7 @@ for (i = any = 0; i < 26; i++) {
     }
 if (sw & SWMASK ('C')) {
     fprintf (st, " ");
-    if (sim_vm_fprint_addr)
-        sim_vm_fprint_addr (st, dptr, loc);
-    else fprint_val (st, loc, dptr->aradix, dptr->awidth, PV_LEFT);
+    sim_brk_show_addr (st, dptr, bp);
     }
 if (bp->cnt > 0)
     fprintf (st, "[%d]", bp->cnt);
@@ -14133,7 +15611,7 @@ return SCPE_OK;
 t_stat sim_brk_showall (FILE *st, int32 sw)
 {
 int32 bit, mask, types;
-BRKTAB **bpt;
+BRKTAB **bpt, *bp;
 
 if ((sw == 0) || (sw == SWMASK ('C')))
     sw = SIM_BRK_ALLTYP | ((sw == SWMASK ('C')) ? SWMASK ('C') : 0);
@@ -14187,6 +15665,44 @@ for (bpt = sim_brk_tab; bpt < (sim_brk_tab + sim_brk_ent); bpt++) {
     /* restore original list */
     *bpt = prev;
     }
+for (bp = sim_brk_rng; bp; bp = bp->next) {
+    if (bp->typ & sw)
+        sim_brk_show_entry (st, bp, bp->typ | ((sw & SWMASK ('C')) ? SWMASK ('C') : 0));
+    }
+return SCPE_OK;
+}
+
+/* Show breakpoint test statistics */
+
+t_stat sim_brk_show_stats (FILE *st)
+{
+BRKTAB *bp;
+int32 i, points = 0, ranges = 0, buckets = 0;
+
+if (!sim_brk_map_valid)
+    sim_brk_map_build ();
+for (i = 0; i < sim_brk_ent; i++) {
+    for (bp = sim_brk_tab[i]; bp; bp = bp->next)
+        ++points;
+    }
+for (bp = sim_brk_rng; bp; bp = bp->next)
+    ++ranges;
+for (i = 0; i < SIM_BRK_MAPSIZE; i++) {
+    if (sim_brk_map[i])
+        ++buckets;
+    }
+fprintf (st, "Breakpoint Statistics:\n");
+fprintf (st, "  Point breakpoints:     %d\n", points);
+fprintf (st, "  Range breakpoints:     %d\n", ranges);
+fprintf (st, "  Map buckets in use:    %d of %d (%d addresses each)\n", buckets, SIM_BRK_MAPSIZE, 1 << SIM_BRK_MAP_V_PG);
+fprintf (st, "  Tests:                 %s\n", sim_fmt_numeric ((double)sim_brk_stat_tests));
+fprintf (st, "  Resolved by map:       %s", sim_fmt_numeric ((double)sim_brk_stat_filtered));
+if (sim_brk_stat_tests)
+    fprintf (st, " (%.1f%%)", (100.0 * sim_brk_stat_filtered) / sim_brk_stat_tests);
+fprintf (st, "\n");
+fprintf (st, "  Table probes:          %s\n", sim_fmt_numeric ((double)sim_brk_stat_probes));
+fprintf (st, "  Range probes:          %s\n", sim_fmt_numeric ((double)sim_brk_stat_rprobes));
+fprintf (st, "  Hits:                  %s\n", sim_fmt_numeric ((double)sim_brk_stat_hits));
 return SCPE_OK;
 }
 
@@ -14196,23 +15712,51 @@ uint32 sim_brk_test (t_addr loc, uint32 btyp)
 {
 BRKTAB *bp;
 uint32 spc = (btyp >> SIM_BKPT_V_SPC) & (SIM_BKPT_N_SPC - 1);
+t_uint64 probes = sim_brk_probes;
+t_bool range = FALSE;
 
 if (sim_brk_summ & BRK_TYP_DYN_ALL)
     btyp |= BRK_TYP_DYN_ALL;
+++sim_brk_stat_tests;
+if (!sim_brk_map_valid)
+    sim_brk_map_build ();
+if ((sim_brk_map[SIM_BRK_MAPIDX (loc)] & btyp & SIM_BRK_TYPMASK) == 0) {
+    ++sim_brk_stat_filtered;                            /* nothing here */
+    return 0;
+    }
+bp = sim_brk_fnd_ex (loc, btyp, TRUE, spc);             /* in table, and type match? */
+sim_brk_stat_probes += sim_brk_probes - probes;
+if (bp == NULL) {
+    double s_gtime = sim_gtime ();
 
-if ((bp = sim_brk_fnd_ex (loc, btyp, TRUE, spc))) {     /* in table, and type match? */
+    for (bp = sim_brk_rng; bp; bp = bp->next) {         /* in a range? */
+        ++sim_brk_stat_rprobes;
+        if ((loc >= bp->addr) && (loc <= bp->end) && (bp->typ & btyp) &&
+            ((bp->time_fired[spc] != s_gtime) || (bp->addr_fired[spc] != loc)))
+            break;
+        }
+    range = TRUE;
+    }
+if (bp) {
     double s_gtime = sim_gtime ();                      /* get time now */
 
-    if (bp->time_fired[spc] == s_gtime)                 /* already taken?  */
+    if ((bp->time_fired[spc] == s_gtime) &&             /* already taken?  */
+        (bp->addr_fired[spc] == loc))
         return 0;
     bp->time_fired[spc] = s_gtime;                      /* remember match time */
+    bp->addr_fired[spc] = loc;
+    ++sim_brk_stat_hits;
     if (--bp->cnt > 0)                                  /* count > 0? */
         return 0;
     bp->cnt = 0;                                        /* reset count */
     sim_brk_setact (bp->act);                           /* set up actions */
     sim_brk_match_type = btyp & bp->typ;                /* set return value */
-    if (bp->typ & BRK_TYP_TEMP)
-        sim_brk_clr (loc, bp->typ);                     /* delete one-shot breakpoint */
+    if (bp->typ & BRK_TYP_TEMP) {                       /* delete one-shot breakpoint */
+        if (range)
+            sim_brk_del_range (bp);
+        else
+            sim_brk_clr (loc, bp->typ);
+        }
     sim_brk_match_addr = loc;
     return sim_brk_match_type;
     }
@@ -14323,6 +15867,10 @@ for (bpt = sim_brk_tab; bpt < (sim_brk_tab + sim_brk_ent); bpt++) {
             bp->time_fired[spc] = -1.0;
         }
     }
+for (bp = sim_brk_rng; bp; bp = bp->next) {
+    for (spc = 0; spc < cnt; spc++)
+        bp->time_fired[spc] = -1.0;
+    }
 }
 
 /* Clear breakpoint space */
@@ -14338,6 +15886,10 @@ if (spc < SIM_BKPT_N_SPC) {
                 bp->time_fired[spc] = -1.0;
             }
         }
+    for (bp = sim_brk_rng; bp; bp = bp->next) {
+        if (bp->typ & btyp)
+            bp->time_fired[spc] = -1.0;
+        }
     }
 }
 
@@ -15115,6 +16667,10 @@ size_t debug_line_bufsize = 0;
 size_t debug_line_offset = 0;
 size_t debug_line_count = 0;
 
+static void _sim_trc_text (const char *buf, size_t len);
+static t_bool _sim_trc_event (uint32 dbits, DEVICE *dptr, UNIT *uptr, const char *fmt, va_list arglist);
+static void _sim_trc_flush (void);
+
 static void _debug_fwrite_all (const char *buf, size_t len, FILE *f)
 {
 size_t len_written;
@@ -15163,6 +16719,10 @@ static void _sim_debug_write_flush (const char *buf, size_t len, t_bool flush)
 {
 char *eol;
 
+if (sim_deb_trace) {                                /* binary trace? */
+    _sim_trc_text (buf, len);                       /* record text as is */
+    return;
+    }
 AIO_LOCK;
 if (sim_deb_switches & SWMASK ('F')) {              /* filtering disabled? */
     if (len > 0)
@@ -15255,6 +16815,10 @@ struct timespec saved_deb_basetime;
 if (sim_deb == NULL)                                    /* no debug? */
     return SCPE_OK;
 
+if (sim_deb_trace) {                                    /* binary trace? */
+    _sim_trc_flush ();                                  /* write out recorded events */
+    return SCPE_OK;
+    }
 AIO_LOCK;
 saved_deb_basetime = *sim_rtcn_get_debug_basetime ();
 
@@ -15585,6 +17149,1123 @@ if (buf != stackbuf)
 return stat | ((stat != SCPE_OK) ? SCPE_NOMESSAGE : 0);
 }
 
+/* Binary debug trace
+
+   SET DEBUG -C writes debug output as a binary trace rather than text.
+   sim_debug() calls then don't format anything.  Each thread which
+   produces debug output owns a lock free single producer/single consumer
+   ring of fixed size records which capture the simulated time, the wall
+   clock time, the PC, the device, the debug verb, the format string and
+   the raw argument values.  A writer thread merges the rings in sequence
+   number order into the debug file.  Every record starts with a NUL byte
+   so text which is written directly to sim_deb passes through the trace
+   unchanged.  The format is copied into the record, since callers may
+   build one on the fly and free it as soon as sim_debug() returns; a
+   format too long to leave room for its arguments is formatted as text
+   instead.  Strings (formats, device names and debug verbs) are defined
+   once in the file by their content and are referenced by id afterwards.
+
+   SHOW DEBUG DECODE renders a trace file as the text which the same debug
+   session would have produced.
+*/
+
+#define SIM_TRC_VERSION     1
+#define SIM_TRC_MAGIC       "SIMH-TRACE"
+#define SIM_TRC_BOM         ((((t_uint64)0x01020304) << 32) | 0x05060708)
+#define SIM_TRC_RECSIZE     512                     /* ring slot size */
+#define SIM_TRC_HDRLEN      72                      /* record header size */
+#define SIM_TRC_MAXARGS     24                      /* argument slots per record */
+#define SIM_TRC_ARGLEN      (SIM_TRC_MAXARGS * sizeof (t_uint64))
+#define SIM_TRC_STRLEN      (SIM_TRC_RECSIZE - SIM_TRC_HDRLEN - SIM_TRC_ARGLEN)
+#define SIM_TRC_FMTLEN      (SIM_TRC_STRLEN / 2)    /* longest format kept in a record */
+#define SIM_TRC_RINGSIZE    4096                    /* slots per ring (power of 2) */
+#define SIM_TRC_MAXRINGS    64                      /* producing threads */
+#define SIM_TRC_BUFSIZE     65536                   /* writer output buffer */
+#define SIM_TRC_WAKE_MS     10                      /* writer polling interval */
+
+#define SIM_TRC_HEADER      'H'                     /* trace header */
+#define SIM_TRC_STRING      'S'                     /* string definition */
+#define SIM_TRC_EVENT       'E'                     /* sim_debug() event */
+#define SIM_TRC_TEXT        'T'                     /* unformatted debug text */
+
+#define SIM_TRC_F_ASYNCH    0x01                    /* produced off the main thread */
+#define SIM_TRC_F_TRUNC     0x02                    /* arguments truncated */
+
+typedef struct SIM_TRC_REC {
+    uint8           sync;                           /* always 0 */
+    uint8           type;                           /* record type */
+    uint16          reclen;                         /* record length in file */
+    uint8           nargs;                          /* argument slots used */
+    uint8           flags;                          /* SIM_TRC_F_* */
+    uint16          slen;                           /* string bytes used */
+    t_uint64        seq;                            /* event sequence number */
+    double          gtime;                          /* simulated time */
+    t_int64         tv_sec;                         /* wall clock time */
+    t_int64         tv_nsec;
+    t_uint64        pc;                             /* PC value */
+    t_uint64        dev;                            /* device name (ring: pointer, file: id) */
+    t_uint64        verb;                           /* debug verb (ring: pointer, file: id) */
+    t_uint64        fmt;                            /* format (ring: offset of its copy, file: id) */
+    uint8           data[SIM_TRC_RECSIZE - SIM_TRC_HDRLEN]; /* arguments, then strings */
+    } SIM_TRC_REC;
+
+typedef struct SIM_TRC_RING {
+    SIM_TRC_REC     *rec;                           /* slots */
+#if defined (SIM_ASYNCH_IO)
+    pthread_t       owner;                          /* producing thread */
+#endif
+    volatile uint32 head;                           /* next slot to fill (producer) */
+    volatile uint32 tail;                           /* next slot to drain (consumer) */
+    uint32          stalls;                         /* producer waits on a full ring */
+    t_bool          pending;                        /* text slot at head being filled */
+    volatile t_bool active;                         /* owner thread still running */
+    } SIM_TRC_RING;
+
+typedef struct SIM_TRC_STR {
+    char            *str;                           /* string text */
+    uint32          hash;
+    t_uint64        id;                             /* id in the trace file */
+    } SIM_TRC_STR;
+
+/* printf conversion classes and argument sizes */
+
+#define SIM_TRC_A_END       0                       /* end of format */
+#define SIM_TRC_A_PCT       1                       /* %% */
+#define SIM_TRC_A_INT       2                       /* signed integer */
+#define SIM_TRC_A_UINT      3                       /* unsigned integer */
+#define SIM_TRC_A_CHAR      4                       /* %c */
+#define SIM_TRC_A_DBL       5                       /* floating point */
+#define SIM_TRC_A_STR       6                       /* %s */
+#define SIM_TRC_A_PTR       7                       /* %p */
+#define SIM_TRC_A_COUNT     8                       /* %n */
+#define SIM_TRC_A_BAD       9                       /* unsupported conversion */
+
+#define SIM_TRC_M_NONE      0                       /* int or double */
+#define SIM_TRC_M_LONG      1                       /* l */
+#define SIM_TRC_M_LLONG     2                       /* ll, q, j, I64 */
+#define SIM_TRC_M_SIZE      3                       /* z, t, I */
+#define SIM_TRC_M_LDOUBLE   4                       /* L */
+
+typedef struct SIM_TRC_SPEC {
+    size_t          lit;                            /* literal text before conversion */
+    const char      *body;                          /* flags, width and precision */
+    size_t          bodylen;
+    int             stars;                          /* * width/precision arguments */
+    int             cls;                            /* SIM_TRC_A_* */
+    int             mod;                            /* SIM_TRC_M_* */
+    char            conv;                           /* conversion character */
+    } SIM_TRC_SPEC;
+
+#if defined (_WIN32)
+#define SIM_TRC_BARRIER()   MemoryBarrier ()
+#define SIM_TRC_NEXT_SEQ()  ((t_uint64)InterlockedIncrement64 ((LONGLONG volatile *)&sim_trc_seq))
+#elif defined (__GNUC__)
+#define SIM_TRC_BARRIER()   __sync_synchronize ()
+#define SIM_TRC_NEXT_SEQ()  __sync_add_and_fetch (&sim_trc_seq, 1)
+#else
+#define SIM_TRC_BARRIER()
+#define SIM_TRC_NEXT_SEQ()  (++sim_trc_seq)
+#endif
+
+static SIM_TRC_RING sim_trc_ring[SIM_TRC_MAXRINGS];
+static volatile uint32 sim_trc_rings = 0;           /* rings in use */
+static volatile t_uint64 sim_trc_seq = 0;           /* last sequence number */
+static AIO_TLS SIM_TRC_RING *sim_trc_self = NULL;   /* this thread's ring */
+static SIM_TRC_STR *sim_trc_strtab = NULL;          /* written strings */
+static uint32 sim_trc_strtab_size = 0;
+static uint32 sim_trc_strtab_count = 0;
+static uint8 *sim_trc_buf = NULL;                   /* writer output buffer */
+static size_t sim_trc_buf_used = 0;
+static t_uint64 sim_trc_records = 0;                /* statistics */
+static t_uint64 sim_trc_bytes = 0;
+static volatile uint32 sim_trc_drops = 0;
+#if defined (SIM_ASYNCH_IO)
+static pthread_mutex_t sim_trc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_trc_wake = PTHREAD_COND_INITIALIZER;
+static pthread_t sim_trc_writer;
+static volatile t_bool sim_trc_writer_active = FALSE;
+static pthread_key_t sim_trc_key;                   /* ring release at thread exit */
+static t_bool sim_trc_key_valid = FALSE;
+#define SIM_TRC_LOCK        pthread_mutex_lock (&sim_trc_lock)
+#define SIM_TRC_UNLOCK      pthread_mutex_unlock (&sim_trc_lock)
+#else
+#define SIM_TRC_LOCK
+#define SIM_TRC_UNLOCK
+#endif
+
+/* Scan the next conversion of a printf format string */
+
+static const char *_sim_trc_spec (const char *fmt, SIM_TRC_SPEC *sp)
+{
+const char *cp = strchr (fmt, '%');
+
+memset (sp, 0, sizeof (*sp));
+if (cp == NULL) {
+    sp->lit = strlen (fmt);
+    sp->cls = SIM_TRC_A_END;
+    return fmt + sp->lit;
+    }
+sp->lit = (size_t)(cp - fmt);
+sp->body = ++cp;
+while ((*cp != '\0') && (strchr ("-+ #0'", *cp) != NULL))
+    ++cp;
+while (sim_isdigit (*cp) || (*cp == '.') || (*cp == '*')) {
+    if (*cp == '*')
+        ++sp->stars;
+    ++cp;
+    }
+sp->bodylen = (size_t)(cp - sp->body);
+switch (*cp) {
+    case 'h':
+        if (*++cp == 'h')
+            ++cp;
+        break;
+    case 'l':
+        sp->mod = SIM_TRC_M_LONG;
+        if (*++cp == 'l') {
+            sp->mod = SIM_TRC_M_LLONG;
+            ++cp;
+            }
+        break;
+    case 'q': case 'j':
+        sp->mod = SIM_TRC_M_LLONG;
+        ++cp;
+        break;
+    case 'L':
+        sp->mod = SIM_TRC_M_LDOUBLE;
+        ++cp;
+        break;
+    case 'z': case 't':
+        sp->mod = SIM_TRC_M_SIZE;
+        ++cp;
+        break;
+    case 'I':
+        ++cp;
+        if ((cp[0] == '6') && (cp[1] == '4')) {
+            sp->mod = SIM_TRC_M_LLONG;
+            cp += 2;
+            }
+        else {
+            if ((cp[0] == '3') && (cp[1] == '2'))
+                cp += 2;
+            else
+                sp->mod = SIM_TRC_M_SIZE;
+            }
+        break;
+    }
+sp->conv = *cp;
+switch (*cp) {
+    case '%':
+        sp->cls = SIM_TRC_A_PCT;
+        break;
+    case 'd': case 'i':
+        sp->cls = SIM_TRC_A_INT;
+        break;
+    case 'o': case 'u': case 'x': case 'X':
+        sp->cls = SIM_TRC_A_UINT;
+        break;
+    case 'c':
+        sp->cls = SIM_TRC_A_CHAR;
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        sp->cls = SIM_TRC_A_DBL;
+        break;
+    case 's':
+        sp->cls = SIM_TRC_A_STR;
+        break;
+    case 'p':
+        sp->cls = SIM_TRC_A_PTR;
+        break;
+    case 'n':
+        sp->cls = SIM_TRC_A_COUNT;
+        break;
+    default:
+        sp->cls = SIM_TRC_A_BAD;
+        return cp;
+    }
+if ((sp->mod == SIM_TRC_M_LDOUBLE) && (sp->cls != SIM_TRC_A_DBL))
+    sp->mod = SIM_TRC_M_LLONG;
+return cp + 1;
+}
+
+/* Capture the raw arguments of a sim_debug() call, keeping %s strings
+   within the first strmax bytes of the record's string space */
+
+static void _sim_trc_args (SIM_TRC_REC *rec, const char *fmt, size_t strmax, va_list arglist)
+{
+t_uint64 *arg = (t_uint64 *)rec->data;
+char *str = (char *)&rec->data[SIM_TRC_ARGLEN];
+size_t slen = 0;
+uint32 nargs = 0;
+SIM_TRC_SPEC spec;
+
+while (1) {
+    fmt = _sim_trc_spec (fmt, &spec);
+    if ((spec.cls == SIM_TRC_A_END) || (spec.cls == SIM_TRC_A_BAD))
+        break;
+    if (spec.cls == SIM_TRC_A_PCT)
+        continue;
+    if (nargs + spec.stars + 1 > SIM_TRC_MAXARGS) {
+        rec->flags |= SIM_TRC_F_TRUNC;
+        break;
+        }
+    while (spec.stars-- > 0)
+        arg[nargs++] = (t_uint64)(t_int64)va_arg (arglist, int);
+    switch (spec.cls) {
+        case SIM_TRC_A_INT:
+            switch (spec.mod) {
+                case SIM_TRC_M_LONG:
+                    arg[nargs++] = (t_uint64)(t_int64)va_arg (arglist, long);
+                    break;
+                case SIM_TRC_M_LLONG:
+                    arg[nargs++] = (t_uint64)va_arg (arglist, t_int64);
+                    break;
+                case SIM_TRC_M_SIZE:
+                    arg[nargs++] = (t_uint64)va_arg (arglist, size_t);
+                    break;
+                default:
+                    arg[nargs++] = (t_uint64)(t_int64)va_arg (arglist, int);
+                    break;
+                }
+            break;
+        case SIM_TRC_A_UINT:
+            switch (spec.mod) {
+                case SIM_TRC_M_LONG:
+                    arg[nargs++] = (t_uint64)va_arg (arglist, unsigned long);
+                    break;
+                case SIM_TRC_M_LLONG:
+                    arg[nargs++] = va_arg (arglist, t_uint64);
+                    break;
+                case SIM_TRC_M_SIZE:
+                    arg[nargs++] = (t_uint64)va_arg (arglist, size_t);
+                    break;
+                default:
+                    arg[nargs++] = (t_uint64)va_arg (arglist, unsigned int);
+                    break;
+                }
+            break;
+        case SIM_TRC_A_CHAR:
+            arg[nargs++] = (t_uint64)(t_int64)va_arg (arglist, int);
+            break;
+        case SIM_TRC_A_DBL: {
+            double d;
+
+            if (spec.mod == SIM_TRC_M_LDOUBLE)
+                d = (double)va_arg (arglist, long double);
+            else
+                d = va_arg (arglist, double);
+            memcpy (&arg[nargs++], &d, sizeof (d));
+            }
+            break;
+        case SIM_TRC_A_STR: {
+            const char *s = va_arg (arglist, const char *);
+            size_t n;
+
+            if (s == NULL)
+                s = "(null)";
+            n = strlen (s);
+            if (slen == strmax) {                   /* full?  reference the last terminator */
+                arg[nargs++] = slen - 1;
+                rec->flags |= SIM_TRC_F_TRUNC;
+                break;
+                }
+            if (slen + n + 1 > strmax) {
+                n = strmax - slen - 1;
+                rec->flags |= SIM_TRC_F_TRUNC;
+                }
+            memcpy (&str[slen], s, n);
+            str[slen + n] = '\0';
+            arg[nargs++] = slen;
+            slen += n + 1;
+            }
+            break;
+        case SIM_TRC_A_PTR:
+            arg[nargs++] = (t_uint64)(size_t)va_arg (arglist, void *);
+            break;
+        case SIM_TRC_A_COUNT:
+            (void)va_arg (arglist, int *);
+            arg[nargs++] = 0;
+            break;
+        }
+    }
+rec->nargs = (uint8)nargs;
+rec->slen = (uint16)slen;
+}
+
+/* Find (or register) the calling thread's ring.  Rings given up by
+   threads which have exited are reused once the writer has drained them. */
+
+static SIM_TRC_RING *_sim_trc_thread_ring (void)
+{
+SIM_TRC_RING *ring = sim_trc_self;
+uint32 i;
+
+#if defined (SIM_ASYNCH_IO)
+pthread_t self = pthread_self ();
+
+if ((ring != NULL) && ring->active && pthread_equal (ring->owner, self))
+    return ring;
+SIM_TRC_LOCK;
+for (i = 0; i < sim_trc_rings; i++)
+    if (sim_trc_ring[i].active && pthread_equal (sim_trc_ring[i].owner, self))
+        break;
+if (i >= sim_trc_rings) {                           /* new thread? */
+    for (i = 0; i < sim_trc_rings; i++)             /* look for a free ring */
+        if (!sim_trc_ring[i].active && (sim_trc_ring[i].head == sim_trc_ring[i].tail))
+            break;
+    }
+#else
+if (ring != NULL)
+    return ring;
+SIM_TRC_LOCK;
+i = 0;                                              /* one ring only */
+#endif
+if ((i < SIM_TRC_MAXRINGS) && ((i >= sim_trc_rings) || !sim_trc_ring[i].active)) {
+    ring = &sim_trc_ring[i];
+    if (ring->rec == NULL)
+        ring->rec = (SIM_TRC_REC *)calloc (SIM_TRC_RINGSIZE, sizeof (*ring->rec));
+    if (ring->rec != NULL) {
+#if defined (SIM_ASYNCH_IO)
+        ring->owner = self;
+        if (sim_trc_key_valid)
+            pthread_setspecific (sim_trc_key, ring);
+#endif
+        if (i >= sim_trc_rings)
+            ring->stalls = 0;
+        ring->head = ring->tail = 0;
+        ring->pending = FALSE;
+        ring->active = TRUE;
+        SIM_TRC_BARRIER ();
+        if (i >= sim_trc_rings)
+            sim_trc_rings = i + 1;
+        }
+    }
+ring = ((i < sim_trc_rings) && sim_trc_ring[i].active) ? &sim_trc_ring[i] : NULL;
+SIM_TRC_UNLOCK;
+sim_trc_self = ring;
+return ring;
+}
+
+static void _sim_trc_publish (SIM_TRC_RING *ring);
+
+#if defined (SIM_ASYNCH_IO)
+/* Thread exit: hand the ring back, the writer drains what is left in it */
+
+static void _sim_trc_thread_exit (void *arg)
+{
+SIM_TRC_RING *ring = (SIM_TRC_RING *)arg;
+
+SIM_TRC_LOCK;
+if (ring->pending)                                  /* complete partial text */
+    _sim_trc_publish (ring);
+ring->active = FALSE;
+SIM_TRC_UNLOCK;
+}
+#endif
+
+/* Release the slots of rings whose threads have exited */
+
+static void _sim_trc_free_rings (void)
+{
+uint32 i;
+
+for (i = 0; i < sim_trc_rings; i++) {
+    SIM_TRC_RING *ring = &sim_trc_ring[i];
+
+    if (ring->active || (ring->head != ring->tail))
+        continue;
+    free (ring->rec);
+    ring->rec = NULL;
+    }
+while ((sim_trc_rings > 0) && (sim_trc_ring[sim_trc_rings - 1].rec == NULL))
+    --sim_trc_rings;
+}
+
+/* Writer side: buffered output of records to the debug file */
+
+static void _sim_trc_out (const void *buf, size_t len)
+{
+sim_trc_bytes += len;
+while (len > 0) {
+    size_t move_size = MIN (len, SIM_TRC_BUFSIZE - sim_trc_buf_used);
+
+    memcpy (sim_trc_buf + sim_trc_buf_used, buf, move_size);
+    sim_trc_buf_used += move_size;
+    buf = (const uint8 *)buf + move_size;
+    len -= move_size;
+    if (sim_trc_buf_used == SIM_TRC_BUFSIZE) {
+        _debug_fwrite_all ((const char *)sim_trc_buf, sim_trc_buf_used, sim_deb);
+        sim_trc_buf_used = 0;
+        }
+    }
+}
+
+static void _sim_trc_out_flush (void)
+{
+if (sim_trc_buf_used > 0)
+    _debug_fwrite_all ((const char *)sim_trc_buf, sim_trc_buf_used, sim_deb);
+sim_trc_buf_used = 0;
+}
+
+static void _sim_trc_out_string (t_uint64 id, const char *str)
+{
+SIM_TRC_REC hdr;
+size_t len = strlen (str) + 1;
+
+if (len > 0xFFFF - SIM_TRC_HDRLEN)
+    len = 0xFFFF - SIM_TRC_HDRLEN;
+memset (&hdr, 0, SIM_TRC_HDRLEN);
+hdr.type = SIM_TRC_STRING;
+hdr.reclen = (uint16)(SIM_TRC_HDRLEN + len);
+hdr.slen = (uint16)len;
+hdr.fmt = id;
+_sim_trc_out (&hdr, SIM_TRC_HDRLEN);
+_sim_trc_out (str, len - 1);
+_sim_trc_out ("", 1);
+}
+
+/* Map a string to its id, defining it in the file when its text is
+   first seen.  Strings are matched by content, since the same address
+   may hold different text over the course of a trace. */
+
+static t_uint64 _sim_trc_strid (const char *str)
+{
+uint32 h, hash = 2166136261u;                       /* FNV-1a */
+const char *cp;
+
+if (str == NULL)
+    return 0;
+for (cp = str; *cp != '\0'; cp++)
+    hash = (hash ^ (uint8)*cp) * 16777619u;
+if (2 * (sim_trc_strtab_count + 1) > sim_trc_strtab_size) {
+    SIM_TRC_STR *oldtab = sim_trc_strtab;
+    uint32 i, oldsize = sim_trc_strtab_size;
+
+    sim_trc_strtab_size = MAX (256, 2 * oldsize);
+    sim_trc_strtab = (SIM_TRC_STR *)calloc (sim_trc_strtab_size, sizeof (*sim_trc_strtab));
+    for (i = 0; i < oldsize; i++) {
+        if (oldtab[i].str == NULL)
+            continue;
+        h = oldtab[i].hash & (sim_trc_strtab_size - 1);
+        while (sim_trc_strtab[h].str != NULL)
+            h = (h + 1) & (sim_trc_strtab_size - 1);
+        sim_trc_strtab[h] = oldtab[i];
+        }
+    free (oldtab);
+    }
+h = hash & (sim_trc_strtab_size - 1);
+while (sim_trc_strtab[h].str != NULL) {
+    if ((sim_trc_strtab[h].hash == hash) && (strcmp (sim_trc_strtab[h].str, str) == 0))
+        return sim_trc_strtab[h].id;
+    h = (h + 1) & (sim_trc_strtab_size - 1);
+    }
+sim_trc_strtab[h].str = strdup (str);
+sim_trc_strtab[h].hash = hash;
+sim_trc_strtab[h].id = ++sim_trc_strtab_count;
+_sim_trc_out_string (sim_trc_strtab[h].id, str);
+return sim_trc_strtab[h].id;
+}
+
+static void _sim_trc_free_strtab (void)
+{
+uint32 i;
+
+for (i = 0; i < sim_trc_strtab_size; i++)
+    free (sim_trc_strtab[i].str);
+free (sim_trc_strtab);
+sim_trc_strtab = NULL;
+sim_trc_strtab_size = sim_trc_strtab_count = 0;
+}
+
+static void _sim_trc_out_rec (const SIM_TRC_REC *rec)
+{
+SIM_TRC_REC hdr;
+size_t arglen = rec->nargs * sizeof (t_uint64);
+
+memcpy (&hdr, rec, SIM_TRC_HDRLEN);
+hdr.dev = _sim_trc_strid ((const char *)(size_t)rec->dev);
+hdr.verb = _sim_trc_strid ((const char *)(size_t)rec->verb);
+hdr.fmt = _sim_trc_strid ((const char *)&rec->data[SIM_TRC_ARGLEN + (size_t)rec->fmt]);
+hdr.reclen = (uint16)(SIM_TRC_HDRLEN + arglen + rec->slen);
+_sim_trc_out (&hdr, SIM_TRC_HDRLEN);
+_sim_trc_out (rec->data, arglen);
+_sim_trc_out (&rec->data[SIM_TRC_ARGLEN], rec->slen);
+++sim_trc_records;
+}
+
+/* Drain all rings in sequence order (caller holds sim_trc_lock) */
+
+static void _sim_trc_drain (void)
+{
+uint32 i;
+
+if ((sim_deb == NULL) || (sim_trc_buf == NULL))
+    return;
+while (1) {
+    SIM_TRC_RING *next = NULL;
+    SIM_TRC_REC *first = NULL;
+
+    for (i = 0; i < sim_trc_rings; i++) {
+        SIM_TRC_RING *ring = &sim_trc_ring[i];
+        SIM_TRC_REC *rec;
+
+        if (ring->head == ring->tail)
+            continue;
+        SIM_TRC_BARRIER ();                         /* read slot after head */
+        rec = &ring->rec[ring->tail & (SIM_TRC_RINGSIZE - 1)];
+        if ((first == NULL) || (rec->seq < first->seq)) {
+            first = rec;
+            next = ring;
+            }
+        }
+    if (first == NULL)
+        break;
+    _sim_trc_out_rec (first);
+    SIM_TRC_BARRIER ();                             /* done with slot before release */
+    next->tail = next->tail + 1;
+    }
+_sim_trc_out_flush ();
+}
+
+/* Producer side: make a filled slot visible to the writer */
+
+static void _sim_trc_publish (SIM_TRC_RING *ring)
+{
+ring->pending = FALSE;
+SIM_TRC_BARRIER ();                                 /* slot contents before head */
+ring->head = ring->head + 1;
+#if defined (SIM_ASYNCH_IO)
+if (((uint32)(ring->head - ring->tail) == (SIM_TRC_RINGSIZE / 2)) && sim_trc_writer_active)
+    pthread_cond_signal (&sim_trc_wake);
+#endif
+}
+
+/* Producer side: reserve the next slot of this thread's ring */
+
+static SIM_TRC_REC *_sim_trc_slot (SIM_TRC_RING **pring, uint8 type)
+{
+SIM_TRC_RING *ring = _sim_trc_thread_ring ();
+SIM_TRC_REC *rec;
+
+if (ring == NULL) {                                 /* too many threads */
+    ++sim_trc_drops;
+    return NULL;
+    }
+if (ring->pending)                                  /* finish partial text first */
+    _sim_trc_publish (ring);
+while ((uint32)(ring->head - ring->tail) >= SIM_TRC_RINGSIZE) {
+    ++ring->stalls;
+#if defined (SIM_ASYNCH_IO)
+    if (sim_trc_writer_active) {
+        pthread_cond_signal (&sim_trc_wake);
+        sim_os_ms_sleep (1);
+        continue;
+        }
+#endif
+    SIM_TRC_LOCK;
+    _sim_trc_drain ();
+    SIM_TRC_UNLOCK;
+    if ((uint32)(ring->head - ring->tail) >= SIM_TRC_RINGSIZE) {
+        ++sim_trc_drops;                            /* no place to drain to */
+        return NULL;
+        }
+    }
+rec = &ring->rec[ring->head & (SIM_TRC_RINGSIZE - 1)];
+memset (rec, 0, SIM_TRC_HDRLEN);
+rec->type = type;
+rec->flags = AIO_MAIN_THREAD ? 0 : SIM_TRC_F_ASYNCH;
+rec->seq = SIM_TRC_NEXT_SEQ ();
+*pring = ring;
+return rec;
+}
+
+/* Record a sim_debug() event.  Returns FALSE, without having touched
+   the arguments, if the format is too long to be kept in a record. */
+
+static t_bool _sim_trc_event (uint32 dbits, DEVICE *dptr, UNIT *uptr, const char *fmt, va_list arglist)
+{
+SIM_TRC_RING *ring;
+SIM_TRC_REC *rec;
+size_t fmtlen = strlen (fmt);
+
+if (fmtlen > SIM_TRC_FMTLEN)
+    return FALSE;
+rec = _sim_trc_slot (&ring, SIM_TRC_EVENT);
+if (rec == NULL)
+    return TRUE;
+rec->gtime = sim_gtime ();
+if (sim_deb_switches & (SWMASK ('T') | SWMASK ('R') | SWMASK ('A'))) {
+    struct timespec time_now;
+
+    sim_rtcn_debug_time (&time_now);
+    rec->tv_sec = (t_int64)time_now.tv_sec;
+    rec->tv_nsec = (t_int64)time_now.tv_nsec;
+    }
+if (sim_deb_switches & SWMASK ('P'))
+    rec->pc = (t_uint64)(sim_vm_pc_value ? (*sim_vm_pc_value)() : get_rval (sim_PC, 0));
+rec->dev = (t_uint64)(size_t)dptr->name;
+rec->verb = (t_uint64)(size_t)_get_dbg_verb (dbits, dptr, uptr);
+rec->fmt = SIM_TRC_STRLEN - (fmtlen + 1);           /* format copy ends the string space */
+memcpy (&rec->data[SIM_TRC_ARGLEN + (size_t)rec->fmt], fmt, fmtlen + 1);
+_sim_trc_args (rec, fmt, (size_t)rec->fmt, arglist);
+_sim_trc_publish (ring);
+if (fmtlen != 0)                                    /* track line state for sim_debug_bits */
+    debug_unterm = (fmt[fmtlen - 1] != '\n');
+return TRUE;
+}
+
+/* Text is accumulated in an unpublished slot until a line is complete */
+
+static void _sim_trc_text (const char *buf, size_t len)
+{
+while (len > 0) {
+    SIM_TRC_RING *ring = _sim_trc_thread_ring ();
+    SIM_TRC_REC *rec;
+    size_t move_size;
+
+    if ((ring != NULL) && ring->pending)            /* continue partial line? */
+        rec = &ring->rec[ring->head & (SIM_TRC_RINGSIZE - 1)];
+    else {
+        rec = _sim_trc_slot (&ring, SIM_TRC_TEXT);
+        if (rec == NULL)
+            return;
+        rec->gtime = sim_gtime ();
+        ring->pending = TRUE;
+        }
+    move_size = MIN (len, SIM_TRC_STRLEN - rec->slen);
+    memcpy (&rec->data[SIM_TRC_ARGLEN + rec->slen], buf, move_size);
+    rec->slen = (uint16)(rec->slen + move_size);
+    buf += move_size;
+    len -= move_size;
+    if ((rec->slen == SIM_TRC_STRLEN) || (buf[-1] == '\n'))
+        _sim_trc_publish (ring);
+    }
+}
+
+#if defined (SIM_ASYNCH_IO)
+static void *_sim_trc_writer_thread (void *arg)
+{
+struct timespec due;
+
+SIM_TRC_LOCK;
+while (sim_trc_writer_active) {
+    _sim_trc_drain ();
+    clock_gettime (CLOCK_REALTIME, &due);
+    due.tv_nsec += SIM_TRC_WAKE_MS * 1000000;
+    if (due.tv_nsec >= 1000000000) {
+        due.tv_sec += due.tv_nsec / 1000000000;
+        due.tv_nsec = due.tv_nsec % 1000000000;
+        }
+    pthread_cond_timedwait (&sim_trc_wake, &sim_trc_lock, &due);
+    }
+SIM_TRC_UNLOCK;
+return NULL;
+}
+#endif
+
+/* Start a binary trace on the (already open) debug file */
+
+t_stat sim_debug_trace_open (void)
+{
+SIM_TRC_REC hdr;
+t_uint64 arg[8];
+const struct timespec *basetime = sim_rtcn_get_debug_basetime ();
+const char *pcname = sim_PC ? sim_PC->name : "";
+uint32 i;
+#if defined (SIM_ASYNCH_IO)
+pthread_attr_t attr;
+#endif
+
+if (sim_deb == NULL)
+    return SCPE_IERR;
+SIM_TRC_LOCK;
+#if defined (SIM_ASYNCH_IO)
+if (!sim_trc_key_valid)
+    sim_trc_key_valid = (0 == pthread_key_create (&sim_trc_key, _sim_trc_thread_exit));
+#endif
+if (sim_trc_buf == NULL)
+    sim_trc_buf = (uint8 *)malloc (SIM_TRC_BUFSIZE);
+if (sim_trc_buf == NULL) {
+    SIM_TRC_UNLOCK;
+    return SCPE_MEM;
+    }
+for (i = 0; i < sim_trc_rings; i++) {               /* discard anything stale */
+    sim_trc_ring[i].tail = sim_trc_ring[i].head;
+    sim_trc_ring[i].stalls = 0;
+    }
+_sim_trc_free_strtab ();
+sim_trc_buf_used = 0;
+sim_trc_records = sim_trc_bytes = 0;
+sim_trc_drops = 0;
+arg[0] = SIM_TRC_BOM;
+arg[1] = SIM_TRC_VERSION;
+arg[2] = (t_uint64)sim_deb_switches;
+arg[3] = (t_uint64)basetime->tv_sec;
+arg[4] = (t_uint64)basetime->tv_nsec;
+arg[5] = sim_PC ? sim_PC->radix : 16;
+arg[6] = sim_PC ? sim_PC->width : 32;
+arg[7] = sim_PC ? (sim_PC->flags & REG_FMT) : 0;
+memset (&hdr, 0, SIM_TRC_HDRLEN);
+hdr.type = SIM_TRC_HEADER;
+hdr.nargs = 8;
+hdr.slen = (uint16)(strlen (SIM_TRC_MAGIC) + strlen (sim_name) + strlen (pcname) + 3);
+hdr.reclen = (uint16)(SIM_TRC_HDRLEN + sizeof (arg) + hdr.slen);
+_sim_trc_out (&hdr, SIM_TRC_HDRLEN);
+_sim_trc_out (arg, sizeof (arg));
+_sim_trc_out (SIM_TRC_MAGIC, strlen (SIM_TRC_MAGIC) + 1);
+_sim_trc_out (sim_name, strlen (sim_name) + 1);
+_sim_trc_out (pcname, strlen (pcname) + 1);
+_sim_trc_out_flush ();
+sim_trc_records = 0;
+SIM_TRC_UNLOCK;
+sim_deb_trace = TRUE;
+#if defined (SIM_ASYNCH_IO)
+sim_trc_writer_active = TRUE;
+pthread_attr_init (&attr);
+pthread_attr_setscope (&attr, PTHREAD_SCOPE_SYSTEM);
+if (pthread_create (&sim_trc_writer, &attr, _sim_trc_writer_thread, NULL))
+    sim_trc_writer_active = FALSE;                  /* drain synchronously */
+pthread_attr_destroy (&attr);
+#endif
+return SCPE_OK;
+}
+
+/* Write out everything recorded so far */
+
+static void _sim_trc_flush (void)
+{
+SIM_TRC_RING *ring = _sim_trc_thread_ring ();
+
+if ((ring != NULL) && ring->pending)                /* finish our partial text */
+    _sim_trc_publish (ring);
+SIM_TRC_LOCK;
+_sim_trc_drain ();
+SIM_TRC_UNLOCK;
+fflush (sim_deb);
+}
+
+/* Stop a binary trace, leaving the debug file open */
+
+void sim_debug_trace_close (void)
+{
+if (!sim_deb_trace)
+    return;
+sim_deb_trace = FALSE;
+#if defined (SIM_ASYNCH_IO)
+if (sim_trc_writer_active) {
+    SIM_TRC_LOCK;
+    sim_trc_writer_active = FALSE;
+    pthread_cond_signal (&sim_trc_wake);
+    SIM_TRC_UNLOCK;
+    pthread_join (sim_trc_writer, NULL);
+    }
+#endif
+_sim_trc_flush ();
+SIM_TRC_LOCK;
+_sim_trc_free_rings ();
+SIM_TRC_UNLOCK;
+_sim_trc_free_strtab ();
+}
+
+void sim_debug_trace_show (FILE *st)
+{
+uint32 i, stalls = 0;
+
+if (!sim_deb_trace)
+    return;
+for (i = 0; i < sim_trc_rings; i++)
+    stalls += sim_trc_ring[i].stalls;
+fprintf (st, "   Debug output is a binary trace (use SHOW DEBUG DECODE to view it)\n");
+fprintf (st, "      %" LL_FMT "u records, %" LL_FMT "u bytes, %u strings written\n",
+             (unsigned LL_TYPE)sim_trc_records, (unsigned LL_TYPE)sim_trc_bytes, sim_trc_strtab_count);
+fprintf (st, "      %u producing thread%s, %u full ring wait%s, %u dropped\n",
+             sim_trc_rings, (sim_trc_rings != 1) ? "s" : "", stalls, (stalls != 1) ? "s" : "", sim_trc_drops);
+}
+
+/* Trace decoder */
+
+static void _sim_trc_append (char **buf, size_t *size, size_t *len, const char *str, size_t n)
+{
+if (*len + n + 1 > *size) {
+    *size = MAX (2 * *size, *len + n + 256);
+    *buf = (char *)realloc (*buf, *size);
+    }
+memcpy (*buf + *len, str, n);
+*len += n;
+(*buf)[*len] = '\0';
+}
+
+/* Render an event's format with its recorded arguments */
+
+static void _sim_trc_render (char **buf, size_t *size, size_t *len, const char *fmt,
+                             const uint8 *data, uint32 nargs, size_t slen)
+{
+const char *strs = (const char *)data + nargs * sizeof (t_uint64);
+uint32 argn = 0;
+SIM_TRC_SPEC spec;
+
+*len = 0;
+_sim_trc_append (buf, size, len, "", 0);
+while (1) {
+    const char *next = _sim_trc_spec (fmt, &spec);
+    char cspec[64], piece[1024];
+    size_t clen = 1;
+    t_uint64 v;
+    size_t i;
+
+    _sim_trc_append (buf, size, len, fmt, spec.lit);
+    if (spec.cls == SIM_TRC_A_END)
+        break;
+    if (spec.cls == SIM_TRC_A_PCT) {
+        _sim_trc_append (buf, size, len, "%", 1);
+        fmt = next;
+        continue;
+        }
+    if ((spec.cls == SIM_TRC_A_BAD) ||              /* unsupported or */
+        (argn + spec.stars + 1 > nargs) ||          /* truncated arguments? */
+        (spec.bodylen + 16 * spec.stars + 8 > sizeof (cspec))) {
+        _sim_trc_append (buf, size, len, fmt + spec.lit, strlen (fmt + spec.lit));
+        break;
+        }
+    cspec[0] = '%';
+    for (i = 0; i < spec.bodylen; i++) {
+        if (spec.body[i] == '*') {
+            memcpy (&v, data + sizeof (v) * argn++, sizeof (v));
+            clen += sprintf (&cspec[clen], "%d", (int)(t_int64)v);
+            }
+        else
+            cspec[clen++] = spec.body[i];
+        }
+    cspec[clen] = '\0';
+    memcpy (&v, data + sizeof (v) * argn++, sizeof (v));
+    piece[0] = '\0';
+    switch (spec.cls) {
+        case SIM_TRC_A_INT:
+        case SIM_TRC_A_UINT:
+            sprintf (&cspec[clen], "%s%c", LL_FMT, spec.conv);
+            if (spec.cls == SIM_TRC_A_INT)
+                snprintf (piece, sizeof (piece), cspec, (LL_TYPE)(t_int64)v);
+            else
+                snprintf (piece, sizeof (piece), cspec, (unsigned LL_TYPE)v);
+            break;
+        case SIM_TRC_A_CHAR:
+            sprintf (&cspec[clen], "%c", spec.conv);
+            snprintf (piece, sizeof (piece), cspec, (int)(t_int64)v);
+            break;
+        case SIM_TRC_A_DBL: {
+            double d;
+
+            memcpy (&d, &v, sizeof (d));
+            sprintf (&cspec[clen], "%c", spec.conv);
+            snprintf (piece, sizeof (piece), cspec, d);
+            }
+            break;
+        case SIM_TRC_A_STR:
+            sprintf (&cspec[clen], "%c", spec.conv);
+            snprintf (piece, sizeof (piece), cspec, (v < slen) ? strs + (size_t)v : "");
+            break;
+        case SIM_TRC_A_PTR:
+            sprintf (&cspec[clen], "%c", spec.conv);
+            snprintf (piece, sizeof (piece), cspec, (void *)(size_t)v);
+            break;
+        }
+    _sim_trc_append (buf, size, len, piece, strlen (piece));
+    fmt = next;
+    }
+}
+
+/* Decode a binary debug trace file into the equivalent text debug output
+
+   SHOW DEBUG DECODE tracefile {textfile}
+*/
+
+t_stat sim_debug_trace_decode (FILE *st, CONST char *cptr)
+{
+char gbuf[CBUFSIZE], obuf[CBUFSIZE];
+FILE *f, *out = st;
+uint8 *data = NULL;
+char **strs = NULL;
+size_t nstrs = 0;
+char *msg = NULL;
+size_t msgsize = 0, msglen;
+t_uint64 hdrarg[8];
+char pcname[CBUFSIZE] = "";
+t_bool have_header = FALSE, unterm = FALSE;
+t_uint64 events = 0;
+t_offset offset = 0;
+const char *eol;
+t_stat r = SCPE_OK;
+int c;
+size_t i;
+
+cptr = get_glyph_quoted (cptr, gbuf, 0);
+if (gbuf[0] == '\0')
+    return SCPE_2FARG;
+obuf[0] = '\0';
+if (*cptr != 0) {
+    cptr = get_glyph_quoted (cptr, obuf, 0);
+    if (*cptr != 0)
+        return SCPE_2MARG;
+    }
+f = sim_fopen (gbuf, "rb");
+if (f == NULL)
+    return sim_messagef (SCPE_OPENERR, "Can't open trace file: %s - %s\n", gbuf, strerror (errno));
+if (obuf[0] != '\0') {
+    out = sim_fopen (obuf, "wb");
+    if (out == NULL) {
+        fclose (f);
+        return sim_messagef (SCPE_OPENERR, "Can't create decoded file: %s - %s\n", obuf, strerror (errno));
+        }
+    }
+eol = (out == st) ? "\n" : "\r\n";
+memset (hdrarg, 0, sizeof (hdrarg));
+data = (uint8 *)malloc (0x10000);
+while ((r == SCPE_OK) && ((c = fgetc (f)) != EOF)) {
+    SIM_TRC_REC rec;
+    size_t datalen;
+    const uint8 *sp;
+
+    if (c != 0) {                                   /* text written directly to the debug file */
+        fputc (c, out);
+        ++offset;
+        continue;
+        }
+    rec.sync = 0;
+    if ((fread (((uint8 *)&rec) + 1, 1, SIM_TRC_HDRLEN - 1, f) != SIM_TRC_HDRLEN - 1) ||
+        (rec.reclen < SIM_TRC_HDRLEN) ||
+        (fread (data, 1, rec.reclen - SIM_TRC_HDRLEN, f) != (size_t)(rec.reclen - SIM_TRC_HDRLEN))) {
+        r = sim_messagef (SCPE_FMT, "Truncated trace record at offset %" LL_FMT "u\n", (unsigned LL_TYPE)offset);
+        break;
+        }
+    datalen = rec.reclen - SIM_TRC_HDRLEN;
+    if ((rec.nargs * sizeof (t_uint64) + rec.slen != datalen) ||
+        ((!have_header) && (rec.type != SIM_TRC_HEADER))) {
+        r = sim_messagef (SCPE_FMT, "Invalid trace record at offset %" LL_FMT "u\n", (unsigned LL_TYPE)offset);
+        break;
+        }
+    sp = data + rec.nargs * sizeof (t_uint64);
+    if ((rec.slen > 0) && (rec.type != SIM_TRC_TEXT))
+        data[datalen - 1] = '\0';                   /* make sure strings are terminated */
+    switch (rec.type) {
+        case SIM_TRC_HEADER:
+            memcpy (hdrarg, data, MIN (sizeof (hdrarg), rec.nargs * sizeof (t_uint64)));
+            if ((rec.nargs < 8) || (rec.slen == 0) || (strcmp ((const char *)sp, SIM_TRC_MAGIC) != 0)) {
+                r = sim_messagef (SCPE_FMT, "%s is not a debug trace file\n", gbuf);
+                break;
+                }
+            if (hdrarg[0] != SIM_TRC_BOM) {
+                r = sim_messagef (SCPE_FMT, "%s was written on a host with a different byte order\n", gbuf);
+                break;
+                }
+            if (hdrarg[1] != SIM_TRC_VERSION) {
+                r = sim_messagef (SCPE_FMT, "%s is trace version %u, expected %u\n", gbuf, (uint32)hdrarg[1], SIM_TRC_VERSION);
+                break;
+                }
+            sp += strlen ((const char *)sp) + 1;        /* skip magic */
+            if (sp < data + datalen)
+                sp += strlen ((const char *)sp) + 1;    /* skip simulator name */
+            if (sp < data + datalen)
+                strlcpy (pcname, (const char *)sp, sizeof (pcname));
+            for (i = 0; i < nstrs; i++)                 /* a new trace starts a new string space */
+                free (strs[i]);
+            nstrs = 0;
+            have_header = TRUE;
+            unterm = FALSE;
+            break;
+        case SIM_TRC_STRING:
+            if ((rec.fmt == 0) || (rec.fmt > nstrs + 1)) {
+                r = sim_messagef (SCPE_FMT, "Out of order string id %u at offset %" LL_FMT "u\n", (uint32)rec.fmt, (unsigned LL_TYPE)offset);
+                break;
+                }
+            if (rec.fmt == nstrs + 1) {
+                strs = (char **)realloc (strs, (nstrs + 1) * sizeof (*strs));
+                strs[nstrs++] = strdup ((const char *)sp);
+                }
+            break;
+        case SIM_TRC_TEXT:
+            fwrite (sp, 1, rec.slen, out);
+            if ((rec.slen > 0) && (sp[rec.slen - 1] == '\n'))
+                unterm = FALSE;
+            break;
+        case SIM_TRC_EVENT: {
+            const char *fmt = ((rec.fmt > 0) && (rec.fmt <= nstrs)) ? strs[rec.fmt - 1] : "";
+            const char *dev = ((rec.dev > 0) && (rec.dev <= nstrs)) ? strs[rec.dev - 1] : "";
+            const char *verb = ((rec.verb > 0) && (rec.verb <= nstrs)) ? strs[rec.verb - 1] : "";
+            int32 switches = (int32)hdrarg[2];
+            char prefix[256 + MAX_WIDTH + 33];
+            char tim_t[32] = "";
+            char pc_s[MAX_WIDTH + 33] = "";
+            size_t j;
+
+            if (switches & (SWMASK ('T') | SWMASK ('R') | SWMASK ('A'))) {
+                struct timespec time_now, basetime;
+
+                time_now.tv_sec = (time_t)rec.tv_sec;
+                time_now.tv_nsec = (long)rec.tv_nsec;
+                basetime.tv_sec = (time_t)hdrarg[3];
+                basetime.tv_nsec = (long)hdrarg[4];
+                if (switches & SWMASK ('R'))
+                    sim_timespec_diff (&time_now, &time_now, &basetime);
+                if (switches & SWMASK ('T')) {
+                    time_t tnow = (time_t)time_now.tv_sec;
+                    struct tm *now = localtime (&tnow);
+
+                    sprintf (tim_t, "%02d:%02d:%02d.%03d ", now->tm_hour, now->tm_min, now->tm_sec, (int)(time_now.tv_nsec/1000000));
+                    }
+                if (switches & SWMASK ('A'))
+                    sprintf (tim_t, "%" LL_FMT "d.%03d ", (LL_TYPE)(time_now.tv_sec), (int)(time_now.tv_nsec/1000000));
+                }
+            if (switches & SWMASK ('P')) {
+                sprintf (pc_s, "-%s:", pcname);
+                sprint_val (&pc_s[strlen (pc_s)], (t_value)rec.pc, (uint32)hdrarg[5], (uint32)hdrarg[6], (uint32)hdrarg[7]);
+                }
+            snprintf (prefix, sizeof (prefix), "DBG(%s%.0f%s)%s> %s %s: ", tim_t, rec.gtime, pc_s,
+                      (rec.flags & SIM_TRC_F_ASYNCH) ? "+" : "", dev, verb);
+            _sim_trc_render (&msg, &msgsize, &msglen, fmt, data, rec.nargs, rec.slen);
+            for (i = j = 0; i < msglen; ++i) {      /* same line handling as _sim_vdebug */
+                if (msg[i] == '\n') {
+                    if ((i != j) || (i == 0)) {
+                        if (!unterm)
+                            fputs (prefix, out);
+                        fwrite (&msg[j], 1, i - j, out);
+                        fputs (eol, out);
+                        }
+                    unterm = FALSE;
+                    j = i + 1;
+                    }
+                }
+            if (i > j) {
+                if (!unterm)
+                    fputs (prefix, out);
+                fwrite (&msg[j], 1, i - j, out);
+                }
+            if (msglen > 0)
+                unterm = (msg[msglen - 1] != '\n');
+            ++events;
+            }
+            break;
+        default:
+            r = sim_messagef (SCPE_FMT, "Unknown trace record type %d at offset %" LL_FMT "u\n", rec.type, (unsigned LL_TYPE)offset);
+            break;
+        }
+    offset += rec.reclen;
+    }
+if (unterm)
+    fputs (eol, out);
+fclose (f);
+if (out != st) {
+    fclose (out);
+    if (r == SCPE_OK)
+        sim_messagef (SCPE_OK, "%" LL_FMT "u debug events decoded to %s\n", (unsigned LL_TYPE)events, obuf);
+    }
+for (i = 0; i < nstrs; i++)
+    free (strs[i]);
+free (strs);
+free (msg);
+free (data);
+return r;
+}
+
 /* Inline debugging - will print debug message if debug file is
    set and the bitmask matches the current device debug options.
    Extra returns are added for un*x systems, since the output
@@ -15595,6 +18276,9 @@ return stat | ((stat != SCPE_OK) ? SCPE_NOMESSAGE : 0);
    incurring call overhead. */
 void _sim_vdebug (uint32 dbits, DEVICE* dptr, UNIT *uptr, const char* fmt, va_list arglist)
 {
+if (sim_deb_trace && sim_deb && dptr && ((dptr->dctrl | (uptr ? uptr->dctrl : 0)) & dbits) &&
+    _sim_trc_event (dbits, dptr, uptr, fmt, arglist))   /* record rather than format */
+    return;
 if (sim_deb && dptr && ((dptr->dctrl | (uptr ? uptr->dctrl : 0)) & dbits)) {
     TMLN *saved_oline = sim_oline;
     char stackbuf[STACKBUFSIZE];
@@ -18299,6 +20983,574 @@ sim_set_deb_switches (start_deb_switches);
 return r;
 }
 
+/*
+ * Event queue engine tests.  Both engines are driven through the same
+ * pseudo random sequence of activations, cancellations and dispatches
+ * and must fire the same units at the same times.  The benchmark then
+ * times each engine with 10, 100 and 1000 pending units.
+ */
+
+#define EVQ_TEST_UNITS      1000
+#define EVQ_TEST_LOGSIZE    20000
+
+static UNIT *evq_test_units;
+static uint32 evq_test_seed;
+static t_bool evq_test_rearm;
+static uint32 *evq_test_log;
+static uint32 evq_test_logged;
+
+static uint32 evq_test_random (void)
+{
+evq_test_seed = evq_test_seed * 1103515245 + 12345;
+return (evq_test_seed >> 8);
+}
+
+static t_stat evq_test_svc (UNIT *uptr)
+{
+if (evq_test_log && (evq_test_logged < EVQ_TEST_LOGSIZE)) {
+    evq_test_log[evq_test_logged++] = (uint32)(uptr - evq_test_units);
+    evq_test_log[evq_test_logged++] = (uint32)sim_gtime ();
+    }
+if (evq_test_rearm)
+    sim_activate (uptr, 1 + (evq_test_random () % (uptr->u3 * 10)));
+return SCPE_OK;
+}
+
+static void evq_test_reset (uint32 units)
+{
+uint32 i;
+
+while (sim_clock_queue != QUEUE_LIST_END)
+    sim_cancel (sim_clock_queue);
+sim_reset_time ();
+evq_test_seed = 1;
+evq_test_logged = 0;
+for (i = 0; i < units; i++) {
+    evq_test_units[i].action = &evq_test_svc;
+    evq_test_units[i].u3 = (int32)units;
+    }
+}
+
+static t_stat evq_test_run (t_bool indexed, uint32 *log)
+{
+uint32 i, u;
+t_stat r = SCPE_OK;
+
+sim_evq_indexed = indexed;
+_sim_evq_rebuild ();
+evq_test_reset (100);
+evq_test_log = log;
+evq_test_rearm = FALSE;
+for (i = 0; (i < 50000) && (evq_test_logged < EVQ_TEST_LOGSIZE) && (r == SCPE_OK); i++) {
+    u = evq_test_random () % 100;
+    switch (evq_test_random () % 8) {
+        case 0:
+            sim_cancel (&evq_test_units[u]);
+            break;
+        case 1:
+            sim_activate_abs (&evq_test_units[u], evq_test_random () % 64);
+            break;
+        case 2:                                         /* immediate, maybe over an overdue head */
+            sim_activate (&evq_test_units[u], -1);
+            break;
+        case 3:
+            sim_activate (&evq_test_units[u], evq_test_random () % 16);
+            break;
+        case 4:
+            if (sim_activate_time (&evq_test_units[u]) != 0)
+                evq_test_log[evq_test_logged++] = (uint32)sim_activate_time (&evq_test_units[u]);
+            break;
+        case 5:
+        case 6:                                         /* let time pass */
+            sim_interval -= (int32)(evq_test_random () % 24);
+            break;
+        default:                                        /* dispatch whatever is due */
+            if (sim_interval <= 0)
+                r = sim_process_event ();
+            break;
+        }
+    }
+evq_test_log = NULL;
+return r;
+}
+
+static t_stat evq_test_benchmark (t_bool indexed, uint32 units, uint32 *msecs)
+{
+uint32 i, start;
+t_stat r = SCPE_OK;
+
+sim_evq_indexed = indexed;
+_sim_evq_rebuild ();
+evq_test_reset (units);
+evq_test_rearm = TRUE;
+for (i = 0; i < units; i++)
+    sim_activate (&evq_test_units[i], 1 + (evq_test_random () % (units * 10)));
+start = sim_os_msec ();
+for (i = 0; (i < 100000) && (r == SCPE_OK); i++) {
+    sim_activate_abs (&evq_test_units[evq_test_random () % units], 1 + (evq_test_random () % (units * 10)));
+    sim_interval = 0;                                   /* next event is due */
+    r = sim_process_event ();
+    }
+*msecs = sim_os_msec () - start;
+evq_test_rearm = FALSE;
+return r;
+}
+
+static t_stat test_scp_event_queue_engines (void)
+{
+static const uint32 bench_units[] = {10, 100, 1000, 0};
+t_bool saved_indexed = sim_evq_indexed;
+uint32 *linear_log = (uint32 *)calloc (EVQ_TEST_LOGSIZE + 1, sizeof (*linear_log));
+uint32 *indexed_log = (uint32 *)calloc (EVQ_TEST_LOGSIZE + 1, sizeof (*indexed_log));
+uint32 linear_logged, i, linear_ms, indexed_ms;
+t_stat r = SCPE_OK;
+
+evq_test_units = (UNIT *)calloc (EVQ_TEST_UNITS, sizeof (*evq_test_units));
+if ((linear_log == NULL) || (indexed_log == NULL) || (evq_test_units == NULL))
+    r = SCPE_MEM;
+if (r == SCPE_OK)
+    r = evq_test_run (FALSE, linear_log);
+linear_logged = evq_test_logged;
+if (r == SCPE_OK)
+    r = evq_test_run (TRUE, indexed_log);
+if ((r == SCPE_OK) &&
+    ((linear_logged != evq_test_logged) ||
+     (memcmp (linear_log, indexed_log, linear_logged * sizeof (*linear_log)) != 0))) {
+    for (i = 0; (i < linear_logged) && (linear_log[i] == indexed_log[i]); i++)
+        ;
+    r = sim_messagef (SCPE_IERR, "Event queue engines diverged at log entry %u of %u\n", i, linear_logged);
+    }
+if (r == SCPE_OK)
+    sim_printf ("Event queue engines produced identical %u entry event logs\n", linear_logged);
+for (i = 0; (r == SCPE_OK) && (bench_units[i] != 0); i++) {
+    r = evq_test_benchmark (FALSE, bench_units[i], &linear_ms);
+    if (r == SCPE_OK)
+        r = evq_test_benchmark (TRUE, bench_units[i], &indexed_ms);
+    if (r == SCPE_OK)
+        sim_printf ("Event queue with %4u pending units: Linear %5u ms, Indexed %5u ms\n", bench_units[i], linear_ms, indexed_ms);
+    }
+evq_test_reset (0);
+if ((r == SCPE_OK) && (sim_evq_lent != 0))
+    r = sim_messagef (SCPE_IERR, "Empty event queue still holds %u borrowed express lane sets\n", sim_evq_lent);
+free (evq_test_units);
+evq_test_units = NULL;
+free (linear_log);
+free (indexed_log);
+sim_evq_indexed = saved_indexed;
+_sim_evq_rebuild ();
+return r;
+}
+
+/*
+ * Breakpoint table tests: point and range breakpoints, partial
+ * clearing of ranges and the address map short cut.  The tests run
+ * against a private table so that breakpoints the user has already
+ * set are left alone.
+ */
+
+static t_stat _test_scp_breakpoints (void)
+{
+static const struct {
+    t_addr  addr;
+    t_bool  hit;
+    } probes[] = {
+        {0x0FFF, FALSE}, {0x1000, TRUE}, {0x13FF, TRUE}, {0x1400, FALSE},
+        {0x14FF, FALSE}, {0x1500, TRUE}, {0x1FFF, TRUE}, {0x2000, FALSE},
+        {0x3000, TRUE},  {0x3001, FALSE}, {0x11000, FALSE},
+        };
+uint32 typ = sim_brk_dflt;
+t_uint64 filtered = sim_brk_stat_filtered;
+BRKTAB *bp;
+size_t i;
+int32 ranges = 0;
+
+if ((sim_brk_set_range (0x1000, 0x1FFF, 0, 0, NULL) != SCPE_OK) ||
+    (sim_brk_set (0x3000, 0, 0, NULL) != SCPE_OK) ||
+    (sim_brk_clr_range (0x1400, 0x14FF, 0) != SCPE_OK))
+    return sim_messagef (SCPE_IERR, "Breakpoint setup failed\n");
+for (bp = sim_brk_rng; bp; bp = bp->next)
+    ++ranges;
+if (ranges != 2)
+    return sim_messagef (SCPE_IERR, "Range split produced %d ranges - expected 2\n", ranges);
+for (i = 0; i < sizeof (probes) / sizeof (probes[0]); i++) {
+    t_bool hit = (sim_brk_test (probes[i].addr, typ) != 0);
+
+    if (hit != probes[i].hit)
+        return sim_messagef (SCPE_IERR, "Breakpoint test at 0x%X returned %s - expected %s\n",
+                             (int)probes[i].addr, hit ? "a match" : "no match", probes[i].hit ? "a match" : "no match");
+    if (hit && (sim_brk_test (probes[i].addr, typ) != 0))
+        return sim_messagef (SCPE_IERR, "Breakpoint at 0x%X matched twice at the same time\n", (int)probes[i].addr);
+    }
+sim_brk_clract ();
+if (sim_brk_stat_filtered == filtered)
+    return sim_messagef (SCPE_IERR, "Breakpoint map didn't resolve any tests\n");
+if (sim_brk_set_range (0x5000, 0x50FF, typ | BRK_TYP_TEMP, 0, NULL) != SCPE_OK)
+    return sim_messagef (SCPE_IERR, "One-shot range breakpoint setup failed\n");
+if (sim_brk_test (0x5010, typ) == 0)
+    return sim_messagef (SCPE_IERR, "One-shot range breakpoint didn't match\n");
+sim_brk_clract ();
+if ((sim_brk_test (0x5020, typ) != 0) || (sim_brk_test (0x5000, typ) != 0))
+    return sim_messagef (SCPE_IERR, "One-shot range breakpoint matched a second time\n");
+for (bp = sim_brk_rng; bp; bp = bp->next) {
+    if (bp->typ & BRK_TYP_TEMP)
+        return sim_messagef (SCPE_IERR, "One-shot range breakpoint remains after it matched\n");
+    }
+sim_brk_clrall (0);
+if ((sim_brk_summ != 0) || (sim_brk_rng != NULL) || (sim_brk_ent != 0))
+    return sim_messagef (SCPE_IERR, "Breakpoints remain after clearing all\n");
+if (sim_brk_test (0x1000, typ) != 0)
+    return sim_messagef (SCPE_IERR, "Breakpoint matched after clearing all\n");
+sim_printf ("Breakpoint table tests passed\n");
+return SCPE_OK;
+}
+
+static t_stat test_scp_breakpoints (void)
+{
+BRKTAB **tab = sim_brk_tab;
+BRKTAB *rng = sim_brk_rng;
+int32 ent = sim_brk_ent, lnt = sim_brk_lnt, ins = sim_brk_ins;
+uint32 summ = sim_brk_summ, types = sim_brk_types;
+t_uint64 tests = sim_brk_stat_tests, filtered = sim_brk_stat_filtered;
+t_uint64 probes = sim_brk_stat_probes, rprobes = sim_brk_stat_rprobes;
+t_uint64 hits = sim_brk_stat_hits;
+t_stat r;
+
+if (sim_brk_types == 0)
+    return SCPE_OK;
+sim_brk_tab = NULL;                                     /* start a private table */
+sim_brk_rng = NULL;
+sim_brk_lnt = 0;
+sim_brk_summ = 0;
+sim_brk_types |= BRK_TYP_TEMP;                          /* allow one-shot breakpoints */
+r = sim_brk_init ();
+if (r == SCPE_OK)
+    r = _test_scp_breakpoints ();
+sim_brk_init ();                                        /* release test entries */
+sim_brk_types = types;
+free (sim_brk_tab);
+sim_brk_tab = tab;                                      /* reinstate user table */
+sim_brk_rng = rng;
+sim_brk_ent = ent;
+sim_brk_lnt = lnt;
+sim_brk_ins = ins;
+sim_brk_summ = summ;
+sim_brk_stat_tests = tests;
+sim_brk_stat_filtered = filtered;
+sim_brk_stat_probes = probes;
+sim_brk_stat_rprobes = rprobes;
+sim_brk_stat_hits = hits;
+sim_brk_map_valid = FALSE;                              /* rebuild map on next test */
+return r;
+}
+
+/*
+ * Binary debug trace tests: argument capture and decoding of assorted
+ * formats, records from concurrent threads and a comparison of the cost
+ * of text and binary debug output.
+ */
+
+#define TRC_TEST_FILE       "debug-trace-test.bin"
+#define TRC_TEST_TEXT       "debug-trace-test.txt"
+#define TRC_TEST_EVENTS     5000
+#define TRC_TEST_BENCH      200000
+
+static DEBTAB trc_test_deb[] = {
+    { "TEST",   1,  "trace test" },
+    { NULL,     0 }
+    };
+static DEVICE trc_test_dev;
+
+#if defined (SIM_ASYNCH_IO)
+static void *trc_test_thread (void *arg)
+{
+int32 i;
+
+for (i = 0; i < TRC_TEST_EVENTS; i++)
+    sim_debug (1, &trc_test_dev, "async %d\n", i);
+return NULL;
+}
+#endif
+
+static t_stat trc_test_open (t_bool binary)
+{
+sim_switches = SWMASK ('N') | SWMASK ('F') | (binary ? SWMASK ('C') : 0);
+return sim_set_debon (0, TRC_TEST_FILE);
+}
+
+static t_stat test_scp_debug_trace (void)
+{
+char *expected = (char *)calloc (1, 8192);
+char *p = expected;
+char line[1024];
+int32 saved_quiet = sim_quiet;
+int32 saved_switches = sim_switches;
+int32 i, next_main = 0, next_async = 0;
+uint32 text_ms, binary_ms, start;
+size_t matched = 0;
+FILE *f;
+t_stat r = SCPE_OK;
+
+if ((sim_deb != NULL) || (expected == NULL)) {      /* don't disturb active debugging */
+    free (expected);
+    return SCPE_OK;
+    }
+trc_test_dev.name = "TRC";
+trc_test_dev.debflags = trc_test_deb;
+trc_test_dev.flags = DEV_DEBUG;
+trc_test_dev.dctrl = 1;
+sim_quiet = 1;
+#define TRC_TEST(...) do {sim_debug (1, &trc_test_dev, __VA_ARGS__); p += sprintf (p, __VA_ARGS__);} while (0)
+r = trc_test_open (TRUE);
+if (r == SCPE_OK) {
+#if defined (SIM_ASYNCH_IO)
+    pthread_t thread;
+    t_bool threaded = (0 == pthread_create (&thread, NULL, trc_test_thread, NULL));
+#endif
+    TRC_TEST ("int %d uint %u hex %08X oct %o chr %c pct %%\n", -5, 7u, 0xBEEFu, 8, 'q');
+    TRC_TEST ("long %ld %lx wide %" LL_FMT "d %" LL_FMT "X\n", -70000L, 0xABCDEFL, (LL_TYPE)-1234567890123LL, (unsigned LL_TYPE)0xFEDCBA9876ULL);
+    TRC_TEST ("str '%s' '%-8s|' '%.3s' '%10s'\n", "hello", "pad", "truncate", "right");
+    TRC_TEST ("dbl %.3f %e %g %5.1f\n", 3.14159, 1.5e-10, 100.0, -2.25);
+    TRC_TEST ("star %*d|%-*s|%.*f\n", 6, 42, 5, "ab", 2, 1.23456);
+    TRC_TEST ("partial ");
+    TRC_TEST ("line %s\n", "completed");
+    for (i = 0; i < 3; i++) {                       /* formats freed once logged */
+        char *hfmt = (char *)malloc (SIM_TRC_FMTLEN + 16);
+
+        if (hfmt == NULL)
+            break;
+        if (i < 2)                                  /* likely reusing one address */
+            sprintf (hfmt, "heap %d arg %%d\n", i);
+        else {                                      /* too long to keep in a record */
+            memset (hfmt, 'L', SIM_TRC_FMTLEN);
+            strcpy (&hfmt[SIM_TRC_FMTLEN], " %d\n");
+            }
+        TRC_TEST (hfmt, 10 + i);
+        free (hfmt);
+        }
+    for (i = 0; i < TRC_TEST_EVENTS; i++)
+        sim_debug (1, &trc_test_dev, "main %d\n", i);
+#if defined (SIM_ASYNCH_IO)
+    if (threaded) {
+        pthread_join (thread, NULL);
+        for (i = 0; i < (int32)sim_trc_rings; i++)
+            if (sim_trc_ring[i].active && !pthread_equal (sim_trc_ring[i].owner, pthread_self ()))
+                r = sim_messagef (SCPE_IERR, "Trace ring %d still held after its thread exited\n", i);
+        }
+    else
+        next_async = TRC_TEST_EVENTS;
+#else
+    next_async = TRC_TEST_EVENTS;
+#endif
+    sim_set_deboff (0, NULL);
+    for (i = 0; i < (int32)sim_trc_rings; i++)
+        if ((sim_trc_ring[i].rec != NULL) && !sim_trc_ring[i].active)
+            r = sim_messagef (SCPE_IERR, "Trace ring %d not released at trace close\n", i);
+    if (r == SCPE_OK)
+        r = sim_debug_trace_decode (stdout, TRC_TEST_FILE " " TRC_TEST_TEXT);
+    }
+#undef TRC_TEST
+if ((r == SCPE_OK) && ((f = fopen (TRC_TEST_TEXT, "r")) == NULL))
+    r = sim_messagef (SCPE_OPENERR, "Can't open decoded trace %s\n", TRC_TEST_TEXT);
+if (r == SCPE_OK) {
+    size_t explen = strlen (expected);
+    char *got = (char *)calloc (1, explen + 1024);
+    size_t gotlen = 0;
+
+    while (fgets (line, sizeof (line), f)) {
+        char *msg = strstr (line, "TRC TEST: ");
+        char *eol = line + strcspn (line, "\r\n");
+        int32 n;
+
+        if (msg == NULL)
+            continue;
+        *eol = '\0';
+        msg += strlen ("TRC TEST: ");
+        if (sscanf (msg, "main %d", &n) == 1) {
+            if (n != next_main++)
+                r = sim_messagef (SCPE_IERR, "Decoded trace has main %d, expected %d\n", n, next_main - 1);
+            continue;
+            }
+        if (sscanf (msg, "async %d", &n) == 1) {
+            if (n != next_async++)
+                r = sim_messagef (SCPE_IERR, "Decoded trace has async %d, expected %d\n", n, next_async - 1);
+            continue;
+            }
+        if (gotlen + strlen (msg) + 2 < explen + 1024)
+            gotlen += sprintf (got + gotlen, "%s\n", msg);
+        ++matched;
+        }
+    fclose (f);
+    if ((r == SCPE_OK) && (strcmp (got, expected) != 0))
+        r = sim_messagef (SCPE_IERR, "Decoded trace differs:\n%s\nExpected:\n%s\n", got, expected);
+    if ((r == SCPE_OK) && ((next_main != TRC_TEST_EVENTS) || (next_async != TRC_TEST_EVENTS)))
+        r = sim_messagef (SCPE_IERR, "Decoded trace has %d main and %d async events, expected %d each\n", next_main, next_async, TRC_TEST_EVENTS);
+    free (got);
+    }
+if (r == SCPE_OK)
+    sim_printf ("Debug trace decoded %u formatted lines and %d events from 2 threads\n", (uint32)matched, next_main + next_async);
+for (i = 0; (r == SCPE_OK) && (i < 2); i++) {      /* text vs binary cost */
+    int32 j;
+
+    r = trc_test_open (i == 1);
+    start = sim_os_msec ();
+    for (j = 0; (r == SCPE_OK) && (j < TRC_TEST_BENCH); j++)
+        sim_debug (1, &trc_test_dev, "event %d of %d at %s status %08X\n", j, TRC_TEST_BENCH, "benchmark", (uint32)j * 7);
+    if (r == SCPE_OK)
+        sim_set_deboff (0, NULL);
+    if (i == 0)
+        text_ms = sim_os_msec () - start;
+    else
+        binary_ms = sim_os_msec () - start;
+    }
+if (r == SCPE_OK)
+    sim_printf ("%d debug events: text %u ms, binary trace %u ms\n", TRC_TEST_BENCH, text_ms, binary_ms);
+remove (TRC_TEST_FILE);
+remove (TRC_TEST_TEXT);
+free (expected);
+sim_quiet = saved_quiet;
+sim_switches = saved_switches;
+return r;
+}
+
+/* Snapshot SAVE/RESTORE test */
+
+#define SNAP_TEST_WORDS (1024 * 1024)                   /* 4MB of test memory */
+#define SNAP_TEST_FILE  "snaptest-%s.sav"
+
+static uint32 *snap_test_mem;
+static uint8 snap_test_map[SNAP_TEST_WORDS / SNAP_PAGE];  /* dirty pages */
+static t_stat snap_test_ex (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw);
+static t_stat snap_test_dep (t_value val, t_addr addr, UNIT *uptr, int32 sw);
+static UNIT snap_test_unit = { UDATA (NULL, UNIT_FIX, 0) };
+static DEVICE snap_test_dev = {
+    "SNAPTEST", &snap_test_unit, NULL, NULL,
+    1, 16, 22, 1, 16, 32,
+    &snap_test_ex, &snap_test_dep, NULL,
+    NULL, NULL, NULL};
+
+static t_stat snap_test_ex (t_value *vptr, t_addr addr, UNIT *uptr, int32 sw)
+{
+if (addr >= uptr->capac)
+    return SCPE_NXM;
+*vptr = snap_test_mem[addr];
+return SCPE_OK;
+}
+
+static t_stat snap_test_dep (t_value val, t_addr addr, UNIT *uptr, int32 sw)
+{
+if (addr >= uptr->capac)
+    return SCPE_NXM;
+snap_test_mem[addr] = (uint32)val;
+snap_test_map[addr / SNAP_PAGE] = 1;
+return SCPE_OK;
+}
+
+static void snap_test_dirty (uint32 seed, uint32 pages)
+{
+uint32 i, j, page;
+
+for (i = 0; i < pages; i++) {
+    seed = seed * 1103515245 + 12345;
+    page = (seed >> 8) % (SNAP_TEST_WORDS / SNAP_PAGE);
+    for (j = 0; j < SNAP_PAGE; j += 7)
+        snap_test_mem[page * SNAP_PAGE + j] ^= seed | 1;
+    snap_test_map[page] = 1;
+    }
+}
+
+static t_stat snap_test_step (const char *what, const char *switches, const char *name, uint32 *ms)
+{
+char cmd[2 * CBUFSIZE], file[CBUFSIZE];
+uint32 start = sim_os_msec ();
+t_stat r;
+
+snprintf (file, sizeof (file), SNAP_TEST_FILE, name);
+snprintf (cmd, sizeof (cmd), "%s%s%s", switches, switches[0] ? " " : "", file);
+sim_switches = 0;
+r = (strcmp (what, "SAVE") == 0) ? save_cmd (0, cmd) : restore_cmd (0, cmd);
+*ms = sim_os_msec () - start;
+if (r != SCPE_OK)
+    return sim_messagef (r, "%s %s failed: %s\n", what, cmd, sim_error_text (r));
+if (strcmp (what, "SAVE") == 0)
+    sim_printf ("SAVE %-3s %-20s %9d bytes %5u ms\n", switches, file, (int)sim_fsize_name (file), *ms);
+else
+    sim_printf ("RESTORE %-20s           %5u ms\n", file, *ms);
+return SCPE_OK;
+}
+
+static t_stat test_scp_snapshots (void)
+{
+uint32 *expect1, *expect2;
+uint32 i, ms;
+int32 saved_switches = sim_switches;
+int32 saved_quiet = sim_quiet;
+char file[CBUFSIZE];
+static const char *names[] = {"plain", "base", "incr1", "incr2", NULL};
+t_stat r;
+
+snap_test_mem = (uint32 *)malloc (SNAP_TEST_WORDS * sizeof (*snap_test_mem));
+expect1 = (uint32 *)malloc (SNAP_TEST_WORDS * sizeof (*expect1));
+expect2 = (uint32 *)malloc (SNAP_TEST_WORDS * sizeof (*expect2));
+if ((snap_test_mem == NULL) || (expect1 == NULL) || (expect2 == NULL)) {
+    free (snap_test_mem);
+    free (expect1);
+    free (expect2);
+    return SCPE_MEM;
+    }
+for (i = 0; i < SNAP_TEST_WORDS; i++)                   /* repetitive, partly empty */
+    snap_test_mem[i] = ((i / SNAP_PAGE) % 3 == 2) ? 0 : ((i % 5) == 0) ? i * 2654435761U : (0xD0 + (i % 61)) | ((i / SNAP_PAGE) << 12);
+sim_register_internal_device (&snap_test_dev);
+sim_set_unit_dirty_map (&snap_test_unit, snap_test_map, 10);
+snap_test_unit.capac = SNAP_TEST_WORDS;
+sim_quiet = 1;
+sim_printf ("Snapshot test: %d words of test memory\n", SNAP_TEST_WORDS);
+r = snap_test_step ("SAVE", "", "plain", &ms);
+if (r == SCPE_OK)
+    r = snap_test_step ("SAVE", "-C", "base", &ms);
+if (r == SCPE_OK) {
+    snap_test_dirty (1, 40);
+    memcpy (expect1, snap_test_mem, SNAP_TEST_WORDS * sizeof (*expect1));
+    r = snap_test_step ("SAVE", "-CI", "incr1", &ms);
+    }
+if (r == SCPE_OK) {
+    snap_test_dirty (2, 20);
+    memcpy (expect2, snap_test_mem, SNAP_TEST_WORDS * sizeof (*expect2));
+    r = snap_test_step ("SAVE", "-I", "incr2", &ms);
+    }
+if (r == SCPE_OK) {
+    sim_switches = SWMASK ('I');
+    r = save_cmd (0, "snaptest-incr2.sav");             /* can't replace its own base */
+    r = (r != SCPE_OK) ? SCPE_OK : sim_messagef (SCPE_IERR, "Replacing the base of an incremental snapshot wasn't detected\n");
+    }
+if (r == SCPE_OK) {
+    memset (snap_test_mem, 0x5A, SNAP_TEST_WORDS * sizeof (*snap_test_mem));
+    r = snap_test_step ("RESTORE", "", "incr2", &ms);
+    if ((r == SCPE_OK) && (memcmp (snap_test_mem, expect2, SNAP_TEST_WORDS * sizeof (*expect2)) != 0))
+        r = sim_messagef (SCPE_IERR, "Memory restored from incremental snapshot chain doesn't match\n");
+    }
+if (r == SCPE_OK) {
+    memset (snap_test_mem, 0xA5, SNAP_TEST_WORDS * sizeof (*snap_test_mem));
+    r = snap_test_step ("RESTORE", "", "incr1", &ms);
+    if ((r == SCPE_OK) && (memcmp (snap_test_mem, expect1, SNAP_TEST_WORDS * sizeof (*expect1)) != 0))
+        r = sim_messagef (SCPE_IERR, "Memory restored from first incremental snapshot doesn't match\n");
+    }
+for (i = 0; names[i]; i++) {
+    snprintf (file, sizeof (file), SNAP_TEST_FILE, names[i]);
+    remove (file);
+    }
+snap_test_unit.capac = 0;                               /* no memory in later saves */
+sim_set_unit_dirty_map (&snap_test_unit, NULL, 0);
+free (snap_test_mem);
+free (expect1);
+free (expect2);
+snap_test_mem = NULL;
+sim_quiet = saved_quiet;
+sim_switches = saved_switches;
+if (r == SCPE_OK)
+    sim_printf ("Snapshot tests GOOD\n");
+return r;
+}
+
 /*
  * Compiled in unit tests for the various device oriented library
  * modules: sim_card, sim_disk, sim_tape, sim_ether, sim_tmxr, etc.
@@ -18345,6 +21597,14 @@ if ((strcmp (gbuf, "ALL") == 0) || (strcmp (gbuf, "SCP") == 0)) {
         return sim_messagef (SCPE_IERR, "SCP argument parsing test failed\n");
     if (test_scp_event_sequencing () != SCPE_OK)
         return sim_messagef (SCPE_IERR, "SCP event sequencing test failed\n");
+    if (test_scp_event_queue_engines () != SCPE_OK)
+        return sim_messagef (SCPE_IERR, "SCP event queue engine test failed\n");
+    if (test_scp_breakpoints () != SCPE_OK)
+        return sim_messagef (SCPE_IERR, "SCP breakpoint test failed\n");
+    if (test_scp_debug_trace () != SCPE_OK)
+        return sim_messagef (SCPE_IERR, "SCP debug trace test failed\n");
+    if (test_scp_snapshots () != SCPE_OK)
+        return sim_messagef (SCPE_IERR, "SCP snapshot test failed\n");
     }
 for (i = 0; (dptr = sim_devices[i]) != NULL; i++) {
     t_stat tstat = SCPE_OK;
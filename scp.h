@@ -215,6 +215,10 @@ DEVICE *find_dev (const char *ptr);
 DEVICE *find_unit (const char *ptr, UNIT **uptr);
 DEVICE *find_dev_from_unit (UNIT *uptr);
 t_stat sim_register_internal_device (DEVICE *dptr);
+t_stat sim_set_unit_memfile (UNIT *uptr, MAPFILE *mfile);
+MAPFILE *sim_get_unit_memfile (UNIT *uptr);
+t_stat sim_set_unit_dirty_map (UNIT *uptr, uint8 *map, uint32 shift);
+void *sim_get_unit_opts (UNIT *uptr, const char *tag, size_t size, t_bool create);
 void sim_sub_args (char *in_str, size_t in_str_size, char *do_arg[]);
 REG *find_reg (CONST char *ptr, CONST char **optr, DEVICE *dptr);
 CTAB *find_ctab (CTAB *tab, const char *gbuf);
@@ -279,6 +283,10 @@ void _sim_debug_device (uint32 dbits, DEVICE* dptr, const char* fmt, ...) GCC_FM
 #define sim_debug_unit(dbits, uptr, ...) do { if ((sim_deb != NULL) && ((uptr) != NULL) && (uptr->dptr != NULL) && (((uptr)->dctrl | (uptr)->dptr->dctrl) & (dbits))) _sim_debug_unit (dbits, uptr, __VA_ARGS__);} while (0)
 #endif
 void sim_flush_buffered_files (t_bool debug_flush);
+t_stat sim_debug_trace_open (void);
+void sim_debug_trace_close (void);
+void sim_debug_trace_show (FILE *st);
+t_stat sim_debug_trace_decode (FILE *st, CONST char *cptr);
 
 /* Only for use in SCP code and libraries - NOT in simulator code */
 #define SIM_SCP_ABORT(msg) _sim_scp_abort (msg, __FILE__, __LINE__)
@@ -326,6 +334,7 @@ extern size_t sim_deb_buffer_size;                      /* debug memory buffer s
 extern char *sim_deb_buffer;                            /* debug memory buffer */
 extern size_t sim_debug_buffer_offset;                  /* debug memory buffer insertion offset */
 extern size_t sim_debug_buffer_inuse;                   /* debug memory buffer inuse count */
+extern t_bool sim_deb_trace;                            /* debug output is a binary trace */
 extern DEVICE **sim_internal_devices;
 extern uint32 sim_internal_device_count;
 extern UNIT *sim_clock_queue;
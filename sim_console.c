@@ -2357,7 +2357,7 @@ sim_deb_switches = switches &
                     SWMASK ('T') | SWMASK ('A') |
                     SWMASK ('F') | SWMASK ('N') |
                     SWMASK ('B') | SWMASK ('E') |
-                    SWMASK ('D') );                 /* save debug switches */
+                    SWMASK ('D') | SWMASK ('C') );  /* save debug switches */
 return old_deb_switches;
 }
 
@@ -2381,7 +2381,15 @@ if (sim_switches & SWMASK ('B')) {
 cptr = get_glyph_quoted (cptr, gbuf, 0);                /* get file name */
 if (*cptr != 0)                                         /* now eol? */
     return SCPE_2MARG;
-r = sim_open_logfile (gbuf, FALSE, &sim_deb, &sim_deb_ref);
+if (sim_switches & SWMASK ('C')) {                      /* binary trace? */
+    if (sim_switches & SWMASK ('B'))
+        return sim_messagef (SCPE_ARG, "A binary debug trace can't be written to a memory buffer\n");
+    if ((sim_strcasecmp (gbuf, "LOG") == 0) || (sim_strcasecmp (gbuf, "STDOUT") == 0) ||
+        (sim_strcasecmp (gbuf, "STDERR") == 0) || (sim_strcasecmp (gbuf, "DEBUG") == 0))
+        return sim_messagef (SCPE_ARG, "A binary debug trace must be written to a file\n");
+    }
+sim_debug_trace_close ();                               /* finish any active trace */
+r = sim_open_logfile (gbuf, (sim_switches & SWMASK ('C')) != 0, &sim_deb, &sim_deb_ref);
 
 if (r != SCPE_OK)
     return r;
@@ -2417,6 +2425,8 @@ if (sim_deb_switches & SWMASK ('E'))
 if (sim_deb_switches & SWMASK ('B'))
     sim_messagef (SCPE_OK, "   Debug messages will be written to a %u MB circular memory buffer\n",
                                 (unsigned int)buffer_size);
+if (sim_deb_switches & SWMASK ('C'))
+    sim_messagef (SCPE_OK, "   Debug messages will be written as a binary trace\n");
 time(&now);
 if (!sim_quiet) {
     fprintf (sim_deb, "Debug output to \"%s\" at %s", sim_logfile_name (sim_deb, sim_deb_ref), ctime(&now));
@@ -2431,6 +2441,8 @@ if (sim_deb_switches & SWMASK ('B')) {
     sim_debug_buffer_offset = sim_debug_buffer_inuse = 0;
     memset (sim_deb_buffer, 0, sim_deb_buffer_size);
     }
+if (sim_deb_switches & SWMASK ('C'))
+    return sim_debug_trace_open ();
 
 return SCPE_OK;
 }
@@ -2447,6 +2459,7 @@ if (sim_deb == NULL) {                                  /* no debug? */
     else
         return SCPE_OK;
     }
+sim_debug_trace_close ();                               /* write out any binary trace */
 if (sim_deb_switches & SWMASK ('B')) {
     size_t offset = (sim_debug_buffer_inuse == sim_deb_buffer_size) ? sim_debug_buffer_offset : 0;
     const char *bufmsg = "\nCircular Buffer Contents follow here:\n\n";
@@ -2480,9 +2493,14 @@ return sim_messagef (SCPE_OK, "Debug output disabled\n");
 t_stat sim_show_debug (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
 {
 int32 i;
+char gbuf[CBUFSIZE];
 
-if (cptr && (*cptr != 0))
+if (cptr && (*cptr != 0)) {
+    cptr = get_glyph (cptr, gbuf, 0);
+    if (MATCH_CMD (gbuf, "DECODE") == 0)                /* decode a binary trace? */
+        return sim_debug_trace_decode (st, cptr);
     return SCPE_2MARG;
+    }
 if (sim_deb) {
     fprintf (st, "Debug output enabled to %s\n",
                  sim_relative_path (sim_logfile_name (sim_deb, sim_deb_ref)));
@@ -2496,6 +2514,7 @@ if (sim_deb) {
         fprintf (st, "   Debug messages are not being filtered to summarize duplicate lines\n");
     if (sim_deb_switches & SWMASK ('E'))
         fprintf (st, "   Debug messages containing blob data in EBCDIC will display in readable form\n");
+    sim_debug_trace_show (st);
     for (i = 0; (dptr = sim_devices[i]) != NULL; i++) {
         t_bool unit_debug = FALSE;
         uint32 unit;
@@ -557,6 +557,24 @@ struct DEVICE {
 #define DEV_UFMASK      (((1u << DEV_V_RSV) - 1) & ~((1u << DEV_V_UF) - 1))
 #define DEV_RFLAGS      (DEV_UFMASK|DEV_DIS)            /* restored flags */
 
+/* Event queue index linkage, maintained by scp for each unit */
+
+#define SIM_EVQ_LEVELS  12                              /* express lanes */
+#define SIM_EVQ_INLINE  2                               /* express lanes held in the unit */
+
+typedef struct SIM_EVQ_NODE SIM_EVQ_NODE;
+struct SIM_EVQ_NODE {
+    UNIT                *uptr;                          /* owning unit */
+    UNIT                *prev;                          /* predecessor on clock queue */
+    t_int64             key;                            /* absolute due time */
+    uint32              gen;                            /* index generation when queued */
+    t_bool              queued;                         /* on the indexed clock queue */
+    int32               levels;                         /* express lanes this entry is on */
+    SIM_EVQ_NODE        **fwd;                          /* express lane successors */
+    SIM_EVQ_NODE        **bwd;                          /* express lane predecessors */
+    SIM_EVQ_NODE        *lane[2 * SIM_EVQ_INLINE];      /* lanes of a short entry */
+    };
+
 /* Unit data structure
 
    Parts of the unit structure are device specific, that is, they are
@@ -617,6 +635,7 @@ struct UNIT {
     int32               u4;                             /* device specific */
     int32               u5;                             /* device specific */
     int32               u6;                             /* device specific */
+    SIM_EVQ_NODE        evq;                            /* event queue index linkage (scp private) */
     };
 
 /* Unit flags */
@@ -656,6 +675,7 @@ struct UNIT {
 #define UNIT_TM_POLL        0000002         /* TMXR Polling unit (connect, transmit or receive) */
 #define UNIT_NO_FIO         0000004         /* fileref is NOT a FILE * */
 #define UNIT_DISK_CHK       0000010         /* disk data debug checking (sim_disk) */
+#define UNIT_DISK_CLU       0000020         /* CLUSTER format disk container (sim_disk) */
 #define UNIT_TMR_UNIT       0000200         /* Unit registered as a calibrated timer */
 #define UNIT_TAPE_MRK       0000400         /* Tape Unit Tapemark */
 #define UNIT_TAPE_PNU       0001000         /* Tape Unit Position Not Updated */
@@ -804,6 +824,8 @@ struct BRKTAB {
     char                *act;                           /* action string */
     double              time_fired[SIM_BKPT_N_SPC];     /* instruction count when match occurred */
     BRKTAB *next;                                       /* list with same address value */
+    t_addr              end;                            /* last address (range breakpoints) */
+    t_addr              addr_fired[SIM_BKPT_N_SPC];     /* address matched (range breakpoints) */
     };
 
 /* Breakpoint table */
@@ -56,6 +56,25 @@ Public routines:
    sim_disk_show_autozap     MTAB display autozap
    sim_disk_set_async        enable asynchronous operation
    sim_disk_clr_async        disable asynchronous operation
+   sim_disk_set_async_depth  set number of concurrent asynchronous requests
+   sim_disk_get_async_depth  get number of concurrent asynchronous requests
+   sim_disk_rdsect_q         read disk sectors, queued asynchronous request
+   sim_disk_wrsect_q         write disk sectors, queued asynchronous request
+   sim_disk_drain            complete all queued asynchronous requests
+   sim_disk_set_cache        set or clear a unit's sector cache (SET <dev> CACHE)
+   sim_disk_show_cache       show sector cache statistics (SHOW <dev> CACHE)
+   sim_disk_set_mmap         map a unit's container into memory (SET <dev> MMAP)
+   sim_disk_set_overlay      keep, discard or merge an overlay at detach (SET <unit> OVERLAY=)
+   sim_disk_show_overlay     show overlay file state (SHOW <dev> OVERLAY)
+   sim_disk_overlay_name     name of a unit's overlay file (for SAVE)
+   sim_disk_set_statistics   reset a unit's I/O statistics (SET <dev> STATISTICS=RESET)
+   sim_disk_show_statistics  show I/O counts and service times (SHOW <dev> STATISTICS)
+   sim_disk_set_compress     compress CLUSTER containers (SET <dev> COMPRESS)
+   sim_disk_set_snapshot     take, revert to or delete a CLUSTER container snapshot
+   sim_disk_show_snapshots   show CLUSTER container snapshots (SHOW <dev> SNAPSHOTS)
+   sim_disk_show_chain       show a VHD differencing chain (SHOW <dev> CHAIN)
+   sim_disk_set_probe        select the file systems probed at attach (SET DISK PROBE=)
+   sim_disk_show_probe       show the file systems probed at attach (SHOW DISK)
    sim_disk_data_trace       debug support
    sim_disk_set_drive_type   MTAB validator routine
    sim_disk_set_drive_type_by_name device reset initialization
@@ -99,16 +118,20 @@ Internal routines:
 #define DKUF_F_STD       1                              /* SIMH format */
 #define DKUF_F_RAW       2                              /* Raw Physical Disk Access */
 #define DKUF_F_VHD       3                              /* VHD format */
+#define DKUF_F_CLU       4                              /* Clustered sparse format (UNIT_DISK_CLU) */
 
 #define DKUF_E_AUTO      0                              /* Auto detect encoding */
 #define DKUF_E_DLD9      1                              /* KLH10 packed 36bit little endian word */
 #define DKUF_E_DBD9      2                              /* KLH10 packed 36bit big endian word */
 
-#define DK_GET_FMT(u)   (((u)->flags >> DKUF_V_FMT) & DKUF_M_FMT)
+#define DK_GET_FMT(u)   (((u)->dynflags & UNIT_DISK_CLU) ? DKUF_F_CLU : (((u)->flags >> DKUF_V_FMT) & DKUF_M_FMT))
 #define DK_GET_ENC(u)   (((u)->flags >> DKUF_V_ENC) & DKUF_M_ENC)
 
 #if defined SIM_ASYNCH_IO
 #include <pthread.h>
+#if !defined (_WIN32)
+#include <unistd.h>
+#endif
 #endif
 
 static t_bool sim_disk_check_attached_container (const char *filename, UNIT **auptr);
@@ -179,6 +202,35 @@ return value;
 }
 #endif
 
+/* I/O statistics
+
+   Every transfer and flush is counted per unit, along with a histogram
+   of the host time it took in power of two microsecond buckets (bucket
+   0 holds times under 2us, bucket n times from 2**n to 2**(n+1)-1us and
+   the last bucket everything longer).  Transfers performed by the
+   simulator thread and by asynchronous I/O threads are kept apart, and
+   flushes are counted on their own. */
+
+#define DK_STAT_READ        0
+#define DK_STAT_WRITE       1
+#define DK_STAT_OPS         2
+
+#define DK_STAT_SYNC        0                   /* simulator thread */
+#define DK_STAT_ASYNC       1                   /* asynchronous I/O thread */
+#define DK_STAT_PATHS       2
+
+#define DK_STAT_BUCKETS     24
+
+struct disk_op_stats {
+    t_uint64            ops;                /* Operations */
+    t_uint64            sectors;            /* Sectors transferred */
+    t_uint64            bytes;              /* Bytes transferred */
+    t_uint64            errors;             /* Operations which failed */
+    t_uint64            usecs;              /* Total host service time */
+    uint32              max_usecs;          /* Longest host service time */
+    uint32              hist[DK_STAT_BUCKETS];/* Host service time histogram */
+    };
+
 struct disk_context {
     t_offset            container_size;     /* Size of the data portion (of the pseudo disk) */
     t_offset            highwater;          /* Furthest written sector in the disk */
@@ -200,6 +252,17 @@ struct disk_context {
     uint32              data_ileave_skew;   /* Data sectors track skew in container */
     DRVTYP              *initial_drvtyp;    /* Unit Drive Type before any autosize */
     t_addr              initial_capac;      /* Unit Capacity before any autosize */
+    uint32              asynch_depth;       /* Concurrent asynchronous requests (0 or 1 = single I/O thread) */
+    struct disk_cache   *cache;             /* Sector cache (NULL if none) */
+    MAPFILE             *map;               /* Memory mapped container (NULL if none) */
+    struct disk_overlay *overlay;           /* Overlay holding written sectors (NULL if none) */
+    uint8               *map_base;          /* Container data mapped at */
+    size_t              map_size;           /* Bytes of container data mapped */
+    size_t              map_grown;          /* Bytes written beyond the mapping since it was made */
+    uint8               *probe_buf;         /* Leading bytes prefetched for file system probes */
+    uint32              probe_bytes;        /* Valid bytes in probe_buf */
+    struct disk_op_stats stats[DK_STAT_PATHS][DK_STAT_OPS];/* I/O statistics since attach */
+    struct disk_op_stats flushes;           /* Flush statistics since attach */
     struct simh_disk_footer
                         *footer;
 #if defined _WIN32
@@ -221,11 +284,53 @@ struct disk_context {
     t_lba               lba;
     DISK_PCALLBACK      callback;
     t_stat              io_status;
+    int                 q_run;              /* Request queue threads running */
+    uint32              q_nthreads;         /* Number of request queue threads */
+    pthread_t           *q_threads;         /* Request queue thread Ids */
+    pthread_cond_t      q_cond;             /* Request queued or stop */
+    pthread_cond_t      q_idle;             /* Request completed */
+    pthread_mutex_t     q_serial;           /* Serializes I/O which isn't positional */
+    struct disk_qreq    *q_head;            /* Pending requests */
+    struct disk_qreq    *q_tail;
+    struct disk_qreq    *q_done;            /* Completed requests */
+    struct disk_qreq    *q_done_tail;
+    uint32              q_active;           /* Requests pending or in progress */
+    UNIT                q_unit;             /* Completion dispatch unit */
 #endif
     };
 
 #define disk_ctx up8                        /* Field in Unit structure which points to the disk_context */
 
+#if defined SIM_ASYNCH_IO
+/* Queued asynchronous request.  Requests issued through the _a routines
+   while the request queue is running carry a DISK_PCALLBACK, those issued
+   through the _q routines a DISK_QCALLBACK and its argument. */
+
+struct disk_qreq {
+    struct disk_qreq    *next;
+    int                 dop;
+    t_lba               lba;
+    uint8               *buf;
+    t_seccnt            *rsects;
+    t_seccnt            sects;
+    DISK_PCALLBACK      pcallback;
+    DISK_QCALLBACK      qcallback;
+    void                *arg;
+    t_stat              status;
+    };
+
+#define DISK_Q_LOCK(ctx)    if ((ctx)->q_run) pthread_mutex_lock (&(ctx)->io_lock)
+#define DISK_Q_UNLOCK(ctx)  if ((ctx)->q_run) pthread_mutex_unlock (&(ctx)->io_lock)
+
+static t_stat _disk_q_submit (UNIT *uptr, int dop, t_lba lba, uint8 *buf, t_seccnt *rsects, t_seccnt sects,
+                              DISK_PCALLBACK pcallback, DISK_QCALLBACK qcallback, void *arg);
+static void _disk_q_drain (UNIT *uptr);
+static t_stat _disk_stat_xfer (UNIT *uptr, uint32 path, uint32 op, t_lba lba, uint8 *buf, t_seccnt *sectsdone, t_seccnt sects);
+#else
+#define DISK_Q_LOCK(ctx)
+#define DISK_Q_UNLOCK(ctx)
+#endif
+
 #if defined SIM_ASYNCH_IO
 #define AIO_CALLSETUP                                               \
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;   \
@@ -243,6 +348,12 @@ if ((!callback) || !ctx->asynch_io)
       "sim_disk AIO_CALL(op=%d, unit=%d, lba=0x%X, sects=%d)\n",\
                 op, (int)(uptr - ctx->dptr->units), _lba, _sects);\
                                                                 \
+        if (ctx->q_run) {       /* request queue running? */    \
+            pthread_mutex_unlock (&ctx->io_lock);               \
+            _disk_q_submit (uptr, op, _lba, _buf, _rsects,      \
+                            _sects, _callback, NULL, NULL);     \
+            return r;                                           \
+            }                                                   \
         if (ctx->callback)      /* horrible mistake, stop */    \
             SIM_SCP_ABORT ("AIO_CALL error");                   \
         ctx->io_dop = op;                                       \
@@ -286,10 +397,10 @@ while (ctx->asynch_io) {
     pthread_mutex_unlock (&ctx->io_lock);
     switch (ctx->io_dop) {
         case DOP_RSEC:
-            ctx->io_status = sim_disk_rdsect (uptr, ctx->lba, ctx->buf, ctx->rsects, ctx->sects);
+            ctx->io_status = _disk_stat_xfer (uptr, DK_STAT_ASYNC, DK_STAT_READ, ctx->lba, ctx->buf, ctx->rsects, ctx->sects);
             break;
         case DOP_WSEC:
-            ctx->io_status = sim_disk_wrsect (uptr, ctx->lba, ctx->buf, ctx->rsects, ctx->sects);
+            ctx->io_status = _disk_stat_xfer (uptr, DK_STAT_ASYNC, DK_STAT_WRITE, ctx->lba, ctx->buf, ctx->rsects, ctx->sects);
             break;
         case DOP_IAVL:
             ctx->io_status = sim_disk_isavailable (uptr);
@@ -351,7 +462,9 @@ struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 
 if (ctx) {
     sim_debug_unit (ctx->dbit, uptr, "_disk_cancel(unit=%d, dop=%d)\n", (int)(uptr - ctx->dptr->units), ctx->io_dop);
-    if (ctx->asynch_io) {
+    if (ctx->q_run)
+        _disk_q_drain (uptr);
+    else if (ctx->asynch_io) {
         pthread_mutex_lock (&ctx->io_lock);
         while (ctx->io_dop != DOP_DONE)
             pthread_cond_wait (&ctx->io_done, &ctx->io_lock);
@@ -360,6 +473,236 @@ if (ctx) {
     }
 return FALSE;
 }
+
+/* Request queue
+
+   When a unit's asynch_depth is greater than one, a pool of asynch_depth
+   threads services a queue of requests in place of the single I/O thread,
+   so that many requests can be in progress at once.  Requests complete
+   in whatever order the host finishes them.  Each completion activates
+   q_unit, whose service routine calls the callbacks of all completed
+   requests in the main simulator thread.
+
+   SIMH format containers are then accessed with positional reads and
+   writes (pread/pwrite) which don't share a file position, as are raw
+   devices with whole storage sectors; other formats are serialized. */
+
+static t_bool _disk_q_positional (UNIT *uptr)
+{
+#if defined (_WIN32)
+return FALSE;
+#else
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (ctx->overlay != NULL)                               /* overlay file I/O is sequential */
+    return FALSE;
+switch (DK_GET_FMT (uptr)) {                            /* case on format */
+    case DKUF_F_STD:                                    /* SIMH format */
+        return (sim_end || (ctx->xfer_encode_size == sizeof (char)));
+    case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
+        return ((ctx->sector_size & (ctx->storage_sector_size - 1)) == 0);
+    default:
+        return FALSE;
+    }
+#endif
+}
+
+static void *
+_disk_q_io (void *arg)
+{
+UNIT* volatile uptr = (UNIT*)arg;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_bool serial;
+struct disk_qreq *req;
+
+sim_os_set_thread_priority (PRIORITY_ABOVE_NORMAL);
+
+pthread_mutex_lock (&ctx->io_lock);
+while (1) {
+    while (ctx->q_run && (ctx->q_head == NULL))
+        pthread_cond_wait (&ctx->q_cond, &ctx->io_lock);
+    if ((req = ctx->q_head) == NULL)                    /* stopping? */
+        break;
+    ctx->q_head = req->next;
+    if (ctx->q_head == NULL)
+        ctx->q_tail = NULL;
+    pthread_mutex_unlock (&ctx->io_lock);
+    serial = !_disk_q_positional (uptr);                /* an overlay may start after the thread */
+    if (serial)
+        pthread_mutex_lock (&ctx->q_serial);
+    switch (req->dop) {
+        case DOP_RSEC:
+            req->status = _disk_stat_xfer (uptr, DK_STAT_ASYNC, DK_STAT_READ, req->lba, req->buf, req->rsects, req->sects);
+            break;
+        case DOP_WSEC:
+            req->status = _disk_stat_xfer (uptr, DK_STAT_ASYNC, DK_STAT_WRITE, req->lba, req->buf, req->rsects, req->sects);
+            break;
+        case DOP_IAVL:
+            req->status = sim_disk_isavailable (uptr);
+            break;
+        }
+    if (serial)
+        pthread_mutex_unlock (&ctx->q_serial);
+    pthread_mutex_lock (&ctx->io_lock);
+    req->next = NULL;
+    if (ctx->q_done_tail)
+        ctx->q_done_tail->next = req;
+    else
+        ctx->q_done = req;
+    ctx->q_done_tail = req;
+    --ctx->q_active;
+    pthread_cond_broadcast (&ctx->q_idle);
+    sim_activate (&ctx->q_unit, ctx->asynch_io_latency);
+    }
+pthread_mutex_unlock (&ctx->io_lock);
+return NULL;
+}
+
+static t_stat _disk_q_submit (UNIT *uptr, int dop, t_lba lba, uint8 *buf, t_seccnt *rsects, t_seccnt sects,
+                              DISK_PCALLBACK pcallback, DISK_QCALLBACK qcallback, void *arg)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_qreq *req = (struct disk_qreq *)calloc (1, sizeof (*req));
+
+if (req == NULL)
+    return SCPE_MEM;
+sim_debug_unit (ctx->dbit, uptr, "_disk_q_submit(unit=%d, op=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), dop, lba, sects);
+req->dop = dop;
+req->lba = lba;
+req->buf = buf;
+req->rsects = rsects;
+req->sects = sects;
+req->pcallback = pcallback;
+req->qcallback = qcallback;
+req->arg = arg;
+pthread_mutex_lock (&ctx->io_lock);
+if (ctx->q_tail)
+    ctx->q_tail->next = req;
+else
+    ctx->q_head = req;
+ctx->q_tail = req;
+++ctx->q_active;
+pthread_cond_signal (&ctx->q_cond);
+pthread_mutex_unlock (&ctx->io_lock);
+return SCPE_OK;
+}
+
+/* Call the callbacks of completed requests - main thread only */
+
+static void _disk_q_dispatch (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_qreq *req, *next;
+
+pthread_mutex_lock (&ctx->io_lock);
+req = ctx->q_done;
+ctx->q_done = ctx->q_done_tail = NULL;
+pthread_mutex_unlock (&ctx->io_lock);
+for ( ; req != NULL; req = next) {
+    next = req->next;
+    sim_debug_unit (ctx->dbit, uptr, "_disk_q_dispatch(unit=%d, op=%d, lba=0x%X, status=%d)\n", (int)(uptr - ctx->dptr->units), req->dop, req->lba, req->status);
+    if (req->qcallback)
+        req->qcallback (uptr, req->status, req->arg);
+    else if (req->pcallback)
+        req->pcallback (uptr, req->status);
+    free (req);
+    }
+}
+
+static t_stat _disk_q_svc (UNIT *quptr)
+{
+_disk_q_dispatch ((UNIT *)quptr->up7);
+return SCPE_OK;
+}
+
+/* Wait for all queued requests and call their callbacks */
+
+static void _disk_q_drain (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+uint32 active;
+
+do {
+    pthread_mutex_lock (&ctx->io_lock);
+    while (ctx->q_active)
+        pthread_cond_wait (&ctx->q_idle, &ctx->io_lock);
+    pthread_mutex_unlock (&ctx->io_lock);
+    _disk_q_dispatch (uptr);                            /* callbacks may queue more */
+    pthread_mutex_lock (&ctx->io_lock);
+    active = ctx->q_active;
+    pthread_mutex_unlock (&ctx->io_lock);
+    } while (active);
+}
+
+static t_bool _disk_q_start (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+pthread_attr_t attr;
+char uname[CBUFSIZE];
+uint32 i;
+
+ctx->q_threads = (pthread_t *)calloc (ctx->asynch_depth, sizeof (*ctx->q_threads));
+if (ctx->q_threads == NULL)
+    return FALSE;
+pthread_cond_init (&ctx->q_cond, NULL);
+pthread_cond_init (&ctx->q_idle, NULL);
+pthread_mutex_init (&ctx->q_serial, NULL);
+ctx->q_unit.action = &_disk_q_svc;
+ctx->q_unit.up7 = uptr;
+snprintf (uname, sizeof (uname), "%s-IOQ", sim_uname (uptr));
+sim_set_uname (&ctx->q_unit, uname);
+if (DK_GET_FMT (uptr) == DKUF_F_STD)
+    fflush (uptr->fileref);                             /* pwrite bypasses stdio */
+ctx->q_run = 1;
+pthread_attr_init (&attr);
+pthread_attr_setscope (&attr, PTHREAD_SCOPE_SYSTEM);
+for (ctx->q_nthreads = 0; ctx->q_nthreads < ctx->asynch_depth; ctx->q_nthreads++) {
+    i = ctx->q_nthreads;
+    if (pthread_create (&ctx->q_threads[i], &attr, _disk_q_io, (void *)uptr) != 0)
+        break;
+    }
+pthread_attr_destroy (&attr);
+sim_debug_unit (ctx->dbit, uptr, "_disk_q_start(unit=%d, threads=%d)\n", (int)(uptr - ctx->dptr->units), ctx->q_nthreads);
+if (ctx->q_nthreads == 0) {                             /* no threads? */
+    ctx->q_run = 0;
+    free (ctx->q_threads);
+    ctx->q_threads = NULL;
+    free (ctx->q_unit.uname);
+    ctx->q_unit.uname = NULL;
+    pthread_cond_destroy (&ctx->q_cond);
+    pthread_cond_destroy (&ctx->q_idle);
+    pthread_mutex_destroy (&ctx->q_serial);
+    return FALSE;
+    }
+return TRUE;
+}
+
+static void _disk_q_stop (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+uint32 i;
+
+sim_debug_unit (ctx->dbit, uptr, "_disk_q_stop(unit=%d)\n", (int)(uptr - ctx->dptr->units));
+_disk_q_drain (uptr);
+pthread_mutex_lock (&ctx->io_lock);
+ctx->q_run = 0;
+pthread_cond_broadcast (&ctx->q_cond);
+pthread_mutex_unlock (&ctx->io_lock);
+for (i = 0; i < ctx->q_nthreads; i++)
+    pthread_join (ctx->q_threads[i], NULL);
+free (ctx->q_threads);
+ctx->q_threads = NULL;
+ctx->q_nthreads = 0;
+AIO_UPDATE_QUEUE;                                       /* migrate pending dispatch */
+sim_cancel (&ctx->q_unit);
+free (ctx->q_unit.uname);
+ctx->q_unit.uname = NULL;
+pthread_cond_destroy (&ctx->q_cond);
+pthread_cond_destroy (&ctx->q_idle);
+pthread_mutex_destroy (&ctx->q_serial);
+if (DK_GET_FMT (uptr) == DKUF_F_STD)
+    fflush (uptr->fileref);                             /* drop stale stdio data */
+}
 #else
 #define AIO_CALLSETUP
 #define AIO_CALL(op, _lba, _buf, _rsects, _sects,  _callback)   \
@@ -379,11 +722,26 @@ static void sim_vhd_disk_flush (FILE *f);
 static t_offset sim_vhd_disk_size (FILE *f);
 static uint32 sim_vhd_CHS (FILE *f);
 static const char *sim_vhd_disk_parent_path (FILE *f);
+static void sim_vhd_disk_show_chain (FILE *st, FILE *f, const char *prefix);
 static t_stat sim_vhd_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects);
 static t_stat sim_vhd_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects);
 static t_stat sim_vhd_disk_clearerr (UNIT *uptr);
 static t_stat sim_vhd_disk_set_dtype (FILE *f, const char *dtype, uint32 SectorSize, uint32 xfer_encode_size, uint32 media_id, const char *device_name, uint32 data_width, DRVTYP *drvtyp);
 static const char *sim_vhd_disk_get_dtype (FILE *f, uint32 *SectorSize, uint32 *xfer_encode_size, char sim_name[64], time_t *creation_time, uint32 *media_id, char device_name[16], uint32 *data_width);
+static FILE *sim_clu_disk_open (const char *path, const char *mode);
+static t_bool sim_clu_disk_probe (const char *path);
+static FILE *sim_clu_disk_create (const char *path, t_offset desiredsize, DRVTYP *drvtyp);
+static int sim_clu_disk_close (FILE *f);
+static void sim_clu_disk_flush (FILE *f);
+static t_offset sim_clu_disk_size (FILE *f);
+static t_stat sim_clu_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects);
+static t_stat sim_clu_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects);
+static t_stat sim_clu_disk_clearerr (UNIT *uptr);
+static t_bool sim_clu_disk_get_footer (FILE *f, struct simh_disk_footer *footer);
+static t_stat sim_clu_disk_set_footer (FILE *f, const struct simh_disk_footer *footer);
+static t_stat sim_clu_disk_set_compress (FILE *f, t_bool compress);
+static t_stat sim_clu_disk_snapshot (FILE *f, int32 op, const char *name);
+static void sim_clu_disk_show_snapshots (FILE *st, FILE *f, const char *prefix);
 static DRVTYP *sim_disk_find_type (UNIT *uptr, const char *dtype);
 uint32 sim_disk_drvtype_geometry (DRVTYP *drvtyp, uint32 totalSectors);
 static uint32 sim_SectorsToCHS (uint32 totalSectors);
@@ -417,6 +775,7 @@ static struct sim_disk_fmt fmts[] = {
     { "SIMH",        0, DKUF_F_STD,      0,                 NULL},
     { "RAW",         0, DKUF_F_RAW,      0,                 sim_os_disk_implemented_raw},
     { "VHD",         0, DKUF_F_VHD,      0,                 sim_vhd_disk_implemented},
+    { "CLUSTER",     0, DKUF_F_CLU,      0,                 NULL},
     { NULL,          0, 0,               0,                 NULL}
     };
 
@@ -434,8 +793,16 @@ for (f = 0; fmts[f].name; f++) {
     if (fmts[f].name && (MATCH_CMD (cptr, fmts[f].name) == 0)) {
         if ((fmts[f].impl_fnc) && (fmts[f].impl_fnc() != SCPE_OK))
             return SCPE_NOFNC;
-        uptr->flags = (uptr->flags & ~DKUF_FMT) |
-            (fmts[f].fmtval << DKUF_V_FMT) | fmts[f].uflags;
+        if (fmts[f].fmtval == DKUF_F_CLU) {             /* CLUSTER doesn't fit the flags field */
+            uptr->flags = (uptr->flags & ~DKUF_FMT) |
+                (DKUF_F_STD << DKUF_V_FMT) | fmts[f].uflags;
+            uptr->dynflags |= UNIT_DISK_CLU;
+            }
+        else {
+            uptr->flags = (uptr->flags & ~DKUF_FMT) |
+                (fmts[f].fmtval << DKUF_V_FMT) | fmts[f].uflags;
+            uptr->dynflags &= ~UNIT_DISK_CLU;
+            }
         if (fmts[f].fmtval == DKUF_F_AUTO)
             uptr->flags = (uptr->flags & ~DKUF_ENC) | (DKUF_E_AUTO << DKUF_V_ENC);
         return SCPE_OK;
@@ -565,6 +932,7 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
         is_available = TRUE;
         break;
     case DKUF_F_VHD:                                    /* VHD format */
+    case DKUF_F_CLU:                                    /* Clustered format */
         is_available = TRUE;
         break;
     case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
@@ -802,15 +1170,18 @@ if (ctx->asynch_io) {
     pthread_mutex_init (&ctx->io_lock, NULL);
     pthread_cond_init (&ctx->io_cond, NULL);
     pthread_cond_init (&ctx->io_done, NULL);
-    pthread_cond_init (&ctx->startup_cond, NULL);
-    pthread_attr_init(&attr);
-    pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
-    pthread_mutex_lock (&ctx->io_lock);
-    pthread_create (&ctx->io_thread, &attr, _disk_io, (void *)uptr);
-    pthread_attr_destroy(&attr);
-    pthread_cond_wait (&ctx->startup_cond, &ctx->io_lock); /* Wait for thread to stabilize */
-    pthread_mutex_unlock (&ctx->io_lock);
-    pthread_cond_destroy (&ctx->startup_cond);
+    if ((ctx->asynch_depth <= 1) ||                     /* single request at a time */
+        (!_disk_q_start (uptr))) {                      /* or no request queue? */
+        pthread_cond_init (&ctx->startup_cond, NULL);
+        pthread_attr_init(&attr);
+        pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+        pthread_mutex_lock (&ctx->io_lock);
+        pthread_create (&ctx->io_thread, &attr, _disk_io, (void *)uptr);
+        pthread_attr_destroy(&attr);
+        pthread_cond_wait (&ctx->startup_cond, &ctx->io_lock); /* Wait for thread to stabilize */
+        pthread_mutex_unlock (&ctx->io_lock);
+        pthread_cond_destroy (&ctx->startup_cond);
+        }
     }
 uptr->a_check_completion = _disk_completion_dispatch;
 uptr->a_is_active = _disk_is_active;
@@ -834,11 +1205,16 @@ if (!ctx) return SCPE_UNATT;
 sim_debug_unit (ctx->dbit, uptr, "sim_disk_clr_async(unit=%d)\n", (int)(uptr - ctx->dptr->units));
 
 if (ctx->asynch_io) {
-    pthread_mutex_lock (&ctx->io_lock);
+    if (ctx->q_run)
+        _disk_q_stop (uptr);
+    else {
+        pthread_mutex_lock (&ctx->io_lock);
+        ctx->asynch_io = 0;
+        pthread_cond_signal (&ctx->io_cond);
+        pthread_mutex_unlock (&ctx->io_lock);
+        pthread_join (ctx->io_thread, NULL);
+        }
     ctx->asynch_io = 0;
-    pthread_cond_signal (&ctx->io_cond);
-    pthread_mutex_unlock (&ctx->io_lock);
-    pthread_join (ctx->io_thread, NULL);
     pthread_mutex_destroy (&ctx->io_lock);
     pthread_cond_destroy (&ctx->io_cond);
     pthread_cond_destroy (&ctx->io_done);
@@ -862,6 +1238,24 @@ da = ((t_offset)lba) * ctx->sector_size;
 tbc = sects * ctx->sector_size;
 if (sectsread)
     *sectsread = 0;
+#if defined (SIM_ASYNCH_IO) && !defined (_WIN32)
+if (ctx->q_run && _disk_q_positional (uptr)) {          /* concurrent requests? */
+    ssize_t bytes;
+
+    for (i = 0; i < tbc; i += (size_t)bytes) {          /* positional read */
+        bytes = pread (fileno (uptr->fileref), buf + i, tbc - i, (off_t)(da + i));
+        if (bytes < 0)
+            return SCPE_IOERR;
+        if (bytes == 0)                                 /* EOF? */
+            break;
+        }
+    if (i < tbc)                                        /* fill */
+        memset (&buf[i], 0, tbc - i);
+    if (sectsread)
+        *sectsread = sects;
+    return SCPE_OK;
+    }
+#endif
 while (tbc) {
     size_t sectbytes;
 
@@ -892,7 +1286,218 @@ while (tbc) {
 return SCPE_OK;
 }
 
-t_stat sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+/* Transfers within a memory mapped SIMH or RAW container are copies to or
+   from the mapping, with the same data layout as the file I/O they replace:
+   reads are byte swapped by the caller after the copy, just like data read
+   from the file, and writes are byte swapped here, just as sim_fwrite does */
+
+#define DISK_MAPPED(ctx, lba, sects) \
+    (((ctx)->map_base != NULL) &&    \
+     ((((t_offset)(lba)) + (sects)) * (ctx)->sector_size <= (t_offset)(ctx)->map_size))
+
+#define DK_MMAP_GROW    (1 << 20)       /* file growth which remakes the mapping */
+
+static t_stat _disk_mmap_setup (UNIT *uptr);
+
+static t_stat _sim_disk_rdsect_mapped (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+memcpy (buf, ctx->map_base + ((size_t)lba) * ctx->sector_size, sects * ctx->sector_size);
+if (sectsread)
+    *sectsread = sects;
+return SCPE_OK;
+}
+
+static t_stat _sim_disk_wrsect_mapped (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+uint8 *dest = ctx->map_base + ((size_t)lba) * ctx->sector_size;
+
+if (!sim_end && (ctx->xfer_encode_size != sizeof (char)))
+    sim_buf_copy_swapped (dest, buf, ctx->xfer_encode_size, (sects * ctx->sector_size) / ctx->xfer_encode_size);
+else
+    memcpy (dest, buf, sects * ctx->sector_size);
+if (sectswritten)
+    *sectswritten = sects;
+return SCPE_OK;
+}
+
+/* A write to the file ended beyond the mapped part of the container.
+   Data still buffered for the mapped part is flushed at once.  When the
+   file has grown by DK_MMAP_GROW the mapping is remade to cover the new
+   end, unless concurrent transfers might be using it. */
+
+static t_stat _disk_mmap_extend (UNIT *uptr, t_offset da, t_offset end_write)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if ((DK_GET_FMT (uptr) == DKUF_F_STD) && (da < (t_offset)ctx->map_size))
+    fflush (uptr->fileref);                             /* write straddled the mapping */
+ctx->map_grown += (size_t)(end_write - da);
+if (ctx->map_grown < DK_MMAP_GROW)
+    return SCPE_OK;
+#if defined (SIM_ASYNCH_IO)
+if (ctx->q_run)
+    return SCPE_OK;
+#endif
+return _disk_mmap_setup (uptr);
+}
+
+/* Overlay files (ATTACH -O overlay base)
+
+   A SIMH or RAW format base container is opened read only, and possibly
+   shared by many simulators, while every sector written is recorded in an
+   overlay file private to the unit.  The overlay is a header followed by
+   records, each a sector number and the sector's data, appended in the
+   order sectors are first written.  Rewriting a sector updates its record
+   in place.  Which sectors are in the overlay is kept in memory, in
+   chunks allocated as sectors in them are first written, and is rebuilt
+   by scanning the records when an overlay is opened again. */
+
+#define DK_OVL_KEEP     0                       /* leave the overlay file at detach */
+#define DK_OVL_DISCARD  1                       /* delete it at detach */
+#define DK_OVL_MERGE    2                       /* write its sectors to the base at detach */
+#define DK_OVL_CHUNK    1024                    /* sectors mapped per chunk */
+#define DK_OVL_HDRSIZE  512                     /* overlay file header bytes */
+#define DK_OVL_RECHDR   8                       /* record header bytes */
+#define DK_OVL_MAGIC    "SIMHOVL1"
+#define DK_OVL_RECMAGIC 0x4F564C52              /* "OVLR" */
+
+struct disk_overlay_header {
+    char                Magic[8];
+    uint32              SectorSize;
+    uint32              SectorCount;
+    uint32              BaseSize[2];        /* base container size in bytes (high, low) */
+    };
+
+struct disk_overlay {
+    FILE                *file;
+    char                *name;
+    uint32              sector_size;
+    uint32              sectors;            /* sectors in the disk */
+    uint32              records;            /* records in the overlay file */
+    uint32              **chunks;           /* record number + 1 of each overlaid sector */
+    uint32              disposition;        /* DK_OVL_KEEP, DK_OVL_DISCARD or DK_OVL_MERGE */
+    t_uint64            reads;              /* sectors read from the overlay */
+    t_uint64            writes;             /* sectors written to the overlay */
+    };
+
+#define DK_OVL_RECORD(ov, rec) \
+    (DK_OVL_HDRSIZE + ((t_offset)(rec)) * (DK_OVL_RECHDR + (ov)->sector_size))
+
+static uint32 _disk_overlay_find (struct disk_overlay *ov, t_lba lba)
+{
+uint32 *chunk = (lba < ov->sectors) ? ov->chunks[lba / DK_OVL_CHUNK] : NULL;
+
+return chunk ? chunk[lba % DK_OVL_CHUNK] : 0;
+}
+
+static t_stat _disk_overlay_insert (struct disk_overlay *ov, t_lba lba, uint32 rec)
+{
+uint32 **chunk;
+
+if (lba >= ov->sectors)
+    return SCPE_IOERR;
+chunk = &ov->chunks[lba / DK_OVL_CHUNK];
+if (*chunk == NULL) {
+    *chunk = (uint32 *)calloc (DK_OVL_CHUNK, sizeof (**chunk));
+    if (*chunk == NULL)
+        return SCPE_MEM;
+    }
+(*chunk)[lba % DK_OVL_CHUNK] = rec + 1;
+return SCPE_OK;
+}
+
+/* Read sectors from a SIMH or RAW base container */
+
+static t_stat _disk_base_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (DISK_MAPPED (ctx, lba, sects))
+    return _sim_disk_rdsect_mapped (uptr, lba, buf, sectsread, sects);
+if (DK_GET_FMT (uptr) == DKUF_F_STD)
+    return _sim_disk_rdsect (uptr, lba, buf, sectsread, sects);
+return sim_os_disk_rdsect (uptr, lba, buf, sectsread, sects);
+}
+
+static t_stat _disk_overlay_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_overlay *ov = ctx->overlay;
+t_seccnt i, run;
+t_stat r = SCPE_OK;
+
+for (i = 0; (r == SCPE_OK) && (i < sects); i += run) {
+    uint32 rec = _disk_overlay_find (ov, lba + i);
+
+    run = 1;
+    if (rec != 0) {                                     /* sector is in the overlay */
+        if ((sim_fseeko (ov->file, DK_OVL_RECORD (ov, rec - 1) + DK_OVL_RECHDR, SEEK_SET) != 0) ||
+            (sim_fread (buf + i * ov->sector_size, 1, ov->sector_size, ov->file) != ov->sector_size))
+            r = SCPE_IOERR;
+        ++ov->reads;
+        continue;
+        }
+    while ((i + run < sects) && (_disk_overlay_find (ov, lba + i + run) == 0))
+        ++run;
+    r = _disk_base_rdsect (uptr, lba + i, buf + i * ov->sector_size, NULL, run);
+    }
+if (sectsread)
+    *sectsread = (r == SCPE_OK) ? sects : 0;
+return r;
+}
+
+static t_stat _disk_overlay_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_overlay *ov = ctx->overlay;
+uint8 *tbuf = NULL;
+t_seccnt i;
+t_stat r = SCPE_OK;
+
+if (sectswritten)
+    *sectswritten = 0;
+if (!sim_end && (ctx->xfer_encode_size != sizeof (char))) {     /* keep the container's byte order */
+    tbuf = (uint8 *)malloc (sects * ov->sector_size);
+    if (tbuf == NULL)
+        return SCPE_MEM;
+    sim_buf_copy_swapped (tbuf, buf, ctx->xfer_encode_size, (sects * ov->sector_size) / ctx->xfer_encode_size);
+    buf = tbuf;
+    }
+for (i = 0; (r == SCPE_OK) && (i < sects); i++) {
+    uint32 rec = _disk_overlay_find (ov, lba + i);
+
+    if (rec != 0) {                                     /* rewrite in place */
+        if (sim_fseeko (ov->file, DK_OVL_RECORD (ov, rec - 1) + DK_OVL_RECHDR, SEEK_SET) != 0)
+            r = SCPE_IOERR;
+        }
+    else {                                              /* append a record */
+        uint32 hdr[2];
+
+        hdr[0] = NtoHl ((uint32)(lba + i));
+        hdr[1] = NtoHl ((uint32)(lba + i) ^ DK_OVL_RECMAGIC);
+        if ((sim_fseeko (ov->file, DK_OVL_RECORD (ov, ov->records), SEEK_SET) != 0) ||
+            (sim_fwrite (hdr, 1, sizeof (hdr), ov->file) != sizeof (hdr)))
+            r = SCPE_IOERR;
+        else
+            r = _disk_overlay_insert (ov, lba + i, ov->records++);
+        }
+    if ((r == SCPE_OK) &&
+        (sim_fwrite (buf + i * ov->sector_size, 1, ov->sector_size, ov->file) != ov->sector_size))
+        r = SCPE_IOERR;
+    if (r == SCPE_OK) {
+        ++ov->writes;
+        if (sectswritten)
+            *sectswritten = i + 1;
+        }
+    }
+free (tbuf);
+return r;
+}
+
+static t_stat _sim_disk_rdsect_uncached (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
 {
 t_stat r;
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
@@ -903,7 +1508,9 @@ uint8 *rbuf;
 
 sim_debug_unit (ctx->dbit, uptr, "sim_disk_rdsect(unit=%d, lba=0x%X, sects=%d)\n", (int)(uptr - ctx->dptr->units), lba, sects);
 
+DISK_Q_LOCK (ctx);
 ctx->read_count++;                                      /* record read operation */
+DISK_Q_UNLOCK (ctx);
 if ((sects == 1) &&                                     /* Single sector reads */
     (lba >= (uptr->capac*ctx->capac_factor)/(ctx->sector_size/((ctx->dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)))) {/* beyond the end of the disk */
     memset (buf, '\0', ctx->sector_size);               /* are bad block management efforts - zero buffer */
@@ -911,11 +1518,19 @@ if ((sects == 1) &&                                     /* Single sector reads *
         *sectsread = 1;
     return SCPE_OK;                                     /* return success */
     }
+if ((ctx->probe_buf != NULL) &&                         /* File system probe within the prefetched data? */
+    ((((t_offset)lba) + sects) * ctx->sector_size <= (t_offset)ctx->probe_bytes)) {
+    memcpy (buf, ctx->probe_buf + lba * ctx->sector_size, sects * ctx->sector_size);
+    if (sectsread)
+        *sectsread = sects;
+    return SCPE_OK;
+    }
 
 if ((0 == (ctx->sector_size & (ctx->storage_sector_size - 1))) ||   /* Sector Aligned & whole sector transfers */
     ((0 == ((lba*ctx->sector_size) & (ctx->storage_sector_size - 1))) &&
      (0 == ((sects*ctx->sector_size) & (ctx->storage_sector_size - 1)))) ||
-    (f == DKUF_F_STD) || (f == DKUF_F_VHD)) {                       /* or SIMH or VHD formats */
+    (f == DKUF_F_STD) || (f == DKUF_F_VHD) || (f == DKUF_F_CLU) ||  /* or SIMH, VHD or Clustered formats */
+    DISK_MAPPED (ctx, lba, sects) || (ctx->overlay != NULL)) {      /* or memory mapped or overlaid */
         if (ctx->xfer_encode_size > DK_ENC_LONGLONG) {
             tbuf = (uint8*) malloc (ctx->sector_size * sects);
             if (tbuf == NULL)
@@ -926,13 +1541,26 @@ if ((0 == (ctx->sector_size & (ctx->storage_sector_size - 1))) ||   /* Sector Al
             rbuf = buf;
     switch (f) {                                        /* case on format */
         case DKUF_F_STD:                                /* SIMH format */
-            r = _sim_disk_rdsect (uptr, lba, rbuf, &sread, sects);
+            if (ctx->overlay != NULL)
+                r = _disk_overlay_rdsect (uptr, lba, rbuf, &sread, sects);
+            else if (DISK_MAPPED (ctx, lba, sects))
+                r = _sim_disk_rdsect_mapped (uptr, lba, rbuf, &sread, sects);
+            else
+                r = _sim_disk_rdsect (uptr, lba, rbuf, &sread, sects);
             break;
         case DKUF_F_VHD:                                /* VHD format */
             r = sim_vhd_disk_rdsect (uptr, lba, rbuf, &sread, sects);
             break;
+        case DKUF_F_CLU:                                /* Clustered format */
+            r = sim_clu_disk_rdsect (uptr, lba, rbuf, &sread, sects);
+            break;
         case DKUF_F_RAW:                                /* Raw Physical Disk Access */
-            r = sim_os_disk_rdsect (uptr, lba, rbuf, &sread, sects);
+            if (ctx->overlay != NULL)
+                r = _disk_overlay_rdsect (uptr, lba, rbuf, &sread, sects);
+            else if (DISK_MAPPED (ctx, lba, sects))
+                r = _sim_disk_rdsect_mapped (uptr, lba, rbuf, &sread, sects);
+            else
+                r = sim_os_disk_rdsect (uptr, lba, rbuf, &sread, sects);
             break;
         default:
             free (tbuf);
@@ -1023,6 +1651,20 @@ da = ((t_offset)lba) * ctx->sector_size;
 tbc = sects * ctx->sector_size;
 if (sectswritten)
     *sectswritten = 0;
+#if defined (SIM_ASYNCH_IO) && !defined (_WIN32)
+if (ctx->q_run && _disk_q_positional (uptr)) {          /* concurrent requests in host order? */
+    ssize_t bytes;
+
+    for (i = 0; i < tbc; i += (size_t)bytes) {          /* positional write */
+        bytes = pwrite (fileno (uptr->fileref), buf + i, tbc - i, (off_t)(da + i));
+        if (bytes <= 0)
+            break;
+        }
+    if (sectswritten)
+        *sectswritten = (t_seccnt)((i + ctx->sector_size - 1)/ctx->sector_size);
+    return (i < tbc) ? SCPE_IOERR : SCPE_OK;
+    }
+#endif
 err = sim_fseeko (uptr->fileref, da, SEEK_SET);          /* set pos */
 if (err)
     return SCPE_IOERR;
@@ -1035,7 +1677,7 @@ if (err)
 return SCPE_OK;
 }
 
-t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+static t_stat _sim_disk_wrsect_uncached (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
 {
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 uint32 f = DK_GET_FMT (uptr);
@@ -1047,7 +1689,9 @@ sim_debug_unit (ctx->dbit, uptr, "sim_disk_wrsect(unit=%d, lba=0x%X, sects=%d)\n
 
 if (sectswritten)
     *sectswritten = 0;
+DISK_Q_LOCK (ctx);
 ctx->write_count++;                                     /* record write operation */
+DISK_Q_UNLOCK (ctx);
 if (uptr->dynflags & UNIT_DISK_CHK) {
     DEVICE *dptr = find_dev_from_unit (uptr);
     uint32 capac_factor = ((dptr->dwidth / dptr->aincr) >= 32) ? 8 : ((dptr->dwidth / dptr->aincr) == 16) ? 2 : 1; /* capacity units (quadword: 8, word: 2, byte: 1) */
@@ -1079,7 +1723,12 @@ if (uptr->dynflags & UNIT_DISK_CHK) {
     }
 switch (f) {                                            /* case on format */
     case DKUF_F_STD:                                    /* SIMH format */
-        r = _sim_disk_wrsect (uptr, lba, buf, &written, sects);
+        if (ctx->overlay != NULL)
+            r = _disk_overlay_wrsect (uptr, lba, buf, &written, sects);
+        else if (DISK_MAPPED (ctx, lba, sects))
+            r = _sim_disk_wrsect_mapped (uptr, lba, buf, &written, sects);
+        else
+            r = _sim_disk_wrsect (uptr, lba, buf, &written, sects);
         break;
     case DKUF_F_VHD:                                    /* VHD format */
         if (!sim_end && (ctx->xfer_encode_size != sizeof (char))) {
@@ -1091,12 +1740,26 @@ switch (f) {                                            /* case on format */
             }
         r = sim_vhd_disk_wrsect  (uptr, lba, buf, &written, sects);
         break;
+    case DKUF_F_CLU:                                    /* Clustered format */
+        if (!sim_end && (ctx->xfer_encode_size != sizeof (char))) {
+            tbuf = (uint8*) malloc (sects * ctx->sector_size);
+            if (NULL == tbuf)
+                return SCPE_MEM;
+            sim_buf_copy_swapped (tbuf, buf, ctx->xfer_encode_size, (sects * ctx->sector_size) / ctx->xfer_encode_size);
+            buf = tbuf;
+            }
+        r = sim_clu_disk_wrsect (uptr, lba, buf, &written, sects);
+        break;
     case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
         break;                                          /* handle below */
     default:
         return SCPE_NOFNC;
     }
-if (f == DKUF_F_RAW) {
+if ((f == DKUF_F_RAW) && (ctx->overlay != NULL))
+    r = _disk_overlay_wrsect (uptr, lba, buf, &written, sects);
+else if ((f == DKUF_F_RAW) && DISK_MAPPED (ctx, lba, sects))
+    r = _sim_disk_wrsect_mapped (uptr, lba, buf, &written, sects);
+else if (f == DKUF_F_RAW) {
     if ((0 == (ctx->sector_size & (ctx->storage_sector_size - 1))) ||   /* Sector Aligned & whole sector transfers */
         ((0 == ((lba*ctx->sector_size) & (ctx->storage_sector_size - 1))) &&
          (0 == ((sects*ctx->sector_size) & (ctx->storage_sector_size - 1))))) {
@@ -1140,20 +1803,1203 @@ if (written > 0) {
     t_offset da = ((t_offset)lba) * ctx->sector_size;
     t_offset end_write = da + (written * ctx->sector_size);
 
+    DISK_Q_LOCK (ctx);
     if (ctx->highwater < end_write)
         ctx->highwater = end_write;
+    DISK_Q_UNLOCK (ctx);
+    if ((ctx->map != NULL) && (ctx->overlay == NULL) && (end_write > (t_offset)ctx->map_size) && (r == SCPE_OK))
+        r = _disk_mmap_extend (uptr, da, end_write);
     }
 return r;
 }
 
-t_stat sim_disk_wrsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_PCALLBACK callback)
-{
-t_stat r = SCPE_OK;
-AIO_CALLSETUP
-    r =  sim_disk_wrsect (uptr, lba, buf, sectswritten, sects);
-AIO_CALL(DOP_WSEC, lba, buf, sectswritten, sects, callback);
-return r;
-}
+/* Sector cache
+
+   An optional per-unit cache of recently used sectors, holding data as
+   seen by the simulator (after any transfer encoding).  Sectors are kept
+   in least recently used order and found through a hash of their LBA.
+   A read which is entirely in the cache does no host I/O; other reads go
+   to the container and the sectors read are added to the cache.
+
+   With write through, writes go to the container and also update the
+   cache.  With write back, writes only update the cache.  Modified
+   sectors are written when they are evicted, and all of them are written
+   (in LBA order, coalesced into runs) whenever the unit's I/O is flushed:
+   when the simulator stops, on detach and before SAVE.
+
+   Transfers larger than a quarter of the cache bypass it, except that
+   cached copies of the sectors involved are kept current. */
+
+#define DK_CACHE_NIL    0xFFFFFFFF
+
+struct disk_cache_ent {
+    t_lba               lba;                /* sector held */
+    uint32              hnext;              /* hash chain */
+    uint32              prev;               /* LRU list, head is most recent */
+    uint32              next;
+    uint8               valid;
+    uint8               dirty;              /* modified, not yet written */
+    };
+
+struct disk_cache {
+    uint32              nent;               /* sectors held */
+    uint32              sector_size;
+    t_bool              writeback;
+    uint32              hmask;              /* hash table size - 1 */
+    uint32              *hash;              /* hash chain heads */
+    struct disk_cache_ent *ent;
+    uint8               *data;
+    uint32              head;               /* most recently used */
+    uint32              tail;               /* least recently used */
+    uint32              ndirty;             /* modified sectors */
+    t_uint64            reads;              /* read requests */
+    t_uint64            read_hits;          /* read requests satisfied from the cache */
+    t_uint64            read_sects;         /* sectors read */
+    t_uint64            read_sect_hits;     /* sectors found in the cache */
+    t_uint64            writes;             /* write requests */
+    t_uint64            write_sects;        /* sectors written */
+    t_uint64            evictions;          /* sectors evicted */
+    t_uint64            writebacks;         /* modified sectors written to the container */
+    t_uint64            flushes;            /* flush operations */
+#if defined (SIM_ASYNCH_IO)
+    pthread_mutex_t     lock;               /* concurrent queued requests */
+#endif
+    };
+
+#if defined (SIM_ASYNCH_IO)
+#define DK_CACHE_LOCK(c)    pthread_mutex_lock (&(c)->lock)
+#define DK_CACHE_UNLOCK(c)  pthread_mutex_unlock (&(c)->lock)
+#else
+#define DK_CACHE_LOCK(c)
+#define DK_CACHE_UNLOCK(c)
+#endif
+
+#define DK_CACHE_HASH(c, lba) ((((uint32)(lba)) * 0x9E3779B1) >> 7 & (c)->hmask)
+
+static struct disk_cache *_disk_cache_create (uint32 nent, uint32 sector_size, t_bool writeback)
+{
+struct disk_cache *c = (struct disk_cache *)calloc (1, sizeof (*c));
+uint32 i;
+
+if (c == NULL)
+    return NULL;
+for (c->hmask = 1; c->hmask < nent; c->hmask <<= 1)
+    ;
+c->hash = (uint32 *)malloc (c->hmask * sizeof (*c->hash));
+c->ent = (struct disk_cache_ent *)calloc (nent, sizeof (*c->ent));
+c->data = (uint8 *)malloc ((size_t)nent * sector_size);
+if ((c->hash == NULL) || (c->ent == NULL) || (c->data == NULL)) {
+    free (c->hash);
+    free (c->ent);
+    free (c->data);
+    free (c);
+    return NULL;
+    }
+c->hmask -= 1;
+c->nent = nent;
+c->sector_size = sector_size;
+c->writeback = writeback;
+for (i = 0; i <= c->hmask; i++)
+    c->hash[i] = DK_CACHE_NIL;
+for (i = 0; i < nent; i++) {                            /* all on LRU list */
+    c->ent[i].prev = (i == 0) ? DK_CACHE_NIL : i - 1;
+    c->ent[i].next = (i == nent - 1) ? DK_CACHE_NIL : i + 1;
+    }
+c->head = 0;
+c->tail = nent - 1;
+#if defined (SIM_ASYNCH_IO)
+pthread_mutex_init (&c->lock, NULL);
+#endif
+return c;
+}
+
+static void _disk_cache_free (struct disk_cache *c)
+{
+if (c == NULL)
+    return;
+#if defined (SIM_ASYNCH_IO)
+pthread_mutex_destroy (&c->lock);
+#endif
+free (c->hash);
+free (c->ent);
+free (c->data);
+free (c);
+}
+
+static uint32 _disk_cache_find (struct disk_cache *c, t_lba lba)
+{
+uint32 i;
+
+for (i = c->hash[DK_CACHE_HASH (c, lba)]; i != DK_CACHE_NIL; i = c->ent[i].hnext) {
+    if (c->ent[i].lba == lba)
+        break;
+    }
+return i;
+}
+
+static void _disk_cache_touch (struct disk_cache *c, uint32 i)
+{
+struct disk_cache_ent *e = &c->ent[i];
+
+if (c->head == i)                                       /* already most recent? */
+    return;
+c->ent[e->prev].next = e->next;                         /* unlink */
+if (e->next != DK_CACHE_NIL)
+    c->ent[e->next].prev = e->prev;
+else
+    c->tail = e->prev;
+e->prev = DK_CACHE_NIL;                                 /* insert at head */
+e->next = c->head;
+c->ent[c->head].prev = i;
+c->head = i;
+}
+
+/* Get a slot for a sector, evicting the least recently used one */
+
+static uint32 _disk_cache_alloc (UNIT *uptr, struct disk_cache *c, t_lba lba)
+{
+uint32 i = c->tail;
+struct disk_cache_ent *e = &c->ent[i];
+uint32 *hp;
+
+if (e->valid) {
+    if (e->dirty) {                                     /* write it first */
+        _sim_disk_wrsect_uncached (uptr, e->lba, &c->data[(size_t)i * c->sector_size], NULL, 1);
+        ++c->writebacks;
+        --c->ndirty;
+        e->dirty = 0;
+        }
+    for (hp = &c->hash[DK_CACHE_HASH (c, e->lba)]; *hp != i; hp = &c->ent[*hp].hnext)
+        ;
+    *hp = e->hnext;                                     /* unhash */
+    ++c->evictions;
+    }
+e->lba = lba;
+e->valid = 1;
+e->hnext = c->hash[DK_CACHE_HASH (c, lba)];
+c->hash[DK_CACHE_HASH (c, lba)] = i;
+_disk_cache_touch (c, i);
+return i;
+}
+
+static int _disk_cache_lba_compare (const void *pa, const void *pb)
+{
+const struct disk_cache_ent *a = *(const struct disk_cache_ent * const *)pa;
+const struct disk_cache_ent *b = *(const struct disk_cache_ent * const *)pb;
+
+return (a->lba < b->lba) ? -1 : ((a->lba > b->lba) ? 1 : 0);
+}
+
+/* Write all modified sectors to the container */
+
+static t_stat _disk_cache_flush (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *c = ctx ? ctx->cache : NULL;
+struct disk_cache_ent **dirty;
+uint8 *buf;
+uint32 i, n, run, max_run = 128;
+t_stat r = SCPE_OK, r2;
+
+if (c == NULL)
+    return SCPE_OK;
+DK_CACHE_LOCK (c);
+if (c->ndirty == 0) {                                   /* nothing to write? */
+    DK_CACHE_UNLOCK (c);
+    return SCPE_OK;
+    }
+dirty = (struct disk_cache_ent **)malloc (c->ndirty * sizeof (*dirty));
+buf = (uint8 *)malloc ((size_t)max_run * c->sector_size);
+if ((dirty == NULL) || (buf == NULL)) {
+    free (dirty);
+    free (buf);
+    DK_CACHE_UNLOCK (c);
+    return SCPE_MEM;
+    }
+for (i = n = 0; i < c->nent; i++) {
+    if (c->ent[i].valid && c->ent[i].dirty)
+        dirty[n++] = &c->ent[i];
+    }
+qsort (dirty, n, sizeof (*dirty), _disk_cache_lba_compare);
+for (i = 0; i < n; i += run) {                          /* write runs */
+    for (run = 0; (i + run < n) && (run < max_run) &&
+                  (dirty[i + run]->lba == dirty[i]->lba + run); run++) {
+        memcpy (&buf[(size_t)run * c->sector_size], &c->data[(size_t)(dirty[i + run] - c->ent) * c->sector_size], c->sector_size);
+        dirty[i + run]->dirty = 0;
+        }
+    r2 = _sim_disk_wrsect_uncached (uptr, dirty[i]->lba, buf, NULL, run);
+    if (r == SCPE_OK)
+        r = r2;
+    c->writebacks += run;
+    }
+c->ndirty = 0;
+++c->flushes;
+DK_CACHE_UNLOCK (c);
+free (dirty);
+free (buf);
+sim_debug_unit (ctx->dbit, uptr, "_disk_cache_flush(unit=%d, sectors=%u, status=%d)\n", (int)(uptr - ctx->dptr->units), n, r);
+return r;
+}
+
+static t_stat _disk_cache_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *c = ctx->cache;
+t_bool fill = (sects <= c->nent / 4);
+t_seccnt i, hits, sread = 0;
+uint32 e;
+t_stat r;
+
+DK_CACHE_LOCK (c);
+++c->reads;
+c->read_sects += sects;
+for (i = hits = 0; i < sects; i++) {
+    if (_disk_cache_find (c, lba + i) != DK_CACHE_NIL)
+        ++hits;
+    }
+c->read_sect_hits += hits;
+if (hits == sects) {                                    /* all cached? */
+    for (i = 0; i < sects; i++) {
+        e = _disk_cache_find (c, lba + i);
+        memcpy (&buf[(size_t)i * c->sector_size], &c->data[(size_t)e * c->sector_size], c->sector_size);
+        _disk_cache_touch (c, e);
+        }
+    ++c->read_hits;
+    DK_CACHE_UNLOCK (c);
+    if (sectsread)
+        *sectsread = sects;
+    return SCPE_OK;
+    }
+DK_CACHE_UNLOCK (c);
+r = _sim_disk_rdsect_uncached (uptr, lba, buf, &sread, sects);
+DK_CACHE_LOCK (c);
+for (i = 0; i < sread; i++) {
+    e = _disk_cache_find (c, lba + i);
+    if (e != DK_CACHE_NIL) {                            /* cached copy is current */
+        memcpy (&buf[(size_t)i * c->sector_size], &c->data[(size_t)e * c->sector_size], c->sector_size);
+        _disk_cache_touch (c, e);
+        }
+    else {
+        if (fill && (r == SCPE_OK)) {
+            e = _disk_cache_alloc (uptr, c, lba + i);
+            memcpy (&c->data[(size_t)e * c->sector_size], &buf[(size_t)i * c->sector_size], c->sector_size);
+            }
+        }
+    }
+DK_CACHE_UNLOCK (c);
+if (sectsread)
+    *sectsread = sread;
+return r;
+}
+
+static t_stat _disk_cache_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_cache *c = ctx->cache;
+t_bool fill = (sects <= c->nent / 4);
+t_bool writeback = (c->writeback && fill);
+t_seccnt i;
+uint32 e;
+
+DK_CACHE_LOCK (c);
+++c->writes;
+c->write_sects += sects;
+for (i = 0; i < sects; i++) {
+    e = _disk_cache_find (c, lba + i);
+    if (e == DK_CACHE_NIL) {
+        if (!fill)
+            continue;
+        e = _disk_cache_alloc (uptr, c, lba + i);
+        }
+    else
+        _disk_cache_touch (c, e);
+    memcpy (&c->data[(size_t)e * c->sector_size], &buf[(size_t)i * c->sector_size], c->sector_size);
+    if (writeback != c->ent[e].dirty) {                 /* dirty state changing? */
+        if (writeback)
+            ++c->ndirty;
+        else
+            --c->ndirty;
+        c->ent[e].dirty = (uint8)writeback;
+        }
+    }
+DK_CACHE_UNLOCK (c);
+if (writeback) {                                        /* written later */
+    if (sectswritten)
+        *sectswritten = sects;
+    return SCPE_OK;
+    }
+return _sim_disk_wrsect_uncached (uptr, lba, buf, sectswritten, sects);
+}
+
+/* I/O statistics recording */
+
+static t_uint64 _disk_stat_usecs (void)
+{
+struct timespec now;
+
+#if defined (CLOCK_MONOTONIC)
+if (clock_gettime (CLOCK_MONOTONIC, &now) != 0)
+#endif
+    clock_gettime (CLOCK_REALTIME, &now);               /* hosts without a monotonic clock */
+return (((t_uint64)now.tv_sec) * 1000000) + (now.tv_nsec / 1000);
+}
+
+static void _disk_stat_record (UNIT *uptr, uint32 path, struct disk_op_stats *s, t_seccnt sects, t_stat r, t_uint64 start)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_uint64 end = _disk_stat_usecs ();
+uint32 usecs = (end <= start) ? 0 : ((end - start) > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32)(end - start);
+uint32 bucket = 0;
+
+while ((bucket < DK_STAT_BUCKETS - 1) && ((usecs >> (bucket + 1)) != 0))
+    ++bucket;
+#if defined (SIM_ASYNCH_IO)
+if (path == DK_STAT_ASYNC)                              /* several I/O threads may record */
+    pthread_mutex_lock (&ctx->io_lock);
+#endif
+++s->ops;
+s->sectors += sects;
+s->bytes += ((t_uint64)sects) * ctx->sector_size;
+if (r != SCPE_OK)
+    ++s->errors;
+s->usecs += usecs;
+if (usecs > s->max_usecs)
+    s->max_usecs = usecs;
+++s->hist[bucket];
+#if defined (SIM_ASYNCH_IO)
+if (path == DK_STAT_ASYNC)
+    pthread_mutex_unlock (&ctx->io_lock);
+#endif
+}
+
+static t_stat _disk_stat_xfer (UNIT *uptr, uint32 path, uint32 op, t_lba lba, uint8 *buf, t_seccnt *sectsdone, t_seccnt sects)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_uint64 start = _disk_stat_usecs ();
+t_seccnt done = 0;
+t_stat r;
+
+if (op == DK_STAT_READ)
+    r = ctx->cache ? _disk_cache_rdsect (uptr, lba, buf, &done, sects) : _sim_disk_rdsect_uncached (uptr, lba, buf, &done, sects);
+else
+    r = ctx->cache ? _disk_cache_wrsect (uptr, lba, buf, &done, sects) : _sim_disk_wrsect_uncached (uptr, lba, buf, &done, sects);
+_disk_stat_record (uptr, path, &ctx->stats[path][op], done, r, start);
+if (sectsdone)
+    *sectsdone = done;
+return r;
+}
+
+t_stat sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+return _disk_stat_xfer (uptr, DK_STAT_SYNC, DK_STAT_READ, lba, buf, sectsread, sects);
+}
+
+t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+return _disk_stat_xfer (uptr, DK_STAT_SYNC, DK_STAT_WRITE, lba, buf, sectswritten, sects);
+}
+
+/* Per-unit disk options which persist while the unit isn't attached */
+
+struct disk_unit_opts {
+    uint32              cache_size;         /* cache size in bytes, 0 for none */
+    t_bool              cache_writeback;    /* write back rather than write through */
+    t_bool              compress_set;       /* compression explicitly selected */
+    t_bool              compress;           /* compress Clustered containers */
+    t_bool              mmap;               /* map the container into memory */
+    };
+
+static struct disk_unit_opts *_disk_unit_opts (UNIT *uptr, t_bool create)
+{
+return (struct disk_unit_opts *)sim_get_unit_opts (uptr, "DISK", sizeof (struct disk_unit_opts), create);
+}
+
+/* (Re)build an attached unit's cache from its options */
+
+static t_stat _disk_cache_setup (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_unit_opts *o = _disk_unit_opts (uptr, FALSE);
+uint32 nent = o ? (o->cache_size / ctx->sector_size) : 0;
+t_stat r;
+
+#if defined (SIM_ASYNCH_IO)
+if (ctx->q_run)
+    _disk_q_drain (uptr);
+#endif
+r = _disk_cache_flush (uptr);
+_disk_cache_free (ctx->cache);
+ctx->cache = NULL;
+if (nent < 4)                                           /* no useful cache? */
+    return r;
+ctx->cache = _disk_cache_create (nent, ctx->sector_size, o->cache_writeback);
+if (ctx->cache == NULL)
+    return sim_messagef (SCPE_MEM, "%s: Can't allocate a %u sector cache\n", sim_uname (uptr), nent);
+sim_debug_unit (ctx->dbit, uptr, "_disk_cache_setup(unit=%d, sectors=%u, %s)\n", (int)(uptr - ctx->dptr->units), nent, o->cache_writeback ? "write back" : "write through");
+return r;
+}
+
+static t_stat _sim_disk_set_unit_cache (UNIT *uptr, uint32 size, t_bool writeback)
+{
+struct disk_unit_opts *o = _disk_unit_opts (uptr, (size != 0));
+
+if (o == NULL)
+    return (size != 0) ? SCPE_MEM : SCPE_OK;
+o->cache_size = size;
+o->cache_writeback = writeback;
+if (uptr->flags & UNIT_ATT)
+    return _disk_cache_setup (uptr);
+return SCPE_OK;
+}
+
+/* SET <dev|unit> CACHE{=size}, WBCACHE{=size} and NOCACHE */
+
+t_stat sim_disk_set_cache (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 size = 0;
+uint32 u;
+t_stat r;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if (flag & DK_CACHE_OFF) {
+    if (cptr)
+        return SCPE_ARG;
+    }
+else {
+    if ((cptr == NULL) || (*cptr == '\0'))
+        size = DK_CACHE_DEFAULT;
+    else {
+        char *tptr;
+        unsigned long val = strtoul (cptr, &tptr, 10);
+
+        if ((toupper (*tptr) == 'K') || (toupper (*tptr) == 'M')) {
+            val = val << ((toupper (*tptr) == 'K') ? 10 : 20);
+            ++tptr;
+            }
+        if ((tptr == cptr) || (*tptr != '\0') ||
+            (val == 0) || (val > DK_CACHE_MAX))
+            return sim_messagef (SCPE_ARG, "Invalid cache size: %s\n", cptr);
+        size = (uint32)val;
+        }
+    }
+if (flag & DK_CACHE_UNIT)
+    return _sim_disk_set_unit_cache (uptr, size, (flag & DK_CACHE_WB) != 0);
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) == 0)
+        continue;
+    r = _sim_disk_set_unit_cache (&dptr->units[u], size, (flag & DK_CACHE_WB) != 0);
+    if (r != SCPE_OK)
+        return r;
+    }
+return SCPE_OK;
+}
+
+/* SHOW <dev|unit> CACHE */
+
+static void _sim_disk_show_unit_cache (FILE *st, UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_unit_opts *o = _disk_unit_opts (uptr, FALSE);
+struct disk_cache *c = ((uptr->flags & UNIT_ATT) && ctx) ? ctx->cache : NULL;
+
+if (c == NULL) {
+    if ((o == NULL) || (o->cache_size == 0))
+        fprintf (st, "%s: no cache\n", sim_uname (uptr));
+    else
+        fprintf (st, "%s: %uKB write %s cache%s\n", sim_uname (uptr), o->cache_size >> 10,
+                     o->cache_writeback ? "back" : "through", (uptr->flags & UNIT_ATT) ? "" : " when attached");
+    return;
+    }
+fprintf (st, "%s: %uKB write %s cache, %u sectors, %u modified\n", sim_uname (uptr),
+             (uint32)(((t_uint64)c->nent * c->sector_size) >> 10), c->writeback ? "back" : "through",
+             c->nent, c->ndirty);
+fprintf (st, "    Reads:    %" LL_FMT "u, %" LL_FMT "u from cache (%.1f%%)\n", c->reads, c->read_hits,
+             c->reads ? (100.0 * c->read_hits) / c->reads : 0.0);
+fprintf (st, "    Sectors:  %" LL_FMT "u read, %" LL_FMT "u found in cache (%.1f%%)\n", c->read_sects, c->read_sect_hits,
+             c->read_sects ? (100.0 * c->read_sect_hits) / c->read_sects : 0.0);
+fprintf (st, "    Writes:   %" LL_FMT "u, %" LL_FMT "u sectors\n", c->writes, c->write_sects);
+fprintf (st, "    Evicted:  %" LL_FMT "u sectors\n", c->evictions);
+if (c->writeback)
+    fprintf (st, "    Written:  %" LL_FMT "u modified sectors, %" LL_FMT "u flushes\n", c->writebacks, c->flushes);
+}
+
+t_stat sim_disk_show_cache (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if (flag) {                                             /* unit? */
+    _sim_disk_show_unit_cache (st, uptr);
+    return SCPE_OK;
+    }
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) &&
+        ((dptr->units[u].flags & UNIT_DIS) == 0))
+        _sim_disk_show_unit_cache (st, &dptr->units[u]);
+    }
+return SCPE_OK;
+}
+
+/* Memory mapped containers
+
+   The data portion of an attached SIMH or RAW format container (up to
+   the unit's capacity, and never beyond the current end of the file) can
+   be mapped into memory, so that transfers within it are copies rather
+   than system calls.  Transfers beyond the mapped part use file I/O, and
+   the mapping is remade as such writes extend the file. */
+
+static void _disk_mmap_release (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (ctx->map == NULL)
+    return;
+#if defined (SIM_ASYNCH_IO)
+if (ctx->q_run)
+    _disk_q_drain (uptr);
+#endif
+sim_memfile_sync (ctx->map);
+sim_memfile_close (ctx->map);
+ctx->map = NULL;
+ctx->map_base = NULL;
+ctx->map_size = 0;
+ctx->map_grown = 0;
+if (DK_GET_FMT (uptr) == DKUF_F_STD)
+    fflush (uptr->fileref);                             /* discard stale buffered file data */
+}
+
+static t_stat _disk_mmap_setup (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_unit_opts *o = _disk_unit_opts (uptr, FALSE);
+uint32 f = DK_GET_FMT (uptr);
+t_offset size;
+t_stat r;
+
+_disk_mmap_release (uptr);
+if ((o == NULL) || (!o->mmap))
+    return SCPE_OK;
+if ((f != DKUF_F_STD) && (f != DKUF_F_RAW))
+    return sim_messagef (SCPE_NOFNC, "%s: Only SIMH and RAW format containers can be memory mapped\n", sim_uname (uptr));
+if (ctx->xfer_encode_size > DK_ENC_LONGLONG)            /* packed data is only converted on read */
+    return sim_messagef (SCPE_NOFNC, "%s: Containers with packed data can't be memory mapped\n", sim_uname (uptr));
+#if defined (SIM_ASYNCH_IO)
+if (ctx->q_run)
+    _disk_q_drain (uptr);
+#endif
+if (f == DKUF_F_STD)
+    fflush (uptr->fileref);                             /* make previous writes visible */
+size = ((t_offset)uptr->capac) * ctx->capac_factor * ((ctx->dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1);
+r = sim_memfile_map (uptr->filename, size, (((uptr->flags & UNIT_RO) == 0) && (ctx->overlay == NULL)), &ctx->map, (void **)&ctx->map_base, &ctx->map_size);
+if (r != SCPE_OK)
+    return r;
+sim_debug_unit (ctx->dbit, uptr, "_disk_mmap_setup(unit=%d, bytes=%" LL_FMT "u)\n", (int)(uptr - ctx->dptr->units), (t_uint64)ctx->map_size);
+return SCPE_OK;
+}
+
+static t_stat _sim_disk_set_unit_mmap (UNIT *uptr, t_bool map)
+{
+struct disk_unit_opts *o = _disk_unit_opts (uptr, map);
+
+if (o == NULL)
+    return map ? SCPE_MEM : SCPE_OK;
+o->mmap = map;
+if (uptr->flags & UNIT_ATT)
+    return _disk_mmap_setup (uptr);
+return SCPE_OK;
+}
+
+/* SET <dev|unit> MMAP and NOMMAP */
+
+t_stat sim_disk_set_mmap (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+t_stat r;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if (cptr)
+    return SCPE_ARG;
+if (flag & DK_MMAP_UNIT)
+    return _sim_disk_set_unit_mmap (uptr, (flag & DK_MMAP) != 0);
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) == 0)
+        continue;
+    r = _sim_disk_set_unit_mmap (&dptr->units[u], (flag & DK_MMAP) != 0);
+    if (r != SCPE_OK)
+        return r;
+    }
+return SCPE_OK;
+}
+
+/* Open or create the overlay for a unit whose base container was just
+   attached read only */
+
+static t_stat _disk_overlay_open (UNIT *uptr, const char *filename, t_bool must_exist)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_overlay *ov;
+struct disk_overlay_header hdr;
+uint8 block[DK_OVL_HDRSIZE];
+t_offset base_size = sim_fsize_name_ex (uptr->filename);
+t_bool created = FALSE;
+t_stat r = SCPE_OK;
+
+if ((DK_GET_FMT (uptr) != DKUF_F_STD) && (DK_GET_FMT (uptr) != DKUF_F_RAW))
+    return sim_messagef (SCPE_NOFNC, "%s: Overlays need a SIMH or RAW format base container\n", sim_uname (uptr));
+ov = (struct disk_overlay *)calloc (1, sizeof (*ov));
+if (ov == NULL)
+    return SCPE_MEM;
+ov->sector_size = ctx->sector_size;
+ov->sectors = (uint32)((((t_offset)uptr->capac) * ctx->capac_factor * ((ctx->dptr->flags & DEV_SECTORS) ? ctx->sector_size : 1)) / ctx->sector_size);
+ov->chunks = (uint32 **)calloc ((ov->sectors + DK_OVL_CHUNK - 1) / DK_OVL_CHUNK + 1, sizeof (*ov->chunks));
+ov->name = strdup (filename);
+if ((ov->chunks == NULL) || (ov->name == NULL)) {
+    free (ov->chunks);
+    free (ov->name);
+    free (ov);
+    return SCPE_MEM;
+    }
+ov->file = sim_fopen (filename, "rb+");
+if ((ov->file == NULL) && !must_exist && (errno == ENOENT)) {
+    ov->file = sim_fopen (filename, "wb+");
+    if (ov->file != NULL) {
+        memset (block, 0, sizeof (block));
+        memset (&hdr, 0, sizeof (hdr));
+        memcpy (hdr.Magic, DK_OVL_MAGIC, sizeof (hdr.Magic));
+        hdr.SectorSize = NtoHl (ov->sector_size);
+        hdr.SectorCount = NtoHl (ov->sectors);
+        hdr.BaseSize[0] = NtoHl ((uint32)(base_size >> 32));
+        hdr.BaseSize[1] = NtoHl ((uint32)(base_size & 0xFFFFFFFF));
+        memcpy (block, &hdr, sizeof (hdr));
+        if (sim_fwrite (block, 1, sizeof (block), ov->file) != sizeof (block))
+            r = sim_messagef (SCPE_IOERR, "%s: Can't write overlay '%s'\n", sim_uname (uptr), filename);
+        created = TRUE;
+        }
+    }
+if (ov->file == NULL)
+    r = sim_messagef (SCPE_OPENERR, "%s: Can't open overlay '%s': %s\n", sim_uname (uptr), filename, strerror (errno));
+if ((r == SCPE_OK) && !created) {
+    t_offset size = sim_fsize_ex (ov->file);
+    uint32 rec;
+
+    if ((sim_fread (&hdr, 1, sizeof (hdr), ov->file) != sizeof (hdr)) ||
+        (memcmp (hdr.Magic, DK_OVL_MAGIC, sizeof (hdr.Magic)) != 0))
+        r = sim_messagef (SCPE_OPENERR, "%s: '%s' is not an overlay file\n", sim_uname (uptr), filename);
+    else if ((NtoHl (hdr.SectorSize) != ov->sector_size) ||
+             (NtoHl (hdr.SectorCount) != ov->sectors) ||
+             ((((t_offset)NtoHl (hdr.BaseSize[0])) << 32) + NtoHl (hdr.BaseSize[1]) != base_size))
+        r = sim_messagef (SCPE_OPENERR, "%s: Overlay '%s' was made for a different base container than '%s'\n", sim_uname (uptr), filename, uptr->filename);
+    for (rec = 0; (r == SCPE_OK) && (DK_OVL_RECORD (ov, rec + 1) <= size); rec++) {
+        uint32 rhdr[2];
+
+        if ((sim_fseeko (ov->file, DK_OVL_RECORD (ov, rec), SEEK_SET) != 0) ||
+            (sim_fread (rhdr, 1, sizeof (rhdr), ov->file) != sizeof (rhdr)) ||
+            ((NtoHl (rhdr[0]) ^ DK_OVL_RECMAGIC) != NtoHl (rhdr[1])))
+            break;                                      /* an incomplete last record is rewritten */
+        r = _disk_overlay_insert (ov, NtoHl (rhdr[0]), rec);
+        }
+    ov->records = rec;
+    }
+if (r != SCPE_OK) {
+    if (ov->file != NULL)
+        fclose (ov->file);
+    if (created)
+        (void)remove (filename);
+    free (ov->chunks);
+    free (ov->name);
+    free (ov);
+    return r;
+    }
+ctx->overlay = ov;
+sim_debug_unit (ctx->dbit, uptr, "_disk_overlay_open(unit=%d, overlay=%s, records=%u)\n", (int)(uptr - ctx->dptr->units), filename, ov->records);
+return SCPE_OK;
+}
+
+/* Close a unit's overlay, first writing its sectors to the base container
+   if they are to be merged */
+
+static t_stat _disk_overlay_close (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_overlay *ov = ctx->overlay;
+uint32 i;
+t_stat r = SCPE_OK;
+
+if (ov == NULL)
+    return SCPE_OK;
+ctx->overlay = NULL;
+if (ov->disposition == DK_OVL_MERGE) {
+    FILE *base = sim_fopen (uptr->filename, "rb+");
+    uint8 *buf = (uint8 *)malloc (DK_OVL_RECHDR + ov->sector_size);
+    uint32 rec;
+
+    if ((base == NULL) || (buf == NULL))
+        r = sim_messagef (SCPE_OPENERR, "%s: Can't open '%s' to merge overlay '%s'\n", sim_uname (uptr), uptr->filename, ov->name);
+    for (rec = 0; (r == SCPE_OK) && (rec < ov->records); rec++) {
+        uint32 *rhdr = (uint32 *)buf;
+
+        if ((sim_fseeko (ov->file, DK_OVL_RECORD (ov, rec), SEEK_SET) != 0) ||
+            (sim_fread (buf, 1, DK_OVL_RECHDR + ov->sector_size, ov->file) != DK_OVL_RECHDR + ov->sector_size) ||
+            (sim_fseeko (base, ((t_offset)NtoHl (rhdr[0])) * ov->sector_size, SEEK_SET) != 0) ||
+            (sim_fwrite (buf + DK_OVL_RECHDR, 1, ov->sector_size, base) != ov->sector_size))
+            r = sim_messagef (SCPE_IOERR, "%s: Error merging overlay '%s' into '%s'\n", sim_uname (uptr), ov->name, uptr->filename);
+        }
+    if ((base != NULL) && (fclose (base) != 0) && (r == SCPE_OK))
+        r = SCPE_IOERR;
+    free (buf);
+    if (r == SCPE_OK)
+        sim_messagef (SCPE_OK, "%s: Merged %u sectors from overlay '%s' into '%s'\n", sim_uname (uptr), ov->records, ov->name, uptr->filename);
+    }
+fclose (ov->file);
+if ((ov->disposition == DK_OVL_DISCARD) ||
+    ((ov->disposition == DK_OVL_MERGE) && (r == SCPE_OK)))
+    (void)remove (ov->name);
+for (i = 0; i < (ov->sectors + DK_OVL_CHUNK - 1) / DK_OVL_CHUNK; i++)
+    free (ov->chunks[i]);
+free (ov->chunks);
+free (ov->name);
+free (ov);
+return r;
+}
+
+/* SET <unit> OVERLAY=KEEP|DISCARD|MERGE
+
+   Chooses what happens to an attached unit's overlay file when the unit
+   is detached: it is kept for a later ATTACH -O (the default), deleted,
+   or its sectors are written to the base container and it is deleted. */
+
+t_stat sim_disk_set_overlay (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+struct disk_context *ctx;
+char gbuf[CBUFSIZE];
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if ((cptr == NULL) || (*cptr == '\0'))
+    return SCPE_MISVAL;
+if (!(uptr->flags & UNIT_ATT))
+    return SCPE_UNATT;
+ctx = (struct disk_context *)uptr->disk_ctx;
+if (ctx->overlay == NULL)
+    return sim_messagef (SCPE_ARG, "%s: Not attached with an overlay\n", sim_uname (uptr));
+get_glyph (cptr, gbuf, 0);
+if (MATCH_CMD (gbuf, "KEEP") == 0)
+    ctx->overlay->disposition = DK_OVL_KEEP;
+else if (MATCH_CMD (gbuf, "DISCARD") == 0)
+    ctx->overlay->disposition = DK_OVL_DISCARD;
+else if (MATCH_CMD (gbuf, "MERGE") == 0)
+    ctx->overlay->disposition = DK_OVL_MERGE;
+else
+    return sim_messagef (SCPE_ARG, "Unknown overlay disposition: %s\n", gbuf);
+return SCPE_OK;
+}
+
+/* SHOW <dev|unit> OVERLAY */
+
+static void _sim_disk_show_unit_overlay (FILE *st, UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+struct disk_overlay *ov = ((uptr->flags & UNIT_ATT) && ctx) ? ctx->overlay : NULL;
+static const char *disposition[] = {"kept", "discarded", "merged into the base"};
+
+if (ov == NULL) {
+    fprintf (st, "%s: no overlay\n", sim_uname (uptr));
+    return;
+    }
+fprintf (st, "%s: overlay %s on %s, %u of %u sectors overlaid, %s at detach\n", sim_uname (uptr),
+             ov->name, uptr->filename, ov->records, ov->sectors, disposition[ov->disposition]);
+fprintf (st, "    Sectors:  %" LL_FMT "u read from and %" LL_FMT "u written to the overlay\n", ov->reads, ov->writes);
+}
+
+t_stat sim_disk_show_overlay (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if (flag) {                                             /* unit? */
+    _sim_disk_show_unit_overlay (st, uptr);
+    return SCPE_OK;
+    }
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) &&
+        ((dptr->units[u].flags & UNIT_DIS) == 0))
+        _sim_disk_show_unit_overlay (st, &dptr->units[u]);
+    }
+return SCPE_OK;
+}
+
+/* Name of a unit's overlay file, or NULL when it has none.  SAVE records
+   it so that RESTORE attaches the base container with the same overlay,
+   which is only possible when the overlay is kept at detach. */
+
+const char *sim_disk_overlay_name (UNIT *uptr, t_bool *kept)
+{
+DEVICE *dptr = find_dev_from_unit (uptr);
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if ((dptr == NULL) ||
+    ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI)) ||
+    !(uptr->flags & UNIT_ATT) || (ctx == NULL) || (ctx->overlay == NULL))
+    return NULL;
+if (kept)
+    *kept = (ctx->overlay->disposition == DK_OVL_KEEP);
+return ctx->overlay->name;
+}
+
+/* SET <dev|unit> STATISTICS=RESET */
+
+t_stat sim_disk_set_statistics (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+char gbuf[CBUFSIZE];
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if ((cptr == NULL) || (*cptr == '\0'))
+    return SCPE_MISVAL;
+get_glyph (cptr, gbuf, 0);
+if (MATCH_CMD (gbuf, "RESET") != 0)
+    return sim_messagef (SCPE_ARG, "Unknown statistics action: %s\n", gbuf);
+for (u = 0; u < dptr->numunits; u++) {
+    UNIT *up = &dptr->units[u];
+    struct disk_context *ctx = (struct disk_context *)up->disk_ctx;
+
+    if ((flag & DK_STATS_UNIT) && (up != uptr))
+        continue;
+    if ((up->flags & UNIT_ATT) && (ctx != NULL)) {
+#if defined (SIM_ASYNCH_IO)
+        if (ctx->asynch_io)
+            pthread_mutex_lock (&ctx->io_lock);
+#endif
+        memset (ctx->stats, 0, sizeof (ctx->stats));
+        memset (&ctx->flushes, 0, sizeof (ctx->flushes));
+#if defined (SIM_ASYNCH_IO)
+        if (ctx->asynch_io)
+            pthread_mutex_unlock (&ctx->io_lock);
+#endif
+        }
+    }
+return SCPE_OK;
+}
+
+/* SHOW <dev|unit> STATISTICS
+
+   With -C each line is comma separated values: unit, path (SYNC or
+   ASYNC, or ALL for flushes), operation, the counts, total and maximum
+   microseconds and then the histogram buckets. */
+
+static const char *_disk_stat_paths[DK_STAT_PATHS] = {"Sync", "Async"};
+static const char *_disk_stat_ops[DK_STAT_OPS] = {"Reads", "Writes"};
+
+static void _sim_disk_show_op_statistics (FILE *st, UNIT *uptr, t_bool csv, const char *path, const char *op, struct disk_op_stats *s, t_bool xfer)
+{
+uint32 i;
+
+if (csv) {
+    fprintf (st, "%s,%s,%s,%" LL_FMT "u,%" LL_FMT "u,%" LL_FMT "u,%" LL_FMT "u,%" LL_FMT "u,%u",
+                 sim_uname (uptr), path, op,
+                 s->ops, s->sectors, s->bytes, s->errors, s->usecs, s->max_usecs);
+    for (i = 0; i < DK_STAT_BUCKETS; i++)
+        fprintf (st, ",%u", s->hist[i]);
+    fprintf (st, "\n");
+    return;
+    }
+if (s->ops == 0)
+    return;
+fprintf (st, "    %-5s %-8s %" LL_FMT "u", path, op, s->ops);
+if (xfer)
+    fprintf (st, ", %" LL_FMT "u sectors, %s bytes", s->sectors, sim_fmt_numeric ((double)s->bytes));
+if (s->errors)
+    fprintf (st, ", %" LL_FMT "u errors", s->errors);
+fprintf (st, ", average %.1f, max %u\n", (double)s->usecs / s->ops, s->max_usecs);
+fprintf (st, "          ");
+for (i = 0; i < DK_STAT_BUCKETS; i++) {
+    if (s->hist[i] == 0)
+        continue;
+    if (i == 0)
+        fprintf (st, " <2:%u", s->hist[i]);
+    else if (i == DK_STAT_BUCKETS - 1)
+        fprintf (st, " >=%u:%u", 1 << i, s->hist[i]);
+    else
+        fprintf (st, " %u-%u:%u", 1 << i, (2 << i) - 1, s->hist[i]);
+    }
+fprintf (st, "\n");
+}
+
+static void _sim_disk_show_unit_statistics (FILE *st, UNIT *uptr, t_bool csv)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+uint32 path, op;
+
+if (!(uptr->flags & UNIT_ATT) || (ctx == NULL)) {
+    if (!csv)
+        fprintf (st, "%s: not attached\n", sim_uname (uptr));
+    return;
+    }
+if (!csv)
+    fprintf (st, "%s: I/O statistics since attach or reset (service times in microseconds)\n", sim_uname (uptr));
+for (path = 0; path < DK_STAT_PATHS; path++)
+    for (op = 0; op < DK_STAT_OPS; op++)
+        _sim_disk_show_op_statistics (st, uptr, csv, _disk_stat_paths[path], _disk_stat_ops[op], &ctx->stats[path][op], TRUE);
+_sim_disk_show_op_statistics (st, uptr, csv, "All", "Flushes", &ctx->flushes, FALSE);
+}
+
+t_stat sim_disk_show_statistics (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+t_bool csv = ((sim_switches & SWMASK ('C')) != 0);
+uint32 u, i;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if (csv) {
+    fprintf (st, "unit,path,operation,count,sectors,bytes,errors,usecs,max_usecs");
+    for (i = 0; i < DK_STAT_BUCKETS; i++)
+        fprintf (st, ",hist_%u", i);
+    fprintf (st, "\n");
+    }
+if (flag) {                                             /* unit? */
+    _sim_disk_show_unit_statistics (st, uptr, csv);
+    return SCPE_OK;
+    }
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) &&
+        ((dptr->units[u].flags & UNIT_DIS) == 0))
+        _sim_disk_show_unit_statistics (st, &dptr->units[u], csv);
+    }
+return SCPE_OK;
+}
+
+/* SET <unit> SNAPSHOT=name, REVERT=name and NOSNAPSHOT=name on Clustered containers */
+
+t_stat sim_disk_set_snapshot (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_stat r;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if ((cptr == NULL) || (*cptr == '\0'))
+    return sim_messagef (SCPE_2FARG, "Missing snapshot name\n");
+if (!(uptr->flags & UNIT_ATT))
+    return SCPE_UNATT;
+if (DK_GET_FMT (uptr) != DKUF_F_CLU)
+    return sim_messagef (SCPE_NOFNC, "%s: Snapshots need a CLUSTER format disk container\n", sim_uname (uptr));
+#if defined (SIM_ASYNCH_IO)
+if (ctx->q_run)
+    _disk_q_drain (uptr);
+#endif
+r = _disk_cache_flush (uptr);
+if (r != SCPE_OK)
+    return r;
+r = sim_clu_disk_snapshot (uptr->fileref, flag, cptr);
+if ((r == SCPE_OK) && (flag == DK_SNAP_REVERT))
+    r = _disk_cache_setup (uptr);                       /* discard now stale cached data */
+sim_debug_unit (ctx->dbit, uptr, "sim_disk_set_snapshot(unit=%d, op=%d, %s) = %d\n", (int)(uptr - ctx->dptr->units), flag, cptr, r);
+return r;
+}
+
+/* SHOW <dev|unit> SNAPSHOTS */
+
+static void _sim_disk_show_unit_snapshots (FILE *st, UNIT *uptr)
+{
+if (!(uptr->flags & UNIT_ATT))
+    fprintf (st, "%s: not attached\n", sim_uname (uptr));
+else {
+    if (DK_GET_FMT (uptr) != DKUF_F_CLU)
+        fprintf (st, "%s: %s format container, no snapshots\n", sim_uname (uptr), fmts[DK_GET_FMT (uptr)].name);
+    else
+        sim_clu_disk_show_snapshots (st, uptr->fileref, sim_uname (uptr));
+    }
+}
+
+t_stat sim_disk_show_snapshots (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if (flag) {                                             /* unit? */
+    _sim_disk_show_unit_snapshots (st, uptr);
+    return SCPE_OK;
+    }
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) &&
+        ((dptr->units[u].flags & UNIT_DIS) == 0))
+        _sim_disk_show_unit_snapshots (st, &dptr->units[u]);
+    }
+return SCPE_OK;
+}
+
+/* SHOW <dev|unit> CHAIN */
+
+static void _sim_disk_show_unit_chain (FILE *st, UNIT *uptr)
+{
+if (!(uptr->flags & UNIT_ATT))
+    fprintf (st, "%s: not attached\n", sim_uname (uptr));
+else {
+    if (DK_GET_FMT (uptr) != DKUF_F_VHD)
+        fprintf (st, "%s: %s format container, not a VHD chain\n", sim_uname (uptr), fmts[DK_GET_FMT (uptr)].name);
+    else
+        sim_vhd_disk_show_chain (st, uptr->fileref, sim_uname (uptr));
+    }
+}
+
+t_stat sim_disk_show_chain (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if (flag) {                                             /* unit? */
+    _sim_disk_show_unit_chain (st, uptr);
+    return SCPE_OK;
+    }
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) &&
+        ((dptr->units[u].flags & UNIT_DIS) == 0))
+        _sim_disk_show_unit_chain (st, &dptr->units[u]);
+    }
+return SCPE_OK;
+}
+
+static t_stat _sim_disk_set_unit_compress (UNIT *uptr, t_bool compress)
+{
+struct disk_unit_opts *o = _disk_unit_opts (uptr, TRUE);
+
+if (o == NULL)
+    return SCPE_MEM;
+o->compress_set = TRUE;
+o->compress = compress;
+if ((uptr->flags & UNIT_ATT) && (DK_GET_FMT (uptr) == DKUF_F_CLU) &&
+    ((uptr->flags & UNIT_RO) == 0))
+    return sim_clu_disk_set_compress (uptr->fileref, compress);
+return SCPE_OK;
+}
+
+/* SET <dev|unit> COMPRESS and NOCOMPRESS
+
+   Selects whether whole clusters written to CLUSTER format containers
+   are stored compressed.  The choice is also recorded in the container. */
+
+t_stat sim_disk_set_compress (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+t_stat r;
+
+if ((DEV_TYPE (dptr) != DEV_DISK) && (DEV_TYPE (dptr) != DEV_SCSI))
+    return sim_messagef (SCPE_NOFNC, "%s is not a disk device\n", sim_dname (dptr));
+if (cptr)
+    return SCPE_ARG;
+if (flag & DK_COMPRESS_UNIT)
+    return _sim_disk_set_unit_compress (uptr, (flag & DK_COMPRESS) != 0);
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) == 0)
+        continue;
+    r = _sim_disk_set_unit_compress (&dptr->units[u], (flag & DK_COMPRESS) != 0);
+    if (r != SCPE_OK)
+        return r;
+    }
+return SCPE_OK;
+}
+
+t_stat sim_disk_wrsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_PCALLBACK callback)
+{
+t_stat r = SCPE_OK;
+AIO_CALLSETUP
+    r =  sim_disk_wrsect (uptr, lba, buf, sectswritten, sects);
+AIO_CALL(DOP_WSEC, lba, buf, sectswritten, sects, callback);
+return r;
+}
+
+/* Queued transfers
+
+   These allow a controller to have several transfers outstanding on a
+   unit at once.  The callback is called with the caller's argument when
+   each completes, which may be in a different order than they were
+   started.  Without a request queue running on the unit, the transfer is
+   performed and the callback called before returning. */
+
+t_stat sim_disk_rdsect_q (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, DISK_QCALLBACK callback, void *arg)
+{
+t_stat r;
+#if defined (SIM_ASYNCH_IO)
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (ctx->q_run && callback)
+    return _disk_q_submit (uptr, DOP_RSEC, lba, buf, sectsread, sects, NULL, callback, arg);
+#endif
+r = sim_disk_rdsect (uptr, lba, buf, sectsread, sects);
+if (callback)
+    callback (uptr, r, arg);
+return r;
+}
+
+t_stat sim_disk_wrsect_q (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_QCALLBACK callback, void *arg)
+{
+t_stat r;
+#if defined (SIM_ASYNCH_IO)
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (ctx->q_run && callback)
+    return _disk_q_submit (uptr, DOP_WSEC, lba, buf, sectswritten, sects, NULL, callback, arg);
+#endif
+r = sim_disk_wrsect (uptr, lba, buf, sectswritten, sects);
+if (callback)
+    callback (uptr, r, arg);
+return r;
+}
+
+/* Wait for outstanding queued transfers and call their callbacks */
+
+t_stat sim_disk_drain (UNIT *uptr)
+{
+#if defined (SIM_ASYNCH_IO)
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (ctx && ctx->q_run)
+    _disk_q_drain (uptr);
+#endif
+return SCPE_OK;
+}
+
+/* Number of transfers which can currently proceed at once */
+
+uint32 sim_disk_get_async_depth (UNIT *uptr)
+{
+#if defined (SIM_ASYNCH_IO)
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (ctx && ctx->q_run)
+    return ctx->q_nthreads;
+#endif
+return 1;
+}
+
+/* Set the number of transfers which may be in progress at once */
+
+t_stat sim_disk_set_async_depth (UNIT *uptr, uint32 depth)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+if (ctx == NULL)
+    return SCPE_UNATT;
+if ((depth < 1) || (depth > DK_MAX_ASYNC_DEPTH))
+    return SCPE_ARG;
+if (depth == ctx->asynch_depth)
+    return SCPE_OK;
+ctx->asynch_depth = depth;
+#if defined (SIM_ASYNCH_IO)
+if (ctx->asynch_io) {                                   /* restart I/O threads */
+    sim_disk_clr_async (uptr);
+    sim_disk_set_async (uptr, ctx->asynch_io_latency);
+    }
+#endif
+return SCPE_OK;
+}
 
 t_stat sim_disk_unload (UNIT *uptr)
 {
@@ -1162,6 +3008,7 @@ struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 switch (DK_GET_FMT (uptr)) {                            /* case on format */
     case DKUF_F_STD:                                    /* Simh */
     case DKUF_F_VHD:                                    /* VHD format */
+    case DKUF_F_CLU:                                    /* Clustered format */
         ctx->media_removed = 1;
         return sim_disk_detach (uptr);
     case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
@@ -1199,14 +3046,17 @@ return SCPE_OK;
 static void _sim_disk_io_flush (UNIT *uptr)
 {
 uint32 f = DK_GET_FMT (uptr);
-
-#if defined (SIM_ASYNCH_IO)
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_uint64 start;
 
+#if defined (SIM_ASYNCH_IO)
 sim_disk_clr_async (uptr);
 if (sim_asynch_enabled)
     sim_disk_set_async (uptr, ctx->asynch_io_latency);
 #endif
+start = _disk_stat_usecs ();
+_disk_cache_flush (uptr);                               /* write modified cached sectors */
+sim_memfile_sync (ctx->map);                            /* write back memory mapped sectors */
 switch (f) {                                            /* case on format */
     case DKUF_F_STD:                                    /* Simh */
         fflush (uptr->fileref);
@@ -1214,10 +3064,14 @@ switch (f) {                                            /* case on format */
     case DKUF_F_VHD:                                    /* Virtual Disk */
         sim_vhd_disk_flush (uptr->fileref);
         break;
+    case DKUF_F_CLU:                                    /* Clustered */
+        sim_clu_disk_flush (uptr->fileref);
+        break;
     case DKUF_F_RAW:                                    /* Physical */
         sim_os_disk_flush_raw (uptr->fileref);
         break;
         }
+_disk_stat_record (uptr, DK_STAT_SYNC, &ctx->flushes, 0, SCPE_OK, start);
 }
 
 static t_stat _err_return (UNIT *uptr, t_stat stat)
@@ -2467,7 +4321,15 @@ if (uar != 0) {
                 } while ((uar = retr.rt_ulnk) != 0);
 
         scanBitmap:
-            for (i = sizeof(bitmap) - 1; i != 0; i--)
+            /* Skip the fully allocated tail a word at a time */
+            for (i = (int)(sizeof(bitmap) - sizeof(t_uint64)); i >= 0; i -= (int)sizeof(t_uint64)) {
+                t_uint64 word;
+
+                memcpy (&word, &bitmap[i], sizeof(word));
+                if (word != ~(t_uint64)0)
+                    break;
+                }
+            for (i += (int)sizeof(t_uint64) - 1; i > 0; i--)
                 if (bitmap[i] != 0xFF) {
                     blocks = i * 8;
                     for (j = 7; j >= 0; j--)
@@ -2782,23 +4644,63 @@ t_offset pseudo_filesystem_size = 0;        /* Dummy file system check return us
 
 typedef t_offset (*FILESYSTEM_CHECK)(UNIT *uptr, uint32, t_bool *);
 
+static struct {
+    const char          *name;
+    FILESYSTEM_CHECK    check;
+    } checks[] = {
+    {"ODS2",    &get_ods2_filesystem_size},
+    {"ODS1",    &get_ods1_filesystem_size},
+    {"ULTRIX",  &get_ultrix_filesystem_size},
+    {"ISO9660", &get_iso9660_filesystem_size},
+    {"RSTS",    &get_rsts_filesystem_size},
+    {"BSD211",  &get_BSD_211_filesystem_size},
+    {"NETBSD",  &get_NetBSD_filesystem_size},
+    {"RT11",    &get_rt11_filesystem_size},     /* This should be the last entry
+                                                   in the table to reduce the
+                                                   possibility of matching an RT-11
+                                                   container file stored in another
+                                                   filesystem */
+    {NULL}
+    };
+
+#define DK_PROBE_ALL    ((1u << (sizeof (checks) / sizeof (checks[0]) - 1)) - 1)
+#define DK_PROBE_BYTES  65536                   /* Leading bytes read once for all probes */
+
+static uint32 sim_disk_probes = DK_PROBE_ALL;   /* Enabled checks[] entries (SET DISK PROBE=) */
+
+/* Read the leading part of the container, which holds the home blocks,
+   labels and volume descriptors of all known file systems, in a single
+   transfer which the probes then share */
+
+static void _disk_probe_prefetch (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_seccnt sects = DK_PROBE_BYTES / ctx->sector_size;
+t_seccnt sread = 0;
+
+if ((ctx->xfer_encode_size > DK_ENC_LONGLONG) ||        /* packed data isn't byte addressable */
+    (sects == 0))
+    return;
+ctx->probe_buf = (uint8 *)malloc (sects * ctx->sector_size);
+if (ctx->probe_buf == NULL)
+    return;
+ctx->probe_bytes = 0;
+if (sim_disk_rdsect (uptr, 0, ctx->probe_buf, &sread, sects) == SCPE_OK)
+    ctx->probe_bytes = sread * ctx->sector_size;
+sim_debug_unit (ctx->dbit, uptr, "_disk_probe_prefetch(unit=%d, bytes=%u)\n", (int)(uptr - ctx->dptr->units), ctx->probe_bytes);
+}
+
+static void _disk_probe_release (UNIT *uptr)
+{
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+
+free (ctx->probe_buf);
+ctx->probe_buf = NULL;
+ctx->probe_bytes = 0;
+}
+
 static t_offset get_filesystem_size (UNIT *uptr, t_bool *isreadonly)
 {
-static FILESYSTEM_CHECK checks[] = {
-    &get_ods2_filesystem_size,
-    &get_ods1_filesystem_size,
-    &get_ultrix_filesystem_size,
-    &get_iso9660_filesystem_size,
-    &get_rsts_filesystem_size,
-    &get_BSD_211_filesystem_size,
-    &get_NetBSD_filesystem_size,
-    &get_rt11_filesystem_size,          /* This should be the last entry
-                                           in the table to reduce the
-                                           possibility of matching an RT-11
-                                           container file stored in another
-                                           filesystem */
-    NULL
-    };
 struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
 uint32 saved_sector_size = ctx->sector_size;
 t_offset ret_val = (t_offset)-1;
@@ -2813,9 +4715,14 @@ if (pseudo_filesystem_size != 0) {      /* Dummy file system size mechanism? */
     return pseudo_filesystem_size;
     }
 
+if (sim_disk_probes == 0)               /* All probes disabled? */
+    return ret_val;
 uptr->flags &= ~DKUF_WRP;
-for (i = 0; checks[i] != NULL; i++) {
-    if ((ret_val = checks[i] (uptr, 0, isreadonly)) != (t_offset)-1) {
+_disk_probe_prefetch (uptr);
+for (i = 0; checks[i].name != NULL; i++) {
+    if ((sim_disk_probes & (1u << i)) == 0)
+        continue;
+    if ((ret_val = checks[i].check (uptr, 0, isreadonly)) != (t_offset)-1) {
         /* ISO files that haven't already been determined to be ISO 9660
          * which contain a known file system are also marked read-only
          * now.  This fits early DEC distribution CDs that were created
@@ -2826,6 +4733,7 @@ for (i = 0; checks[i] != NULL; i++) {
             (NULL != match_ext (uptr->filename, "ISO")))
             *isreadonly = TRUE;
         uptr->flags = saved_flags;
+        _disk_probe_release (uptr);
         return ret_val;
         }
     }
@@ -2837,14 +4745,17 @@ uptr->flags = saved_flags;
  * should be added here.
  */
 
-for (i = 0; checks[i] != NULL; i++) {
+for (i = 0; checks[i].name != NULL; i++) {
+    if ((sim_disk_probes & (1u << i)) == 0)
+        continue;
     ctx->sector_size = 256;
-    if ((ret_val = checks[i] (uptr, ctx->sector_size, isreadonly)) != (t_offset)-1)
+    if ((ret_val = checks[i].check (uptr, ctx->sector_size, isreadonly)) != (t_offset)-1)
         break;
     ctx->sector_size = 128;
-    if ((ret_val = checks[i] (uptr, ctx->sector_size, isreadonly)) != (t_offset)-1)
+    if ((ret_val = checks[i].check (uptr, ctx->sector_size, isreadonly)) != (t_offset)-1)
         break;
     }
+_disk_probe_release (uptr);
 if (ret_val != (t_offset)-1) {
     ctx->data_ileave = RX0xINTER;
     ctx->data_ileave_skew = RX0xISKEW;
@@ -2856,6 +4767,61 @@ ctx->sector_size = saved_sector_size;
 return ret_val;
 }
 
+/* SET DISK PROBE{=name{;name...}}
+
+   Restricts the file systems looked for when determining the size of
+   the data on a disk being attached.  ALL and NONE are also accepted. */
+
+t_stat sim_disk_set_probe (int32 flag, CONST char *cptr)
+{
+char gbuf[CBUFSIZE];
+uint32 probes = 0;
+int i;
+
+if ((cptr == NULL) || (*cptr == '\0'))
+    return SCPE_2FARG;
+cptr = get_glyph (cptr, gbuf, '=');
+if (MATCH_CMD (gbuf, "PROBE") != 0)
+    return sim_messagef (SCPE_ARG, "Unknown disk option: %s\n", gbuf);
+if (*cptr == '\0') {
+    sim_disk_probes = DK_PROBE_ALL;
+    return SCPE_OK;
+    }
+while (*cptr != '\0') {
+    cptr = get_glyph (cptr, gbuf, ';');
+    if (strcmp (gbuf, "ALL") == 0) {
+        probes = DK_PROBE_ALL;
+        continue;
+        }
+    if (strcmp (gbuf, "NONE") == 0)
+        continue;
+    for (i = 0; checks[i].name != NULL; i++)
+        if (strcmp (gbuf, checks[i].name) == 0)
+            break;
+    if (checks[i].name == NULL)
+        return sim_messagef (SCPE_ARG, "Unknown file system: %s\n", gbuf);
+    probes |= (1u << i);
+    }
+sim_disk_probes = probes;
+return SCPE_OK;
+}
+
+/* SHOW DISK {PROBE} */
+
+t_stat sim_disk_show_probe (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+int i, count = 0;
+
+if ((cptr != NULL) && (*cptr != '\0') && (MATCH_CMD (cptr, "PROBE") != 0))
+    return SCPE_ARG;
+fprintf (st, "File system probes: ");
+for (i = 0; checks[i].name != NULL; i++)
+    if (sim_disk_probes & (1u << i))
+        fprintf (st, "%s%s", (count++ == 0) ? "" : ";", checks[i].name);
+fprintf (st, "%s\n", (count == 0) ? "NONE" : "");
+return SCPE_OK;
+}
+
 static t_stat store_disk_footer (UNIT *uptr, const char *dtype);
 
 static t_stat get_disk_footer (UNIT *uptr, struct disk_context **pctx)
@@ -2933,6 +4899,15 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
             f->Checksum = NtoHl (eth_crc32 (0, f, sizeof (*f) - sizeof (f->Checksum)));
             }
         break;
+    case DKUF_F_CLU:                                    /* Clustered format */
+        ctx->container_size = sim_clu_disk_size (uptr->fileref);
+        if (sim_clu_disk_get_footer (uptr->fileref, f)) {
+            ctx->container_size += sizeof (*f);         /* Adjust since it is removed below */
+            break;
+            }
+        free (f);
+        f = NULL;
+        break;
     default:
         free (f);
         return SCPE_IERR;
@@ -3153,6 +5128,9 @@ else {      /* meta data changed or created */
             break;
         case DKUF_F_VHD:                                    /* VHD format */
             break;
+        case DKUF_F_CLU:                                    /* Clustered format */
+            sim_clu_disk_set_footer (uptr->fileref, f);
+            break;
         case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
             sim_os_disk_write (uptr, total_sectors * ctx->sector_size, (uint8 *)f, NULL, sizeof (*f));
             sim_os_disk_set_size (uptr, (t_offset)(total_sectors * ctx->sector_size + sizeof (*f)));
@@ -3183,6 +5161,8 @@ if (uptr->flags & UNIT_RO)
     return SCPE_RO;
 if (ctx == NULL)
     return SCPE_IERR;
+if (ctx->overlay != NULL)                               /* base container is read only */
+    return SCPE_RO;
 if ((uptr->drvtyp != NULL) &&
     ((uptr->drvtyp->flags & DRVFL_DETAUTO) != 0) &&
     ((uptr->flags & DKUF_NOAUTOSIZE) == 0))
@@ -3213,6 +5193,9 @@ switch (DK_GET_FMT (uptr)) {
         break;
     case DKUF_F_VHD:                                    /* VHD format */
         break;
+    case DKUF_F_CLU:                                    /* Clustered format */
+        sim_clu_disk_set_footer (uptr->fileref, f);
+        break;
     case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
         sim_os_disk_write (uptr, total_sectors * ctx->sector_size, (uint8 *)f, NULL, sizeof (*f));
         sim_os_disk_close_raw (uptr->fileref);
@@ -3317,9 +5300,36 @@ if (sim_switches & SWMASK ('D')) {                      /* create difference dis
         }
     return sim_messagef (SCPE_ARG, "Unable to create differencing VHD: %s - %s\n", gbuf, strerror (errno));
     }
+if ((sim_switches & SWMASK ('O')) &&                    /* overlay on a read only base container? */
+    (*get_glyph_nc (cptr, tbuf, 0) != '\0')) {           /* (-O with one container overrides VHD checks) */
+    char gbuf[CBUFSIZE];
+    t_bool must_exist = ((sim_switches & SWMASK ('E')) != 0);
+    int32 saved_sim_quiet = sim_quiet;
+    t_stat r;
+
+    cptr = get_glyph_nc (cptr, gbuf, 0);                /* get overlay file */
+    sim_switches = (sim_switches & ~SWMASK ('O')) | SWMASK ('R') | SWMASK ('E');
+    sim_quiet = TRUE;                                   /* the unit won't be read only */
+    r = sim_disk_attach_ex2 (uptr, cptr, sector_size, xfer_encode_size, dontchangecapac,
+                             dbit, dtype, pdp11tracksize, completion_delay, drivetypes,
+                             reserved_sectors);
+    sim_quiet = saved_sim_quiet;
+    if (r != SCPE_OK)
+        return r;
+    r = _disk_overlay_open (uptr, gbuf, must_exist);
+    if (r != SCPE_OK) {
+        sim_disk_detach (uptr);
+        return r;
+        }
+    uptr->flags &= ~UNIT_RO;                            /* writes go to the overlay */
+    return sim_messagef (SCPE_OK, "%s: '%s' attached read only with writes going to overlay '%s' (%u sectors)\n",
+                                  sim_uname (uptr), cptr, gbuf, ((struct disk_context *)uptr->disk_ctx)->overlay->records);
+    }
 if (sim_switches & SWMASK ('C')) {                      /* create new disk container & copy contents? */
     char gbuf[CBUFSIZE];
-    const char *dest_fmt = ((DK_GET_FMT (uptr) == DKUF_F_AUTO) || (DK_GET_FMT (uptr) == DKUF_F_VHD)) ? "VHD" : "SIMH";
+    const char *dest_fmt = ((DK_GET_FMT (uptr) == DKUF_F_AUTO) || (DK_GET_FMT (uptr) == DKUF_F_VHD)) ? "VHD" :
+                           (DK_GET_FMT (uptr) == DKUF_F_CLU) ? "CLUSTER" : "SIMH";
+    struct disk_unit_opts *opts = _disk_unit_opts (uptr, FALSE);
     FILE *dest;
     int saved_sim_switches = sim_switches;
     int32 saved_sim_quiet = sim_quiet;
@@ -3348,6 +5358,9 @@ if (sim_switches & SWMASK ('C')) {                      /* create new disk conta
         sim_switches = saved_sim_switches;
         return sim_messagef (r, "%s: Cannot open copy source: %s - %s\n", sim_uname (uptr), cptr, sim_error_text (r));
         }
+    ctx = (struct disk_context *)uptr->disk_ctx;        /* copy directly, the destination */
+    _disk_cache_free (ctx->cache);                      /* mustn't be seen through the */
+    ctx->cache = NULL;                                  /* source's sector cache */
     source_drvtyp = uptr->drvtyp;
     source_capac = uptr->capac;
     if (saved_noautosize) {
@@ -3360,8 +5373,15 @@ if (sim_switches & SWMASK ('C')) {                      /* create new disk conta
     target_capac = uptr->capac;
     if (strcmp ("VHD", dest_fmt) == 0)
         dest = sim_vhd_disk_create (gbuf, ((t_offset)uptr->capac)*capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1), uptr->drvtyp);
-    else
-        dest = sim_fopen (gbuf, "wb+");
+    else {
+        if (strcmp ("CLUSTER", dest_fmt) == 0) {
+            dest = sim_clu_disk_create (gbuf, ((t_offset)uptr->capac)*capac_factor*((dptr->flags & DEV_SECTORS) ? 512 : 1), uptr->drvtyp);
+            if ((dest != NULL) && (opts != NULL) && opts->compress)
+                sim_clu_disk_set_compress (dest, TRUE);
+            }
+        else
+            dest = sim_fopen (gbuf, "wb+");
+        }
     if (!dest) {
         sim_disk_detach (uptr);
         return sim_messagef (r, "%s: Cannot create %s disk container '%s'\n", sim_uname (uptr), dest_fmt, gbuf);
@@ -3377,8 +5397,12 @@ if (sim_switches & SWMASK ('C')) {                      /* create new disk conta
         if (!copy_buf) {
             if (strcmp ("VHD", dest_fmt) == 0)
                 sim_vhd_disk_close (dest);
-            else
-                fclose (dest);
+            else {
+                if (strcmp ("CLUSTER", dest_fmt) == 0)
+                    sim_clu_disk_close (dest);
+                else
+                    fclose (dest);
+                }
             (void)remove (gbuf);
             sim_disk_detach (uptr);
             return SCPE_MEM;
@@ -3428,8 +5452,12 @@ if (sim_switches & SWMASK ('C')) {                      /* create new disk conta
             if (!verify_buf) {
                 if (strcmp ("VHD", dest_fmt) == 0)
                     sim_vhd_disk_close (dest);
-                else
-                    fclose (dest);
+                else {
+                    if (strcmp ("CLUSTER", dest_fmt) == 0)
+                        sim_clu_disk_close (dest);
+                    else
+                        fclose (dest);
+                    }
                 (void)remove (gbuf);
                 free (copy_buf);
                 sim_disk_detach (uptr);
@@ -3488,8 +5516,12 @@ if (sim_switches & SWMASK ('C')) {                      /* create new disk conta
             sim_vhd_disk_set_dtype (dest, (char *)uptr->drvtyp->name, sector_size, xfer_encode_size, uptr->drvtyp->MediaId, uptr->dptr->name, uptr->dptr->dwidth, uptr->drvtyp);
             sim_vhd_disk_close (dest);
             }
-        else
-            fclose (dest);
+        else {
+            if (strcmp ("CLUSTER", dest_fmt) == 0)
+                sim_clu_disk_close (dest);
+            else
+                fclose (dest);
+            }
         sim_disk_detach (uptr);
         if (r == SCPE_OK) {
             created = TRUE;
@@ -3538,6 +5570,11 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
             open_function = sim_vhd_disk_open;
             break;
             }
+        if (sim_clu_disk_probe (cptr)) {                /* Try Clustered */
+            sim_disk_set_fmt (uptr, 0, "CLUSTER", NULL);/* set file format to CLUSTER */
+            open_function = sim_clu_disk_open;
+            break;
+            }
         while (tmp_size < sector_size)
             tmp_size <<= 1;
         if (tmp_size ==  sector_size) {                     /* Power of 2 sector size can do RAW */
@@ -3562,6 +5599,12 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
             auto_format = TRUE;
             break;
             }
+        if (sim_clu_disk_probe (cptr)) {                /* Try Clustered next */
+            sim_disk_set_fmt (uptr, 0, "CLUSTER", NULL);/* set file format to CLUSTER */
+            open_function = sim_clu_disk_open;
+            auto_format = TRUE;
+            break;
+            }
         open_function = sim_fopen;
         break;
     case DKUF_F_VHD:                                    /* VHD format */
@@ -3569,6 +5612,10 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
         create_function = sim_vhd_disk_create;
         storage_function = sim_os_disk_info_raw;
         break;
+    case DKUF_F_CLU:                                    /* Clustered format */
+        open_function = sim_clu_disk_open;
+        create_function = sim_clu_disk_create;
+        break;
     case DKUF_F_RAW:                                    /* Raw Physical Disk Access */
         if (NULL != (uptr->fileref = sim_vhd_disk_open (cptr, "rb"))) { /* Try VHD first */
             sim_disk_set_fmt (uptr, 0, "VHD", NULL);    /* set file format to VHD */
@@ -3578,6 +5625,12 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
             auto_format = TRUE;
             break;
             }
+        if (sim_clu_disk_probe (cptr)) {                /* Try Clustered next */
+            sim_disk_set_fmt (uptr, 0, "CLUSTER", NULL);/* set file format to CLUSTER */
+            open_function = sim_clu_disk_open;
+            auto_format = TRUE;
+            break;
+            }
         open_function = sim_os_disk_open_raw;
         storage_function = sim_os_disk_info_raw;
         break;
@@ -3965,6 +6018,7 @@ if (container_size && (container_size != (t_offset)-1) &&
             else {                                              /* Unrecognized file system */
                 if (container_size < current_unit_size)         /*     Use MAX of container or current device size */
                     if ((DKUF_F_VHD != DK_GET_FMT (uptr)) &&    /*     when size can be expanded */
+                        (DKUF_F_CLU != DK_GET_FMT (uptr)) &&
                         (0 == (uptr->flags & UNIT_RO))) {
                         container_size = current_unit_size;     /*     Use MAX of container or current device size */
                         autosized = TRUE;
@@ -4043,7 +6097,7 @@ if (container_size && (container_size != (t_offset)-1) &&
         }
     if ((container_size != current_unit_size)) {
         if (container_size <= current_unit_size) {
-            if (DKUF_F_VHD == DK_GET_FMT (uptr)){
+            if ((DKUF_F_VHD == DK_GET_FMT (uptr)) || (DKUF_F_CLU == DK_GET_FMT (uptr))) {
                 t_stat r = SCPE_INCOMPDSK;
                 const char *container_dtype = ctx->footer ? (const char *)ctx->footer->DriveType : "";
                 char *capac1;
@@ -4143,6 +6197,16 @@ if (uptr->flags & UNIT_BUFABLE) {                       /* buffer in memory? */
     }
 if (DK_GET_FMT (uptr) != DKUF_F_STD)
     uptr->dynflags |= UNIT_NO_FIO;
+if ((DK_GET_FMT (uptr) == DKUF_F_CLU) && ((uptr->flags & UNIT_RO) == 0)) {
+    struct disk_unit_opts *o = _disk_unit_opts (uptr, FALSE);
+
+    if ((o != NULL) && o->compress_set)
+        sim_clu_disk_set_compress (uptr->fileref, o->compress);
+    }
+_disk_mmap_setup (uptr);                                /* memory mapped if configured */
+_disk_cache_setup (uptr);                               /* sector cache if configured */
+memset (ctx->stats, 0, sizeof (ctx->stats));            /* count from here, not the probes */
+memset (&ctx->flushes, 0, sizeof (ctx->flushes));
 return SCPE_OK;
 }
 
@@ -4152,6 +6216,7 @@ struct disk_context *ctx;
 int (*close_function)(FILE *f);
 FILE *fileref;
 t_bool auto_format;
+t_bool overlaid;
 char *autozap_filename = NULL;
 
 if (uptr == NULL)
@@ -4173,6 +6238,9 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
     case DKUF_F_VHD:                                    /* Virtual Disk */
         close_function = sim_vhd_disk_close;
         break;
+    case DKUF_F_CLU:                                    /* Clustered */
+        close_function = sim_clu_disk_close;
+        break;
     case DKUF_F_RAW:                                    /* Physical */
         close_function = sim_os_disk_close_raw;
         break;
@@ -4202,6 +6270,7 @@ uptr->filebuf = NULL;
 free (uptr->filebuf2);
 uptr->filebuf2 = NULL;
 
+_disk_cache_flush (uptr);                               /* write modified cached sectors */
 update_disk_footer (uptr);                              /* Update meta data if highwater has changed */
 fileref = uptr->fileref;                                /* update local copy used after unit cleanup */
 
@@ -4211,10 +6280,15 @@ if (uptr->io_flush)
     uptr->io_flush (uptr);                              /* flush buffered data */
 
 sim_disk_clr_async (uptr);
+_disk_cache_free (ctx->cache);
+ctx->cache = NULL;
+_disk_mmap_release (uptr);
+overlaid = (ctx->overlay != NULL);
+_disk_overlay_close (uptr);
 
 uptr->flags &= ~(UNIT_ATT | UNIT_RO);
 uptr->dynflags &= ~(UNIT_NO_FIO | UNIT_DISK_CHK);
-if ((uptr->flags & DKUF_AUTOZAP) != 0)
+if (((uptr->flags & DKUF_AUTOZAP) != 0) && !overlaid)  /* never change a shared base */
     autozap_filename = strdup (uptr->filename);
 free (uptr->filename);
 uptr->filename = NULL;
@@ -4365,8 +6439,14 @@ fprintf (st, "                expanding one).\n");
 fprintf (st, "    -D          Create a Differencing VHD (relative to an already existing VHD\n");
 fprintf (st, "                disk)\n");
 fprintf (st, "    -M          Merge a Differencing VHD into its parent VHD disk\n");
-fprintf (st, "    -O          Override consistency checks when attaching differencing disks\n");
-fprintf (st, "                which have unexpected parent disk GUID or timestamps\n");
+fprintf (st, "    -O          With one file, override consistency checks when attaching\n");
+fprintf (st, "                differencing disks which have unexpected parent disk GUID or\n");
+fprintf (st, "                timestamps.  With two files, an overlay and a SIMH or RAW format\n");
+fprintf (st, "                base container, attaches the base read only and records the\n");
+fprintf (st, "                sectors written in the overlay, which is created if needed.\n");
+fprintf (st, "                Many simulators can share one base container this way.  SET\n");
+fprintf (st, "                <unit> OVERLAY=KEEP|DISCARD|MERGE chooses whether the overlay\n");
+fprintf (st, "                is kept, deleted or merged into the base at detach.\n");
 fprintf (st, "    -U          Fix inconsistencies which are overridden by the -O switch\n");
 if (strstr (sim_name, "-10") == NULL) {
     fprintf (st, "    -Y          Answer Yes to prompt to overwrite last track (on disk create)\n");
@@ -4480,6 +6560,9 @@ switch (DK_GET_FMT (uptr)) {                            /* case on format */
     case DKUF_F_VHD:                                    /* VHD format */
         sim_vhd_disk_clearerr (uptr);
         break;
+    case DKUF_F_CLU:                                    /* Clustered format */
+        sim_clu_disk_clearerr (uptr);
+        break;
     default:
         ;
     }
@@ -5517,6 +7600,10 @@ static FILE *sim_vhd_disk_parent_path (FILE *f)
 return NULL;
 }
 
+static void sim_vhd_disk_show_chain (FILE *st, FILE *f, const char *prefix)
+{
+}
+
 static t_stat sim_vhd_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
 {
 *sectsread = 0;
@@ -6170,8 +8257,20 @@ struct VHD_IOData {
     char VHDPath[512];
     char ParentVHDPath[512];
     struct VHD_IOData *Parent;
+    uint64 FileEnd;             /* offset of the trailing footer, 0 until first needed */
+    uint8 *BATDirty;            /* BAT sectors modified since last written, one byte each */
+    t_bool BATModified;         /* some BATDirty entry is set */
+    uint32 BlocksAllocated;     /* statistics */
+    uint32 BATWrites;
+    uint8 *Owner;               /* differencing chain: layer holding each block */
+    struct VHD_IOData **Chain;  /* the chain's layers, this disk first */
+    uint32 Depth;
     };
 
+#define VHD_NO_OWNER    0xFF    /* No layer of the chain holds the block */
+
+#define VHD_BATSectors(hVHD) ((uint32)((sizeof(*(hVHD)->BAT) * NtoHl((hVHD)->Dynamic.MaxTableEntries) + VHD_Internal_SectorSize - 1) / VHD_Internal_SectorSize))
+
 static t_stat sim_vhd_disk_implemented (void)
 {
 return SCPE_OK;
@@ -6275,6 +8374,68 @@ if (data_width)
 return (char *)(&hVHD->Footer.DriveType[0]);
 }
 
+/* Merge the allocation maps of a differencing disk and all of its parents
+   into a map of which layer holds each block, so that reads go directly
+   to that layer rather than walking down the chain for each block.  If
+   the layers' geometries don't allow this, reads just walk the chain. */
+
+static void
+BuildChainMap(VHDHANDLE hVHD)
+{
+uint32 Blocks = NtoHl(hVHD->Dynamic.MaxTableEntries);
+uint32 BlockSize = NtoHl(hVHD->Dynamic.BlockSize);
+uint32 Depth, Layer, BlockNumber;
+VHDHANDLE h;
+
+for (Depth = 0, h = hVHD; h != NULL; h = h->Parent) {
+    if ((++Depth >= VHD_NO_OWNER) ||
+        (NtoHll(h->Footer.CurrentSize) < NtoHll(hVHD->Footer.CurrentSize)))
+        return;
+    if (NtoHl(h->Footer.DiskType) == VHD_DT_Fixed)
+        break;
+    if ((NtoHl(h->Dynamic.BlockSize) != BlockSize) ||
+        (NtoHl(h->Dynamic.MaxTableEntries) < Blocks))
+        return;
+    }
+hVHD->Owner = (uint8 *)malloc(Blocks);
+hVHD->Chain = (VHDHANDLE *)calloc(Depth, sizeof(*hVHD->Chain));
+if ((hVHD->Owner == NULL) || (hVHD->Chain == NULL)) {
+    free(hVHD->Owner);
+    free(hVHD->Chain);
+    hVHD->Owner = NULL;
+    hVHD->Chain = NULL;
+    return;
+    }
+memset(hVHD->Owner, VHD_NO_OWNER, Blocks);
+for (Layer = 0, h = hVHD; Layer < Depth; ++Layer, h = h->Parent) {
+    hVHD->Chain[Layer] = h;
+    for (BlockNumber = 0; BlockNumber < Blocks; ++BlockNumber) {
+        if ((hVHD->Owner[BlockNumber] == VHD_NO_OWNER) &&
+            ((NtoHl(h->Footer.DiskType) == VHD_DT_Fixed) ||
+             (h->BAT[BlockNumber] != VHD_BAT_FREE_ENTRY)))
+            hVHD->Owner[BlockNumber] = (uint8)Layer;
+        }
+    }
+hVHD->Depth = Depth;
+}
+
+/* File offset of a block's data in the layer of the chain which holds it */
+
+static uint64
+ChainBlockOffset(VHDHANDLE hVHD, uint32 BlockNumber, uint32 BitMapSectors, VHDHANDLE *hOwner)
+{
+VHDHANDLE h;
+
+if (hVHD->Owner[BlockNumber] == VHD_NO_OWNER) {
+    *hOwner = NULL;
+    return 0;
+    }
+*hOwner = h = hVHD->Chain[hVHD->Owner[BlockNumber]];
+if (NtoHl(h->Footer.DiskType) == VHD_DT_Fixed)
+    return (uint64)BlockNumber * NtoHl(hVHD->Dynamic.BlockSize);
+return VHD_Internal_SectorSize * ((uint64)(NtoHl (h->BAT[BlockNumber]) + BitMapSectors));
+}
+
 static FILE *sim_vhd_disk_open (const char *szVHDPath, const char *DesiredAccess)
     {
     VHDHANDLE hVHD = (VHDHANDLE) calloc (1, sizeof(*hVHD));
@@ -6341,6 +8502,8 @@ static FILE *sim_vhd_disk_open (const char *szVHDPath, const char *DesiredAccess
     else {
         strlcpy (hVHD->VHDPath, szVHDPath, sizeof (hVHD->VHDPath));
         hVHD->Writable = (strchr (DesiredAccess, 'w') || strchr (DesiredAccess, '+'));
+        if (hVHD->Parent)
+            BuildChainMap (hVHD);
         }
 Cleanup_Return:
     if (Status) {
@@ -6484,6 +8647,43 @@ Cleanup_Return:
     return (FILE *)hVHD;
     }
 
+/* Write the BAT sectors changed by the blocks allocated for a write.
+   Newly allocated blocks (their bitmaps, data and the footer beyond them)
+   reach the file first, so that the BAT on disk never refers to an
+   incomplete block. */
+
+static t_stat
+FlushVirtualDiskMetadata(VHDHANDLE hVHD)
+{
+uint32 Sectors = VHD_BATSectors(hVHD);
+uint32 First, Last;
+t_stat r = SCPE_OK;
+
+if (!hVHD->BATModified)
+    return SCPE_OK;
+if (fflush (hVHD->File))
+    return SCPE_IOERR;
+for (First = 0; First < Sectors; First = Last) {
+    for (; (First < Sectors) && !hVHD->BATDirty[First]; ++First)
+        ;
+    for (Last = First; (Last < Sectors) && hVHD->BATDirty[Last]; ++Last)
+        hVHD->BATDirty[Last] = 0;
+    if (First == Last)
+        break;
+    if (WriteFilePosition(hVHD->File,
+                          ((uint8 *)hVHD->BAT) + First * VHD_Internal_SectorSize,
+                          (Last - First) * VHD_Internal_SectorSize,
+                          NULL,
+                          NtoHll(hVHD->Dynamic.TableOffset) + First * VHD_Internal_SectorSize))
+        r = SCPE_IOERR;
+    ++hVHD->BATWrites;
+    }
+hVHD->BATModified = FALSE;
+if (fflush (hVHD->File))
+    r = SCPE_IOERR;
+return r;
+}
+
 static int sim_vhd_disk_close (FILE *f)
 {
 VHDHANDLE hVHD = (VHDHANDLE)f;
@@ -6491,11 +8691,15 @@ VHDHANDLE hVHD = (VHDHANDLE)f;
 if (NULL != hVHD) {
     if (hVHD->Parent)
         sim_vhd_disk_close ((FILE *)hVHD->Parent);
-    free (hVHD->BAT);
     if (hVHD->File) {
+        FlushVirtualDiskMetadata (hVHD);
         fflush (hVHD->File);
         fclose (hVHD->File);
         }
+    free (hVHD->BAT);
+    free (hVHD->BATDirty);
+    free (hVHD->Owner);
+    free (hVHD->Chain);
     free (hVHD);
     return 0;
     }
@@ -6506,8 +8710,10 @@ static void sim_vhd_disk_flush (FILE *f)
 {
 VHDHANDLE hVHD = (VHDHANDLE)f;
 
-if ((NULL != hVHD) && (hVHD->File))
+if ((NULL != hVHD) && (hVHD->File)) {
+    FlushVirtualDiskMetadata (hVHD);
     fflush (hVHD->File);
+    }
 }
 
 static t_offset sim_vhd_disk_size (FILE *f)
@@ -6517,6 +8723,41 @@ VHDHANDLE hVHD = (VHDHANDLE)f;
 return (t_offset)(NtoHll (hVHD->Footer.CurrentSize));
 }
 
+static void sim_vhd_disk_show_chain (FILE *st, FILE *f, const char *prefix)
+{
+VHDHANDLE hVHD = (VHDHANDLE)f;
+VHDHANDLE h;
+uint32 Layer, Depth;
+
+for (Depth = 0, h = hVHD; h != NULL; h = h->Parent)
+    ++Depth;
+fprintf (st, "%s: VHD chain depth %u%s\n", prefix, Depth, (hVHD->Owner != NULL) ? ", reads use a merged allocation map" : "");
+for (Layer = 0, h = hVHD; h != NULL; ++Layer, h = h->Parent) {
+    uint32 Blocks = NtoHl (h->Dynamic.MaxTableEntries);
+    uint32 BlockNumber, Extents = 0, Held = 0;
+    t_bool InExtent = FALSE;
+
+    if (NtoHl (h->Footer.DiskType) == VHD_DT_Fixed) {
+        fprintf (st, "    %u: %s, fixed, holds all remaining data\n", Layer, h->VHDPath);
+        continue;
+        }
+    for (BlockNumber = 0; BlockNumber < Blocks; ++BlockNumber) {
+        t_bool Holds = (hVHD->Owner != NULL) ? (hVHD->Owner[BlockNumber] == Layer) :
+                                               (h->BAT[BlockNumber] != VHD_BAT_FREE_ENTRY);
+
+        if (Holds) {
+            ++Held;
+            if (!InExtent)
+                ++Extents;
+            }
+        InExtent = Holds;
+        }
+    fprintf (st, "    %u: %s, %s, %u extent%s, %u of %u %uKB blocks\n", Layer, h->VHDPath,
+                 (NtoHl (h->Footer.DiskType) == VHD_DT_Differencing) ? "differencing" : "dynamic",
+                 Extents, (Extents == 1) ? "" : "s", Held, Blocks, NtoHl (h->Dynamic.BlockSize) / 1024);
+    }
+}
+
 static uint32 sim_vhd_CHS (FILE *f)
 {
 VHDHANDLE hVHD = (VHDHANDLE)f;
@@ -7107,7 +9348,37 @@ while (BytesToRead && (r == SCPE_OK)) {
 
     if (BlockNumber != (Offset + BytesToRead) / DynamicBlockSize)
         BytesInRead = (uint32)(((BlockNumber + 1) * DynamicBlockSize) - Offset);
-    if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY) {
+    if (hVHD->Owner != NULL) {          /* Differencing chain with a merged map? */
+        VHDHANDLE hOwner;
+        uint64 BlockOffset = ChainBlockOffset(hVHD, BlockNumber, BitMapSectors, &hOwner) + (Offset % DynamicBlockSize);
+        uint32 NextBlock;
+
+        /* Extend the read over following blocks held contiguously by the same layer */
+        for (NextBlock = BlockNumber + 1;
+             (BytesInRead < BytesToRead) && (NextBlock < NtoHl (hVHD->Dynamic.MaxTableEntries));
+             ++NextBlock) {
+            VHDHANDLE hNext;
+            uint64 NextOffset = ChainBlockOffset(hVHD, NextBlock, BitMapSectors, &hNext);
+
+            if ((hNext != hOwner) ||
+                ((hOwner != NULL) && (NextOffset != BlockOffset + BytesInRead)))
+                break;
+            BytesInRead += ((BytesToRead - BytesInRead) > DynamicBlockSize) ? DynamicBlockSize : (BytesToRead - BytesInRead);
+            }
+        if (hOwner == NULL) {
+            memset (buf, 0, BytesInRead);
+            BytesThisRead = BytesInRead;
+            }
+        else {
+            if (ReadFilePosition(hOwner->File,
+                                 buf,
+                                 BytesInRead,
+                                 &BytesThisRead,
+                                 BlockOffset))
+                r = SCPE_IOERR;
+            }
+        }
+    else if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY) {
         if (!hVHD->Parent) {
             memset (buf, 0, BytesInRead);
             BytesThisRead = BytesInRead;
@@ -7243,99 +9514,63 @@ while (BytesToWrite && (r == SCPE_OK)) {
         BytesInWrite = (uint32)(((BlockNumber + 1) * DynamicBlockSize) - Offset);
     if (hVHD->BAT[BlockNumber] == VHD_BAT_FREE_ENTRY) {
         uint8 *BitMap = NULL;
-        uint32 BitMapBufferSize = VHD_DATA_BLOCK_ALIGNMENT;
-        uint8 *BitMapBuffer = NULL;
         void *BlockData = NULL;
-        uint8 *BATUpdateBufferAddress;
-        uint32 BATUpdateBufferSize;
-        uint64 BATUpdateStorageAddress;
         uint64 BlockOffset;
+        uint64 BlockEnd;
 
         if (!hVHD->Parent && BufferIsZeros(buf, BytesInWrite)) {
             BytesThisWrite = BytesInWrite;
             goto IO_Done;
             }
         /* Need to allocate a new Data Block. */
-        BlockOffset = sim_fsize_ex (hVHD->File);
-        if (((int64)BlockOffset) == -1)
-            return SCPE_IOERR;
-        if ((BitMapSectors * VHD_Internal_SectorSize) > BitMapBufferSize)
-            BitMapBufferSize = BitMapSectors * VHD_Internal_SectorSize;
-        BitMapBuffer = (uint8 *)calloc(1, BitMapBufferSize + DynamicBlockSize);
-        if (BitMapBufferSize > BitMapSectors * VHD_Internal_SectorSize)
-            BitMap = BitMapBuffer + BitMapBufferSize - BitMapBytes;
-        else
-            BitMap = BitMapBuffer;
-        memset(BitMap, 0xFF, BitMapBytes);
-        BlockOffset -= sizeof(hVHD->Footer);
-        if (0 == (BlockOffset & (VHD_DATA_BLOCK_ALIGNMENT-1)))
-            {  // Already aligned, so use padded BitMapBuffer
-            if (WriteFilePosition(hVHD->File,
-                                  BitMapBuffer,
-                                  BitMapBufferSize + DynamicBlockSize,
-                                  NULL,
-                                  BlockOffset)) {
-                free (BitMapBuffer);
+        if (hVHD->FileEnd == 0) {       /* first allocation since open? */
+            BlockOffset = sim_fsize_ex (hVHD->File);
+            if (((int64)BlockOffset) == -1)
                 return SCPE_IOERR;
-                }
-            BlockOffset += BitMapBufferSize;
+            hVHD->FileEnd = BlockOffset - sizeof(hVHD->Footer);
             }
-        else
-            {
-            // align the data portion of the block to the desired alignment
-            // compute the address of the data portion of the block
-            BlockOffset += BitMapSectors * VHD_Internal_SectorSize;
-            // round up this address to the desired alignment
-            BlockOffset += VHD_DATA_BLOCK_ALIGNMENT-1;
-            BlockOffset &= ~(VHD_DATA_BLOCK_ALIGNMENT - 1);
-            BlockOffset -= BitMapSectors * VHD_Internal_SectorSize;
-            if (WriteFilePosition(hVHD->File,
-                                  BitMap,
-                                  (BitMapSectors * VHD_Internal_SectorSize) + DynamicBlockSize,
-                                  NULL,
-                                  BlockOffset)) {
-                free (BitMapBuffer);
-                return SCPE_IOERR;
-                }
-            BlockOffset += BitMapSectors * VHD_Internal_SectorSize;
+        if (hVHD->BATDirty == NULL) {
+            hVHD->BATDirty = (uint8 *)calloc (VHD_BATSectors(hVHD), sizeof (*hVHD->BATDirty));
+            if (hVHD->BATDirty == NULL)
+                return SCPE_MEM;
             }
-        free(BitMapBuffer);
-        BitMapBuffer = BitMap = NULL;
-        /* the BAT block address is the beginning of the block bitmap */
+        // align the data portion of the block to the desired alignment
+        BlockOffset = hVHD->FileEnd + BitMapSectors * VHD_Internal_SectorSize;
+        BlockOffset += VHD_DATA_BLOCK_ALIGNMENT-1;
+        BlockOffset &= ~(VHD_DATA_BLOCK_ALIGNMENT - 1);
         BlockOffset -= BitMapSectors * VHD_Internal_SectorSize;
-        hVHD->BAT[BlockNumber] = NtoHl((uint32)(BlockOffset / VHD_Internal_SectorSize));
-        BlockOffset += (BitMapSectors * VHD_Internal_SectorSize) + DynamicBlockSize;
+        BlockEnd = BlockOffset + (BitMapSectors * VHD_Internal_SectorSize) + DynamicBlockSize;
+        /* Move the footer beyond the new block first, so that the file always
+           ends with a valid footer.  The data portion of the block is never
+           explicitly zeroed: it reads as zeros until it is written */
         if (WriteFilePosition(hVHD->File,
                               &hVHD->Footer,
                               sizeof(hVHD->Footer),
                               NULL,
-                              BlockOffset))
-            goto Fatal_IO_Error;
-        /* Since a large VHD can have a pretty large BAT, and we've only changed one longword bat entry
-           in the current BAT, we write just the aligned sector which contains the updated BAT entry */
-        BATUpdateBufferAddress = (uint8 *)hVHD->BAT - (size_t)NtoHll(hVHD->Dynamic.TableOffset) +
-            (size_t)((((size_t)&hVHD->BAT[BlockNumber]) - (size_t)hVHD->BAT + (size_t)NtoHll(hVHD->Dynamic.TableOffset)) & ~(VHD_DATA_BLOCK_ALIGNMENT-1));
-        /* If the starting of the BAT isn't on a VHD_DATA_BLOCK_ALIGNMENT boundary and we've just updated
-           a BAT entry early in the array, the buffer computed address might be before the start of the
-           BAT table.  If so, only write the BAT data needed */
-        if (BATUpdateBufferAddress < (uint8 *)hVHD->BAT) {
-            BATUpdateBufferAddress = (uint8 *)hVHD->BAT;
-            BATUpdateBufferSize = (uint32)((((size_t)&hVHD->BAT[BlockNumber]) - (size_t)hVHD->BAT) + 512) & ~511;
-            BATUpdateStorageAddress = NtoHll(hVHD->Dynamic.TableOffset);
-            }
-        else {
-            BATUpdateBufferSize = VHD_DATA_BLOCK_ALIGNMENT;
-            BATUpdateStorageAddress = NtoHll(hVHD->Dynamic.TableOffset) + BATUpdateBufferAddress - ((uint8 *)hVHD->BAT);
-            }
-        /* If the total BAT is smaller than one VHD_DATA_BLOCK_ALIGNMENT, then be sure to only write out the BAT data */
-        if ((size_t)(BATUpdateBufferAddress - (uint8 *)hVHD->BAT + BATUpdateBufferSize) > VHD_Internal_SectorSize * ((sizeof(*hVHD->BAT)*NtoHl(hVHD->Dynamic.MaxTableEntries) + VHD_Internal_SectorSize - 1)/VHD_Internal_SectorSize))
-            BATUpdateBufferSize = (uint32)(VHD_Internal_SectorSize * ((sizeof(*hVHD->BAT) * NtoHl(hVHD->Dynamic.MaxTableEntries) + VHD_Internal_SectorSize - 1)/VHD_Internal_SectorSize) - (BATUpdateBufferAddress - ((uint8 *)hVHD->BAT)));
+                              BlockEnd))
+            return SCPE_IOERR;
+        hVHD->FileEnd = BlockEnd;
+        BitMap = (uint8 *)calloc(BitMapSectors, VHD_Internal_SectorSize);
+        if (BitMap == NULL)
+            return SCPE_MEM;
+        memset(BitMap, 0xFF, BitMapBytes);
         if (WriteFilePosition(hVHD->File,
-                              BATUpdateBufferAddress,
-                              BATUpdateBufferSize,
+                              BitMap,
+                              BitMapSectors * VHD_Internal_SectorSize,
                               NULL,
-                              BATUpdateStorageAddress))
+                              BlockOffset))
             goto Fatal_IO_Error;
+        free(BitMap);
+        BitMap = NULL;
+        /* the BAT block address is the beginning of the block bitmap.  The
+           BAT is written before this write completes, after the block's
+           bitmap, the footer which follows it and the data */
+        hVHD->BAT[BlockNumber] = NtoHl((uint32)(BlockOffset / VHD_Internal_SectorSize));
+        hVHD->BATDirty[(BlockNumber * sizeof(*hVHD->BAT)) / VHD_Internal_SectorSize] = 1;
+        hVHD->BATModified = TRUE;
+        ++hVHD->BlocksAllocated;
+        if (hVHD->Owner != NULL)
+            hVHD->Owner[BlockNumber] = 0;       /* now held by this layer */
         if (hVHD->Parent)
             { /* Need to populate data block contents from parent VHD */
             BlockData = malloc (NtoHl (hVHD->Dynamic.BlockSize));
@@ -7376,6 +9611,8 @@ IO_Done:
     Offset += BytesThisWrite;
     TotalBytesWritten += BytesThisWrite;
     }
+if ((r == SCPE_OK) && hVHD->BATModified)    /* new blocks are referenced before the write completes */
+    r = FlushVirtualDiskMetadata (hVHD);
 if (BytesWritten)
     *BytesWritten = TotalBytesWritten;
 return r;
@@ -7410,6 +9647,779 @@ return WriteVirtualDiskSectors(hVHD, buf, sects, sectswritten, ctx->sector_size,
 }
 #endif
 
+/* Clustered sparse disk container (CLUSTER format)
+
+   A container which holds only those clusters (64KB) of the simulated
+   disk which have been written with non zero data.  Clusters are found
+   through a two level table, much as in QEMU's QCOW2 format:
+
+       header      4KB at offset 0: identification, table locations and
+                   a copy of the simh disk footer (metadata)
+       L1 table    one 64 bit entry per L2 table, 0 if none
+       L2 tables   one cluster each, one 64 bit entry per data cluster,
+                   0 if the cluster has never been written
+       data        clusters, appended as they are first written
+
+   All values are stored big endian.  Table entries referenced only by
+   the active image have CLU_COPIED set, and their clusters are written
+   in place.  Any other cluster (shared with a snapshot, or compressed)
+   is copied to newly allocated space when it is written.  When
+   compression is enabled, clusters written in their entirety (as by
+   ATTACH -C) are stored LZ4 compressed if that saves space, and the
+   entry holds the byte offset and length of the compressed data.
+
+   A snapshot is a saved copy of the L1 table.  Taking one clears
+   CLU_COPIED in the active L1 table, so that later writes copy rather
+   than overwrite shared data.  There are no reference counts, so the
+   space used by deleted snapshots, or left behind by reverting to one,
+   isn't reused; copying the container with ATTACH -C reclaims it. */
+
+#define CLU_MAGIC           "simhCLU1"
+#define CLU_VERSION         1
+#define CLU_HEADER_SIZE     4096                        /* reserved at the start of the container */
+#define CLU_CLUSTER_BITS    16                          /* 64KB clusters */
+#define CLU_COPIED          (((t_uint64)1) << 63)       /* referenced only by the active image */
+#define CLU_COMPRESSED      (((t_uint64)1) << 62)       /* LZ4 compressed data cluster */
+#define CLU_OFFSET_MASK     ((((t_uint64)1) << 62) - 1)
+#define CLU_CMP_V_LEN       40                          /* compressed entry: length<61:40>, offset<39:0> */
+#define CLU_CMP_M_LEN       0x3FFFFF
+#define CLU_CMP_OFFSET_MASK ((((t_uint64)1) << CLU_CMP_V_LEN) - 1)
+#define CLU_FL_COMPRESS     1                           /* compress whole cluster writes */
+#define CLU_MAX_SNAPSHOTS   64
+#define CLU_L2_CACHE        16                          /* L2 tables kept in memory */
+#define CLU_NONE            0xFFFFFFFF
+#define CLU_NO_ENTRY        (~(t_uint64)0)
+
+typedef struct {
+    uint8       Magic[8];
+    uint8       Version[4];
+    uint8       ClusterBits[4];
+    uint8       Flags[4];
+    uint8       L1Entries[4];
+    uint8       Size[8];                /* simulated disk size in bytes */
+    uint8       L1Offset[8];
+    uint8       SnapshotOffset[8];
+    uint8       SnapshotCount[4];
+    uint8       FooterSize[4];          /* size of the footer which follows the header, 0 if none */
+    uint8       Reserved[452];
+    uint8       Checksum[4];            /* CRC32 of the prior 508 bytes */
+    } CLU_HEADER;
+
+typedef struct {
+    uint8       Name[64];
+    uint8       L1Offset[8];
+    uint8       L1Entries[4];
+    uint8       Reserved[4];
+    uint8       Time[8];                /* creation time (time_t) */
+    } CLU_SNAPSHOT;
+
+typedef struct {
+    FILE        *File;
+    t_bool      ReadOnly;
+    uint32      ClusterBits;
+    uint32      ClusterSize;
+    uint32      L2Entries;              /* entries per L2 table */
+    uint32      Flags;
+    t_offset    Size;
+    uint32      L1Entries;
+    t_offset    L1Offset;
+    t_uint64    *L1;
+    t_offset    FileEnd;                /* allocation point */
+    CLU_SNAPSHOT *Snapshots;
+    uint32      SnapshotCount;
+    t_offset    SnapshotOffset;
+    t_bool      HasFooter;
+    struct simh_disk_footer Footer;
+    struct {
+        uint32      Index;              /* L1 index of table held, or CLU_NONE */
+        t_uint64    *Table;
+        } L2Cache[CLU_L2_CACHE];
+    uint8       *Cluster;               /* cluster work buffer */
+    uint8       *Decoded;               /* cluster contents for DecodedEntry */
+    t_uint64    DecodedEntry;
+    uint8       *Compressed;
+    } CLU_DISK, *CLUHANDLE;
+
+static uint32 _clu_get32 (const uint8 *p)
+{
+return ((uint32)p[0] << 24) | ((uint32)p[1] << 16) | ((uint32)p[2] << 8) | (uint32)p[3];
+}
+
+static t_uint64 _clu_get64 (const uint8 *p)
+{
+return (((t_uint64)_clu_get32 (p)) << 32) | (t_uint64)_clu_get32 (p + 4);
+}
+
+static void _clu_put32 (uint8 *p, uint32 v)
+{
+p[0] = (uint8)(v >> 24);
+p[1] = (uint8)(v >> 16);
+p[2] = (uint8)(v >> 8);
+p[3] = (uint8)v;
+}
+
+static void _clu_put64 (uint8 *p, t_uint64 v)
+{
+_clu_put32 (p, (uint32)(v >> 32));
+_clu_put32 (p + 4, (uint32)v);
+}
+
+/* CRC32 (IEEE 802.3) of the container header */
+
+static uint32 _clu_crc32 (const void *buf, size_t len)
+{
+const uint8 *p = (const uint8 *)buf;
+uint32 crc = 0xFFFFFFFF;
+int bit;
+
+while (len--) {
+    crc ^= *p++;
+    for (bit = 0; bit < 8; bit++)
+        crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+return crc ^ 0xFFFFFFFF;
+}
+
+static t_bool _clu_read (CLUHANDLE h, t_offset offset, void *buf, size_t len)
+{
+return ((sim_fseeko (h->File, offset, SEEK_SET) == 0) &&
+        (sim_fread (buf, 1, len, h->File) == len));
+}
+
+static t_bool _clu_write (CLUHANDLE h, t_offset offset, const void *buf, size_t len)
+{
+return ((sim_fseeko (h->File, offset, SEEK_SET) == 0) &&
+        (sim_fwrite (buf, 1, len, h->File) == len));
+}
+
+static t_bool _clu_is_zero (const uint8 *buf, size_t len)
+{
+return (len == 0) || ((buf[0] == 0) && (memcmp (buf, buf + 1, len - 1) == 0));
+}
+
+static t_bool _clu_write_header (CLUHANDLE h)
+{
+uint8 buf[sizeof (CLU_HEADER) + sizeof (struct simh_disk_footer)];
+CLU_HEADER *hdr = (CLU_HEADER *)buf;
+
+memset (buf, 0, sizeof (buf));
+memcpy (hdr->Magic, CLU_MAGIC, sizeof (hdr->Magic));
+_clu_put32 (hdr->Version, CLU_VERSION);
+_clu_put32 (hdr->ClusterBits, h->ClusterBits);
+_clu_put32 (hdr->Flags, h->Flags);
+_clu_put32 (hdr->L1Entries, h->L1Entries);
+_clu_put64 (hdr->Size, (t_uint64)h->Size);
+_clu_put64 (hdr->L1Offset, (t_uint64)h->L1Offset);
+_clu_put64 (hdr->SnapshotOffset, (t_uint64)h->SnapshotOffset);
+_clu_put32 (hdr->SnapshotCount, h->SnapshotCount);
+if (h->HasFooter) {
+    _clu_put32 (hdr->FooterSize, sizeof (h->Footer));
+    memcpy (&buf[sizeof (*hdr)], &h->Footer, sizeof (h->Footer));
+    }
+_clu_put32 (hdr->Checksum, _clu_crc32 (hdr, sizeof (*hdr) - sizeof (hdr->Checksum)));
+return _clu_write (h, 0, buf, sizeof (buf));
+}
+
+/* Write an L1 table, with the given entry flags removed */
+
+static t_bool _clu_write_l1 (CLUHANDLE h, t_offset offset, t_uint64 clear)
+{
+uint8 *buf = (uint8 *)malloc (h->L1Entries * sizeof (t_uint64));
+t_bool ok;
+uint32 i;
+
+if (buf == NULL)
+    return FALSE;
+for (i = 0; i < h->L1Entries; i++)
+    _clu_put64 (&buf[i * sizeof (t_uint64)], h->L1[i] & ~clear);
+ok = _clu_write (h, offset, buf, h->L1Entries * sizeof (t_uint64));
+free (buf);
+return ok;
+}
+
+static t_bool _clu_set_l1 (CLUHANDLE h, uint32 l1idx, t_uint64 entry)
+{
+uint8 buf[sizeof (t_uint64)];
+
+h->L1[l1idx] = entry;
+_clu_put64 (buf, entry);
+return _clu_write (h, h->L1Offset + l1idx * sizeof (t_uint64), buf, sizeof (buf));
+}
+
+static t_bool _clu_set_l2 (CLUHANDLE h, uint32 l1idx, uint32 l2idx, t_uint64 entry)
+{
+uint8 buf[sizeof (t_uint64)];
+
+_clu_put64 (buf, entry);
+return _clu_write (h, (t_offset)(h->L1[l1idx] & CLU_OFFSET_MASK) + l2idx * sizeof (t_uint64), buf, sizeof (buf));
+}
+
+static t_offset _clu_alloc (CLUHANDLE h, size_t size, t_bool aligned)
+{
+t_offset offset = h->FileEnd;
+
+if (aligned)
+    offset = (offset + h->ClusterSize - 1) & ~((t_offset)h->ClusterSize - 1);
+h->FileEnd = offset + size;
+return offset;
+}
+
+static void _clu_invalidate (CLUHANDLE h)
+{
+uint32 i;
+
+for (i = 0; i < CLU_L2_CACHE; i++)
+    h->L2Cache[i].Index = CLU_NONE;
+h->DecodedEntry = CLU_NO_ENTRY;
+}
+
+/* Get the L2 table for an L1 entry which isn't 0 */
+
+static t_uint64 *_clu_load_l2 (CLUHANDLE h, uint32 l1idx)
+{
+uint32 slot = l1idx % CLU_L2_CACHE;
+t_uint64 *t = h->L2Cache[slot].Table;
+uint32 i;
+
+if (h->L2Cache[slot].Index == l1idx)
+    return t;
+h->L2Cache[slot].Index = CLU_NONE;
+if (!_clu_read (h, (t_offset)(h->L1[l1idx] & CLU_OFFSET_MASK), h->Cluster, h->ClusterSize))
+    return NULL;
+for (i = 0; i < h->L2Entries; i++)
+    t[i] = _clu_get64 (&h->Cluster[i * sizeof (t_uint64)]);
+h->L2Cache[slot].Index = l1idx;
+return t;
+}
+
+/* Get an L2 table which can be updated in place, creating it or
+   copying one shared with a snapshot as needed */
+
+static t_uint64 *_clu_l2_for_write (CLUHANDLE h, uint32 l1idx)
+{
+uint32 slot = l1idx % CLU_L2_CACHE;
+t_uint64 *t;
+t_offset offset;
+uint32 i;
+
+if (h->L1[l1idx] & CLU_COPIED)
+    return _clu_load_l2 (h, l1idx);
+if (h->L1[l1idx] == 0) {                                /* new table */
+    h->L2Cache[slot].Index = CLU_NONE;
+    t = h->L2Cache[slot].Table;
+    memset (t, 0, h->L2Entries * sizeof (*t));
+    }
+else {                                                  /* table shared with a snapshot */
+    t = _clu_load_l2 (h, l1idx);
+    if (t == NULL)
+        return NULL;
+    h->L2Cache[slot].Index = CLU_NONE;
+    for (i = 0; i < h->L2Entries; i++)
+        t[i] &= ~CLU_COPIED;                            /* so are its data clusters */
+    }
+for (i = 0; i < h->L2Entries; i++)
+    _clu_put64 (&h->Cluster[i * sizeof (t_uint64)], t[i]);
+offset = _clu_alloc (h, h->ClusterSize, TRUE);
+if (!_clu_write (h, offset, h->Cluster, h->ClusterSize) ||
+    !_clu_set_l1 (h, l1idx, (t_uint64)offset | CLU_COPIED))
+    return NULL;
+h->L2Cache[slot].Index = l1idx;
+return t;
+}
+
+/* Get the whole contents of an unallocated or compressed cluster */
+
+static uint8 *_clu_cluster_data (CLUHANDLE h, t_uint64 entry)
+{
+entry &= ~CLU_COPIED;
+if (entry == h->DecodedEntry)
+    return h->Decoded;
+h->DecodedEntry = CLU_NO_ENTRY;
+if (entry == 0)
+    memset (h->Decoded, 0, h->ClusterSize);
+else {
+    if (entry & CLU_COMPRESSED) {
+        size_t len = (size_t)((entry >> CLU_CMP_V_LEN) & CLU_CMP_M_LEN);
+        size_t dlen;
+
+        if ((len > h->ClusterSize) ||
+            !_clu_read (h, (t_offset)(entry & CLU_CMP_OFFSET_MASK), h->Compressed, len) ||
+            sim_lz4_decompress (h->Compressed, len, h->Decoded, h->ClusterSize, &dlen) ||
+            (dlen != h->ClusterSize))
+            return NULL;
+        }
+    else {                                              /* may be rewritten, so not kept */
+        if (!_clu_read (h, (t_offset)(entry & CLU_OFFSET_MASK), h->Decoded, h->ClusterSize))
+            return NULL;
+        return h->Decoded;
+        }
+    }
+h->DecodedEntry = entry;
+return h->Decoded;
+}
+
+static void _clu_free (CLUHANDLE h)
+{
+uint32 i;
+
+for (i = 0; i < CLU_L2_CACHE; i++)
+    free (h->L2Cache[i].Table);
+free (h->L1);
+free (h->Snapshots);
+free (h->Cluster);
+free (h->Decoded);
+free (h->Compressed);
+free (h);
+}
+
+static FILE *sim_clu_disk_open (const char *path, const char *mode)
+{
+uint8 buf[sizeof (CLU_HEADER) + sizeof (struct simh_disk_footer)];
+CLU_HEADER *hdr = (CLU_HEADER *)buf;
+t_bool writable = (strchr (mode, '+') != NULL);
+FILE *file = sim_fopen (path, writable ? "rb+" : "rb");
+CLUHANDLE h;
+uint8 *l1;
+uint32 i;
+
+if (file == NULL)
+    return NULL;
+if ((sim_fread (buf, 1, sizeof (buf), file) != sizeof (buf)) ||
+    (memcmp (hdr->Magic, CLU_MAGIC, sizeof (hdr->Magic)) != 0) ||
+    (_clu_get32 (hdr->Checksum) != _clu_crc32 (hdr, sizeof (*hdr) - sizeof (hdr->Checksum))) ||
+    (_clu_get32 (hdr->Version) != CLU_VERSION) ||
+    (_clu_get32 (hdr->ClusterBits) < 12) || (_clu_get32 (hdr->ClusterBits) > 21) ||
+    (_clu_get32 (hdr->SnapshotCount) > CLU_MAX_SNAPSHOTS)) {
+    fclose (file);
+    errno = EINVAL;
+    return NULL;
+    }
+h = (CLUHANDLE)calloc (1, sizeof (*h));
+if (h == NULL) {
+    fclose (file);
+    return NULL;
+    }
+h->File = file;
+h->ReadOnly = !writable;
+h->ClusterBits = _clu_get32 (hdr->ClusterBits);
+h->ClusterSize = 1 << h->ClusterBits;
+h->L2Entries = h->ClusterSize / sizeof (t_uint64);
+h->Flags = _clu_get32 (hdr->Flags);
+h->Size = (t_offset)_clu_get64 (hdr->Size);
+h->L1Entries = _clu_get32 (hdr->L1Entries);
+h->L1Offset = (t_offset)_clu_get64 (hdr->L1Offset);
+h->SnapshotOffset = (t_offset)_clu_get64 (hdr->SnapshotOffset);
+h->SnapshotCount = _clu_get32 (hdr->SnapshotCount);
+h->HasFooter = (_clu_get32 (hdr->FooterSize) == sizeof (h->Footer));
+if (h->HasFooter)
+    memcpy (&h->Footer, &buf[sizeof (*hdr)], sizeof (h->Footer));
+h->FileEnd = sim_fsize_ex (file);
+h->L1 = (t_uint64 *)calloc (h->L1Entries + 1, sizeof (*h->L1));
+h->Snapshots = (CLU_SNAPSHOT *)calloc (h->SnapshotCount + 1, sizeof (*h->Snapshots));
+h->Cluster = (uint8 *)malloc (h->ClusterSize);
+h->Decoded = (uint8 *)malloc (h->ClusterSize);
+h->Compressed = (uint8 *)malloc (h->ClusterSize);
+l1 = (uint8 *)malloc ((h->L1Entries + 1) * sizeof (t_uint64));
+for (i = 0; i < CLU_L2_CACHE; i++) {
+    h->L2Cache[i].Index = CLU_NONE;
+    h->L2Cache[i].Table = (t_uint64 *)malloc (h->L2Entries * sizeof (t_uint64));
+    if (h->L2Cache[i].Table == NULL)
+        break;
+    }
+h->DecodedEntry = CLU_NO_ENTRY;
+if ((i < CLU_L2_CACHE) || (h->L1 == NULL) || (h->Snapshots == NULL) ||
+    (h->Cluster == NULL) || (h->Decoded == NULL) || (h->Compressed == NULL) || (l1 == NULL) ||
+    (h->FileEnd == (t_offset)-1) ||
+    ((((t_offset)h->L1Entries) * h->L2Entries) << h->ClusterBits) < h->Size ||
+    !_clu_read (h, h->L1Offset, l1, h->L1Entries * sizeof (t_uint64)) ||
+    ((h->SnapshotCount > 0) &&
+     !_clu_read (h, h->SnapshotOffset, h->Snapshots, h->SnapshotCount * sizeof (*h->Snapshots)))) {
+    free (l1);
+    fclose (file);
+    _clu_free (h);
+    errno = EINVAL;
+    return NULL;
+    }
+for (i = 0; i < h->L1Entries; i++)
+    h->L1[i] = _clu_get64 (&l1[i * sizeof (t_uint64)]);
+free (l1);
+return (FILE *)h;
+}
+
+/* Check for a clustered container when detecting the format of a file.
+   Only the magic number is examined, and errno is left untouched so that
+   a file of some other format doesn't report a stray error. */
+
+static t_bool sim_clu_disk_probe (const char *path)
+{
+int saved_errno = errno;
+uint8 magic[sizeof (((CLU_HEADER *)0)->Magic)];
+FILE *file = sim_fopen (path, "rb");
+t_bool found = FALSE;
+
+if (file != NULL) {
+    found = (sim_fread (magic, 1, sizeof (magic), file) == sizeof (magic)) &&
+            (memcmp (magic, CLU_MAGIC, sizeof (magic)) == 0);
+    fclose (file);
+    }
+errno = saved_errno;
+return found;
+}
+
+static FILE *sim_clu_disk_create (const char *path, t_offset desiredsize, DRVTYP *drvtyp)
+{
+CLU_DISK d;
+uint8 *l1;
+size_t l1_size;
+t_bool ok;
+
+memset (&d, 0, sizeof (d));
+d.ClusterBits = CLU_CLUSTER_BITS;
+d.ClusterSize = 1 << d.ClusterBits;
+d.L2Entries = d.ClusterSize / sizeof (t_uint64);
+d.Size = desiredsize;
+d.L1Entries = (uint32)((desiredsize + (((t_offset)d.L2Entries) << d.ClusterBits) - 1) / (((t_offset)d.L2Entries) << d.ClusterBits));
+if (d.L1Entries == 0)
+    d.L1Entries = 1;
+d.L1Offset = CLU_HEADER_SIZE;
+l1_size = d.L1Entries * sizeof (t_uint64);
+l1 = (uint8 *)calloc (1, l1_size);
+if (l1 == NULL)
+    return NULL;
+d.File = sim_fopen (path, "wb+");
+if (d.File == NULL) {
+    free (l1);
+    return NULL;
+    }
+ok = _clu_write_header (&d) && _clu_write (&d, d.L1Offset, l1, l1_size);
+free (l1);
+if (fclose (d.File) || !ok) {
+    (void)remove (path);
+    return NULL;
+    }
+return sim_clu_disk_open (path, "rb+");
+}
+
+static int sim_clu_disk_close (FILE *f)
+{
+CLUHANDLE h = (CLUHANDLE)f;
+int r = fclose (h->File);
+
+_clu_free (h);
+return r;
+}
+
+static void sim_clu_disk_flush (FILE *f)
+{
+CLUHANDLE h = (CLUHANDLE)f;
+
+fflush (h->File);
+}
+
+static t_offset sim_clu_disk_size (FILE *f)
+{
+CLUHANDLE h = (CLUHANDLE)f;
+
+return h->Size;
+}
+
+static t_stat sim_clu_disk_clearerr (UNIT *uptr)
+{
+CLUHANDLE h = (CLUHANDLE)uptr->fileref;
+
+clearerr (h->File);
+return SCPE_OK;
+}
+
+static t_bool sim_clu_disk_get_footer (FILE *f, struct simh_disk_footer *footer)
+{
+CLUHANDLE h = (CLUHANDLE)f;
+
+if (h->HasFooter)
+    memcpy (footer, &h->Footer, sizeof (*footer));
+return h->HasFooter;
+}
+
+static t_stat sim_clu_disk_set_footer (FILE *f, const struct simh_disk_footer *footer)
+{
+CLUHANDLE h = (CLUHANDLE)f;
+
+h->HasFooter = (footer != NULL);
+if (footer != NULL)
+    memcpy (&h->Footer, footer, sizeof (h->Footer));
+return _clu_write_header (h) ? SCPE_OK : SCPE_IOERR;
+}
+
+static t_stat sim_clu_disk_set_compress (FILE *f, t_bool compress)
+{
+CLUHANDLE h = (CLUHANDLE)f;
+uint32 flags = compress ? (h->Flags | CLU_FL_COMPRESS) : (h->Flags & ~CLU_FL_COMPRESS);
+
+if (flags == h->Flags)
+    return SCPE_OK;
+if (h->ReadOnly)
+    return SCPE_RO;
+h->Flags = flags;
+return _clu_write_header (h) ? SCPE_OK : SCPE_IOERR;
+}
+
+static t_stat sim_clu_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects)
+{
+CLUHANDLE h = (CLUHANDLE)uptr->fileref;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_offset offset = ((t_offset)lba) * ctx->sector_size;
+size_t len = ((size_t)sects) * ctx->sector_size;
+size_t done = 0;
+
+if (sectsread)
+    *sectsread = 0;
+if (offset >= h->Size) {
+    errno = ERANGE;
+    return SCPE_IOERR;
+    }
+if (offset + len > h->Size)
+    len = (size_t)(h->Size - offset);
+while (done < len) {
+    t_offset pos = offset + done;
+    t_uint64 cluster = (t_uint64)(pos >> h->ClusterBits);
+    uint32 l1idx = (uint32)(cluster / h->L2Entries);
+    uint32 l2idx = (uint32)(cluster % h->L2Entries);
+    uint32 coff = (uint32)(pos & (h->ClusterSize - 1));
+    size_t chunk = h->ClusterSize - coff;
+    t_uint64 *t = NULL;
+    t_uint64 entry = 0;
+
+    if (chunk > len - done)
+        chunk = len - done;
+    if (h->L1[l1idx] != 0) {
+        t = _clu_load_l2 (h, l1idx);
+        if (t == NULL)
+            return SCPE_IOERR;
+        entry = t[l2idx] & ~CLU_COPIED;
+        }
+    if ((entry != 0) && ((entry & CLU_COMPRESSED) == 0)) {
+        t_offset host = (t_offset)entry;
+
+        while ((done + chunk < len) &&                  /* read contiguous clusters at once */
+               (l2idx + 1 < h->L2Entries) &&
+               ((t[l2idx + 1] & ~CLU_COPIED) == entry + h->ClusterSize)) {
+            entry = t[++l2idx] & ~CLU_COPIED;
+            chunk += (len - done - chunk < h->ClusterSize) ? len - done - chunk : h->ClusterSize;
+            }
+        if (!_clu_read (h, host + coff, buf + done, chunk))
+            return SCPE_IOERR;
+        }
+    else {
+        uint8 *data = _clu_cluster_data (h, entry);
+
+        if (data == NULL)
+            return SCPE_IOERR;
+        memcpy (buf + done, data + coff, chunk);
+        }
+    done += chunk;
+    }
+if (sectsread)
+    *sectsread = (t_seccnt)(done / ctx->sector_size);
+return SCPE_OK;
+}
+
+static t_stat sim_clu_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects)
+{
+CLUHANDLE h = (CLUHANDLE)uptr->fileref;
+struct disk_context *ctx = (struct disk_context *)uptr->disk_ctx;
+t_offset offset = ((t_offset)lba) * ctx->sector_size;
+size_t len = ((size_t)sects) * ctx->sector_size;
+size_t done;
+
+if (sectswritten)
+    *sectswritten = 0;
+if (h->ReadOnly)
+    return SCPE_RO;
+if (offset + len > h->Size) {
+    errno = ERANGE;
+    return SCPE_IOERR;
+    }
+for (done = 0; done < len; ) {
+    t_offset pos = offset + done;
+    t_uint64 cluster = (t_uint64)(pos >> h->ClusterBits);
+    uint32 l1idx = (uint32)(cluster / h->L2Entries);
+    uint32 l2idx = (uint32)(cluster % h->L2Entries);
+    uint32 coff = (uint32)(pos & (h->ClusterSize - 1));
+    size_t chunk = h->ClusterSize - coff;
+    const uint8 *src = buf + done;
+    const uint8 *data = src;
+    t_uint64 *t;
+    t_uint64 entry = 0, new_entry = 0;
+    t_bool zero;
+
+    if (chunk > len - done)
+        chunk = len - done;
+    if (h->L1[l1idx] != 0) {
+        t = _clu_load_l2 (h, l1idx);
+        if (t == NULL)
+            return SCPE_IOERR;
+        entry = t[l2idx];
+        }
+    if ((h->L1[l1idx] & CLU_COPIED) &&                  /* cluster only in the active image? */
+        ((entry & (CLU_COPIED | CLU_COMPRESSED)) == CLU_COPIED)) {
+        if (!_clu_write (h, (t_offset)(entry & CLU_OFFSET_MASK) + coff, src, chunk))
+            return SCPE_IOERR;
+        done += chunk;
+        continue;
+        }
+    zero = _clu_is_zero (src, chunk);
+    if ((entry == 0) && zero) {                         /* still all zero? */
+        done += chunk;
+        continue;
+        }
+    t = _clu_l2_for_write (h, l1idx);                   /* new location needed */
+    if (t == NULL)
+        return SCPE_IOERR;
+    entry = t[l2idx];
+    if (chunk < h->ClusterSize) {                       /* merge with existing contents */
+        const uint8 *old = _clu_cluster_data (h, entry);
+
+        if (old == NULL)
+            return SCPE_IOERR;
+        memcpy (h->Cluster, old, h->ClusterSize);
+        memcpy (h->Cluster + coff, src, chunk);
+        data = h->Cluster;
+        }
+    else {
+        if (zero) {                                     /* an all zero cluster needs no space */
+            t[l2idx] = 0;
+            if (!_clu_set_l2 (h, l1idx, l2idx, 0))
+                return SCPE_IOERR;
+            done += chunk;
+            continue;
+            }
+        if (h->Flags & CLU_FL_COMPRESS) {
+            size_t clen = sim_lz4_compress (data, h->ClusterSize, h->Compressed, h->ClusterSize - 1);
+
+            if (clen != 0) {
+                t_offset where = _clu_alloc (h, clen, FALSE);
+
+                if (!_clu_write (h, where, h->Compressed, clen))
+                    return SCPE_IOERR;
+                new_entry = CLU_COMPRESSED | (((t_uint64)clen) << CLU_CMP_V_LEN) | (t_uint64)where;
+                }
+            }
+        }
+    if (new_entry == 0) {
+        t_offset where = _clu_alloc (h, h->ClusterSize, TRUE);
+
+        if (!_clu_write (h, where, data, h->ClusterSize))
+            return SCPE_IOERR;
+        new_entry = (t_uint64)where | CLU_COPIED;
+        }
+    t[l2idx] = new_entry;
+    if (!_clu_set_l2 (h, l1idx, l2idx, new_entry))
+        return SCPE_IOERR;
+    done += chunk;
+    }
+if (sectswritten)
+    *sectswritten = (t_seccnt)(done / ctx->sector_size);
+return SCPE_OK;
+}
+
+/* Rewrite the snapshot table in new space */
+
+static t_stat _clu_write_snapshots (CLUHANDLE h)
+{
+size_t size = h->SnapshotCount * sizeof (*h->Snapshots);
+
+h->SnapshotOffset = 0;
+if (size > 0) {
+    h->SnapshotOffset = _clu_alloc (h, size, FALSE);
+    if (!_clu_write (h, h->SnapshotOffset, h->Snapshots, size))
+        return SCPE_IOERR;
+    }
+return _clu_write_header (h) ? SCPE_OK : SCPE_IOERR;
+}
+
+static t_stat sim_clu_disk_snapshot (FILE *f, int32 op, const char *name)
+{
+CLUHANDLE h = (CLUHANDLE)f;
+CLU_SNAPSHOT *s;
+uint8 *l1;
+t_offset where;
+uint32 i;
+
+if (h->ReadOnly)
+    return SCPE_RO;
+for (s = h->Snapshots; s < h->Snapshots + h->SnapshotCount; s++) {
+    if (strncmp ((char *)s->Name, name, sizeof (s->Name)) == 0)
+        break;
+    }
+switch (op) {
+    case DK_SNAP_CREATE:
+        if (s < h->Snapshots + h->SnapshotCount)
+            return sim_messagef (SCPE_ARG, "Snapshot %s already exists\n", name);
+        if (strlen (name) >= sizeof (s->Name))
+            return sim_messagef (SCPE_ARG, "Snapshot name too long: %s\n", name);
+        if (h->SnapshotCount >= CLU_MAX_SNAPSHOTS)
+            return sim_messagef (SCPE_ARG, "No more than %d snapshots are supported\n", CLU_MAX_SNAPSHOTS);
+        s = (CLU_SNAPSHOT *)realloc (h->Snapshots, (h->SnapshotCount + 1) * sizeof (*s));
+        if (s == NULL)
+            return SCPE_MEM;
+        h->Snapshots = s;
+        s += h->SnapshotCount;
+        memset (s, 0, sizeof (*s));
+        strlcpy ((char *)s->Name, name, sizeof (s->Name));
+        where = _clu_alloc (h, h->L1Entries * sizeof (t_uint64), FALSE);
+        _clu_put64 (s->L1Offset, (t_uint64)where);
+        _clu_put32 (s->L1Entries, h->L1Entries);
+        _clu_put64 (s->Time, (t_uint64)time (NULL));
+        for (i = 0; i < h->L1Entries; i++)             /* everything is now shared */
+            h->L1[i] &= ~CLU_COPIED;
+        if (!_clu_write_l1 (h, where, CLU_COPIED) ||
+            !_clu_write_l1 (h, h->L1Offset, CLU_COPIED))
+            return SCPE_IOERR;
+        ++h->SnapshotCount;
+        return _clu_write_snapshots (h);
+    case DK_SNAP_REVERT:
+        if (s == h->Snapshots + h->SnapshotCount)
+            return sim_messagef (SCPE_ARG, "No such snapshot: %s\n", name);
+        if (_clu_get32 (s->L1Entries) != h->L1Entries)
+            return sim_messagef (SCPE_IERR, "Snapshot %s has an inconsistent table size\n", name);
+        l1 = (uint8 *)malloc (h->L1Entries * sizeof (t_uint64));
+        if (l1 == NULL)
+            return SCPE_MEM;
+        if (!_clu_read (h, (t_offset)_clu_get64 (s->L1Offset), l1, h->L1Entries * sizeof (t_uint64))) {
+            free (l1);
+            return SCPE_IOERR;
+            }
+        for (i = 0; i < h->L1Entries; i++)
+            h->L1[i] = _clu_get64 (&l1[i * sizeof (t_uint64)]) & ~CLU_COPIED;
+        free (l1);
+        _clu_invalidate (h);
+        return _clu_write_l1 (h, h->L1Offset, 0) ? SCPE_OK : SCPE_IOERR;
+    case DK_SNAP_DELETE:
+        if (s == h->Snapshots + h->SnapshotCount)
+            return sim_messagef (SCPE_ARG, "No such snapshot: %s\n", name);
+        memmove (s, s + 1, (h->Snapshots + h->SnapshotCount - (s + 1)) * sizeof (*s));
+        --h->SnapshotCount;
+        return _clu_write_snapshots (h);
+    default:
+        return SCPE_IERR;
+    }
+}
+
+static void sim_clu_disk_show_snapshots (FILE *st, FILE *f, const char *prefix)
+{
+CLUHANDLE h = (CLUHANDLE)f;
+uint32 i;
+
+fprintf (st, "%s: %u snapshot%s%s\n", prefix, h->SnapshotCount, (h->SnapshotCount == 1) ? "" : "s",
+             (h->Flags & CLU_FL_COMPRESS) ? ", compressing whole cluster writes" : "");
+for (i = 0; i < h->SnapshotCount; i++) {
+    time_t when = (time_t)_clu_get64 (h->Snapshots[i].Time);
+    const char *ts = ctime (&when);
+
+    fprintf (st, "    %-24s %s", (char *)h->Snapshots[i].Name, ts ? ts : "\n");
+    }
+}
+
 /* Used when sorting a drive type list: */
 /* - Disks come first ordered by drive size */
 /* - Tapes come last ordered by drive name */
@@ -7809,6 +10819,22 @@ if (info->flag) {        /* zap disk type */
         info->stat = sim_messagef (SCPE_OPENERR, "Cannot change the disk type of a VHD container file: %s\n", FullPath);
         return;
         }
+    container = sim_clu_disk_open (FullPath, "rb+");
+    if (container != NULL) {                            /* Clustered keeps its footer in the header */
+        if (sim_clu_disk_get_footer (container, f)) {
+            t_stat r = sim_clu_disk_set_footer (container, NULL);
+
+            sim_clu_disk_close (container);
+            if (r == SCPE_OK)
+                info->stat = sim_messagef (SCPE_OK, "Disk Type Info Removed from container: %s\n", sim_relative_path (FullPath));
+            else
+                info->stat = sim_messagef (r, "Cannot remove Disk Type Info from container: %s\n", sim_relative_path (FullPath));
+            return;
+            }
+        sim_clu_disk_close (container);
+        info->stat = sim_messagef (SCPE_ARG, "No footer found on disk container '%s'.\n", FullPath);
+        return;
+        }
     if (sim_stat (FullPath, &statb)) {
         info->stat = sim_messagef (SCPE_OPENERR, "Cannot stat file: '%s' - %s\n", FullPath, strerror (errno));
         return;
@@ -7907,6 +10933,16 @@ if (info->flag == 0) {  /* DISKINFO */
     disk_ctx.dptr = uptr->dptr = dptr;
     sim_disk_set_fmt (uptr, 0, "VHD", NULL);
     container = sim_vhd_disk_open (FullPath, "rb");
+    close_function = sim_vhd_disk_close;
+    size_function = sim_vhd_disk_size;
+    parent_path_function = sim_vhd_disk_parent_path;
+    if (container == NULL) {
+        sim_disk_set_fmt (uptr, 0, "CLUSTER", NULL);
+        container = sim_clu_disk_open (FullPath, "rb");
+        close_function = sim_clu_disk_close;
+        size_function = sim_clu_disk_size;
+        parent_path_function = NULL;
+        }
     if (container == NULL) {
         sim_disk_set_fmt (uptr, 0, "SIMH", NULL);
         container = sim_fopen (FullPath, "rb");
@@ -7914,11 +10950,6 @@ if (info->flag == 0) {  /* DISKINFO */
         size_function = sim_fsize_ex;
         parent_path_function = NULL;
         }
-    else {
-        close_function = sim_vhd_disk_close;
-        size_function = sim_vhd_disk_size;
-        parent_path_function = sim_vhd_disk_parent_path;
-        }
     if (container != NULL) {
         while (container != NULL) {
             container_size = size_function (container);
@@ -8644,9 +11675,743 @@ sim_free_filelist (&tarfiles);
 return SCPE_OK;
 }
 
+/* Fixture for the unit tests below.  Each test runs on unit 0 of the
+   device with freshly created containers of 512 byte sectors.  The unit's
+   flags (and so its format), drive type, capacity, disk options and the
+   command switches are saved when a test begins and put back when it
+   ends, so each test leaves the unit as it found it. */
+
+#define DK_TEST_SECT    512
+
+typedef struct {
+    UNIT                    *uptr;
+    const char              *what;              /* reported with the result */
+    uint32                  xfer_size;          /* transfer element size */
+    int32                   switches;
+    uint32                  flags;
+    uint32                  dynflags;
+    DRVTYP                  *drvtyp;
+    t_addr                  capac;
+    struct disk_unit_opts   opts;
+    } DISK_TEST;
+
+static void _sim_disk_test_begin (DISK_TEST *t, UNIT *uptr, const char *title, const char *what, const char *fmt)
+{
+struct disk_unit_opts *o = _disk_unit_opts (uptr, FALSE);
+
+memset (t, 0, sizeof (*t));
+t->uptr = uptr;
+t->what = what;
+t->xfer_size = 1;
+t->switches = sim_switches;
+t->flags = uptr->flags;
+t->dynflags = uptr->dynflags;
+t->drvtyp = uptr->drvtyp;
+t->capac = uptr->capac;
+if (o != NULL)
+    t->opts = *o;
+sim_printf ("\n*** %s\n", title);
+sim_disk_set_fmt (uptr, 0, fmt, NULL);
+}
+
+static t_stat _sim_disk_test_attach (DISK_TEST *t, const char *filename, int32 switches)
+{
+t_stat r;
+
+sim_switches = switches;
+r = sim_disk_attach_ex (t->uptr, filename, DK_TEST_SECT, t->xfer_size, TRUE, 0, NULL, 0, 0, NULL);
+sim_switches = t->switches;
+return r;
+}
+
+static t_stat _sim_disk_test_end (DISK_TEST *t, t_stat r)
+{
+UNIT *uptr = t->uptr;
+struct disk_unit_opts *o;
+
+sim_printf ("%s %s\n", t->what, (r == SCPE_OK) ? "OK" : "FAILED");
+if (uptr->flags & UNIT_ATT)
+    sim_disk_detach (uptr);
+o = _disk_unit_opts (uptr, FALSE);
+if (o != NULL)
+    *o = t->opts;
+uptr->flags = t->flags;
+uptr->dynflags = t->dynflags;
+uptr->drvtyp = t->drvtyp;
+uptr->capac = t->capac;
+sim_switches = t->switches;
+return r;
+}
+
+/* Queued transfer testing: many concurrent transfers, completing in any order */
+
+#define DK_QTEST_XFERS  64
+#define DK_QTEST_SECTS  8
+
+static uint32 sim_disk_queue_test_done;
+
+static void _sim_disk_queue_test_callback (UNIT *uptr, t_stat status, void *arg)
+{
+t_stat *stat = (t_stat *)arg;
+
+*stat = status;
+++sim_disk_queue_test_done;
+}
+
+static t_stat sim_disk_queue_test (DEVICE *dptr, const char *cptr)
+{
+const char *filename = "TestQueue.dsk";
+UNIT *uptr = &dptr->units[0];
+uint32 sect_size = DK_TEST_SECT;
+uint32 words = (sect_size * DK_QTEST_SECTS) / sizeof (uint32);
+uint32 *data = (uint32 *)malloc (DK_QTEST_XFERS * words * sizeof (uint32));
+t_stat status[DK_QTEST_XFERS];
+t_bool saved_end = sim_end;
+DISK_TEST t;
+t_stat r;
+uint32 i, j, pass;
+
+if (data == NULL)
+    return SCPE_MEM;
+_sim_disk_test_begin (&t, uptr, "Disk queued transfer tests", "Queued transfers", "SIMH");
+t.xfer_size = sizeof (uint32);
+(void)remove (filename);
+r = _sim_disk_test_attach (&t, filename, 0);
+if (r == SCPE_OK)
+    r = sim_disk_set_async_depth (uptr, 8);
+if (r == SCPE_OK)
+    sim_printf ("Testing %s with %u transfers in progress at once\n", sim_uname (uptr), sim_disk_get_async_depth (uptr));
+for (pass = 0; (r == SCPE_OK) && (pass < 2); pass++) {
+    if (pass == 1) {                                    /* then as a big endian host, */
+        sim_printf ("Testing %s with the container in big endian order\n", sim_uname (uptr));
+        sim_end = FALSE;                                /* which swaps the data in the file */
+        }
+    sim_disk_queue_test_done = 0;
+    for (i = 0; (r == SCPE_OK) && (i < DK_QTEST_XFERS); i++) {  /* scattered writes */
+        t_lba lba = ((i * 37) % DK_QTEST_XFERS) * DK_QTEST_SECTS;
+
+        for (j = 0; j < words; j++)
+            data[i * words + j] = lba + j / (sect_size / sizeof (uint32));
+        r = sim_disk_wrsect_q (uptr, lba, (uint8 *)&data[i * words], NULL, DK_QTEST_SECTS, _sim_disk_queue_test_callback, &status[i]);
+        }
+    sim_disk_drain (uptr);
+    memset (data, 0, DK_QTEST_XFERS * words * sizeof (uint32));
+    for (i = 0; (r == SCPE_OK) && (i < DK_QTEST_XFERS); i++)    /* reads in order */
+        r = sim_disk_rdsect_q (uptr, i * DK_QTEST_SECTS, (uint8 *)&data[i * words], NULL, DK_QTEST_SECTS, _sim_disk_queue_test_callback, &status[i]);
+    sim_disk_drain (uptr);
+    if ((r == SCPE_OK) && (sim_disk_queue_test_done != 2 * DK_QTEST_XFERS)) {
+        sim_printf ("%u of %u transfers completed\n", sim_disk_queue_test_done, 2 * DK_QTEST_XFERS);
+        r = SCPE_IERR;
+        }
+    for (i = 0; (r == SCPE_OK) && (i < DK_QTEST_XFERS); i++) {
+        if (status[i] != SCPE_OK)
+            r = status[i];
+        for (j = 0; (r == SCPE_OK) && (j < words); j++) {
+            if (data[i * words + j] != (i * DK_QTEST_SECTS) + j / (sect_size / sizeof (uint32))) {
+                sim_printf ("Unexpected data in sector %u\n", (uint32)(i * DK_QTEST_SECTS + j / (sect_size / sizeof (uint32))));
+                r = SCPE_IERR;
+                }
+            }
+        }
+    }
+sim_end = saved_end;
+r = _sim_disk_test_end (&t, r);
+(void)remove (filename);
+free (data);
+return r;
+}
+
+#define DK_CTEST_SECTS  64
+
+static t_stat _sim_disk_cache_test_check (UNIT *uptr, uint32 *data, uint32 words, const char *what)
+{
+t_stat r = SCPE_OK;
+uint32 i, j;
+
+for (i = 0; (r == SCPE_OK) && (i < DK_CTEST_SECTS); i++) {
+    r = sim_disk_rdsect (uptr, i, (uint8 *)data, NULL, 1);
+    for (j = 0; (r == SCPE_OK) && (j < words); j++) {
+        if (data[j] != (i * 3 + 1) * 0x10001 + j) {
+            sim_printf ("Unexpected data in sector %u %s\n", i, what);
+            r = SCPE_IERR;
+            }
+        }
+    }
+return r;
+}
+
+static t_stat sim_disk_cache_test (DEVICE *dptr, const char *cptr)
+{
+const char *filename = "TestCache.dsk";
+UNIT *uptr = &dptr->units[0];
+uint32 sect_size = DK_TEST_SECT;
+uint32 words = sect_size / sizeof (uint32);
+uint32 *data = (uint32 *)malloc (sect_size);
+struct disk_context *ctx;
+DISK_TEST t;
+t_stat r;
+uint32 i, j;
+
+if (data == NULL)
+    return SCPE_MEM;
+_sim_disk_test_begin (&t, uptr, "Disk sector cache tests", "Sector cache", "SIMH");
+(void)remove (filename);
+r = _sim_disk_set_unit_cache (uptr, 16 * sect_size, TRUE); /* small write back cache */
+if (r == SCPE_OK)
+    r = _sim_disk_test_attach (&t, filename, 0);
+ctx = (struct disk_context *)uptr->disk_ctx;
+for (i = 0; (r == SCPE_OK) && (i < DK_CTEST_SECTS); i++) {  /* scattered writes, forcing evictions */
+    t_lba lba = (i * 37) % DK_CTEST_SECTS;
+
+    for (j = 0; j < words; j++)
+        data[j] = (lba * 3 + 1) * 0x10001 + j;
+    r = sim_disk_wrsect (uptr, lba, (uint8 *)data, NULL, 1);
+    }
+if (r == SCPE_OK)
+    r = _sim_disk_cache_test_check (uptr, data, words, "through the cache");
+if ((r == SCPE_OK) && ((ctx->cache == NULL) || (ctx->cache->evictions == 0) || (ctx->cache->writebacks == 0))) {
+    sim_printf ("Cache didn't evict and write back modified sectors\n");
+    r = SCPE_IERR;
+    }
+if ((r == SCPE_OK) &&                                   /* check read left the last sector cached */
+    (_disk_cache_find (ctx->cache, DK_CTEST_SECTS - 1) == DK_CACHE_NIL)) {
+    sim_printf ("Most recently read sector isn't in the cache\n");
+    r = SCPE_IERR;
+    }
+if (r == SCPE_OK) {
+    t_uint64 hits = ctx->cache->read_hits;
+
+    r = sim_disk_rdsect (uptr, DK_CTEST_SECTS - 1, (uint8 *)data, NULL, 1);
+    if ((r == SCPE_OK) && (ctx->cache->read_hits != hits + 1)) {
+        sim_printf ("Cached sector wasn't read from the cache\n");
+        r = SCPE_IERR;
+        }
+    }
+if (r == SCPE_OK)
+    r = _sim_disk_set_unit_cache (uptr, 0, FALSE);      /* flush and remove */
+if (r == SCPE_OK)
+    r = _sim_disk_cache_test_check (uptr, data, words, "after flush");
+r = _sim_disk_test_end (&t, r);
+(void)remove (filename);
+free (data);
+return r;
+}
+
+/* Memory mapped container: data written through the mapping must be seen
+   by file I/O once the mapping is released, and vice versa.  The unit
+   transfers 32 bit words, which must be stored in the same (little endian)
+   byte order as file I/O stores them.  Writes which extend a short
+   container beyond the mapping must remake the mapping to cover them. */
+
+#define DK_MTEST_GROW   ((DK_MMAP_GROW / DK_TEST_SECT) + DK_CTEST_SECTS)
+
+static t_stat _sim_disk_mmap_test_layout (const char *filename, uint32 sect_size)
+{
+FILE *f = sim_fopen (filename, "rb");
+uint8 *sect = (uint8 *)malloc (sect_size);
+t_stat r = SCPE_OK;
+uint32 i, j;
+
+if ((f == NULL) || (sect == NULL))
+    r = SCPE_OPENERR;
+for (i = 0; (r == SCPE_OK) && (i < DK_CTEST_SECTS); i++) {
+    if (sim_fread (sect, 1, sect_size, f) != sect_size)
+        r = SCPE_IOERR;
+    for (j = 0; (r == SCPE_OK) && (j < sect_size / sizeof (uint32)); j++) {
+        uint32 val = (i * 3 + 1) * 0x10001 + j;
+        uint8 *b = &sect[j * sizeof (uint32)];
+
+        if ((b[0] != (uint8)val) || (b[1] != (uint8)(val >> 8)) ||
+            (b[2] != (uint8)(val >> 16)) || (b[3] != (uint8)(val >> 24))) {
+            sim_printf ("Unexpected byte order in sector %u of the container\n", i);
+            r = SCPE_IERR;
+            }
+        }
+    }
+if (f != NULL)
+    fclose (f);
+free (sect);
+return r;
+}
+
+static t_stat _sim_disk_mmap_test_grow (DISK_TEST *t, const char *filename, uint32 *data, uint32 words)
+{
+UNIT *uptr = t->uptr;
+struct disk_context *ctx;
+FILE *f = sim_fopen (filename, "rb+");
+size_t mapped;
+t_stat r = SCPE_OK;
+uint32 i, j;
+
+if ((f == NULL) || (sim_set_fsize (f, DK_CTEST_SECTS * DK_TEST_SECT) != 0))   /* a short container */
+    r = SCPE_IOERR;
+if (f != NULL)
+    fclose (f);
+if (r == SCPE_OK)
+    r = _sim_disk_test_attach (t, filename, 0);
+if (r != SCPE_OK)
+    return r;
+ctx = (struct disk_context *)uptr->disk_ctx;
+mapped = ctx->map_size;
+for (i = DK_CTEST_SECTS; (r == SCPE_OK) && (i < DK_MTEST_GROW); i++) {  /* sequential appends */
+    for (j = 0; j < words; j++)
+        data[j] = (i * 3 + 1) * 0x10001 + j;
+    r = sim_disk_wrsect (uptr, i, (uint8 *)data, NULL, 1);
+    }
+if ((r == SCPE_OK) && ((ctx->map == NULL) || (ctx->map_size <= mapped))) {
+    sim_printf ("Mapping wasn't extended as the container grew\n");
+    r = SCPE_IERR;
+    }
+for (i = 0; (r == SCPE_OK) && (i < DK_MTEST_GROW); i++) {
+    r = sim_disk_rdsect (uptr, i, (uint8 *)data, NULL, 1);
+    for (j = 0; (r == SCPE_OK) && (j < words); j++) {
+        if (data[j] != (i * 3 + 1) * 0x10001 + j) {
+            sim_printf ("Unexpected data in sector %u of the grown container\n", i);
+            r = SCPE_IERR;
+            }
+        }
+    }
+sim_disk_detach (uptr);
+return r;
+}
+
+static t_stat sim_disk_mmap_test (DEVICE *dptr, const char *cptr)
+{
+const char *filename = "TestMmap.dsk";
+UNIT *uptr = &dptr->units[0];
+uint32 sect_size = DK_TEST_SECT;
+uint32 words = sect_size / sizeof (uint32);
+uint32 *data = (uint32 *)malloc (sect_size);
+struct disk_context *ctx;
+DISK_TEST t;
+t_stat r;
+uint32 i, j;
+
+if (data == NULL)
+    return SCPE_MEM;
+_sim_disk_test_begin (&t, uptr, "Memory mapped disk container tests", "Memory mapped container", "SIMH");
+t.xfer_size = sizeof (uint32);
+(void)remove (filename);
+r = _sim_disk_set_unit_mmap (uptr, TRUE);
+if (r == SCPE_OK)
+    r = _sim_disk_test_attach (&t, filename, 0);
+ctx = (struct disk_context *)uptr->disk_ctx;
+if ((r == SCPE_OK) && (ctx->map == NULL)) {
+    sim_printf ("Container wasn't mapped\n");
+    r = SCPE_IERR;
+    }
+for (i = 0; (r == SCPE_OK) && (i < DK_CTEST_SECTS); i++) {
+    t_lba lba = (i * 37) % DK_CTEST_SECTS;
+
+    for (j = 0; j < words; j++)
+        data[j] = (lba * 3 + 1) * 0x10001 + j;
+    r = sim_disk_wrsect (uptr, lba, (uint8 *)data, NULL, 1);
+    }
+if (r == SCPE_OK)
+    r = _sim_disk_cache_test_check (uptr, data, words, "through the mapping");
+if (r == SCPE_OK)
+    r = _sim_disk_set_unit_mmap (uptr, FALSE);
+if (r == SCPE_OK)
+    r = _sim_disk_cache_test_check (uptr, data, words, "with file I/O");
+if (r == SCPE_OK)
+    r = _sim_disk_mmap_test_layout (filename, sect_size);
+for (j = 0; (r == SCPE_OK) && (j < words); j++)         /* rewrite sector 0 with file I/O */
+    data[j] = 0x10001 + j;
+if (r == SCPE_OK)
+    r = sim_disk_wrsect (uptr, 0, (uint8 *)data, NULL, 1);
+if (r == SCPE_OK)
+    r = _sim_disk_set_unit_mmap (uptr, TRUE);
+if (r == SCPE_OK)
+    r = _sim_disk_cache_test_check (uptr, data, words, "after mapping again");
+if (uptr->flags & UNIT_ATT)
+    sim_disk_detach (uptr);
+if (r == SCPE_OK)
+    r = _sim_disk_mmap_test_grow (&t, filename, data, words);
+r = _sim_disk_test_end (&t, r);
+(void)remove (filename);
+free (data);
+return r;
+}
+
+/* Overlays: writes go to the overlay and leave the base container as it
+   was until the overlay is merged into it */
+
+static t_stat _sim_disk_overlay_test_data (UNIT *uptr, uint32 *data, uint32 words, t_lba lba, uint32 sects, uint32 gen, t_bool verify)
+{
+t_stat r = SCPE_OK;
+uint32 i, j;
+
+if (verify)
+    r = sim_disk_rdsect (uptr, lba, (uint8 *)data, NULL, sects);
+for (i = 0; (r == SCPE_OK) && (i < sects); i++) {
+    for (j = 0; j < words; j++) {
+        uint32 val = ((lba + i) * 3 + 1 + (gen << 8)) * 0x10001 + j;
+
+        if (!verify)
+            data[i * words + j] = val;
+        else if (data[i * words + j] != val) {
+            sim_printf ("Unexpected data in sector %u\n", (uint32)(lba + i));
+            r = SCPE_IERR;
+            break;
+            }
+        }
+    }
+if ((r == SCPE_OK) && !verify)
+    r = sim_disk_wrsect (uptr, lba, (uint8 *)data, NULL, sects);
+return r;
+}
+
+static t_stat _sim_disk_overlay_test_check (UNIT *uptr, uint32 *data, uint32 words, uint32 gen, const char *what)
+{
+t_stat r;
+
+r = _sim_disk_overlay_test_data (uptr, data, words, 0, 8, 0, TRUE);
+if (r == SCPE_OK)
+    r = _sim_disk_overlay_test_data (uptr, data, words, 8, 16, gen, TRUE);
+if (r == SCPE_OK)
+    r = _sim_disk_overlay_test_data (uptr, data, words, 24, 16, 0, TRUE);
+if (r == SCPE_OK)
+    r = _sim_disk_overlay_test_data (uptr, data, words, 40, 1, gen, TRUE);
+if (r == SCPE_OK)
+    r = _sim_disk_overlay_test_data (uptr, data, words, 41, DK_CTEST_SECTS - 41, 0, TRUE);
+if (r != SCPE_OK)
+    sim_printf ("Overlay check failed %s\n", what);
+return r;
+}
+
+static t_stat sim_disk_overlay_test (DEVICE *dptr, const char *cptr)
+{
+const char *filename = "TestOverlay.dsk";
+const char *overlay = "TestOverlay.ovl";
+UNIT *uptr = &dptr->units[0];
+uint32 sect_size = DK_TEST_SECT;
+uint32 words = sect_size / sizeof (uint32);
+uint32 *data = (uint32 *)malloc (DK_CTEST_SECTS * sect_size);
+char names[2*CBUFSIZE];
+DISK_TEST t;
+t_stat r;
+
+if (data == NULL)
+    return SCPE_MEM;
+_sim_disk_test_begin (&t, uptr, "Disk overlay tests", "Disk overlay", "SIMH");
+(void)remove (filename);
+(void)remove (overlay);
+snprintf (names, sizeof (names), "%s %s", overlay, filename);
+r = _sim_disk_test_attach (&t, filename, 0);
+if (r == SCPE_OK) {
+    r = _sim_disk_overlay_test_data (uptr, data, words, 0, DK_CTEST_SECTS, 0, FALSE);
+    sim_disk_detach (uptr);
+    }
+if (r == SCPE_OK) {                                     /* write through a new overlay */
+    r = _sim_disk_test_attach (&t, names, SWMASK ('O'));
+    if (r == SCPE_OK) {
+        r = _sim_disk_overlay_test_data (uptr, data, words, 8, 16, 1, FALSE);
+        if (r == SCPE_OK)
+            r = _sim_disk_overlay_test_data (uptr, data, words, 8, 16, 2, FALSE);
+        if (r == SCPE_OK)
+            r = _sim_disk_overlay_test_data (uptr, data, words, 40, 1, 2, FALSE);
+        if (r == SCPE_OK)
+            r = _sim_disk_overlay_test_check (uptr, data, words, 2, "while attached");
+        sim_disk_detach (uptr);
+        }
+    }
+if (r == SCPE_OK) {                                     /* base must be unchanged */
+    r = _sim_disk_test_attach (&t, filename, SWMASK ('R'));
+    if (r == SCPE_OK) {
+        r = _sim_disk_overlay_test_check (uptr, data, words, 0, "on the base container");
+        sim_disk_detach (uptr);
+        }
+    }
+if (r == SCPE_OK) {                                     /* reopen the kept overlay and merge it */
+    r = _sim_disk_test_attach (&t, names, SWMASK ('O') | SWMASK ('E'));
+    if (r == SCPE_OK) {
+        r = _sim_disk_overlay_test_check (uptr, data, words, 2, "after reopening");
+        if (r == SCPE_OK)
+            r = sim_disk_set_overlay (dptr, uptr, 0, "MERGE");
+        sim_disk_detach (uptr);
+        }
+    if ((r == SCPE_OK) && (sim_fsize_name_ex (overlay) != 0)) {
+        sim_printf ("Merged overlay wasn't deleted\n");
+        r = SCPE_IERR;
+        }
+    }
+if (r == SCPE_OK) {                                     /* base now has the overlaid sectors */
+    r = _sim_disk_test_attach (&t, filename, SWMASK ('R'));
+    if (r == SCPE_OK) {
+        r = _sim_disk_overlay_test_check (uptr, data, words, 2, "after merging");
+        sim_disk_detach (uptr);
+        }
+    }
+r = _sim_disk_test_end (&t, r);
+(void)remove (filename);
+(void)remove (overlay);
+free (data);
+return r;
+}
+
+/* I/O statistics: transfers are counted once each with their histogram
+   buckets adding up to the operation count */
+
+static t_stat sim_disk_statistics_test (DEVICE *dptr, const char *cptr)
+{
+const char *filename = "TestStats.dsk";
+UNIT *uptr = &dptr->units[0];
+uint32 sect_size = DK_TEST_SECT;
+uint8 *data = (uint8 *)calloc (4, sect_size);
+struct disk_context *ctx;
+DISK_TEST t;
+t_stat r;
+uint32 i, path, op;
+
+if (data == NULL)
+    return SCPE_MEM;
+_sim_disk_test_begin (&t, uptr, "Disk I/O statistics tests", "Disk I/O statistics", "SIMH");
+(void)remove (filename);
+r = _sim_disk_test_attach (&t, filename, 0);
+ctx = (struct disk_context *)uptr->disk_ctx;
+for (i = 0; (r == SCPE_OK) && (i < 10); i++)
+    r = sim_disk_wrsect (uptr, i * 4, data, NULL, 4);
+for (i = 0; (r == SCPE_OK) && (i < 20); i++)
+    r = sim_disk_rdsect (uptr, i, data, NULL, 1);
+if (r == SCPE_OK)
+    _sim_disk_io_flush (uptr);
+for (path = 0; (r == SCPE_OK) && (path < DK_STAT_PATHS); path++) {
+    for (op = 0; (r == SCPE_OK) && (op < DK_STAT_OPS); op++) {
+        struct disk_op_stats *s = &ctx->stats[path][op];
+        static const uint32 expect[DK_STAT_OPS][2] = {{20, 20}, {10, 40}};
+        t_uint64 total = 0;
+
+        for (i = 0; i < DK_STAT_BUCKETS; i++)
+            total += s->hist[i];
+        if ((total != s->ops) ||
+            (s->ops != ((path == DK_STAT_SYNC) ? expect[op][0] : 0)) ||
+            (s->sectors != ((path == DK_STAT_SYNC) ? expect[op][1] : 0)) ||
+            (s->bytes != s->sectors * sect_size) ||
+            (s->errors != 0)) {
+            sim_printf ("Unexpected %s %s statistics\n", _disk_stat_paths[path], _disk_stat_ops[op]);
+            r = SCPE_IERR;
+            }
+        }
+    }
+if ((r == SCPE_OK) &&
+    ((ctx->flushes.ops != 1) || (ctx->flushes.sectors != 0) || (ctx->flushes.errors != 0))) {
+    sim_printf ("Unexpected flush statistics\n");
+    r = SCPE_IERR;
+    }
+if ((r == SCPE_OK) && (sim_deb != NULL))
+    sim_disk_show_statistics (sim_deb, dptr, uptr, 1, NULL);
+if (r == SCPE_OK)
+    r = sim_disk_set_statistics (dptr, uptr, DK_STATS_UNIT, "RESET");
+if ((r == SCPE_OK) &&
+    ((ctx->stats[DK_STAT_SYNC][DK_STAT_READ].ops != 0) || (ctx->flushes.ops != 0))) {
+    sim_printf ("Statistics weren't reset\n");
+    r = SCPE_IERR;
+    }
+r = _sim_disk_test_end (&t, r);
+(void)remove (filename);
+free (data);
+return r;
+}
+
+/* Dynamic VHD write benchmark: sequential and then random single sector
+   writes to a freshly created container, verified after reattaching it */
+
+#define DK_VTEST_WRITES 4096
+
+static uint32 _sim_disk_vhd_test_rand (uint32 *seed)
+{
+*seed = *seed * 1103515245 + 12345;
+return (*seed >> 8);
+}
+
+static t_stat _sim_disk_vhd_test_pass (UNIT *uptr, t_lba sectors, t_bool random, t_bool verify, uint32 *data, uint32 words)
+{
+uint32 *check = (uint32 *)malloc (words * sizeof (*check));
+uint32 seed = 1;
+uint32 i, j;
+t_stat r = SCPE_OK;
+
+if (check == NULL)
+    return SCPE_MEM;
+for (i = 0; (r == SCPE_OK) && (i < DK_VTEST_WRITES); i++) {
+    t_lba lba = random ? (_sim_disk_vhd_test_rand (&seed) % sectors) : i;
+
+    for (j = 0; j < words; j++)
+        data[j] = (lba + 1) * 0x10001 + j;
+    if (!verify)
+        r = sim_disk_wrsect (uptr, lba, (uint8 *)data, NULL, 1);
+    else {
+        r = sim_disk_rdsect (uptr, lba, (uint8 *)check, NULL, 1);
+        if ((r == SCPE_OK) && (memcmp (data, check, words * sizeof (*check)) != 0)) {
+            sim_printf ("Data mismatch at lbn %u\n", (uint32)lba);
+            r = SCPE_IERR;
+            }
+        }
+    }
+free (check);
+return r;
+}
+
+static t_stat sim_disk_vhd_write_test (DEVICE *dptr, const char *cptr)
+{
+#if defined (DONT_DO_VHD_SUPPORT)
+return SCPE_OK;
+#else
+const char *filename = "TestVHDWrite.vhd";
+UNIT *uptr = &dptr->units[0];
+uint32 sect_size = DK_TEST_SECT;
+uint32 words = sect_size / sizeof (uint32);
+uint32 *data = (uint32 *)malloc (sect_size);
+uint32 start, seq_msec, rand_msec, flush_msec;
+uint32 allocated, bat_writes;
+t_lba sectors;
+DISK_TEST t;
+t_stat r;
+
+if (data == NULL)
+    return SCPE_MEM;
+_sim_disk_test_begin (&t, uptr, "Dynamic VHD write tests", "Dynamic VHD writes", "VHD");
+(void)remove (filename);
+r = _sim_disk_test_attach (&t, filename, 0);
+if (r != SCPE_OK) {
+    free (data);
+    return _sim_disk_test_end (&t, r);
+    }
+sectors = (t_lba)(sim_vhd_disk_size (uptr->fileref) / sect_size);
+start = sim_os_msec ();
+r = _sim_disk_vhd_test_pass (uptr, sectors, FALSE, FALSE, data, words);
+seq_msec = sim_os_msec () - start;
+start = sim_os_msec ();
+if (r == SCPE_OK)
+    r = _sim_disk_vhd_test_pass (uptr, sectors, TRUE, FALSE, data, words);
+rand_msec = sim_os_msec () - start;
+start = sim_os_msec ();
+_sim_disk_io_flush (uptr);
+flush_msec = sim_os_msec () - start;
+allocated = ((VHDHANDLE)uptr->fileref)->BlocksAllocated;
+bat_writes = ((VHDHANDLE)uptr->fileref)->BATWrites;
+sim_disk_detach (uptr);
+if (r == SCPE_OK) {
+    sim_printf ("%u sequential %u byte writes: %u ms\n", DK_VTEST_WRITES, sect_size, seq_msec);
+    sim_printf ("%u random %u byte writes:     %u ms\n", DK_VTEST_WRITES, sect_size, rand_msec);
+    sim_printf ("Flush: %u ms, %u blocks allocated, %u BAT writes, %s byte container\n",
+                flush_msec, allocated, bat_writes, sim_fmt_numeric ((double)sim_fsize_name_ex (filename)));
+    r = _sim_disk_test_attach (&t, filename, SWMASK ('R'));
+    }
+if (r == SCPE_OK)
+    r = _sim_disk_vhd_test_pass (uptr, sectors, TRUE, TRUE, data, words);
+if (r == SCPE_OK)
+    r = _sim_disk_vhd_test_pass (uptr, sectors, FALSE, TRUE, data, words);
+r = _sim_disk_test_end (&t, r);
+(void)remove (filename);
+free (data);
+return r;
+#endif
+}
+
+/* VHD differencing chain: three layers, each writing some sectors, read
+   back through the merged map one sector at a time and in bulk */
+
+#define DK_CHTEST_SECTS     64
+#define DK_CHTEST_STRIDE    1000                /* spread across several blocks */
+#define DK_CHTEST_BULK      (3 * DK_CHTEST_STRIDE)
+
+static uint32 _sim_disk_chain_test_layer (uint32 i, uint32 layers)
+{
+uint32 layer = 0;
+
+if (i >= DK_CHTEST_SECTS / 2)                   /* the base alone holds the rest */
+    return 0;
+if (((i % 3) == 0) && (layers > 1))
+    layer = 1;
+if (((i % 5) == 0) && (layers > 2))
+    layer = 2;
+return layer;
+}
+
+static t_stat sim_disk_vhd_chain_test (DEVICE *dptr, const char *cptr)
+{
+#if defined (DONT_DO_VHD_SUPPORT)
+return SCPE_OK;
+#else
+const char *filename[] = {"TestChain0.vhd", "TestChain1.vhd", "TestChain2.vhd"};
+UNIT *uptr = &dptr->units[0];
+uint32 sect_size = DK_TEST_SECT;
+uint32 words = sect_size / sizeof (uint32);
+uint32 *data = (uint32 *)malloc (sect_size);
+uint32 *bulk = (uint32 *)malloc (DK_CHTEST_BULK * sect_size);
+uint32 layer, i, j;
+DISK_TEST t;
+t_stat r = SCPE_OK;
+FILE *f;
+
+if ((data == NULL) || (bulk == NULL)) {
+    free (data);
+    free (bulk);
+    return SCPE_MEM;
+    }
+_sim_disk_test_begin (&t, uptr, "VHD differencing chain tests", "VHD differencing chain", "VHD");
+for (layer = 0; layer < 3; layer++)
+    (void)remove (filename[layer]);
+for (layer = 0; (r == SCPE_OK) && (layer < 3); layer++) {
+    if (layer > 0) {
+        f = sim_vhd_disk_create_diff (filename[layer], filename[layer - 1]);
+        if (f == NULL) {
+            r = sim_messagef (SCPE_OPENERR, "Can't create differencing disk %s\n", filename[layer]);
+            break;
+            }
+        sim_vhd_disk_close (f);
+        }
+    r = _sim_disk_test_attach (&t, filename[layer], 0);
+    for (i = 0; (r == SCPE_OK) && (i < DK_CHTEST_SECTS); i++) {
+        if (_sim_disk_chain_test_layer (i, layer + 1) != layer)
+            continue;
+        for (j = 0; j < words; j++)
+            data[j] = ((layer + 1) << 24) + i * 0x100 + j;
+        r = sim_disk_wrsect (uptr, i * DK_CHTEST_STRIDE, (uint8 *)data, NULL, 1);
+        }
+    if (r == SCPE_OK)
+        sim_disk_detach (uptr);
+    }
+if (r == SCPE_OK)
+    r = _sim_disk_test_attach (&t, filename[2], SWMASK ('R'));
+if ((r == SCPE_OK) && (((VHDHANDLE)uptr->fileref)->Depth != 3)) {
+    sim_printf ("No merged map for the chain\n");
+    r = SCPE_IERR;
+    }
+for (i = 0; (r == SCPE_OK) && (i < DK_CHTEST_SECTS); i++) {
+    t_lba lba = i * DK_CHTEST_STRIDE;
+    uint32 *expect = bulk + (lba % DK_CHTEST_BULK) * words;
+    uint32 *before = expect - words;
+
+    if ((lba % DK_CHTEST_BULK) == 0)            /* read a bulk chunk at once */
+        r = sim_disk_rdsect (uptr, lba, (uint8 *)bulk, NULL, DK_CHTEST_BULK);
+    if (r == SCPE_OK)
+        r = sim_disk_rdsect (uptr, lba, (uint8 *)data, NULL, 1);
+    for (j = 0; (r == SCPE_OK) && (j < words); j++) {
+        uint32 value = ((_sim_disk_chain_test_layer (i, 3) + 1) << 24) + i * 0x100 + j;
+
+        if ((data[j] != value) || (expect[j] != value) ||
+            ((lba % DK_CHTEST_BULK) && (before[j] != 0))) {
+            sim_printf ("Data mismatch at lbn %u\n", (uint32)lba);
+            r = SCPE_IERR;
+            }
+        }
+    }
+if (r == SCPE_OK)
+    _sim_disk_show_unit_chain (stdout, uptr);
+r = _sim_disk_test_end (&t, r);
+for (layer = 0; layer < 3; layer++)
+    (void)remove (filename[layer]);
+free (data);
+free (bulk);
+return r;
+#endif
+}
+
 t_stat sim_disk_test (DEVICE *dptr, const char *cptr)
 {
-const char *fmt[] = {"RAW", "VHD", "VHD", "SIMH", NULL};
+const char *fmt[] = {"RAW", "VHD", "VHD", "SIMH", "CLUSTER", NULL};
 uint32 sect_size[] = {576, 4096, 1024, 512, 256, 128, 64, 0};
 uint32 xfr_size[] = {1, 2, 4, 8, 0};
 int x, s, f;
@@ -8654,6 +12419,9 @@ UNIT *uptr = &dptr->units[0];
 char filename[256];
 t_stat r;
 int32 saved_switches = sim_switches & ~SWMASK('T');
+uint32 saved_flags = uptr->flags;
+DRVTYP *saved_drvtyp = uptr->drvtyp;
+t_addr saved_capac = uptr->capac;
 SIM_TEST_INIT;
 
 if (sim_switches & SWMASK ('M')) { /* Do meta first? */
@@ -8697,5 +12465,16 @@ for (x = 0; xfr_size[x] != 0; x++) {
             }
         }
     }
+sim_switches = saved_switches;
+uptr->flags = saved_flags;                      /* the unit as the tests above found it */
+uptr->drvtyp = saved_drvtyp;
+uptr->capac = saved_capac;
+SIM_TEST (sim_disk_queue_test (dptr, cptr));
+SIM_TEST (sim_disk_cache_test (dptr, cptr));
+SIM_TEST (sim_disk_mmap_test (dptr, cptr));
+SIM_TEST (sim_disk_overlay_test (dptr, cptr));
+SIM_TEST (sim_disk_statistics_test (dptr, cptr));
+SIM_TEST (sim_disk_vhd_write_test (dptr, cptr));
+SIM_TEST (sim_disk_vhd_chain_test (dptr, cptr));
 return SCPE_OK;
 }
@@ -74,7 +74,35 @@ typedef uint32          t_lba;                          /* disk logical block ad
 
 #define DKSE_OK         0                               /* no error */
 
+#define DK_MAX_ASYNC_DEPTH  64                          /* max concurrent transfers per unit */
+
+/* Sector cache (SET <dev> CACHE, WBCACHE, NOCACHE) */
+
+#define DK_CACHE_WB         1                           /* write back */
+#define DK_CACHE_UNIT       2                           /* unit rather than device */
+#define DK_CACHE_OFF        4                           /* no cache */
+#define DK_CACHE_DEFAULT    (1 << 20)                   /* default cache size */
+#define DK_CACHE_MAX        (1 << 30)                   /* max cache size */
+
+/* Clustered containers (SET <dev> COMPRESS, SET <unit> SNAPSHOT) */
+
+#define DK_COMPRESS         1                           /* compress whole clusters */
+#define DK_COMPRESS_UNIT    2                           /* unit rather than device */
+#define DK_SNAP_CREATE      0                           /* take a snapshot */
+#define DK_SNAP_REVERT      1                           /* revert to a snapshot */
+#define DK_SNAP_DELETE      2                           /* delete a snapshot */
+
+/* Memory mapped containers (SET <dev> MMAP, NOMMAP) */
+
+#define DK_MMAP             1                           /* map the container */
+#define DK_MMAP_UNIT        2                           /* unit rather than device */
+
+/* I/O statistics (SET <dev> STATISTICS=RESET) */
+
+#define DK_STATS_UNIT       1                           /* unit rather than device */
+
 typedef void (*DISK_PCALLBACK)(UNIT *unit, t_stat status);
+typedef void (*DISK_QCALLBACK)(UNIT *unit, t_stat status, void *arg);
 
 /* Prototypes */
 
@@ -117,6 +145,9 @@ t_stat sim_disk_rdsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread,
 t_stat sim_disk_rdsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, DISK_PCALLBACK callback);
 t_stat sim_disk_wrsect (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects);
 t_stat sim_disk_wrsect_a (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_PCALLBACK callback);
+t_stat sim_disk_rdsect_q (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectsread, t_seccnt sects, DISK_QCALLBACK callback, void *arg);
+t_stat sim_disk_wrsect_q (UNIT *uptr, t_lba lba, uint8 *buf, t_seccnt *sectswritten, t_seccnt sects, DISK_QCALLBACK callback, void *arg);
+t_stat sim_disk_drain (UNIT *uptr);
 t_stat sim_disk_unload (UNIT *uptr);
 t_stat sim_disk_erase (UNIT *uptr);
 t_stat sim_disk_set_fmt (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
@@ -127,6 +158,22 @@ t_stat sim_disk_set_autosize (UNIT *uptr, int32 val, CONST char *cptr, void *des
 t_stat sim_disk_show_autosize (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat sim_disk_set_asynch (UNIT *uptr, int latency);
 t_stat sim_disk_clr_asynch (UNIT *uptr);
+t_stat sim_disk_set_async_depth (UNIT *uptr, uint32 depth);
+uint32 sim_disk_get_async_depth (UNIT *uptr);
+t_stat sim_disk_set_cache (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_show_cache (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_set_compress (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_set_mmap (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_set_snapshot (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_show_snapshots (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_show_chain (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_set_overlay (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_show_overlay (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+const char *sim_disk_overlay_name (UNIT *uptr, t_bool *kept);
+t_stat sim_disk_set_statistics (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_show_statistics (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_disk_set_probe (int32 flag, CONST char *cptr);
+t_stat sim_disk_show_probe (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
 t_stat sim_disk_reset (UNIT *uptr);
 t_stat sim_disk_perror (UNIT *uptr, const char *msg);
 t_stat sim_disk_clearerr (UNIT *uptr);
@@ -1089,6 +1089,8 @@ t_stat eth_check_address_conflict (ETH_DEV* dev,
   {return SCPE_NOFNC;}
 t_stat eth_set_throttle (ETH_DEV* dev, uint32 time, uint32 burst, uint32 delay)
   {return SCPE_NOFNC;}
+t_stat eth_set_write_queue (ETH_DEV* dev, int depth)
+  {return SCPE_NOFNC;}
 t_stat eth_set_async (ETH_DEV *dev, int latency)
   {return SCPE_NOFNC;}
 t_stat eth_clr_async (ETH_DEV *dev)
@@ -2525,6 +2527,115 @@ _eth_callback((u_char *)opaque, &header, buf);
 #endif
 
 #if defined (USE_READER_THREAD)
+/* Receive ring
+
+   Frames accepted by the reader thread are copied into a ring of
+   preallocated packet slots.  eth_read only ever moves head and the
+   receive side only ever moves tail, so frames reach the simulator
+   without it taking the device lock.  Receive side callers (the reader
+   thread, and the writer thread when NAT or loopback processing answers
+   a frame) still serialize with each other on dev->lock.  A frame
+   arriving at a full ring is dropped and counted as a loss, like a
+   receive FIFO overrun, since the oldest slot may be being copied out.
+
+   The same ring carries frames from eth_write to the writer thread,
+   which transmits straight out of the slot before releasing it.
+*/
+#if defined (_WIN32)
+#define ETH_RING_BARRIER()  MemoryBarrier ()
+#else
+#define ETH_RING_BARRIER()  __sync_synchronize ()
+#endif
+
+static t_stat _eth_ring_init (ETH_RING *ring, int max, const char *name)
+{
+  if (!ring->slot) {
+    ring->slot = (struct eth_packet *) calloc(max, sizeof(struct eth_packet));
+    if (!ring->slot) {
+      sim_printf("EthQ: failed to allocate %s ring[%d]\n", name, max);
+      return SCPE_MEM;
+    }
+    ring->max = max;
+  }
+  ring->head = ring->tail = 0;
+  ring->loss = ring->high = 0;
+  return SCPE_OK;
+}
+
+static void _eth_ring_destroy (ETH_RING *ring)
+{
+  free(ring->slot);
+  memset(ring, 0, sizeof(*ring));
+}
+
+static int _eth_ring_count (const ETH_RING *ring)
+{
+  return (int)(ring->tail - ring->head);
+}
+
+#if defined (USE_BPF)
+/* Discard everything queued; only called from the eth_read side */
+
+static void _eth_ring_clear (ETH_RING *ring)
+{
+  ring->head = ring->tail;
+}
+#endif
+
+static void _eth_ring_insert (ETH_RING *ring, const uint8 *data, size_t len, size_t crc_len, const uint8 *crc_data)
+{
+  uint32 tail = ring->tail;
+  int count = (int)(tail - ring->head);
+  struct eth_packet* slot;
+
+  if ((count >= ring->max) ||
+      (MAX (len, crc_len) > sizeof (slot->msg))) {
+    ring->loss++;
+    return;
+  }
+  slot = &ring->slot[tail & (ring->max - 1)];
+  slot->len = len;
+  slot->crc_len = crc_len;
+  memcpy(slot->msg, data, len);
+  if (crc_data && (crc_len > len))
+    memcpy(&slot->msg[len], crc_data, ETH_CRC_SIZE);
+  ETH_RING_BARRIER ();                  /* slot contents before tail */
+  ring->tail = tail + 1;
+  if (count + 1 > ring->high)
+    ring->high = count + 1;
+}
+
+/* Oldest queued slot, which stays in place until released */
+
+static struct eth_packet *_eth_ring_peek (ETH_RING *ring)
+{
+  uint32 head = ring->head;
+
+  if (head == ring->tail)
+    return NULL;
+  ETH_RING_BARRIER ();                  /* tail before slot contents */
+  return &ring->slot[head & (ring->max - 1)];
+}
+
+static void _eth_ring_release (ETH_RING *ring)
+{
+  ETH_RING_BARRIER ();                  /* done with slot before head */
+  ring->head = ring->head + 1;
+}
+
+static int _eth_ring_remove (ETH_RING *ring, ETH_PACK *packet)
+{
+  struct eth_packet* slot = _eth_ring_peek (ring);
+
+  if (!slot)
+    return 0;
+  packet->len = slot->len;
+  packet->crc_len = slot->crc_len;
+  memcpy(packet->msg, slot->msg, ((slot->len > slot->crc_len) ? slot->len : slot->crc_len));
+  _eth_ring_release (ring);
+  return 1;
+}
+
 static void *
 _eth_reader(void *arg)
 {
@@ -2609,21 +2720,26 @@ while (dev->handle) {
         if (1) {
           struct pcap_pkthdr header;
           int len;
+          int batch = 0;
           u_char buf[ETH_MAX_JUMBO_FRAME];
 
+          /* Drain what has arrived (the fd is non-blocking) so a burst */
+          /* reaches the simulator with a single wakeup */
           memset(&header, 0, sizeof(header));
-          len = read(dev->fd_handle, buf, sizeof(buf));
-          if (len > 0) {
-            status = 1;
-            header.caplen = header.len = len;
-            _eth_callback((u_char *)dev, &header, buf);
-            }
-          else {
-            if (len < 0)
-              status = -1;
-            else
-              status = 0;
-            }
+          status = 0;
+          do {
+            len = read(dev->fd_handle, buf, sizeof(buf));
+            if (len > 0) {
+              status = 1;
+              header.caplen = header.len = len;
+              _eth_callback((u_char *)dev, &header, buf);
+              }
+            else {
+              if ((len < 0) &&
+                  ((batch == 0) || ((errno != EAGAIN) && (errno != EWOULDBLOCK))))
+                status = -1;
+              }
+            } while ((len > 0) && (++batch < ETH_READ_BATCH));
           }
         break;
 #endif /* HAVE_TAP_NETWORK */
@@ -2691,31 +2807,28 @@ while (dev->handle) {
         if (1) {
           struct pcap_pkthdr header;
           int len;
+          int batch = 0;
           u_char buf[ETH_MAX_JUMBO_FRAME];
 
           memset(&header, 0, sizeof(header));
-          len = (int)sim_read_sock (select_fd, (char *)buf, (int32)sizeof(buf));
-          if (len > 0) {
-            status = 1;
-            header.caplen = header.len = len;
-            _eth_callback((u_char *)dev, &header, buf);
-            }
-          else {
-            if (len < 0)
-              status = -1;
-            else
-              status = 0;
-            }
+          status = 0;
+          do {
+            len = (int)sim_read_sock (select_fd, (char *)buf, (int32)sizeof(buf));
+            if (len > 0) {
+              status = 1;
+              header.caplen = header.len = len;
+              _eth_callback((u_char *)dev, &header, buf);
+              }
+            else {
+              if (len < 0)
+                status = -1;
+              }
+            } while ((len > 0) && (++batch < ETH_READ_BATCH));
           }
         break;
       }
     if ((status > 0) && (dev->asynch_io)) {
-      int wakeup_needed;
-
-      pthread_mutex_lock (&dev->lock);
-      wakeup_needed = (dev->read_queue.count != 0);
-      pthread_mutex_unlock (&dev->lock);
-      if (wakeup_needed) {
+      if (_eth_ring_count (&dev->read_queue) != 0) {
         sim_debug(dev->dbit, dev->dptr, "Queueing automatic poll\n");
         sim_activate_abs (dev->dptr->units, dev->asynch_io_latency);
         }
@@ -2747,7 +2860,7 @@ static void *
 _eth_writer(void *arg)
 {
 ETH_DEV* volatile dev = (ETH_DEV*)arg;
-ETH_WRITE_REQUEST *request = NULL;
+ETH_PACK *packet;
 
 /* Boost Priority for this I/O thread vs the CPU instruction execution
    thread which in general won't be readily yielding the processor when
@@ -2756,16 +2869,9 @@ sim_os_set_thread_priority (PRIORITY_ABOVE_NORMAL);
 
 sim_debug(dev->dbit, dev->dptr, "Writer Thread Starting\n");
 
-pthread_mutex_lock (&dev->writer_lock);
 while (dev->handle) {
-  pthread_cond_wait (&dev->writer_cond, &dev->writer_lock);
-  while (NULL != (request = dev->write_requests)) {
-    /* Pull buffer off request list */
-    dev->write_requests = request->next;
-    if (dev->handle == NULL)      /* Shutting down? */
-      break;
-    pthread_mutex_unlock (&dev->writer_lock);
-
+  /* Send everything queued before going back to sleep */
+  while ((dev->handle) && (NULL != (packet = _eth_ring_peek (&dev->write_queue)))) {
     if (dev->throttle_delay != ETH_THROT_DISABLED_DELAY) {
       uint32 packet_delta_time = sim_os_msec() - dev->throttle_packet_time;
       dev->throttle_events <<= 1;
@@ -2776,22 +2882,19 @@ while (dev->handle) {
         }
       dev->throttle_packet_time = sim_os_msec();
       }
-    dev->write_status = _eth_write(dev, &request->packet, NULL);
-
-    pthread_mutex_lock (&dev->writer_lock);
-    /* Put buffer on free buffer list */
-    request->next = dev->write_buffers;
-    dev->write_buffers = request;
-    request = NULL;
+    dev->write_status = _eth_write(dev, packet, NULL);
+    _eth_ring_release (&dev->write_queue);
     }
+  /* Announce we're about to sleep, then look once more so that a frame */
+  /* queued while announcing isn't left waiting for the next one */
+  pthread_mutex_lock (&dev->writer_lock);
+  dev->writer_waiting = TRUE;
+  ETH_RING_BARRIER ();
+  if ((dev->handle) && (_eth_ring_count (&dev->write_queue) == 0))
+    pthread_cond_wait (&dev->writer_cond, &dev->writer_lock);
+  dev->writer_waiting = FALSE;
+  pthread_mutex_unlock (&dev->writer_lock);
   }
-/* If we exited these loops with a request allocated, */
-/* avoid buffer leaking by putting it on free buffer list */
-if (request) {
-  request->next = dev->write_buffers;
-  dev->write_buffers = request;
-  }
-pthread_mutex_unlock (&dev->writer_lock);
 
 sim_debug(dev->dbit, dev->dptr, "Writer Thread Exiting\n");
 return NULL;
@@ -2809,14 +2912,9 @@ char *msg = "Eth: Can't operate asynchronously, must poll.\n"
             " *** Build with USE_READER_THREAD defined and link with pthreads for asynchronous operation. ***\n";
 return sim_messagef (SCPE_NOFNC, "%s", msg);
 #else
-int wakeup_needed;
-
 dev->asynch_io = sim_asynch_enabled;
 dev->asynch_io_latency = latency;
-pthread_mutex_lock (&dev->lock);
-wakeup_needed = (dev->read_queue.count != 0);
-pthread_mutex_unlock (&dev->lock);
-if (wakeup_needed) {
+if (_eth_ring_count (&dev->read_queue) != 0) {
   sim_debug(dev->dbit, dev->dptr, "Queueing automatic poll\n");
   sim_activate_abs (dev->dptr->units, dev->asynch_io_latency);
   }
@@ -2852,6 +2950,51 @@ dev->throttle_mask = (1 << dev->throttle_burst) - 1;
 return SCPE_OK;
 }
 
+/* eth_set_write_queue
+ *
+ * Set the number of frames which can be waiting for the writer thread.
+ * The depth is rounded up to a power of 2.  Frames already queued are
+ * sent before the ring is replaced; if the writer thread doesn't send
+ * them within ETH_WRITE_WAIT_MSEC the ring is left as it was.
+ */
+t_stat eth_set_write_queue (ETH_DEV* dev, int depth)
+{
+#if defined (USE_READER_THREAD)
+int max = 1;
+struct eth_packet *slot;
+uint32 start;
+#endif
+
+if (!dev)
+  return SCPE_IERR;
+if ((depth < 1) || (depth > ETH_WRITE_RING_MAX))
+  return SCPE_ARG;
+#if defined (USE_READER_THREAD)
+while (max < depth)
+  max <<= 1;
+if (max == dev->write_queue.max)
+  return SCPE_OK;
+slot = (struct eth_packet *)calloc (max, sizeof (*slot));
+if (!slot)
+  return SCPE_MEM;
+/* The writer thread only touches slots while frames are queued, and */
+/* this is the only thread which queues them */
+start = sim_os_msec ();
+while ((_eth_ring_count (&dev->write_queue) != 0) &&
+       (dev->handle) &&
+       ((sim_os_msec () - start) < ETH_WRITE_WAIT_MSEC))
+  sim_os_ms_sleep (1);
+if (_eth_ring_count (&dev->write_queue) != 0) {
+  free (slot);
+  return sim_messagef (SCPE_IOERR, "Transmit ring still holds %d frames, its size is unchanged\n", _eth_ring_count (&dev->write_queue));
+  }
+free (dev->write_queue.slot);
+dev->write_queue.slot = slot;
+dev->write_queue.max = max;
+#endif
+return SCPE_OK;
+}
+
 #if defined(HAVE_VMNET_NETWORK)
 /* Because vmnet operates via callbacks, set up a semaphore to block on.  */
 /* These variables are referenced by the single command input thread      */
@@ -3424,7 +3567,8 @@ dev->dbit = dbit;
 if (1) {
   pthread_attr_t attr;
 
-  ethq_init (&dev->read_queue, 200);         /* initialize FIFO queue */
+  _eth_ring_init (&dev->read_queue, ETH_READ_RING_SIZE, "receive"); /* initialize receive ring */
+  _eth_ring_init (&dev->write_queue, ETH_WRITE_RING_SIZE, "transmit"); /* initialize transmit ring */
   pthread_mutex_init (&dev->lock, NULL);
   pthread_mutex_init (&dev->writer_lock, NULL);
   pthread_mutex_init (&dev->self_lock, NULL);
@@ -3512,23 +3656,15 @@ dev->have_host_nic_phy_addr = 0;
 #if defined (USE_READER_THREAD)
 pthread_join (dev->reader_thread, NULL);
 pthread_mutex_destroy (&dev->lock);
+pthread_mutex_lock (&dev->writer_lock);
 pthread_cond_signal (&dev->writer_cond);
+pthread_mutex_unlock (&dev->writer_lock);
 pthread_join (dev->writer_thread, NULL);
 pthread_mutex_destroy (&dev->self_lock);
 pthread_mutex_destroy (&dev->writer_lock);
 pthread_cond_destroy (&dev->writer_cond);
-if (1) {
-  ETH_WRITE_REQUEST *buffer;
-   while (NULL != (buffer = dev->write_buffers)) {
-    dev->write_buffers = buffer->next;
-    free(buffer);
-    }
-  while (NULL != (buffer = dev->write_requests)) {
-    dev->write_requests = buffer->next;
-    free(buffer);
-    }
-  }
-ethq_destroy (&dev->read_queue);         /* release FIFO queue */
+_eth_ring_destroy (&dev->read_queue);    /* release receive ring */
+_eth_ring_destroy (&dev->write_queue);   /* release transmit ring */
 #endif
 
 _eth_close_port (dev->eth_api, pcap, pcap_fd);
@@ -4088,8 +4224,7 @@ return ((status == 0) ? SCPE_OK : SCPE_IOERR);
 t_stat eth_write(ETH_DEV* dev, ETH_PACK* packet, ETH_PCALLBACK routine)
 {
 #ifdef USE_READER_THREAD
-ETH_WRITE_REQUEST *request;
-int write_queue_size = 1;
+uint32 start;
 
 /* make sure device exists */
 if ((!dev) || (dev->eth_api == ETH_API_NONE)) return SCPE_UNATT;
@@ -4097,43 +4232,28 @@ if ((!dev) || (dev->eth_api == ETH_API_NONE)) return SCPE_UNATT;
 if (packet->len > sizeof (packet->msg)) /* packet oversized? */
     return SCPE_IERR;                   /* that's no good! */
 
-/* Get a buffer */
-pthread_mutex_lock (&dev->writer_lock);
-if (NULL != (request = dev->write_buffers))
-  dev->write_buffers = request->next;
-pthread_mutex_unlock (&dev->writer_lock);
-if (NULL == request)
-  request = (ETH_WRITE_REQUEST *)malloc(sizeof(*request));
-
-/* Copy buffer contents */
-request->packet.len = packet->len;
-request->packet.used = packet->used;
-request->packet.status = packet->status;
-request->packet.crc_len = packet->crc_len;
-memcpy(request->packet.msg, packet->msg, packet->len);
-
-/* Insert buffer at the end of the write list (to make sure that */
-/* packets make it to the wire in the order they were presented here) */
-pthread_mutex_lock (&dev->writer_lock);
-request->next = NULL;
-if (dev->write_requests) {
-  ETH_WRITE_REQUEST *last_request = dev->write_requests;
-
-  ++write_queue_size;
-  while (last_request->next) {
-    last_request = last_request->next;
-    ++write_queue_size;
-    }
-  last_request->next = request;
+/* When throttling, the writer thread paces the frames, so a burst */
+/* larger than the ring waits here for a slot rather than being lost */
+if ((dev->throttle_delay != ETH_THROT_DISABLED_DELAY) &&
+    (_eth_ring_count (&dev->write_queue) >= dev->write_queue.max)) {
+  start = sim_os_msec ();
+  while ((_eth_ring_count (&dev->write_queue) >= dev->write_queue.max) &&
+         (dev->handle) &&
+         ((sim_os_msec () - start) < ETH_WRITE_WAIT_MSEC))
+    sim_os_ms_sleep (1);
   }
-else
-    dev->write_requests = request;
-if (write_queue_size > dev->write_queue_peak)
-  dev->write_queue_peak = write_queue_size;
-pthread_mutex_unlock (&dev->writer_lock);
 
-/* Awaken writer thread to perform actual write */
-pthread_cond_signal (&dev->writer_cond);
+/* Copy the frame into the next transmit slot (a full ring drops it */
+/* and counts it as lost, like a frame lost on the wire) */
+_eth_ring_insert (&dev->write_queue, packet->msg, packet->len, 0, NULL);
+
+/* Awaken writer thread to perform actual write if it is sleeping */
+ETH_RING_BARRIER ();                    /* tail before writer_waiting */
+if (dev->writer_waiting) {
+  pthread_mutex_lock (&dev->writer_lock);
+  pthread_cond_signal (&dev->writer_cond);
+  pthread_mutex_unlock (&dev->writer_lock);
+  }
 
 /* Return with a status from some prior write */
 if (routine)
@@ -4765,7 +4885,7 @@ if (bpf_used ? to_me : (to_me && !from_me)) {
     eth_packet_trace (dev, data, len, "rcvqd");
 
     pthread_mutex_lock (&dev->lock);
-    ethq_insert_data(&dev->read_queue, ETH_ITM_NORMAL, data, 0, len, crc_len, crc_data, 0);
+    _eth_ring_insert(&dev->read_queue, data, len, crc_len, crc_data);
     ++dev->packets_received;
     pthread_mutex_unlock (&dev->lock);
     free(moved_data);
@@ -4936,17 +5056,7 @@ if (status < 0) {
 
 #else /* USE_READER_THREAD */
 
-  status = 0;
-  pthread_mutex_lock (&dev->lock);
-  if (dev->read_queue.count > 0) {
-    ETH_ITEM* item = &dev->read_queue.item[dev->read_queue.head];
-    packet->len = item->packet.len;
-    packet->crc_len = item->packet.crc_len;
-    memcpy(packet->msg, item->packet.msg, ((packet->len > packet->crc_len) ? packet->len : packet->crc_len));
-    status = 1;
-    ethq_remove(&dev->read_queue);
-  }
-  pthread_mutex_unlock (&dev->lock);
+  status = _eth_ring_remove(&dev->read_queue, packet);
   if ((status) && (routine))
     routine(0);
 #endif
@@ -5212,9 +5322,7 @@ if (dev->eth_api == ETH_API_PCAP) {
     pcap_freecode(&bpf);
     }
 #ifdef USE_READER_THREAD
-  pthread_mutex_lock (&dev->lock);
-  ethq_clear (&dev->read_queue); /* Empty FIFO Queue when filter list changes */
-  pthread_mutex_unlock (&dev->lock);
+  _eth_ring_clear (&dev->read_queue); /* Empty receive ring when filter list changes */
 #endif
   }
 #endif /* USE_BPF */
@@ -5265,10 +5373,14 @@ if (dev->asynch_io)
   fprintf(st, "  Interrupt Latency:       %d uSec\n", dev->asynch_io_latency);
 if (dev->throttle_count)
   fprintf(st, "  Throttle Delays:         %d\n", dev->throttle_count);
-fprintf(st, "  Read Queue: Count:       %d\n", dev->read_queue.count);
+fprintf(st, "  Read Queue: Size:        %d\n", dev->read_queue.max);
+fprintf(st, "  Read Queue: Count:       %d\n", _eth_ring_count (&dev->read_queue));
 fprintf(st, "  Read Queue: High:        %d\n", dev->read_queue.high);
 fprintf(st, "  Read Queue: Loss:        %d\n", dev->read_queue.loss);
-fprintf(st, "  Peak Write Queue Size:   %d\n", dev->write_queue_peak);
+fprintf(st, "  Write Queue: Size:       %d\n", dev->write_queue.max);
+fprintf(st, "  Write Queue: Count:      %d\n", _eth_ring_count (&dev->write_queue));
+fprintf(st, "  Write Queue: High:       %d\n", dev->write_queue.high);
+fprintf(st, "  Write Queue: Loss:       %d\n", dev->write_queue.loss);
 #endif
 if (dev->error_needs_reset)
   fprintf(st, "  In Error Needs Reset:    True\n");
@@ -5491,6 +5603,169 @@ if (bpf_compile_skip_count)
 return (errors == 0) ? SCPE_OK : SCPE_IERR;
 }
 
+#if defined (USE_READER_THREAD)
+#define ETH_TEST_RING_FRAMES 200000
+
+static void *
+_eth_test_ring_producer (void *arg)
+{
+ETH_RING *ring = (ETH_RING *)arg;
+uint8 frame[ETH_MIN_PACKET];
+uint32 seq;
+
+memset (frame, 0, sizeof (frame));
+for (seq = 0; seq < ETH_TEST_RING_FRAMES; seq++) {
+  while (_eth_ring_count (ring) == ring->max)   /* wait for room */
+    sched_yield ();
+  memcpy (&frame[14], &seq, sizeof (seq));
+  _eth_ring_insert (ring, frame, sizeof (frame), 0, NULL);
+  }
+return NULL;
+}
+
+static
+t_stat eth_test_receive_ring (DEVICE *dptr)
+{
+int errors = 0;
+ETH_RING ring;
+ETH_PACK packet;
+uint8 frame[ETH_MIN_PACKET];
+pthread_t producer;
+uint32 seq, last;
+int received;
+
+memset (&ring, 0, sizeof (ring));
+if (_eth_ring_init (&ring, ETH_READ_RING_SIZE, "receive") != SCPE_OK)
+  return SCPE_MEM;
+/* Overfilling keeps the oldest frames and counts the rest as lost */
+memset (frame, 0, sizeof (frame));
+for (seq = 0; seq < ETH_READ_RING_SIZE + 10; seq++) {
+  memcpy (&frame[14], &seq, sizeof (seq));
+  _eth_ring_insert (&ring, frame, sizeof (frame), 0, NULL);
+  }
+if ((_eth_ring_count (&ring) != ETH_READ_RING_SIZE) || (ring.loss != 10) || (ring.high != ETH_READ_RING_SIZE)) {
+  sim_printf ("Full receive ring: count %d, loss %d, high %d\n", _eth_ring_count (&ring), ring.loss, ring.high);
+  ++errors;
+  }
+for (seq = 0; _eth_ring_remove (&ring, &packet); seq++) {
+  memcpy (&last, &packet.msg[14], sizeof (last));
+  if ((last != seq) || (packet.len != ETH_MIN_PACKET)) {
+    sim_printf ("Receive ring frame %u: got sequence %u, length %u\n", seq, last, packet.len);
+    ++errors;
+    break;
+    }
+  }
+/* A concurrent producer which waits for room must deliver every frame */
+/* in order with no duplicates or holes */
+_eth_ring_init (&ring, ETH_READ_RING_SIZE, "receive");
+pthread_create (&producer, NULL, _eth_test_ring_producer, &ring);
+received = 0;
+while (received < ETH_TEST_RING_FRAMES) {
+  if (!_eth_ring_remove (&ring, &packet)) {
+    sched_yield ();
+    continue;
+    }
+  memcpy (&seq, &packet.msg[14], sizeof (seq));
+  if ((seq != (uint32)received) && (errors++ == 0))   /* keep draining so the producer finishes */
+    sim_printf ("Receive ring delivered sequence %u, expected %d\n", seq, received);
+  ++received;
+  }
+pthread_join (producer, NULL);
+if ((errors == 0) && ((ring.loss != 0) || (_eth_ring_count (&ring) != 0))) {
+  sim_printf ("Receive ring: %d lost, %d left over\n", ring.loss, _eth_ring_count (&ring));
+  ++errors;
+  }
+sim_printf ("Receive ring: %d frames passed between threads, high water %d\n", received, ring.high);
+_eth_ring_destroy (&ring);
+return (errors == 0) ? SCPE_OK : SCPE_IERR;
+}
+
+/* A UDP bridge to a plain socket on the loopback interface gives the */
+/* writer thread somewhere to send; nothing reads what arrives there */
+
+static
+t_stat eth_test_write_queue (DEVICE *dptr)
+{
+int errors = 0;
+ETH_DEV *dev = (ETH_DEV *)calloc (1, sizeof (*dev));
+ETH_PACK *packet = (ETH_PACK *)calloc (1, sizeof (*packet));
+SOCKET sink;
+static const ETH_MAC src = {0x08, 0x00, 0x2B, 0x11, 0x22, 0x33};
+int pass, loss;
+uint32 seq, start;
+
+if ((dev == NULL) || (packet == NULL)) {
+  free (dev);
+  free (packet);
+  return SCPE_MEM;
+  }
+sink = sim_connect_sock_ex ("60124", "localhost:60123", NULL, NULL, SIM_SOCK_OPT_DATAGRAM);
+if ((sink == INVALID_SOCKET) ||
+    (SCPE_OK != eth_open (dev, "udp:60123:localhost:60124", dptr, 0))) {
+  sim_printf ("Write queue: UDP loopback unavailable, test skipped\n");
+  if (sink != INVALID_SOCKET)
+    sim_close_sock (sink);
+  free (dev);
+  free (packet);
+  return SCPE_OK;
+  }
+memset (packet->msg, 0xFF, sizeof (ETH_MAC));
+memcpy (&packet->msg[6], src, sizeof (ETH_MAC));
+packet->msg[12] = 0x60;
+packet->msg[13] = 0x06;
+packet->len = ETH_MIN_PACKET;
+/* A shallow ring overruns during a burst, then a resized ring takes */
+/* the same burst; each must drain without the writer being left asleep */
+for (pass = 0; pass < 2; pass++) {
+  if (SCPE_OK != eth_set_write_queue (dev, pass ? 4000 : 16)) {
+    ++errors;
+    break;
+    }
+  for (seq = 0; seq < 20000; seq++) {
+    memcpy (&packet->msg[14], &seq, sizeof (seq));
+    eth_write (dev, packet, NULL);
+    }
+  for (start = sim_os_msec (); (_eth_ring_count (&dev->write_queue) != 0) && (sim_os_msec () - start < 10000); )
+    sim_os_ms_sleep (1);
+  if (_eth_ring_count (&dev->write_queue) != 0) {
+    sim_printf ("Write queue: writer thread stalled with %d frames queued\n", _eth_ring_count (&dev->write_queue));
+    ++errors;
+    break;
+    }
+  }
+if ((errors == 0) &&
+    ((dev->write_queue.max != 4096) ||
+     (dev->packets_sent + dev->write_queue.loss < 40000))) {
+  sim_printf ("Write queue: size %d, %u sent + %d dropped of 40000\n", dev->write_queue.max, dev->packets_sent, dev->write_queue.loss);
+  ++errors;
+  }
+sim_printf ("Write queue: 40000 frames, %d dropped, high water %d\n", dev->write_queue.loss, dev->write_queue.high);
+/* A throttled burst larger than a shallow ring holds the sender back */
+/* rather than dropping frames */
+if (errors == 0) {
+  if (SCPE_OK != eth_set_write_queue (dev, 16))
+    ++errors;
+  loss = dev->write_queue.loss;
+  eth_set_throttle (dev, ETH_THROT_DEFAULT_TIME, ETH_THROT_DEFAULT_BURST, 1);
+  for (seq = 0; seq < 200; seq++) {
+    memcpy (&packet->msg[14], &seq, sizeof (seq));
+    eth_write (dev, packet, NULL);
+    }
+  for (start = sim_os_msec (); (_eth_ring_count (&dev->write_queue) != 0) && (sim_os_msec () - start < 10000); )
+    sim_os_ms_sleep (1);
+  if (dev->write_queue.loss != loss) {
+    sim_printf ("Write queue: throttled burst dropped %d of 200 frames\n", dev->write_queue.loss - loss);
+    ++errors;
+    }
+  }
+eth_close (dev);
+sim_close_sock (sink);
+free (dev);
+free (packet);
+return (errors == 0) ? SCPE_OK : SCPE_IERR;
+}
+#endif /* USE_READER_THREAD */
+
 t_stat sim_ether_test (DEVICE *dptr, const char *cptr)
 {
 t_stat stat = SCPE_OK;
@@ -5500,6 +5775,10 @@ sim_printf ("Testing %s device sim_ether APIs\n", dptr->name);
 
 SIM_TEST(eth_test_crc32 (dptr));
 SIM_TEST(eth_test_bpf (dptr));
+#if defined (USE_READER_THREAD)
+SIM_TEST(eth_test_receive_ring (dptr));
+SIM_TEST(eth_test_write_queue (dptr));
+#endif
 return stat;
 }
 #endif /* USE_NETWORK */
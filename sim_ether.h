@@ -241,6 +241,20 @@ struct eth_queue {
   struct eth_item*    item;
 };
 
+struct eth_ring {
+  int                 max;                              /* slot count (power of 2) */
+  volatile uint32     head;                             /* next slot to remove (eth_read side) */
+  volatile uint32     tail;                             /* next slot to fill (receive side) */
+  int                 loss;
+  int                 high;
+  struct eth_packet*  slot;
+};
+#define ETH_READ_RING_SIZE  1024                        /* receive ring slots */
+#define ETH_READ_BATCH      64                          /* frames read per reader thread wakeup */
+#define ETH_WRITE_RING_SIZE 512                         /* default transmit ring slots */
+#define ETH_WRITE_RING_MAX  65536                       /* largest transmit ring */
+#define ETH_WRITE_WAIT_MSEC 5000                        /* longest wait on the writer thread */
+
 typedef unsigned char ETH_MAC[6];
 
 struct eth_list {
@@ -258,11 +272,7 @@ typedef void (*ETH_PCALLBACK)(int status);
 typedef struct eth_list ETH_LIST;
 typedef struct eth_queue ETH_QUE;
 typedef struct eth_item ETH_ITEM;
-struct eth_write_request {
-  struct eth_write_request *next;
-  ETH_PACK packet;
-  };
-typedef struct eth_write_request ETH_WRITE_REQUEST;
+typedef struct eth_ring ETH_RING;
 
 struct eth_device {
   char*         name;                                   /* name of ethernet device */
@@ -326,16 +336,15 @@ struct eth_device {
 #if defined (USE_READER_THREAD)
   int           asynch_io;                              /* Asynchronous Interrupt scheduling enabled */
   int           asynch_io_latency;                      /* instructions to delay pending interrupt */
-  ETH_QUE       read_queue;
+  ETH_RING      read_queue;                             /* receive ring */
   pthread_mutex_t     lock;
   pthread_t     reader_thread;                          /* Reader Thread Id */
   pthread_t     writer_thread;                          /* Writer Thread Id */
   pthread_mutex_t     writer_lock;
   pthread_mutex_t     self_lock;
   pthread_cond_t      writer_cond;
-  ETH_WRITE_REQUEST *write_requests;
-  int write_queue_peak;
-  ETH_WRITE_REQUEST *write_buffers;
+  ETH_RING      write_queue;                            /* transmit ring */
+  volatile int  writer_waiting;                         /* writer thread is (about to be) asleep */
   t_stat write_status;
 #endif
 };
@@ -376,6 +385,7 @@ void eth_setcrc   (ETH_DEV* dev, int need_crc);         /* enable/disable CRC mo
 t_stat eth_set_async (ETH_DEV* dev, int latency);       /* set read behavior to be async */
 t_stat eth_clr_async (ETH_DEV* dev);                    /* set read behavior to be not async */
 t_stat eth_set_throttle (ETH_DEV* dev, uint32 time, uint32 burst, uint32 delay); /* set transmit throttle parameters */
+t_stat eth_set_write_queue (ETH_DEV* dev, int depth);  /* set transmit ring depth */
 uint32 eth_crc32(uint32 crc, const void* vbuf, size_t len); /* Compute Ethernet Autodin II CRC for buffer */
 
 void eth_packet_trace (ETH_DEV* dev, const uint8 *msg, int len, const char* txt); /* trace ethernet packet header+crc */
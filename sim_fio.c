@@ -53,8 +53,14 @@
    sim_buf_swap_data -       swap data elements inplace in buffer if needed
    sim_byte_swap_data -      swap data elements inplace in buffer
    sim_buf_pack_unpack -     pack or unpack data between buffers
+   sim_lz4_compress -        compress a buffer (LZ4 block format)
+   sim_lz4_decompress -      decompress an LZ4 block
    sim_shmem_open            create or attach to a shared memory region
    sim_shmem_close           close a shared memory region
+   sim_memfile_open          map a file as memory
+   sim_memfile_map           map the leading part of an existing file
+   sim_memfile_sync          write back changes to a mapped file
+   sim_memfile_close         unmap a memory file
    sim_chdir                 change working directory
    sim_mkdir                 create a directory
    sim_rmdir                 remove a directory
@@ -265,6 +271,168 @@ for (element = 0; element < scount; element++) {
 return FALSE;
 }
 
+/* LZ4 block format compression
+
+   The compressed stream is a sequence of tokens, each describing a run of
+   literal bytes followed by a back reference (a 16 bit little endian offset
+   and a length) into the already produced output.  The final sequence
+   carries only literals.  This is the block format produced by the
+   reference LZ4 implementation, so data compressed here can be inspected
+   with standard tools and vice versa.
+
+   sim_lz4_compress returns the compressed size, or 0 if the result would
+   not fit in dcap bytes (the caller is then expected to store the data
+   uncompressed).  sim_lz4_decompress returns TRUE if the input is malformed
+   or would overflow the destination.
+*/
+
+#define LZ4_HASH_LOG    12                              /* match table size */
+#define LZ4_MIN_MATCH   4
+#define LZ4_MF_LIMIT    12                              /* last match start from end */
+#define LZ4_LAST_LIT    5                               /* trailing literal bytes */
+#define LZ4_MAX_OFFSET  65535
+
+static uint32 _lz4_read32 (const uint8 *p)
+{
+uint32 v;
+
+memcpy (&v, p, sizeof (v));
+return v;
+}
+
+static uint8 *_lz4_put_length (uint8 *op, size_t len)
+{
+while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+    }
+*op++ = (uint8)len;
+return op;
+}
+
+size_t sim_lz4_compress (const void *src, size_t slen, void *dst, size_t dcap)
+{
+const uint8 *base = (const uint8 *)src;
+const uint8 *ip = base, *anchor = base;
+const uint8 *iend = base + slen;
+const uint8 *mflimit = iend - LZ4_MF_LIMIT;
+const uint8 *matchlimit = iend - LZ4_LAST_LIT;
+uint8 *op = (uint8 *)dst;
+uint8 *oend = op + dcap;
+uint32 table[1 << LZ4_HASH_LOG];
+size_t litlen, mlen;
+
+if (slen > LZ4_MF_LIMIT) {
+    memset (table, 0, sizeof (table));
+    ++ip;                                               /* position 0 is the table default */
+    while (ip < mflimit) {
+        uint32 seq = _lz4_read32 (ip);
+        uint32 h = (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+        const uint8 *ref = base + table[h];
+        const uint8 *mp;
+
+        table[h] = (uint32)(ip - base);
+        if ((ip - ref > LZ4_MAX_OFFSET) || (_lz4_read32 (ref) != seq)) {
+            ++ip;
+            continue;
+            }
+        while ((ip > anchor) && (ref > base) && (ip[-1] == ref[-1])) {
+            --ip;                                       /* extend match backwards */
+            --ref;
+            }
+        for (mp = ip + LZ4_MIN_MATCH, ref += LZ4_MIN_MATCH;
+             (mp < matchlimit) && (*mp == *ref); ++mp, ++ref)
+            ;
+        litlen = (size_t)(ip - anchor);
+        mlen = (size_t)(mp - ip) - LZ4_MIN_MATCH;
+        if ((size_t)(oend - op) < 1 + litlen + (litlen / 255) + 1 + 2 + (mlen / 255) + 1)
+            return 0;                                   /* doesn't fit */
+        *op = (uint8)(((litlen < 15) ? litlen : 15) << 4);
+        *op |= (uint8)((mlen < 15) ? mlen : 15);
+        ++op;
+        if (litlen >= 15)
+            op = _lz4_put_length (op, litlen - 15);
+        memcpy (op, anchor, litlen);
+        op += litlen;
+        *op++ = (uint8)((mp - ref) & 0xFF);             /* offset */
+        *op++ = (uint8)((mp - ref) >> 8);
+        if (mlen >= 15)
+            op = _lz4_put_length (op, mlen - 15);
+        ip = anchor = mp;
+        }
+    }
+litlen = (size_t)(iend - anchor);                       /* last literals */
+if ((size_t)(oend - op) < 1 + litlen + (litlen / 255) + 1)
+    return 0;
+*op++ = (uint8)(((litlen < 15) ? litlen : 15) << 4);
+if (litlen >= 15)
+    op = _lz4_put_length (op, litlen - 15);
+memcpy (op, anchor, litlen);
+op += litlen;
+return (size_t)(op - (uint8 *)dst);
+}
+
+t_bool sim_lz4_decompress (const void *src, size_t slen, void *dst, size_t dcap, size_t *dlen)
+{
+const uint8 *ip = (const uint8 *)src;
+const uint8 *iend = ip + slen;
+uint8 *op = (uint8 *)dst;
+uint8 *oend = op + dcap;
+size_t len, offset;
+uint8 token, b;
+
+*dlen = 0;
+while (ip < iend) {
+    token = *ip++;
+    len = token >> 4;                                   /* literal length */
+    if (len == 15) {
+        do {
+            if (ip >= iend)
+                return TRUE;
+            b = *ip++;
+            len += b;
+            } while (b == 255);
+        }
+    if (((size_t)(iend - ip) < len) || ((size_t)(oend - op) < len))
+        return TRUE;
+    memcpy (op, ip, len);
+    op += len;
+    ip += len;
+    if (ip == iend)                                     /* last sequence? */
+        break;
+    if (iend - ip < 2)
+        return TRUE;
+    offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if ((offset == 0) || (offset > (size_t)(op - (uint8 *)dst)))
+        return TRUE;
+    len = token & 0xF;                                  /* match length */
+    if (len == 15) {
+        do {
+            if (ip >= iend)
+                return TRUE;
+            b = *ip++;
+            len += b;
+            } while (b == 255);
+        }
+    len += LZ4_MIN_MATCH;
+    if ((size_t)(oend - op) < len)
+        return TRUE;
+    if (offset >= len)
+        memcpy (op, op - offset, len);
+    else {
+        const uint8 *mp = op - offset;                  /* overlapping copy */
+        size_t i;
+
+        for (i = 0; i < len; i++)
+            op[i] = mp[i];
+        }
+    op += len;
+    }
+*dlen = (size_t)(op - (uint8 *)dst);
+return FALSE;
+}
+
 size_t sim_fwrite (const void *bptr, size_t size, size_t count, FILE *fptr)
 {
 size_t c, nelem, nbuf, lcnt, total;
@@ -868,6 +1036,103 @@ for (gt = get_test, tests = 0; gt->name; ++gt) {
     }
 if (r == SCPE_OK)
     sim_messagef (SCPE_OK, "All %d sim_get_filelist tests GOOD\n", tests);
+if (r == SCPE_OK) {
+    static const char *lz4_desc[] = {"empty", "short", "zeros", "pattern", "words", "random", NULL};
+    static const size_t lz4_size[] = {0, 11, 4096, 5000, 65536, 4096};
+    uint8 *src = (uint8 *)malloc (65536);
+    uint8 *cmp = (uint8 *)malloc (65536 + 65536/255 + 16);
+    uint8 *out = (uint8 *)malloc (65536);
+    size_t clen, dlen, i;
+    uint32 seed = 1;
+
+    for (tests = 0; lz4_desc[tests]; ++tests) {
+        for (i = 0; i < lz4_size[tests]; i++) {
+            seed = seed * 1103515245 + 12345;
+            switch (tests) {
+                case 1:
+                    src[i] = "Hello world"[i];
+                    break;
+                case 2:
+                    src[i] = 0;
+                    break;
+                case 3:
+                    src[i] = (uint8)("abcdefg"[i % 7] + (i / 1000));
+                    break;
+                case 4:                                 /* sparse little endian words */
+                    src[i] = ((i & 3) == 0) ? (uint8)((i >> 6) & 0x7F) : (((i & 3) == 1) && ((seed >> 16) & 1)) ? 0x80 : 0;
+                    break;
+                default:
+                    src[i] = (uint8)(seed >> 16);
+                    break;
+                }
+            }
+        clen = sim_lz4_compress (src, lz4_size[tests], cmp, lz4_size[tests] + lz4_size[tests]/255 + 16);
+        if ((clen == 0) ||
+            sim_lz4_decompress (cmp, clen, out, lz4_size[tests], &dlen) ||
+            (dlen != lz4_size[tests]) ||
+            (memcmp (src, out, dlen) != 0)) {
+            r = sim_messagef (SCPE_IERR, "LZ4 %s roundtrip of %d bytes FAILED\n", lz4_desc[tests], (int)lz4_size[tests]);
+            break;
+            }
+        sim_messagef (SCPE_OK, "LZ4 %s: %d bytes compressed to %d\n", lz4_desc[tests], (int)lz4_size[tests], (int)clen);
+        if ((clen > 1) &&
+            (!sim_lz4_decompress (cmp, clen - 1, out, lz4_size[tests], &dlen)) &&
+            (dlen == lz4_size[tests])) {
+            r = sim_messagef (SCPE_IERR, "LZ4 %s truncated input not detected\n", lz4_desc[tests]);
+            break;
+            }
+        }
+    if ((r == SCPE_OK) &&                               /* incompressible must not fit */
+        (sim_lz4_compress (src, lz4_size[tests - 1], cmp, lz4_size[tests - 1] - 1) != 0))
+        r = sim_messagef (SCPE_IERR, "LZ4 random data unexpectedly compressed\n");
+    free (src);
+    free (cmp);
+    free (out);
+    if (r == SCPE_OK)
+        sim_messagef (SCPE_OK, "All %d LZ4 tests GOOD\n", tests);
+    }
+if (r == SCPE_OK) {
+    MAPFILE *mf;
+    uint32 *mem;
+    t_bool loaded;
+    uint32 i;
+    const size_t mfsize = 256 * 1024;
+    t_stat st = sim_memfile_open ("testmemfile.bin", mfsize, TRUE, &mf, (void **)&mem, &loaded);
+
+    if (st == SCPE_NOFNC)
+        sim_messagef (SCPE_OK, "Memory files not available - skipping tests\n");
+    else {
+        if ((st != SCPE_OK) || loaded)
+            r = sim_messagef (SCPE_IERR, "Creating a shared memory file failed\n");
+        else {
+            for (i = 0; i < mfsize / sizeof (*mem); i++)
+                mem[i] = i ^ 0x5A5A5A5A;
+            sim_memfile_sync (mf);
+            sim_memfile_close (mf);
+            st = sim_memfile_open ("testmemfile.bin", mfsize, FALSE, &mf, (void **)&mem, &loaded);
+            if ((st != SCPE_OK) || !loaded || (mem[1234] != (1234 ^ 0x5A5A5A5A)))
+                r = sim_messagef (SCPE_IERR, "Private memory file doesn't see the saved contents\n");
+            else {
+                mem[1234] = 0;                          /* private change */
+                sim_memfile_close (mf);
+                st = sim_memfile_open ("testmemfile.bin", mfsize, TRUE, &mf, (void **)&mem, &loaded);
+                if ((st != SCPE_OK) || !loaded || (mem[1234] != (1234 ^ 0x5A5A5A5A)))
+                    r = sim_messagef (SCPE_IERR, "Private memory file change reached the file\n");
+                sim_memfile_close (mf);
+                }
+            if (r == SCPE_OK) {
+                st = sim_memfile_open ("testmemfile.bin", mfsize / 2, FALSE, &mf, (void **)&mem, &loaded);
+                if (st == SCPE_OK) {
+                    sim_memfile_close (mf);
+                    r = sim_messagef (SCPE_IERR, "Private memory file of the wrong size was accepted\n");
+                    }
+                }
+            }
+        remove ("testmemfile.bin");
+        if (r == SCPE_OK)
+            sim_messagef (SCPE_OK, "Memory file tests GOOD\n");
+        }
+    }
 return r;
 }
 
@@ -1567,6 +1832,164 @@ t_bool sim_shmem_atomic_cas (int32 *ptr, int32 oldv, int32 newv)
 return (InterlockedCompareExchange ((LONG volatile *) ptr, newv, oldv) == oldv);
 }
 
+struct MAPFILE {
+    HANDLE hFile;
+    HANDLE hMapping;
+    size_t size;
+    void *base;
+    t_bool shared;
+    char *name;
+    };
+
+t_stat sim_memfile_open (const char *name, size_t size, t_bool shared, MAPFILE **mfile, void **addr, t_bool *loaded)
+{
+LARGE_INTEGER FileSize;
+MAPFILE *mf;
+
+*mfile = NULL;
+*addr = NULL;
+*loaded = FALSE;
+mf = (MAPFILE *)calloc (1, sizeof (*mf));
+if (mf == NULL)
+    return SCPE_MEM;
+mf->hFile = mf->hMapping = INVALID_HANDLE_VALUE;
+mf->size = size;
+mf->shared = shared;
+mf->name = sim_filepath_parts (name, "f");
+if (mf->name == NULL) {
+    free (mf);
+    return SCPE_MEM;
+    }
+mf->hFile = CreateFileA (mf->name, GENERIC_READ | (shared ? GENERIC_WRITE : 0), FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, shared ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+if (mf->hFile == INVALID_HANDLE_VALUE) {
+    DWORD LastError = GetLastError();
+
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Can't open memory file '%s' - LastError=0x%X\n", name, (unsigned int)LastError);
+    }
+if (!GetFileSizeEx (mf->hFile, &FileSize))
+    FileSize.QuadPart = 0;
+*loaded = ((t_uint64)FileSize.QuadPart == (t_uint64)size);
+if (!*loaded) {
+    if (!shared) {
+        sim_memfile_close (mf);
+        return sim_messagef (SCPE_ARG, "Private memory file '%s' must be %u bytes long\n", name, (unsigned int)size);
+        }
+    FileSize.QuadPart = size;
+    if ((!SetFilePointerEx (mf->hFile, FileSize, NULL, FILE_BEGIN)) ||
+        (!SetEndOfFile (mf->hFile))) {
+        sim_memfile_close (mf);
+        return sim_messagef (SCPE_IOERR, "Can't size memory file '%s' to %u bytes\n", name, (unsigned int)size);
+        }
+    }
+mf->hMapping = CreateFileMappingA (mf->hFile, NULL, shared ? PAGE_READWRITE : PAGE_WRITECOPY, (DWORD)(((t_uint64)size) >> 32), (DWORD)size, NULL);
+if (mf->hMapping == NULL) {
+    DWORD LastError = GetLastError();
+
+    mf->hMapping = INVALID_HANDLE_VALUE;
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Can't CreateFileMapping of memory file '%s' - LastError=0x%X\n", name, (unsigned int)LastError);
+    }
+mf->base = MapViewOfFile (mf->hMapping, shared ? FILE_MAP_ALL_ACCESS : FILE_MAP_COPY, 0, 0, size);
+if (mf->base == NULL) {
+    DWORD LastError = GetLastError();
+
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Can't MapViewOfFile() of memory file '%s' - LastError=0x%X\n", name, (unsigned int)LastError);
+    }
+*mfile = mf;
+*addr = mf->base;
+return SCPE_OK;
+}
+
+t_stat sim_memfile_map (const char *name, t_offset size, t_bool writable, MAPFILE **mfile, void **addr, size_t *mapped)
+{
+LARGE_INTEGER FileSize;
+MAPFILE *mf;
+
+*mfile = NULL;
+*addr = NULL;
+*mapped = 0;
+mf = (MAPFILE *)calloc (1, sizeof (*mf));
+if (mf == NULL)
+    return SCPE_MEM;
+mf->hFile = mf->hMapping = INVALID_HANDLE_VALUE;
+mf->shared = writable;
+mf->name = sim_filepath_parts (name, "f");
+if (mf->name == NULL) {
+    free (mf);
+    return SCPE_MEM;
+    }
+mf->hFile = CreateFileA (mf->name, GENERIC_READ | (writable ? GENERIC_WRITE : 0), FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+if (mf->hFile == INVALID_HANDLE_VALUE) {
+    DWORD LastError = GetLastError();
+
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Can't open memory file '%s' - LastError=0x%X\n", name, (unsigned int)LastError);
+    }
+if (!GetFileSizeEx (mf->hFile, &FileSize))
+    FileSize.QuadPart = 0;
+if ((t_offset)FileSize.QuadPart < size)                 /* never extend the file */
+    size = (t_offset)FileSize.QuadPart;
+if ((size == 0) || ((t_offset)(size_t)size != size)) {
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_ARG, "Can't map %s bytes of '%s' into memory\n", (size == 0) ? "any" : "all", name);
+    }
+mf->size = (size_t)size;
+mf->hMapping = CreateFileMappingA (mf->hFile, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, (DWORD)(((t_uint64)size) >> 32), (DWORD)size, NULL);
+if (mf->hMapping == NULL) {
+    DWORD LastError = GetLastError();
+
+    mf->hMapping = INVALID_HANDLE_VALUE;
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Can't CreateFileMapping of memory file '%s' - LastError=0x%X\n", name, (unsigned int)LastError);
+    }
+mf->base = MapViewOfFile (mf->hMapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, mf->size);
+if (mf->base == NULL) {
+    DWORD LastError = GetLastError();
+
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Can't MapViewOfFile() of memory file '%s' - LastError=0x%X\n", name, (unsigned int)LastError);
+    }
+*mfile = mf;
+*addr = mf->base;
+*mapped = mf->size;
+return SCPE_OK;
+}
+
+t_stat sim_memfile_sync (MAPFILE *mfile)
+{
+if ((mfile == NULL) || (!mfile->shared))
+    return SCPE_OK;
+if (!FlushViewOfFile (mfile->base, mfile->size))
+    return sim_messagef (SCPE_IOERR, "Error flushing memory file '%s' - LastError=0x%X\n", mfile->name, (unsigned int)GetLastError ());
+return SCPE_OK;
+}
+
+void sim_memfile_close (MAPFILE *mfile)
+{
+if (mfile == NULL)
+    return;
+if (mfile->base != NULL)
+    UnmapViewOfFile (mfile->base);
+if (mfile->hMapping != INVALID_HANDLE_VALUE)
+    CloseHandle (mfile->hMapping);
+if (mfile->hFile != INVALID_HANDLE_VALUE)
+    CloseHandle (mfile->hFile);
+free (mfile->name);
+free (mfile);
+}
+
+const char *sim_memfile_name (MAPFILE *mfile)
+{
+return mfile ? mfile->name : NULL;
+}
+
+t_bool sim_memfile_shared (MAPFILE *mfile)
+{
+return mfile ? mfile->shared : FALSE;
+}
+
 #else /* !defined(_WIN32) */
 #include <unistd.h>
 int sim_set_fsize (FILE *fptr, t_addr size)
@@ -1783,6 +2206,148 @@ else
 #endif
 }
 
+#include <sys/mman.h>
+
+struct MAPFILE {
+    int fd;
+    size_t size;
+    void *base;
+    t_bool shared;
+    char *name;
+    };
+
+t_stat sim_memfile_open (const char *name, size_t size, t_bool shared, MAPFILE **mfile, void **addr, t_bool *loaded)
+{
+struct stat statb;
+MAPFILE *mf;
+
+*mfile = NULL;
+*addr = NULL;
+*loaded = FALSE;
+mf = (MAPFILE *)calloc (1, sizeof (*mf));
+if (mf == NULL)
+    return SCPE_MEM;
+mf->fd = -1;
+mf->base = MAP_FAILED;
+mf->size = size;
+mf->shared = shared;
+mf->name = sim_filepath_parts (name, "f");
+if (mf->name == NULL) {
+    free (mf);
+    return SCPE_MEM;
+    }
+mf->fd = open (mf->name, shared ? (O_RDWR | O_CREAT) : O_RDONLY, 0666);
+if (mf->fd == -1) {
+    int last_errno = errno;
+
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Can't open memory file '%s' - errno=%d - %s\n", name, last_errno, strerror (last_errno));
+    }
+if (fstat (mf->fd, &statb))
+    statb.st_size = 0;
+*loaded = ((t_uint64)statb.st_size == (t_uint64)size);
+if (!*loaded) {
+    if (!shared) {
+        sim_memfile_close (mf);
+        return sim_messagef (SCPE_ARG, "Private memory file '%s' must be %u bytes long\n", name, (unsigned int)size);
+        }
+    if (ftruncate (mf->fd, (off_t)size)) {              /* new space reads as zero */
+        sim_memfile_close (mf);
+        return sim_messagef (SCPE_IOERR, "Can't size memory file '%s' to %u bytes\n", name, (unsigned int)size);
+        }
+    }
+mf->base = mmap (NULL, size, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE, mf->fd, 0);
+if (mf->base == MAP_FAILED) {
+    int last_errno = errno;
+
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Memory file '%s' mmap() failed. errno=%d - %s\n", name, last_errno, strerror (last_errno));
+    }
+*mfile = mf;
+*addr = mf->base;
+return SCPE_OK;
+}
+
+t_stat sim_memfile_map (const char *name, t_offset size, t_bool writable, MAPFILE **mfile, void **addr, size_t *mapped)
+{
+MAPFILE *mf;
+off_t fsize;
+
+*mfile = NULL;
+*addr = NULL;
+*mapped = 0;
+mf = (MAPFILE *)calloc (1, sizeof (*mf));
+if (mf == NULL)
+    return SCPE_MEM;
+mf->fd = -1;
+mf->base = MAP_FAILED;
+mf->shared = writable;
+mf->name = sim_filepath_parts (name, "f");
+if (mf->name == NULL) {
+    free (mf);
+    return SCPE_MEM;
+    }
+mf->fd = open (mf->name, writable ? O_RDWR : O_RDONLY);
+if (mf->fd == -1) {
+    int last_errno = errno;
+
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Can't open memory file '%s' - errno=%d - %s\n", name, last_errno, strerror (last_errno));
+    }
+fsize = lseek (mf->fd, 0, SEEK_END);                    /* also sizes block devices */
+if (fsize < 0)
+    fsize = 0;
+if ((t_offset)fsize < size)                             /* never extend the file */
+    size = (t_offset)fsize;
+if ((size == 0) || ((t_offset)(size_t)size != size)) {
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_ARG, "Can't map %s bytes of '%s' into memory\n", (size == 0) ? "any" : "all", name);
+    }
+mf->size = (size_t)size;
+mf->base = mmap (NULL, mf->size, PROT_READ | (writable ? PROT_WRITE : 0), MAP_SHARED, mf->fd, 0);
+if (mf->base == MAP_FAILED) {
+    int last_errno = errno;
+
+    sim_memfile_close (mf);
+    return sim_messagef (SCPE_OPENERR, "Memory file '%s' mmap() failed. errno=%d - %s\n", name, last_errno, strerror (last_errno));
+    }
+*mfile = mf;
+*addr = mf->base;
+*mapped = mf->size;
+return SCPE_OK;
+}
+
+t_stat sim_memfile_sync (MAPFILE *mfile)
+{
+if ((mfile == NULL) || (!mfile->shared))
+    return SCPE_OK;
+if (msync (mfile->base, mfile->size, MS_SYNC))
+    return sim_messagef (SCPE_IOERR, "Error flushing memory file '%s' - %s\n", mfile->name, strerror (errno));
+return SCPE_OK;
+}
+
+void sim_memfile_close (MAPFILE *mfile)
+{
+if (mfile == NULL)
+    return;
+if (mfile->base != MAP_FAILED)
+    munmap (mfile->base, mfile->size);
+if (mfile->fd != -1)
+    close (mfile->fd);
+free (mfile->name);
+free (mfile);
+}
+
+const char *sim_memfile_name (MAPFILE *mfile)
+{
+return mfile ? mfile->name : NULL;
+}
+
+t_bool sim_memfile_shared (MAPFILE *mfile)
+{
+return mfile ? mfile->shared : FALSE;
+}
+
 #else /* !(defined (__linux__) || defined (__APPLE__)) */
 
 t_stat sim_shmem_open (const char *name, size_t size, SHMEM **shmem, void **addr)
@@ -1804,6 +2369,41 @@ t_bool sim_shmem_atomic_cas (int32 *ptr, int32 oldv, int32 newv)
 return FALSE;
 }
 
+t_stat sim_memfile_open (const char *name, size_t size, t_bool shared, MAPFILE **mfile, void **addr, t_bool *loaded)
+{
+*mfile = NULL;
+*addr = NULL;
+*loaded = FALSE;
+return sim_messagef (SCPE_NOFNC, "Memory files are not available on this host\n");
+}
+
+t_stat sim_memfile_map (const char *name, t_offset size, t_bool writable, MAPFILE **mfile, void **addr, size_t *mapped)
+{
+*mfile = NULL;
+*addr = NULL;
+*mapped = 0;
+return sim_messagef (SCPE_NOFNC, "Memory files are not available on this host\n");
+}
+
+t_stat sim_memfile_sync (MAPFILE *mfile)
+{
+return SCPE_OK;
+}
+
+void sim_memfile_close (MAPFILE *mfile)
+{
+}
+
+const char *sim_memfile_name (MAPFILE *mfile)
+{
+return NULL;
+}
+
+t_bool sim_memfile_shared (MAPFILE *mfile)
+{
+return FALSE;
+}
+
 #endif /* defined (__linux__) || defined (__APPLE__) */
 #endif /* defined (_WIN32) */
 
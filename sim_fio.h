@@ -104,11 +104,20 @@ t_bool sim_buf_pack_unpack (const void *sptr,          /* source buffer pointer
                             uint32 scount,             /* count of source elements */
                             uint32 dbits,              /* interesting bits of each destination element */
                             t_bool dLSB_o_numbering);  /* destination numbered using LSB ordering */
+size_t sim_lz4_compress (const void *src, size_t slen, void *dst, size_t dcap);
+t_bool sim_lz4_decompress (const void *src, size_t slen, void *dst, size_t dcap, size_t *dlen);
 t_stat sim_fio_test (const char *cptr);
 const char *sim_get_os_error_text (int error);
 typedef struct SHMEM SHMEM;
 t_stat sim_shmem_open (const char *name, size_t size, SHMEM **shmem, void **addr);
 void sim_shmem_close (SHMEM *shmem);
+typedef struct MAPFILE MAPFILE;
+t_stat sim_memfile_open (const char *name, size_t size, t_bool shared, MAPFILE **mfile, void **addr, t_bool *loaded);
+t_stat sim_memfile_map (const char *name, t_offset size, t_bool writable, MAPFILE **mfile, void **addr, size_t *mapped);
+t_stat sim_memfile_sync (MAPFILE *mfile);
+void sim_memfile_close (MAPFILE *mfile);
+const char *sim_memfile_name (MAPFILE *mfile);
+t_bool sim_memfile_shared (MAPFILE *mfile);
 int32 sim_shmem_atomic_add (int32 *ptr, int32 val);
 t_bool sim_shmem_atomic_cas (int32 *ptr, int32 oldv, int32 newv);
 extern int sim_check_source (int argc, char **argv);
@@ -86,6 +86,11 @@
    sim_tape_show_capac  show tape capacity
    sim_tape_set_dens    set tape density
    sim_tape_show_dens   show tape density
+   sim_tape_set_index   index SIMH and E11 images (SET <dev> INDEX)
+   sim_tape_show_index  show a unit's image index (SHOW <dev> INDEX)
+   sim_tape_set_prefetch read ahead of queued forward reads (SET <dev> PREFETCH)
+   sim_tape_show_prefetch show a unit's request queue and read ahead use
+   sim_tape_drain       complete all queued asynchronous requests
    sim_tape_error_text  the textual description of a tape status
    sim_tape_set_async   enable asynchronous operation
    sim_tape_clr_async   disable asynchronous operation
@@ -109,6 +114,13 @@
 #include <pthread.h>
 #endif
 
+#if defined (HAVE_ZLIB)
+#include <zlib.h>
+#if !defined (ZLIB_VERNUM) || (ZLIB_VERNUM < 0x1280)   /* inflateGetDictionary needs zlib 1.2.8 */
+#undef HAVE_ZLIB
+#endif
+#endif
+
 static struct sim_tape_fmt {
     const char          *name;                          /* name */
     int32               uflags;                         /* unit flags */
@@ -147,6 +159,75 @@ static t_addr sim_tape_tpc_fnd (UNIT *uptr, t_addr *map);
 static void sim_tape_data_trace (UNIT *uptr, const uint8 *data, size_t len, const char* txt, int detail, uint32 reason);
 static t_stat tape_erase_fwd (UNIT *uptr, t_mtrlnt gap_size);
 static t_stat tape_erase_rev (UNIT *uptr, t_mtrlnt gap_size);
+static t_stat sim_tape_buf_flush (UNIT *uptr);
+static struct tape_index *sim_tape_index_create (UNIT *uptr);
+static void sim_tape_index_free (struct tape_index *idx);
+static t_bool sim_tape_index_load (UNIT *uptr);
+static void sim_tape_index_close (UNIT *uptr, struct tape_index *idx, const char *filename);
+static void sim_tape_index_truncate (UNIT *uptr, t_offset pos);
+static t_bool sim_tape_index_unit_opt (UNIT *uptr);
+static t_bool sim_tape_prefetch_unit_opt (UNIT *uptr);
+struct tape_gz;
+static t_stat sim_tape_gz_attach (UNIT *uptr);
+static void sim_tape_gz_free (struct tape_gz *gz);
+static size_t sim_tape_gz_read (UNIT *uptr, t_offset pos, uint8 *buf, size_t len);
+static t_offset sim_tape_gz_size (UNIT *uptr);
+static t_offset sim_tape_size (UNIT *uptr);
+static int sim_tape_ferror (UNIT *uptr);
+
+#define MTSE_TBUF_SIZE  (1024 * 1024)           /* image window size (SIMH and E11 formats) */
+
+#if defined (HAVE_ZLIB)
+#define MTSE_GZ_SPAN    (4 * MTSE_TBUF_SIZE)    /* uncompressed bytes between access points */
+#define MTSE_GZ_WINSIZE 32768                   /* deflate history needed at an access point */
+#define MTSE_GZ_INSIZE  65536                   /* compressed data read at once */
+
+/* A place in a gzip compressed image where decompression can restart */
+
+struct tape_gz_point {
+    t_offset            out;                /* Uncompressed image offset */
+    t_offset            in;                 /* Compressed file offset of the next full byte */
+    int                 bits;               /* Bits of the byte before in not yet used */
+    uint32              wsize;              /* Bytes of history in window */
+    uint8               *window;            /* Uncompressed data preceding out */
+    };
+
+struct tape_gz {
+    z_stream            strm;               /* Decompression state */
+    t_bool              strm_ok;            /* strm initialized */
+    t_bool              raw;                /* Restarted at an access point (no gzip header) */
+    t_bool              between;            /* At the end of a gzip member */
+    uint8               *in;                /* Compressed data buffer */
+    t_offset            in_pos;             /* Compressed file offset after the buffered data */
+    t_offset            out;                /* Uncompressed offset of the stream */
+    t_offset            scanned;            /* Uncompressed data decompressed at least once */
+    t_offset            size;               /* Uncompressed image size once known */
+    t_bool              end;                /* Stream at the end of the image */
+    t_bool              size_known;         /* Decompressed through to the end */
+    t_bool              error;              /* Compressed data is corrupt or truncated */
+    struct tape_gz_point *pt;               /* Access points in image order */
+    uint32              pts;                /* Access points recorded */
+    uint32              pt_size;            /* Capacity of pt */
+    uint32              restarts;           /* Decompression restarts */
+    };
+#endif
+
+struct tape_index {
+    uint32              format;             /* MTUF_F_STD or MTUF_F_E11 */
+    t_offset            *obj;               /* Image offset of each record and tape mark */
+    uint32              objs;               /* Objects indexed */
+    uint32              obj_size;           /* Capacity of obj */
+    uint32              *tmk;               /* Object numbers of the tape marks */
+    uint32              tmks;               /* Tape marks indexed */
+    uint32              tmk_size;           /* Capacity of tmk */
+    t_offset            end;                /* Image offset just beyond the last object */
+    t_offset            length;             /* Image length (uncompressed) when saved */
+    t_bool              complete;           /* Indexed from BOT through EOM */
+    t_bool              loaded;             /* Read from the index file at attach */
+    t_bool              dirty;              /* Changed since attach */
+    t_bool              written;            /* Image written since attach */
+    uint32              hits;               /* Spacing operations done from the index */
+    };
 
 struct tape_context {
     DEVICE              *dptr;              /* Device for unit (access to debug flags) */
@@ -155,6 +236,18 @@ struct tape_context {
     uint32              chunk_buf_size;
     uint32              chunk_data_size;
     uint32              chunk_offset;
+    uint8               *tbuf;              /* Window of the image file (SIMH and E11 formats) */
+    uint32              tbuf_size;          /* Window capacity */
+    t_addr              tbuf_base;          /* File offset of tbuf[0] */
+    uint32              tbuf_len;           /* Valid bytes in the window */
+    uint32              tbuf_dlo;           /* Written bytes not yet in the file are */
+    uint32              tbuf_dhi;           /*   tbuf[tbuf_dlo] through tbuf[tbuf_dhi - 1] */
+    t_addr              tpos;               /* File position of the next read or write */
+    t_bool              teof;               /* Last read reached the end of the file */
+    uint32              tbuf_fills;         /* Window reads from the file */
+    uint32              tbuf_writes;        /* Window writes to the file */
+    struct tape_index   *index;             /* Record and tape mark offsets (SET <dev> INDEX) */
+    struct tape_gz      *gz;                /* Decompression of a gzip compressed image */
 #if defined SIM_ASYNCH_IO
     t_bool              asynch_io;          /* Asynchronous Interrupt scheduling enabled */
     int                 asynch_io_latency;  /* instructions to delay pending interrupt */
@@ -164,7 +257,41 @@ struct tape_context {
     pthread_cond_t      io_cond;
     pthread_cond_t      io_done;
     pthread_cond_t      startup_cond;
-    int                 io_top;
+    int                 io_top;             /* Request in progress */
+    struct tape_qreq    *q_head;            /* Pending requests */
+    struct tape_qreq    *q_tail;
+    struct tape_qreq    *q_done;            /* Completed requests */
+    struct tape_qreq    *q_done_tail;
+    uint32              q_active;           /* Requests pending or in progress */
+    uint32              q_max;              /* Most requests outstanding at once */
+    uint32              q_requests;         /* Requests queued */
+    t_bool              pf_enabled;         /* Read ahead (SET <dev> PREFETCH) */
+    t_bool              pf_busy;            /* Read ahead in progress */
+    t_bool              pf_valid;           /* pf_buf holds the record at pf_pos */
+    UNIT                pf_unit;            /* Copy of the unit moved by the read ahead */
+    char                *pf_uname;          /* Unit name for the read ahead's messages */
+    uint8               *pf_buf;            /* Record read ahead */
+    t_mtrlnt            pf_bc;              /* Its length */
+    t_stat              pf_status;          /*   and read status */
+    t_addr              pf_pos;             /* Position before the record */
+    t_addr              pf_end;             /* Position, */
+    t_addr              pf_eom;             /*   EOM */
+    uint32              pf_dynflags;        /*   and PNU and TAR mark state after it */
+    uint32              pf_reads;           /* Records read ahead */
+    uint32              pf_hits;            /* Records read ahead which were used */
+#endif
+    };
+#define tape_ctx up8                        /* Field in Unit structure which points to the tape_context */
+
+#if defined SIM_ASYNCH_IO
+/* Queued asynchronous request.  Any number of requests issued through
+   the _a routines may be outstanding on a unit.  The unit's I/O thread
+   performs them in the order they were issued and their callbacks are
+   called in that order in the main simulator thread. */
+
+struct tape_qreq {
+    struct tape_qreq    *next;
+    int                 top;
     uint8               *buf;
     uint32              *bc;
     uint32              *fc;
@@ -174,44 +301,30 @@ struct tape_context {
     uint32              bpi;
     uint32              *objupdate;
     TAPE_PCALLBACK      callback;
-    t_stat              io_status;
-#endif
+    t_stat              status;
     };
-#define tape_ctx up8                        /* Field in Unit structure which points to the tape_context */
 
-#if defined SIM_ASYNCH_IO
+static t_stat _tape_q_submit (UNIT *uptr, int top, uint8 *buf, uint32 *bc, uint32 *fc, uint32 max,
+                              uint32 vbc, uint32 gaplen, uint32 bpi, uint32 *objupdate, TAPE_PCALLBACK callback);
+static void _tape_q_wait (UNIT *uptr);
+static void _tape_sync (UNIT *uptr);
+
+#define AIO_SYNC(uptr) _tape_sync (uptr)
+
 #define AIO_CALLSETUP                                                   \
 struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;       \
                                                                         \
 if (ctx == NULL)                                                        \
     return sim_messagef (SCPE_IERR, "Bad Attach\n");                    \
+if ((callback == NULL) && (ctx->asynch_io)) {                           \
+    _tape_q_wait (uptr);        /* queued requests go first */          \
+    ctx->pf_valid = FALSE;      /*   and the tape may move */           \
+    }                                                                   \
 if ((callback == NULL) || !(ctx->asynch_io))
 
 #define AIO_CALL(op, _buf, _bc, _fc, _max, _vbc, _gaplen, _bpi, _obj, _callback)\
-    if (ctx->asynch_io) {                                               \
-        struct tape_context *ctx =                                      \
-                      (struct tape_context *)uptr->tape_ctx;            \
-                                                                        \
-        pthread_mutex_lock (&ctx->io_lock);                             \
-                                                                        \
-        sim_debug_unit (MTSE_DBG_INT, uptr,                             \
-      "sim_tape AIO_CALL(op=%d, unit=%d)\n", op, (int)(uptr-ctx->dptr->units));\
-                                                                        \
-        if (ctx->callback)      /* horrible mistake, stop */            \
-            SIM_SCP_ABORT ("AIO_CALL error");                           \
-        ctx->io_top = op;                                               \
-        ctx->buf = _buf;                                                \
-        ctx->bc = _bc;                                                  \
-        ctx->fc = _fc;                                                  \
-        ctx->max = _max;                                                \
-        ctx->vbc = _vbc;                                                \
-        ctx->gaplen = _gaplen;                                          \
-        ctx->bpi = _bpi;                                                \
-        ctx->objupdate = _obj;                                          \
-        ctx->callback = _callback;                                      \
-        pthread_cond_signal (&ctx->io_cond);                            \
-        pthread_mutex_unlock (&ctx->io_lock);                           \
-        }                                                               \
+    if ((ctx->asynch_io) && (_callback))                                \
+        r = _tape_q_submit (uptr, op, _buf, _bc, _fc, _max, _vbc, _gaplen, _bpi, _obj, _callback);\
     else                                                                \
         if (_callback)                                                  \
             (_callback) (uptr, r);
@@ -234,11 +347,129 @@ if ((callback == NULL) || !(ctx->asynch_io))
 #define TOP_RWND 16             /* sim_tape_rewind_a */
 #define TOP_POSN 17             /* sim_tape_position_a */
 
+static t_stat _tape_q_perform (UNIT *uptr, struct tape_qreq *req)
+{
+switch (req->top) {
+    case TOP_RDRF:
+        return sim_tape_rdrecf (uptr, req->buf, req->bc, req->max);
+    case TOP_RDRR:
+        return sim_tape_rdrecr (uptr, req->buf, req->bc, req->max);
+    case TOP_WREC:
+        return sim_tape_wrrecf (uptr, req->buf, req->vbc);
+    case TOP_WTMK:
+        return sim_tape_wrtmk (uptr);
+    case TOP_WEOM:
+        return sim_tape_wreom (uptr);
+    case TOP_WEMR:
+        return sim_tape_wreomrw (uptr);
+    case TOP_WGAP:
+        return sim_tape_wrgap (uptr, req->gaplen);
+    case TOP_SPRF:
+        return sim_tape_sprecf (uptr, req->bc);
+    case TOP_SRSF:
+        return sim_tape_sprecsf (uptr, req->vbc, req->bc);
+    case TOP_SPRR:
+        return sim_tape_sprecr (uptr, req->bc);
+    case TOP_SRSR:
+        return sim_tape_sprecsr (uptr, req->vbc, req->bc);
+    case TOP_SPFF:
+        return sim_tape_spfilef (uptr, req->vbc, req->bc);
+    case TOP_SFRF:
+        return sim_tape_spfilebyrecf (uptr, req->vbc, req->bc, req->fc, req->max);
+    case TOP_SPFR:
+        return sim_tape_spfiler (uptr, req->vbc, req->bc);
+    case TOP_SFRR:
+        return sim_tape_spfilebyrecr (uptr, req->vbc, req->bc, req->fc);
+    case TOP_RWND:
+        return sim_tape_rewind (uptr);
+    case TOP_POSN:
+        return sim_tape_position (uptr, req->vbc, req->gaplen, req->bc, req->bpi, req->fc, req->objupdate);
+    }
+return MTSE_OK;
+}
+
+/* Read ahead
+
+   With read ahead enabled, once a queued forward read completes and no
+   other request is pending, the I/O thread reads the following record
+   while the simulator digests the one just read.  The read ahead moves
+   a copy of the unit, so the unit's position and state are exactly those
+   left by the completed request.  The next request uses the record read
+   ahead if it is a forward read from the position the record was read
+   from, and otherwise discards it and proceeds normally, so a change of
+   direction, a write or any positioning sees the tape where the guest
+   left it.  Only records and tape marks are read ahead; an error or end
+   of medium is left to be found by the request itself. */
+
+static void _tape_read_ahead (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+if ((ctx->pf_uname == NULL) ||
+    ((ctx->pf_buf == NULL) &&
+     ((ctx->pf_buf = (uint8 *)malloc (MTR_MAXLEN)) == NULL)))
+    return;
+memset (&ctx->pf_unit, 0, sizeof (ctx->pf_unit));     /* only the fields the tape library owns, */
+ctx->pf_unit.flags = uptr->flags;                       /*   which the simulator thread changes only */
+ctx->pf_unit.dynflags = uptr->dynflags;                 /*   through calls that wait for this */
+ctx->pf_unit.fileref = uptr->fileref;
+ctx->pf_unit.filename = uptr->filename;
+ctx->pf_unit.filebuf = uptr->filebuf;
+ctx->pf_unit.hwmark = uptr->hwmark;
+ctx->pf_unit.capac = uptr->capac;
+ctx->pf_unit.pos = uptr->pos;
+ctx->pf_unit.recsize = uptr->recsize;
+ctx->pf_unit.tape_eom = uptr->tape_eom;
+ctx->pf_unit.tape_chunk_size = uptr->tape_chunk_size;
+ctx->pf_unit.tape_ctx = uptr->tape_ctx;
+ctx->pf_unit.dptr = uptr->dptr;
+ctx->pf_unit.dctrl = uptr->dctrl;
+ctx->pf_unit.uname = ctx->pf_uname;
+ctx->pf_pos = uptr->pos;
+ctx->pf_status = sim_tape_rdrecf (&ctx->pf_unit, ctx->pf_buf, &ctx->pf_bc, MTR_MAXLEN);
+if ((ctx->pf_status != MTSE_OK) && (ctx->pf_status != MTSE_TMK))
+    return;
+ctx->pf_end = ctx->pf_unit.pos;
+ctx->pf_eom = ctx->pf_unit.tape_eom;
+ctx->pf_dynflags = ctx->pf_unit.dynflags & (UNIT_TAPE_PNU | UNIT_TAPE_MRK);
+ctx->pf_valid = TRUE;
+++ctx->pf_reads;
+sim_debug_unit (MTSE_DBG_INT, uptr, "_tape_read_ahead(unit=%d) read %d bytes at %" T_ADDR_FMT "u\n", (int)(uptr-ctx->dptr->units), ctx->pf_bc, ctx->pf_pos);
+}
+
+/* Complete a request from the record read ahead, if it can be */
+
+static t_bool _tape_read_ahead_used (UNIT *uptr, struct tape_qreq *req)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+if (!ctx->pf_valid)
+    return FALSE;
+ctx->pf_valid = FALSE;
+if ((req->top != TOP_RDRF) ||                           /* not a forward read */
+    (uptr->pos != ctx->pf_pos) ||                       /*   from where the record was read, */
+    (ctx->pf_bc > req->max) ||                          /*   with room for it */
+    (uptr->tape_chunk_size != 0)) {
+    sim_debug_unit (MTSE_DBG_INT, uptr, "_tape_read_ahead_used(unit=%d, top=%d) discarded\n", (int)(uptr-ctx->dptr->units), req->top);
+    return FALSE;
+    }
+memcpy (req->buf, ctx->pf_buf, ctx->pf_bc);
+*req->bc = ctx->pf_bc;
+uptr->pos = ctx->pf_end;
+uptr->tape_eom = ctx->pf_eom;
+uptr->dynflags = (uptr->dynflags & ~(UNIT_TAPE_PNU | UNIT_TAPE_MRK)) | ctx->pf_dynflags;
+req->status = ctx->pf_status;
+++ctx->pf_hits;
+return TRUE;
+}
+
 static void *
 _tape_io(void *arg)
 {
 UNIT* volatile uptr = (UNIT*)arg;
 struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_qreq *req;
+t_bool read_ahead;
 
     /* Boost Priority for this I/O thread vs the CPU instruction execution
        thread which in general won't be readily yielding the processor when
@@ -250,67 +481,39 @@ struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
     pthread_mutex_lock (&ctx->io_lock);
     pthread_cond_signal (&ctx->startup_cond);   /* Signal we're ready to go */
     while (1) {
-        pthread_cond_wait (&ctx->io_cond, &ctx->io_lock);
-        if (ctx->io_top == TOP_DONE)
+        while (ctx->asynch_io && (ctx->q_head == NULL))
+            pthread_cond_wait (&ctx->io_cond, &ctx->io_lock);
+        if ((req = ctx->q_head) == NULL)        /* stopping with nothing pending? */
             break;
+        ctx->q_head = req->next;
+        if (ctx->q_head == NULL)
+            ctx->q_tail = NULL;
+        ctx->io_top = req->top;
         pthread_mutex_unlock (&ctx->io_lock);
-        switch (ctx->io_top) {
-            case TOP_RDRF:
-                ctx->io_status = sim_tape_rdrecf (uptr, ctx->buf, ctx->bc, ctx->max);
-                break;
-            case TOP_RDRR:
-                ctx->io_status = sim_tape_rdrecr (uptr, ctx->buf, ctx->bc, ctx->max);
-                break;
-            case TOP_WREC:
-                ctx->io_status = sim_tape_wrrecf (uptr, ctx->buf, ctx->vbc);
-                break;
-            case TOP_WTMK:
-                ctx->io_status = sim_tape_wrtmk (uptr);
-                break;
-            case TOP_WEOM:
-                ctx->io_status = sim_tape_wreom (uptr);
-                break;
-            case TOP_WEMR:
-                ctx->io_status = sim_tape_wreomrw (uptr);
-                break;
-            case TOP_WGAP:
-                ctx->io_status = sim_tape_wrgap (uptr, ctx->gaplen);
-                break;
-            case TOP_SPRF:
-                ctx->io_status = sim_tape_sprecf (uptr, ctx->bc);
-                break;
-            case TOP_SRSF:
-                ctx->io_status = sim_tape_sprecsf (uptr, ctx->vbc, ctx->bc);
-                break;
-            case TOP_SPRR:
-                ctx->io_status = sim_tape_sprecr (uptr, ctx->bc);
-                break;
-            case TOP_SRSR:
-                ctx->io_status = sim_tape_sprecsr (uptr, ctx->vbc, ctx->bc);
-                break;
-            case TOP_SPFF:
-                ctx->io_status = sim_tape_spfilef (uptr, ctx->vbc, ctx->bc);
-                break;
-            case TOP_SFRF:
-                ctx->io_status = sim_tape_spfilebyrecf (uptr, ctx->vbc, ctx->bc, ctx->fc, ctx->max);
-                break;
-            case TOP_SPFR:
-                ctx->io_status = sim_tape_spfiler (uptr, ctx->vbc, ctx->bc);
-                break;
-            case TOP_SFRR:
-                ctx->io_status = sim_tape_spfilebyrecr (uptr, ctx->vbc, ctx->bc, ctx->fc);
-                break;
-            case TOP_RWND:
-                ctx->io_status = sim_tape_rewind (uptr);
-                break;
-            case TOP_POSN:
-                ctx->io_status = sim_tape_position (uptr, ctx->vbc, ctx->gaplen, ctx->bc, ctx->bpi, ctx->fc, ctx->objupdate);
-                break;
-            }
+        if (!_tape_read_ahead_used (uptr, req))
+            req->status = _tape_q_perform (uptr, req);
         pthread_mutex_lock (&ctx->io_lock);
+        req->next = NULL;
+        if (ctx->q_done_tail)
+            ctx->q_done_tail->next = req;
+        else
+            ctx->q_done = req;
+        ctx->q_done_tail = req;
+        --ctx->q_active;
         ctx->io_top = TOP_DONE;
-        pthread_cond_signal (&ctx->io_done);
+        read_ahead = ctx->pf_enabled && ctx->asynch_io && (ctx->q_head == NULL) &&
+                     (req->top == TOP_RDRF) && ((req->status == MTSE_OK) || (req->status == MTSE_TMK)) &&
+                     (uptr->tape_chunk_size == 0);
+        ctx->pf_busy = read_ahead;
+        pthread_cond_broadcast (&ctx->io_done);
         sim_activate (uptr, ctx->asynch_io_latency);
+        if (read_ahead) {
+            pthread_mutex_unlock (&ctx->io_lock);
+            _tape_read_ahead (uptr);
+            pthread_mutex_lock (&ctx->io_lock);
+            ctx->pf_busy = FALSE;
+            pthread_cond_broadcast (&ctx->io_done);
+            }
     }
     pthread_mutex_unlock (&ctx->io_lock);
 
@@ -319,37 +522,93 @@ struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
     return NULL;
 }
 
+static t_stat _tape_q_submit (UNIT *uptr, int top, uint8 *buf, uint32 *bc, uint32 *fc, uint32 max,
+                              uint32 vbc, uint32 gaplen, uint32 bpi, uint32 *objupdate, TAPE_PCALLBACK callback)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_qreq *req = (struct tape_qreq *)calloc (1, sizeof (*req));
+
+if (req == NULL)
+    return SCPE_MEM;
+req->top = top;
+req->buf = buf;
+req->bc = bc;
+req->fc = fc;
+req->max = max;
+req->vbc = vbc;
+req->gaplen = gaplen;
+req->bpi = bpi;
+req->objupdate = objupdate;
+req->callback = callback;
+pthread_mutex_lock (&ctx->io_lock);
+sim_debug_unit (MTSE_DBG_INT, uptr, "sim_tape AIO_CALL(op=%d, unit=%d, queued=%d)\n", top, (int)(uptr-ctx->dptr->units), ctx->q_active);
+if (ctx->q_tail)
+    ctx->q_tail->next = req;
+else
+    ctx->q_head = req;
+ctx->q_tail = req;
+++ctx->q_requests;
+if (++ctx->q_active > ctx->q_max)
+    ctx->q_max = ctx->q_active;
+pthread_cond_signal (&ctx->io_cond);
+pthread_mutex_unlock (&ctx->io_lock);
+return SCPE_OK;
+}
+
+/* Wait until the I/O thread has performed every queued request and
+   finished any read ahead */
+
+static void _tape_q_wait (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+pthread_mutex_lock (&ctx->io_lock);
+while ((ctx->q_active != 0) || ctx->pf_busy)
+    pthread_cond_wait (&ctx->io_done, &ctx->io_lock);
+pthread_mutex_unlock (&ctx->io_lock);
+}
+
+/* A synchronous call from the simulator thread waits for the queued
+   requests and the read ahead, since it moves the tape from wherever they
+   leave it.  The I/O thread's own calls, which perform those requests and
+   the read ahead, go straight through. */
+
+static void _tape_sync (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+if ((ctx == NULL) || !ctx->asynch_io || pthread_equal (pthread_self (), ctx->io_thread))
+    return;
+_tape_q_wait (uptr);
+ctx->pf_valid = FALSE;
+}
+
 /* This routine is called in the context of the main simulator thread before
    processing events for any unit. It is only called when an asynchronous
    thread has called sim_activate() to activate a unit.  The job of this
    routine is to put the unit in proper condition to digest what may have
    occurred in the asynchronous thread.
 
-   Since tape processing only handles a single I/O at a time to a
-   particular tape device, we have the opportunity to possibly detect
-   improper attempts to issue multiple concurrent I/O requests. */
+   The callbacks of all of the requests completed since the last call
+   are called, in the order the requests were issued. */
 static void _tape_completion_dispatch (UNIT *uptr)
 {
 struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
-TAPE_PCALLBACK callback = ctx->callback;
-
-sim_debug_unit (MTSE_DBG_INT, uptr, "_tape_completion_dispatch(unit=%d, top=%d, callback=%p)\n", (int)(uptr-ctx->dptr->units), ctx->io_top, ctx->callback);
-
-if (ctx->io_top != TOP_DONE)
-    SIM_SCP_ABORT ("_tape_completion_dispatch()"); /* horribly wrong, stop */
+struct tape_qreq *req, *next;
 
+if (ctx == NULL)                                /* detached since completing? */
+    return;
 if (ctx->asynch_io)
     pthread_mutex_lock (&ctx->io_lock);
-
-if (ctx->callback) {
-    ctx->callback = NULL;
-    if (ctx->asynch_io)
-        pthread_mutex_unlock (&ctx->io_lock);
-    callback (uptr, ctx->io_status);
-    }
-else {
-    if (ctx->asynch_io)
-        pthread_mutex_unlock (&ctx->io_lock);
+req = ctx->q_done;
+ctx->q_done = ctx->q_done_tail = NULL;
+if (ctx->asynch_io)
+    pthread_mutex_unlock (&ctx->io_lock);
+for ( ; req != NULL; req = next) {
+    next = req->next;
+    sim_debug_unit (MTSE_DBG_INT, uptr, "_tape_completion_dispatch(unit=%d, top=%d, status=%d, callback=%p)\n", (int)(uptr-ctx->dptr->units), req->top, req->status, req->callback);
+    req->callback (uptr, req->status);
+    free (req);
     }
 }
 
@@ -358,8 +617,8 @@ static t_bool _tape_is_active (UNIT *uptr)
 struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 
 if (ctx) {
-    sim_debug_unit (MTSE_DBG_INT, uptr, "_tape_is_active(unit=%d, top=%d)\n", (int)(uptr-ctx->dptr->units), ctx->io_top);
-    return (ctx->io_top != TOP_DONE);
+    sim_debug_unit (MTSE_DBG_INT, uptr, "_tape_is_active(unit=%d, top=%d, queued=%d)\n", (int)(uptr-ctx->dptr->units), ctx->io_top, ctx->q_active);
+    return (ctx->q_active != 0);
     }
 return FALSE;
 }
@@ -369,17 +628,14 @@ static t_bool _tape_cancel (UNIT *uptr)
 struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 
 if (ctx) {
-    sim_debug_unit (MTSE_DBG_INT, uptr, "_tape_cancel(unit=%d, top=%d)\n", (int)(uptr-ctx->dptr->units), ctx->io_top);
-    if (ctx->asynch_io) {
-        pthread_mutex_lock (&ctx->io_lock);
-        while (ctx->io_top != TOP_DONE)
-            pthread_cond_wait (&ctx->io_done, &ctx->io_lock);
-        pthread_mutex_unlock (&ctx->io_lock);
-        }
+    sim_debug_unit (MTSE_DBG_INT, uptr, "_tape_cancel(unit=%d, top=%d, queued=%d)\n", (int)(uptr-ctx->dptr->units), ctx->io_top, ctx->q_active);
+    if (ctx->asynch_io)
+        _tape_q_wait (uptr);
     }
 return FALSE;
 }
 #else
+#define AIO_SYNC(uptr)
 #define AIO_CALLSETUP                                                       \
     if (uptr->tape_ctx == NULL)                                             \
         return sim_messagef (SCPE_IERR, "Bad Attach\n");
@@ -449,19 +705,60 @@ typedef struct HDR4 {       /* Also EOF4, EOV4 */
     char unused[11];
     } HDR4;
 
+/* Tapes made from host files (ANSI, FIXED and DOS11) are generated as they
+   are read.  Labels are kept in a small pool while file data records are
+   described only by their host file offset and are produced again from
+   the host file whenever they are read. */
+
 typedef struct TAPE_RECORD {
-    uint32 size;
-    uint8 data[1];
+    t_offset offset;        /* label pool offset or host file offset of the data */
+    uint32 size;            /* record size (0 for a tape mark) */
+    uint32 source;          /* 0 for a label, else 1 + source index and state */
     } TAPE_RECORD;
 
+#define TAPE_SRC_MASK       0x7FFFFFFF  /* source index */
+#define TAPE_SRC_CRLAST     0x80000000  /* DOS11 text: CR preceded this record */
+#define TAPE_NO_REC         0xFFFFFFFF
+
+typedef struct TAPE_SOURCE {
+    char *filename;         /* host file path */
+    const char *name;       /* file name part of the path */
+    time_t ctime;           /* DOS11 creation date */
+    t_bool text;            /* text file (else binary) */
+    t_bool crlf;            /* text with CRLF line endings */
+    size_t rms_record_size; /* longest line (or 512 for binary files) */
+    size_t max_record_size; /* ANSI record size */
+    } TAPE_SOURCE;
+
 typedef struct MEMORY_TAPE {
     uint32 ansi_type;       /* ANSI-VMS, ANSI-RT11, ANSI-RSTS, ANSI-RSX11, etc. */
-    uint32 file_count;      /* number of labeled files */
-    uint32 record_count;    /* number of entries in the record array */
+    uint32 file_count;      /* number of files on the tape */
+    uint32 record_count;    /* number of records generated so far */
     uint32 array_size;      /* allocated size of records array */
     uint32 block_size;      /* tape block size */
-    TAPE_RECORD **records;
+    TAPE_RECORD *records;
     VOL1 vol1;
+    uint32 format;          /* MTUF_F_ANSI, MTUF_F_FIXED or MTUF_F_DOS11 */
+    t_bool verbose;         /* report each ANSI file as it is generated */
+    t_bool ebcdic;          /* FIXED text records are translated to EBCDIC */
+    TAPE_SOURCE *sources;   /* host files in tape order */
+    uint32 source_size;     /* allocated size of sources array */
+    uint8 *labels;          /* label record pool */
+    size_t label_len;       /* bytes used in the label pool */
+    size_t label_size;      /* allocated size of the label pool */
+    t_bool complete;        /* all records have been generated */
+    uint32 gen_source;      /* next source to start generating */
+    FILE *gen_f;            /* source file currently being generated */
+    t_bool gen_crlast;      /* DOS11 text: last character was a CR */
+    uint32 gen_blocks;      /* data blocks generated for the current file */
+    HDR1 hdr1;              /* labels of the current ANSI file */
+    HDR2 hdr2;
+    HDR3 hdr3;
+    HDR4 hdr4;
+    FILE *read_f;           /* source file used to produce record data */
+    uint32 read_source;     /* index of the source open on read_f */
+    uint8 *data;            /* data of the most recently produced record */
+    uint32 data_rec;        /* record held in data (TAPE_NO_REC if none) */
     } MEMORY_TAPE;
 
 const char HDR3_RMS_STREAM[] = "HDR3020002040000"
@@ -517,8 +814,11 @@ static struct ansi_tape_parameters {
 
 
 static MEMORY_TAPE *ansi_create_tape (const char *label, uint32 block_size, uint32 ansi_type);
-static MEMORY_TAPE *memory_create_tape (void);
+static MEMORY_TAPE *memory_create_tape (uint32 format);
 static void memory_free_tape (void *vtape);
+static t_bool memory_tape_add_source (MEMORY_TAPE *tape, const char *filename, const char *name);
+static t_bool memory_tape_generated (UNIT *uptr, uint32 rec);
+static uint8 *memory_tape_record_data (MEMORY_TAPE *tape, uint32 rec);
 static void sim_tape_add_ansi_entry (const char *directory,
                                      const char *filename,
                                      t_offset FileSize,
@@ -560,7 +860,10 @@ pthread_attr_t attr;
 
 ctx->asynch_io = sim_asynch_enabled;
 ctx->asynch_io_latency = latency;
+ctx->pf_enabled = sim_tape_prefetch_unit_opt (uptr);
 if (ctx->asynch_io) {
+    free (ctx->pf_uname);
+    ctx->pf_uname = strdup (sim_uname (uptr));
     pthread_mutex_init (&ctx->io_lock, NULL);
     pthread_cond_init (&ctx->io_cond, NULL);
     pthread_cond_init (&ctx->io_done, NULL);
@@ -603,10 +906,30 @@ if (ctx->asynch_io) {
     pthread_cond_destroy (&ctx->io_cond);
     pthread_cond_destroy (&ctx->io_done);
     }
+free (ctx->pf_uname);
+ctx->pf_uname = NULL;
 return SCPE_OK;
 #endif
 }
 
+/* Wait for outstanding queued requests and call their callbacks */
+
+t_stat sim_tape_drain (UNIT *uptr)
+{
+#if defined (SIM_ASYNCH_IO)
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+if (ctx == NULL)
+    return SCPE_OK;
+do {
+    if (ctx->asynch_io)
+        _tape_q_wait (uptr);
+    _tape_completion_dispatch (uptr);                   /* callbacks may queue more */
+    } while (ctx->q_active != 0);
+#endif
+return SCPE_OK;
+}
+
 t_stat sim_tape_set_chunk_mode (UNIT *uptr, uint32 chunk_size)
 {
 uptr->tape_chunk_size = chunk_size;
@@ -626,8 +949,11 @@ sim_tape_clr_async (uptr);
 if (sim_asynch_enabled)
     sim_tape_set_async (uptr, ctx->asynch_io_latency);
 #endif
-if (MT_GET_FMT (uptr) < MTUF_F_ANSI)
+if (MT_GET_FMT (uptr) < MTUF_F_ANSI) {
+    if (sim_tape_buf_flush (uptr) != SCPE_OK)           /* write collected data */
+        sim_tape_ioerr (uptr);
     fflush (uptr->fileref);
+    }
 }
 
 static const char *_sim_tape_format_name (UNIT *uptr)
@@ -732,14 +1058,9 @@ switch (MT_GET_FMT (uptr)) {
                 }
             if ((tape->file_count > 0) && (file_errors == 0)) {
                 r = SCPE_OK;
-                memory_tape_add_block (tape, NULL, 0);  /* Tape Mark */
-                /* RT-11 and RSTS write three tape marks at the end of an ANSI volume */
-                /* RSX-11 and VMS do not, but there is no harm in the extra tape mark */
-                memory_tape_add_block (tape, NULL, 0);  /* Tape Mark */
                 uptr->flags |= UNIT_ATT;
                 uptr->filename = (char *)malloc (strlen (ocptr) + 1);
                 strcpy (uptr->filename, ocptr);
-                uptr->tape_eom = tape->record_count;
                 }
             else {
                 r = SCPE_ARG;
@@ -757,28 +1078,9 @@ switch (MT_GET_FMT (uptr)) {
             size_t max_record_size;
             t_bool lf_line_endings;
             t_bool crlf_line_endings;
-            uint8 *block = NULL;
-            int error = FALSE;
-            static const uint8 ascii2ebcdic[128] = {
-                0000,0001,0002,0003,0067,0055,0056,0057,
-                0026,0005,0045,0013,0014,0015,0016,0017,
-                0020,0021,0022,0023,0074,0075,0062,0046,
-                0030,0031,0077,0047,0034,0035,0036,0037,
-                0100,0117,0177,0173,0133,0154,0120,0175,
-                0115,0135,0134,0116,0153,0140,0113,0141,
-                0360,0361,0362,0363,0364,0365,0366,0367,
-                0370,0371,0172,0136,0114,0176,0156,0157,
-                0174,0301,0302,0303,0304,0305,0306,0307,
-                0310,0311,0321,0322,0323,0324,0325,0326,
-                0327,0330,0331,0342,0343,0344,0345,0346,
-                0347,0350,0351,0112,0340,0132,0137,0155,
-                0171,0201,0202,0203,0204,0205,0206,0207,
-                0210,0211,0221,0222,0223,0224,0225,0226,
-                0227,0230,0231,0242,0243,0244,0245,0246,
-                0247,0250,0251,0300,0152,0320,0241,0007};
 
             memset (&statb, 0, sizeof (statb));
-            tape = memory_create_tape ();
+            tape = memory_create_tape (MTUF_F_FIXED);
             uptr->fileref = (FILE *)tape;
             if (uptr->fileref == NULL)
                 return SCPE_MEM;
@@ -794,69 +1096,33 @@ switch (MT_GET_FMT (uptr)) {
                 }
             r = SCPE_OK;
             tape_classify_file_contents (f, &max_record_size, &lf_line_endings, &crlf_line_endings);
+            fclose (f);
             if (!lf_line_endings && !crlf_line_endings) {       /* binary file? */
                 if (uptr->recsize == 0)
                     uptr->recsize = 512;
                 if ((statb.st_size % uptr->recsize) != 0) {
                     r = sim_messagef (SCPE_ARG, "Binary file data is not a multiple of the specified record size (%d)\n", (int)uptr->recsize);
-                    fclose (f);
                     break;
                     }
-                tape->block_size = uptr->recsize;
-                block = (uint8 *)malloc (tape->block_size);
-                while (!feof (f) && !error) {
-                    size_t data_read = fread (block, 1, tape->block_size, f);
-                    if (data_read == tape->block_size)
-                        error = memory_tape_add_block (tape, block, tape->block_size);
-                    else {
-                        if (data_read != 0) {
-                            r = sim_messagef (SCPE_ARG, "Read %u bytes of data when expecting %u bytes\n", (uint32)data_read, (uint32)tape->block_size);
-                            error = TRUE;
-                            }
-                        }
-                    }
                 }
             else {                                              /* text file */
                 if (uptr->recsize == 0)
                     uptr->recsize = max_record_size;
                 if (uptr->recsize < max_record_size) {
                     r = sim_messagef (SCPE_ARG, "Text file: %s has lines longer than %d.  Max Line Size: %d\n", cptr, (int)uptr->recsize, (int)max_record_size);
-                    fclose (f);
                     break;
                     }
-                tape->block_size = uptr->recsize;
-                block = (uint8 *)calloc (1, tape->block_size + 3);
-                while (!feof (f) && !error) {
-                    if (fgets ((char *)block, (int)(tape->block_size + 3), f)) {
-                        size_t len = strlen ((char *)block);
-
-                        while ((len > 0) &&
-                               ((block[len - 1] == '\r') || (block[len - 1] == '\n')))
-                            --len;
-                        memset (block + len, ' ', tape->block_size - len);
-                        if (sim_switches & SWMASK ('C')) {
-                            uint32 i;
-
-                            for (i = 0; i < tape->block_size; i++)
-                                block[i] = ascii2ebcdic[block[i]];
-                            }
-                        error = memory_tape_add_block (tape, block, tape->block_size);
-                        }
-                    else
-                        error = ferror (f);
-                    }
                 }
-            free (block);
-            fclose (f);
-            if (error)
-                r = sim_messagef (SCPE_IERR, "Error processing input file %s\n", cptr);
+            tape->block_size = uptr->recsize;
+            if (memory_tape_add_source (tape, cptr, cptr))
+                r = sim_messagef (SCPE_MEM, "Error processing input file %s\n", cptr);
             else {
-                memory_tape_add_block (tape, NULL, 0);  /* Tape Mark */
-                memory_tape_add_block (tape, NULL, 0);  /* Tape Mark */
+                tape->sources[0].text = (lf_line_endings || crlf_line_endings);
+                tape->sources[0].crlf = crlf_line_endings;
+                tape->sources[0].rms_record_size = max_record_size;
                 uptr->flags |= UNIT_ATT;
                 uptr->filename = (char *)malloc (strlen (cptr) + 1);
                 strcpy (uptr->filename, cptr);
-                uptr->tape_eom = tape->record_count;
                 }
             }
         break;
@@ -868,11 +1134,11 @@ switch (MT_GET_FMT (uptr)) {
 
             uptr->recsize = 512;
 
-            tape = memory_create_tape();
-            tape->block_size = uptr->recsize;
+            tape = memory_create_tape (MTUF_F_DOS11);
             uptr->fileref = (FILE *)tape;
             if (uptr->fileref == NULL)
                 return SCPE_MEM;
+            tape->block_size = uptr->recsize;
 
             while (*cptr != 0) {
                 uint32 initial_file_count = tape->file_count;
@@ -887,14 +1153,9 @@ switch (MT_GET_FMT (uptr)) {
 
             if ((tape->file_count > 0) && (file_errors == 0)) {
                 r = SCPE_OK;
-                memory_tape_add_block (tape, NULL, 0); /* Tape Mark */
-                /* RSX-11 and RSTS write three tape marks at the end of a DOS volume */
-                /* VMS does not, but there is no harm in the extra tape mark         */
-                memory_tape_add_block (tape, NULL, 0); /* Tape Mark */
                 uptr->flags |= UNIT_ATT;
                 uptr->filename = (char *)malloc (strlen (ocptr) + 1);
                 strcpy (uptr->filename, ocptr);
-                uptr->tape_eom = tape->record_count;
                 }
             else {
                 r = SCPE_ARG;
@@ -942,10 +1203,25 @@ uptr->tape_ctx = ctx = (struct tape_context *)calloc(1, sizeof(struct tape_conte
 ctx->dptr = dptr;                                       /* save DEVICE pointer */
 uptr->dctrl = dbit;                                     /* save debug bit(s) */
 ctx->auto_format = auto_format;                         /* save that we auto selected format */
+if ((MT_GET_FMT (uptr) == MTUF_F_STD) ||                /* windowed image access? */
+    (MT_GET_FMT (uptr) == MTUF_F_E11)) {
+    ctx->tbuf = (uint8 *)malloc (MTSE_TBUF_SIZE);
+    ctx->tbuf_size = (ctx->tbuf != NULL) ? MTSE_TBUF_SIZE : 0;
+    if (sim_tape_index_unit_opt (uptr))                 /* indexed? */
+        ctx->index = sim_tape_index_create (uptr);
+    }
+if ((MT_GET_FMT (uptr) < MTUF_F_ANSI) &&                /* on-disk image which */
+    (MT_GET_FMT (uptr) != MTUF_F_TAR)) {                /*   might be compressed? */
+    r = sim_tape_gz_attach (uptr);
+    if (r != SCPE_OK)
+        sim_tape_detach (uptr);
+    }
 
 switch (MT_GET_FMT (uptr)) {                            /* case on format */
 
     case MTUF_F_TPC:                                    /* TPC */
+        if (r != SCPE_OK)                               /* compressed image unusable? */
+            break;
         objc = sim_tape_tpc_map (uptr, NULL, 0);        /* get # objects */
         if (objc == 0) {                                /* tape empty? */
             sim_tape_detach (uptr);
@@ -970,7 +1246,14 @@ switch (MT_GET_FMT (uptr)) {                            /* case on format */
 
 if (r == SCPE_OK) {
 
-    sim_tape_validate_tape (uptr);
+    if ((MT_GET_FMT (uptr) >= MTUF_F_ANSI) &&           /* generated tape without */
+        !(sim_switches & (SWMASK ('V') | SWMASK ('L'))))/*   a requested report? */
+        sim_messagef (SCPE_OK, "%s: Tape Image made from '%s' will be generated as %s format as it is read\n",
+                               sim_uname (uptr), uptr->filename, _sim_tape_format_name (uptr));
+    else {
+        if (!sim_tape_index_load (uptr))                /* no current index file? */
+            sim_tape_validate_tape (uptr);
+        }
 
     sim_tape_rewind (uptr);
 
@@ -994,6 +1277,8 @@ return r;
 t_stat sim_tape_detach (UNIT *uptr)
 {
 struct tape_context *ctx;
+struct tape_index *idx;
+char *filename;
 uint32 f;
 t_bool auto_format = FALSE;
 
@@ -1035,20 +1320,41 @@ uptr->tape_eom = 0;
 uptr->pos = 0;
 MT_CLR_PNU (uptr);
 MT_CLR_INMRK (uptr);                                    /* Not within a TAR tapemark */
+idx = ctx->index;
+if ((idx != NULL) && idx->complete && idx->dirty)       /* index to be saved? */
+    idx->length = sim_tape_size (uptr);
+#if defined (SIM_ASYNCH_IO)
+while (ctx->q_done != NULL) {                           /* completed, but never dispatched */
+    struct tape_qreq *req = ctx->q_done;
+
+    ctx->q_done = req->next;
+    free (req);
+    }
+free (ctx->pf_buf);
+#endif
 free (ctx->chunk_buf);
+free (ctx->tbuf);
+sim_tape_gz_free (ctx->gz);
 free (uptr->tape_ctx);
 uptr->tape_ctx = NULL;
 uptr->io_flush = NULL;
 uptr->flags = uptr->flags & ~(UNIT_ATT | ((uptr->flags & UNIT_ROABLE) ? UNIT_RO : 0));
-free (uptr->filename);
+filename = uptr->filename;
 uptr->filename = NULL;
 if (uptr->fileref) {                        /* Only close open file */
     if (fclose (uptr->fileref) == EOF) {
         uptr->fileref = NULL;
+        sim_tape_index_free (idx);
+        free (filename);
         return SCPE_IOERR;
         }
     uptr->fileref = NULL;
     }
+if (idx != NULL) {                          /* save or drop the image's index file */
+    sim_tape_index_close (uptr, idx, filename);
+    sim_tape_index_free (idx);
+    }
+free (filename);
 uptr->dynflags &= ~UNIT_NO_FIO;
 if (auto_format)    /* format was determined or specified at attach time? */
     sim_tape_set_fmt (uptr, 0, "SIMH", NULL);   /* restore default format */
@@ -1115,6 +1421,10 @@ fprintf (st, "        placed in an otherwise unused word in the header which som
 fprintf (st, "        operating systems will be able to process. If the resulting\n");
 fprintf (st, "        filename is NULL, a filename in the range 000000 - 999999 will be\n");
 fprintf (st, "        generated based of the file position on the tape.\n\n");
+fprintf (st, "        A SIMH, E11, TPC, P7B or AWS format tape image which has been\n");
+fprintf (st, "        compressed with gzip (for example tape.tap.gz) can be attached\n");
+fprintf (st, "        directly.  It is read as it is decompressed and the unit is write\n");
+fprintf (st, "        protected.\n\n");
 fprintf (st, "Examples:\n\n");
 fprintf (st, "  sim> ATTACH %s -F ANSI-VMS Hobbyist-USE-ONLY-VA.TXT\n", dptr->name);
 fprintf (st, "  sim> ATTACH %s -F ANSI-RSX11 *.TXT,*.ini,*.exe\n", dptr->name);
@@ -1135,88 +1445,1033 @@ if (sim_deb && ((uptr->dctrl | ctx->dptr->dctrl) & reason))
     sim_data_trace(ctx->dptr, uptr, (detail ? data : NULL), "", len, txt, reason);
 }
 
+/* Buffered image file access
+
+   SIMH and E11 format images are read and written through a window of
+   the file held in memory.  The separate reads of a record's leading
+   length, data and trailing length, and the seeks between them, are then
+   copies from the window, which is refilled forward from the position
+   being read, or so that it ends there when reading in reverse.  Writes
+   are collected in the window until it has to move or the image is
+   flushed.  Gzip compressed images (of any on-disk format) are also read
+   through the window, which is then filled by decompressing the image.
+   The routines below stand in for sim_fseek, sim_fread, sim_fwrite, feof,
+   ferror and sim_ftell on the image file; for other formats they pass
+   straight through to them. */
+
+static t_stat sim_tape_buf_flush (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+uint32 lo, bytes;
+
+if ((ctx == NULL) || (ctx->tbuf_dhi == ctx->tbuf_dlo))  /* nothing written? */
+    return SCPE_OK;
+lo = ctx->tbuf_dlo;
+bytes = ctx->tbuf_dhi - lo;
+ctx->tbuf_dlo = ctx->tbuf_dhi = 0;
+++ctx->tbuf_writes;
+if ((sim_fseek (uptr->fileref, ctx->tbuf_base + lo, SEEK_SET) != 0) ||
+    (sim_fwrite (ctx->tbuf + lo, 1, bytes, uptr->fileref) != bytes)) {
+    ctx->tbuf_len = 0;                                  /* window no longer matches the file */
+    return SCPE_IOERR;
+    }
+return SCPE_OK;
+}
+
 static int sim_tape_seek (UNIT *uptr, t_addr pos)
 {
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+if ((ctx != NULL) && (ctx->tbuf != NULL)) {
+    ctx->tpos = pos;
+    ctx->teof = FALSE;
+    return 0;
+    }
 if (MT_GET_FMT (uptr) < MTUF_F_ANSI)
     return sim_fseek (uptr->fileref, pos, SEEK_SET);
 return 0;
 }
 
-static t_offset sim_tape_size (UNIT *uptr)
+static size_t sim_tape_image_read (UNIT *uptr, t_addr pos, void *buf, size_t bytes)
 {
-if (MT_GET_FMT (uptr) < MTUF_F_ANSI)
-    return sim_fsize_ex (uptr->fileref); /* True on-disk tape images: file size  */
-return uptr->tape_eom;                   /* Virtual tape images: record/TM count */
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+if (ctx->gz != NULL)
+    return sim_tape_gz_read (uptr, (t_offset)pos, (uint8 *)buf, bytes);
+if (sim_fseek (uptr->fileref, pos, SEEK_SET) != 0)
+    return 0;
+return sim_fread (buf, 1, bytes, uptr->fileref);
 }
 
-/* Read record length forward (internal routine).
+static size_t sim_tape_fread (UNIT *uptr, void *bptr, size_t size, size_t count)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+size_t bytes = size * count;
+size_t avail;
+
+if ((ctx == NULL) || (ctx->tbuf == NULL))
+    return sim_fread (bptr, size, count, uptr->fileref);
+if ((bytes == 0) || (ctx->tbuf_len == 0) ||             /* not all in the window? */
+    (ctx->tpos < ctx->tbuf_base) ||
+    (ctx->tpos + bytes > ctx->tbuf_base + ctx->tbuf_len)) {
+    if (sim_tape_buf_flush (uptr) != SCPE_OK)
+        return 0;
+    if (bytes > ctx->tbuf_size / 2) {                   /* too big to be worth windowing? */
+        avail = sim_tape_image_read (uptr, ctx->tpos, bptr, bytes);
+        ctx->tpos += avail;
+        ctx->teof = (avail < bytes);
+        count = avail / size;
+        if (!sim_end && (size > sizeof (char)) && (count > 0))
+            sim_buf_swap_data (bptr, size, count);
+        return count;
+        }
+    if ((ctx->tpos < ctx->tbuf_base) &&                 /* moving backward through the image? */
+        (ctx->tpos + ctx->tbuf_size > ctx->tbuf_base))
+        ctx->tbuf_base = (ctx->tpos + bytes > ctx->tbuf_size) ? ctx->tpos + bytes - ctx->tbuf_size : 0;
+    else
+        ctx->tbuf_base = ctx->tpos;
+    ctx->tbuf_len = (uint32)sim_tape_image_read (uptr, ctx->tbuf_base, ctx->tbuf, ctx->tbuf_size);
+    ++ctx->tbuf_fills;
+    if (sim_tape_ferror (uptr))
+        return 0;
+    }
+avail = (ctx->tpos >= ctx->tbuf_base + ctx->tbuf_len) ? 0 : (size_t)(ctx->tbuf_base + ctx->tbuf_len - ctx->tpos);
+if (avail > bytes)
+    avail = bytes;
+memcpy (bptr, ctx->tbuf + (size_t)(ctx->tpos - ctx->tbuf_base), avail);
+ctx->tpos += avail;
+ctx->teof = (avail < bytes);
+count = avail / size;
+if (!sim_end && (size > sizeof (char)) && (count > 0))
+    sim_buf_swap_data (bptr, size, count);
+return count;
+}
 
-   Inputs:
-        uptr    =       pointer to tape unit
-        bc      =       pointer to returned record length
+static size_t sim_tape_fwrite (UNIT *uptr, const void *bptr, size_t size, size_t count)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+size_t bytes = size * count;
+uint32 off;
+
+if ((ctx != NULL) && (ctx->index != NULL))
+    sim_tape_index_truncate (uptr, (ctx->tbuf != NULL) ? (t_offset)ctx->tpos : sim_ftell (uptr->fileref));
+if ((ctx == NULL) || (ctx->tbuf == NULL))
+    return sim_fwrite (bptr, size, count, uptr->fileref);
+if ((ctx->tpos < ctx->tbuf_base) ||                     /* not within or just after the window's data? */
+    (ctx->tpos > ctx->tbuf_base + ctx->tbuf_len) ||
+    (ctx->tpos + bytes > ctx->tbuf_base + ctx->tbuf_size)) {
+    if (sim_tape_buf_flush (uptr) != SCPE_OK)
+        return 0;
+    ctx->tbuf_base = ctx->tpos;                         /* start a new window here */
+    ctx->tbuf_len = 0;
+    if (bytes > ctx->tbuf_size) {                       /* bigger than the window? */
+        if (sim_fseek (uptr->fileref, ctx->tpos, SEEK_SET) != 0)
+            return 0;
+        count = sim_fwrite (bptr, size, count, uptr->fileref);
+        ctx->tpos += count * size;
+        return count;
+        }
+    }
+off = (uint32)(ctx->tpos - ctx->tbuf_base);
+sim_buf_copy_swapped (ctx->tbuf + off, bptr, size, count);
+if (ctx->tbuf_dlo == ctx->tbuf_dhi) {
+    ctx->tbuf_dlo = off;
+    ctx->tbuf_dhi = off + (uint32)bytes;
+    }
+else {
+    ctx->tbuf_dlo = MIN (ctx->tbuf_dlo, off);
+    ctx->tbuf_dhi = MAX (ctx->tbuf_dhi, off + (uint32)bytes);
+    }
+if (off + bytes > ctx->tbuf_len)
+    ctx->tbuf_len = off + (uint32)bytes;
+ctx->tpos += bytes;
+return count;
+}
 
-   Outputs:
-        status  =       operation status
+static int sim_tape_feof (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 
-   exit condition       tape position
-   ------------------   -----------------------------------------------------
-   unit unattached      unchanged
-   read error           unchanged, PNU set
-   end of file/medium   updated if a gap precedes, else unchanged and PNU set
-   tape mark            updated
-   tape runaway         updated
-   data record          updated, sim_fread will read record forward
+if ((ctx != NULL) && (ctx->tbuf != NULL))
+    return ctx->teof;
+return feof (uptr->fileref);
+}
 
-   This routine is called to set up a record read or spacing in the forward
-   direction.  On return, status is MTSE_OK and the tape is positioned at the
-   first data byte if a record was encountered, or status is an MTSE error code
-   giving the reason that the operation did not succeed and the tape position is
-   as indicated above.
+static int sim_tape_ferror (UNIT *uptr)
+{
+#if defined (HAVE_ZLIB)
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 
-   The ANSI standards for magnetic tape recording (X3.22, X3.39, and X3.54) and
-   the equivalent ECMA standard (ECMA-62) specify a maximum erase gap length of
-   25 feet (7.6 meters).  While gaps of any length may be written, gaps longer
-   than this are non-standard and may indicate that an unrecorded or erased tape
-   is being read.
+if ((ctx != NULL) && (ctx->gz != NULL) && ctx->gz->error)
+    return 1;
+#endif
+return ferror (uptr->fileref);
+}
 
-   If the tape density has been set via a previous "sim_tape_set_dens" call,
-   then the length is monitored when skipping over erase gaps.  If the length
-   reaches 25 feet, motion is terminated, and MTSE_RUNAWAY status is returned.
-   Runaway status is also returned if an end-of-medium marker or the physical
-   end of file is encountered while spacing over a gap; however, MTSE_EOM is
-   returned if the tape is positioned at the EOM or EOF on entry.
+static t_offset sim_tape_ftell (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 
-   If the density has not been set, then a gap of any length is skipped, and
-   MTSE_RUNAWAY status is never returned.  In effect, erase gaps present in the
-   tape image file will be transparent to the caller.
+if ((ctx != NULL) && (ctx->tbuf != NULL))
+    return (t_offset)ctx->tpos;
+return sim_ftell (uptr->fileref);
+}
 
-   Erase gaps are currently supported only in SIMH (MTUF_F_STD) tape format.
-   Because gaps may be partially overwritten with data records, gap metadata
-   must be examined marker-by-marker.  To reduce the number of file read calls,
-   a buffer of metadata elements is used.  The buffer size is initially
-   established at 256 elements but may be set to any size desired.  To avoid a
-   large read for the typical case where an erase gap is not present, the first
-   read is of a single metadatum marker.  If that is a gap marker, then
-   additional buffered reads are performed.
+static t_offset sim_tape_size (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 
-   See the notes at "tape_erase_fwd" regarding the erase gap implementation.
+if ((ctx != NULL) && (ctx->gz != NULL))  /* Compressed images: uncompressed size */
+    return sim_tape_gz_size (uptr);
+if (MT_GET_FMT (uptr) < MTUF_F_ANSI) {
+    sim_tape_buf_flush (uptr);           /* include written data */
+    return sim_fsize_ex (uptr->fileref); /* True on-disk tape images: file size  */
+    }
+return uptr->tape_eom;                   /* Virtual tape images: record/TM count */
+}
 
+/* Gzip compressed images
 
-   Implementation notes:
+   An on-disk image whose file starts with the gzip magic number is read
+   through the image window by decompressing it, and the unit is write
+   protected.  As decompression first passes through the image, access
+   points are recorded at deflate block boundaries every MTSE_GZ_SPAN
+   bytes of uncompressed data, each holding the deflate history needed to
+   restart there.  Reading anywhere behind the decompression stream, or
+   well ahead of it, then restarts at the nearest preceding access point
+   rather than at the start of the image.  Concatenated gzip members are
+   read as one image. */
 
-    1. For programming convenience, erase gap processing is performed for both
-       SIMH standard and E11 tape formats, although the latter will never
-       contain erase gaps, as the "tape_erase_fwd" call takes no action for the
-       E11 format.
+static t_stat sim_tape_gz_attach (UNIT *uptr)
+{
+#if defined (HAVE_ZLIB)
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+#endif
+uint8 magic[2];
 
-    2. The "feof" call cannot return a non-zero value on the first pass through
-       the loop, because the "sim_fseek" call resets the internal end-of-file
-       indicator.  Subsequent passes only occur if an erase gap is present, so
-       a non-zero return indicates an EOF was seen while reading through a gap.
+if ((sim_fseek (uptr->fileref, 0, SEEK_SET) != 0) ||
+    (sim_fread (magic, 1, sizeof (magic), uptr->fileref) != sizeof (magic)) ||
+    (magic[0] != 0x1F) || (magic[1] != 0x8B)) {        /* not gzip? */
+    (void)sim_fseek (uptr->fileref, 0, SEEK_SET);
+    return SCPE_OK;
+    }
+#if !defined (HAVE_ZLIB)
+return sim_messagef (SCPE_NOFNC, "%s: '%s' is a gzip compressed tape image which this simulator can't read\n",
+                                 sim_uname (uptr), uptr->filename);
+#else
+ctx->gz = (struct tape_gz *)calloc (1, sizeof (*ctx->gz));
+if (ctx->gz != NULL)
+    ctx->gz->in = (uint8 *)malloc (MTSE_GZ_INSIZE);
+if (ctx->tbuf == NULL) {                                /* format not otherwise windowed? */
+    ctx->tbuf = (uint8 *)malloc (MTSE_TBUF_SIZE);
+    ctx->tbuf_size = (ctx->tbuf != NULL) ? MTSE_TBUF_SIZE : 0;
+    }
+if ((ctx->gz == NULL) || (ctx->gz->in == NULL) || (ctx->tbuf == NULL))
+    return SCPE_MEM;
+sim_messagef (SCPE_OK, "%s: '%s' is a gzip compressed tape image, unit is write protected\n",
+                       sim_uname (uptr), uptr->filename);
+return SCPE_OK;
+#endif
+}
 
-    3. The "runaway_counter" cannot decrement to zero (or below) in the presence
-       of an error that terminates the gap-search loop.  Therefore, the test
-       after the loop exit need not check for error status.
+static void sim_tape_gz_free (struct tape_gz *gz)
+{
+#if defined (HAVE_ZLIB)
+uint32 i;
+
+if (gz == NULL)
+    return;
+if (gz->strm_ok)
+    inflateEnd (&gz->strm);
+for (i = 0; i < gz->pts; i++)
+    free (gz->pt[i].window);
+free (gz->pt);
+free (gz->in);
+free (gz);
+#endif
+}
+
+#if defined (HAVE_ZLIB)
+
+/* Restart decompression at the last access point at or before pos, or
+   at the start of the image */
+
+static t_bool sim_tape_gz_restart (UNIT *uptr, struct tape_gz *gz, t_offset pos)
+{
+struct tape_gz_point *p = NULL;
+uint32 lo = 0, hi = gz->pts;
+uint8 c;
+
+while (lo < hi) {                                       /* find the last point at or before pos */
+    uint32 mid = (lo + hi) / 2;
+
+    if (gz->pt[mid].out <= pos)
+        lo = mid + 1;
+    else
+        hi = mid;
+    }
+if (lo > 0)
+    p = &gz->pt[lo - 1];
+if (gz->strm_ok)
+    inflateEnd (&gz->strm);
+memset (&gz->strm, 0, sizeof (gz->strm));
+gz->strm_ok = gz->end = gz->between = FALSE;
+if (p == NULL) {                                        /* from the gzip header */
+    if (inflateInit2 (&gz->strm, 15 + 16) != Z_OK)
+        return FALSE;
+    gz->strm_ok = TRUE;
+    gz->raw = FALSE;
+    gz->in_pos = 0;
+    gz->out = 0;
+    return TRUE;
+    }
+if (inflateInit2 (&gz->strm, -15) != Z_OK)              /* raw deflate from within a member */
+    return FALSE;
+gz->strm_ok = TRUE;
+gz->raw = TRUE;
+gz->in_pos = p->in;
+gz->out = p->out;
+++gz->restarts;
+if (p->bits) {                                          /* point is within a byte? */
+    if ((sim_fseeko (uptr->fileref, p->in - 1, SEEK_SET) != 0) ||
+        (sim_fread (&c, 1, 1, uptr->fileref) != 1))
+        return FALSE;
+    inflatePrime (&gz->strm, p->bits, c >> (8 - p->bits));
+    }
+inflateSetDictionary (&gz->strm, p->window, p->wsize);
+return TRUE;
+}
+
+/* Record an access point at the stream's current position, which is at a
+   deflate block boundary */
+
+static void sim_tape_gz_point (struct tape_gz *gz)
+{
+struct tape_gz_point *p;
+uInt wsize = MTSE_GZ_WINSIZE;
+
+if (gz->pts == gz->pt_size) {
+    uint32 new_size = (gz->pt_size == 0) ? 64 : 2 * gz->pt_size;
+    struct tape_gz_point *new_pt = (struct tape_gz_point *)realloc (gz->pt, new_size * sizeof (*gz->pt));
+
+    if (new_pt == NULL)
+        return;                                         /* just have fewer points */
+    gz->pt = new_pt;
+    gz->pt_size = new_size;
+    }
+p = &gz->pt[gz->pts];
+p->window = (uint8 *)malloc (MTSE_GZ_WINSIZE);
+if ((p->window == NULL) ||
+    (inflateGetDictionary (&gz->strm, p->window, &wsize) != Z_OK)) {
+    free (p->window);
+    return;
+    }
+p->wsize = (uint32)wsize;
+p->out = gz->out;
+p->in = gz->in_pos - gz->strm.avail_in;
+p->bits = gz->strm.data_type & 7;
+++gz->pts;
+}
+
+/* Decompress up to len bytes at the stream's position into buf */
+
+static size_t sim_tape_gz_inflate (UNIT *uptr, struct tape_gz *gz, uint8 *buf, size_t len)
+{
+size_t done = 0;
+
+while ((done < len) && !gz->end && !gz->error) {
+    size_t produced;
+    int ret;
+
+    if (gz->strm.avail_in == 0) {                       /* need compressed data? */
+        size_t n = 0;
+
+        if (sim_fseeko (uptr->fileref, gz->in_pos, SEEK_SET) == 0)
+            n = sim_fread (gz->in, 1, MTSE_GZ_INSIZE, uptr->fileref);
+        if (n == 0) {                                   /* end of the file */
+            if (gz->between)
+                gz->end = TRUE;
+            else {
+                sim_printf ("%s: compressed tape image '%s' is truncated\n", sim_uname (uptr), uptr->filename);
+                gz->error = TRUE;
+                }
+            break;
+            }
+        gz->in_pos += n;
+        gz->strm.next_in = gz->in;
+        gz->strm.avail_in = (uInt)n;
+        }
+    gz->strm.next_out = buf + done;
+    gz->strm.avail_out = (uInt)(len - done);
+    ret = inflate (&gz->strm, Z_BLOCK);
+    produced = (len - done) - gz->strm.avail_out;
+    done += produced;
+    gz->out += produced;
+    if (produced > 0)
+        gz->between = FALSE;
+    if (ret == Z_STREAM_END) {                          /* end of a gzip member */
+        if (gz->raw) {                                  /* skip the trailer inflate didn't see */
+            uInt skip = MIN (gz->strm.avail_in, 8);
+
+            gz->strm.next_in += skip;
+            gz->strm.avail_in -= skip;
+            gz->in_pos += 8 - skip;
+            }
+        gz->between = TRUE;
+        gz->raw = FALSE;
+        inflateReset2 (&gz->strm, 15 + 16);             /* another member may follow */
+        continue;
+        }
+    if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+        if (gz->between)                                /* trailing garbage after a member */
+            gz->end = TRUE;
+        else {
+            sim_printf ("%s: compressed tape image '%s' is corrupt at uncompressed offset %s\n",
+                        sim_uname (uptr), uptr->filename, sim_fmt_numeric ((double)gz->out));
+            gz->error = TRUE;
+            }
+        break;
+        }
+    if ((gz->out >= gz->scanned) &&                     /* first pass through here and */
+        (gz->strm.data_type & 128) &&                   /*   at a block boundary but */
+        !(gz->strm.data_type & 64) &&                   /*   not after the last block and */
+        (gz->out >= ((gz->pts == 0) ? 0 : gz->pt[gz->pts - 1].out) + MTSE_GZ_SPAN))
+        sim_tape_gz_point (gz);
+    if (gz->out > gz->scanned)
+        gz->scanned = gz->out;
+    }
+if (gz->end || gz->error) {
+    gz->size = gz->scanned;
+    gz->size_known = TRUE;
+    }
+return done;
+}
+
+#endif /* HAVE_ZLIB */
+
+/* Read len bytes of the uncompressed image at pos into buf */
+
+static size_t sim_tape_gz_read (UNIT *uptr, t_offset pos, uint8 *buf, size_t len)
+{
+#if defined (HAVE_ZLIB)
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_gz *gz = ctx->gz;
+t_offset nearest = 0;
+uint32 i;
+
+if (gz->error)
+    return 0;
+if (gz->size_known && (pos >= gz->size))
+    return 0;
+for (i = gz->pts; i > 0; i--)                           /* nearest access point at or before pos */
+    if (gz->pt[i - 1].out <= pos) {
+        nearest = gz->pt[i - 1].out;
+        break;
+        }
+if (!gz->strm_ok || (pos < gz->out) || (nearest > gz->out))
+    if (!sim_tape_gz_restart (uptr, gz, pos)) {
+        gz->error = TRUE;
+        return 0;
+        }
+while (gz->out < pos) {                                 /* skip forward to pos */
+    size_t skip = (size_t)MIN (pos - gz->out, (t_offset)len);
+
+    if (sim_tape_gz_inflate (uptr, gz, buf, skip) == 0)
+        return 0;
+    }
+return sim_tape_gz_inflate (uptr, gz, buf, len);
+#else
+return 0;
+#endif
+}
+
+/* Uncompressed image size, decompressing to the end to find it if needed */
+
+static t_offset sim_tape_gz_size (UNIT *uptr)
+{
+#if defined (HAVE_ZLIB)
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_gz *gz = ctx->gz;
+uint8 *buf;
+
+if (!gz->size_known) {
+    buf = (uint8 *)malloc (MTSE_GZ_INSIZE);
+    while ((buf != NULL) && !gz->size_known &&
+           (sim_tape_gz_read (uptr, gz->scanned, buf, MTSE_GZ_INSIZE) > 0))
+        ;
+    free (buf);
+    }
+return gz->size;
+#else
+return 0;
+#endif
+}
+
+/* Per-unit tape options which persist while the unit isn't attached */
+
+struct tape_unit_opts {
+    t_bool              index;              /* index SIMH and E11 images */
+    t_bool              prefetch;           /* read ahead of queued forward reads */
+    };
+
+static struct tape_unit_opts *_tape_unit_opts (UNIT *uptr, t_bool create)
+{
+return (struct tape_unit_opts *)sim_get_unit_opts (uptr, "TAPE", sizeof (struct tape_unit_opts), create);
+}
+
+static t_bool sim_tape_index_unit_opt (UNIT *uptr)
+{
+struct tape_unit_opts *o = _tape_unit_opts (uptr, FALSE);
+
+return (o != NULL) && o->index;
+}
+
+static t_bool sim_tape_prefetch_unit_opt (UNIT *uptr)
+{
+struct tape_unit_opts *o = _tape_unit_opts (uptr, FALSE);
+
+return (o != NULL) && o->prefetch;
+}
+
+/* Image index
+
+   The image offset of each record and tape mark of a SIMH or E11 image
+   is noted as the tape is read forward from BOT; the scan made when the
+   image is attached normally indexes the whole tape.  Spacing records or
+   files forward or in reverse within the indexed part of the tape then
+   moves directly to the resulting position rather than reading every
+   record length on the way.  Indexing stops at an erase gap, since a
+   record preceded by one starts at a different place in each direction.
+   A write truncates the index at the position written.
+
+   A complete index is saved at detach in <image>.mtidx and, when the
+   image file's size and modification time still match, is used in place
+   of the attach time scan.  The file holds a magic string, the words of
+   MTSE_IDX_H_* and then the object offsets and the object numbers of the
+   tape marks, all little endian.  The offsets are checked against the
+   image's uncompressed length, which is recorded as well since finding it
+   for a compressed image means decompressing all of it. */
+
+#define MTSE_IDX_MAGIC      "SIMHTIX2"
+#define MTSE_IDX_SUFFIX     ".mtidx"
+
+#define MTSE_IDX_H_FORMAT   0                   /* image format */
+#define MTSE_IDX_H_SIZE     1                   /* image file size in bytes */
+#define MTSE_IDX_H_TIME     2                   /* image modification time */
+#define MTSE_IDX_H_OBJS     3                   /* objects */
+#define MTSE_IDX_H_TMKS     4                   /* tape marks */
+#define MTSE_IDX_H_END      5                   /* offset beyond the last object */
+#define MTSE_IDX_H_LENGTH   6                   /* uncompressed image length in bytes */
+#define MTSE_IDX_H_WORDS    7
+
+static struct tape_index *sim_tape_index_create (UNIT *uptr)
+{
+struct tape_index *idx = (struct tape_index *)calloc (1, sizeof (*idx));
+
+if (idx != NULL)
+    idx->format = MT_GET_FMT (uptr);
+return idx;
+}
+
+static void sim_tape_index_free (struct tape_index *idx)
+{
+if (idx == NULL)
+    return;
+free (idx->obj);
+free (idx->tmk);
+free (idx);
+}
+
+/* Number of entries of the ascending list a[0..n-1] which are below val */
+
+static uint32 sim_tape_index_below (const t_offset *a, uint32 n, t_offset val)
+{
+uint32 lo = 0, hi = n, mid;
+
+while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (a[mid] < val)
+        lo = mid + 1;
+    else
+        hi = mid;
+    }
+return lo;
+}
+
+static uint32 sim_tape_index_tmks_below (const struct tape_index *idx, uint32 obj)
+{
+uint32 lo = 0, hi = idx->tmks, mid;
+
+while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (idx->tmk[mid] < obj)
+        lo = mid + 1;
+    else
+        hi = mid;
+    }
+return lo;
+}
+
+/* Image offset of object k, or of the end of the index for k == objs */
+
+static t_offset sim_tape_index_start (const struct tape_index *idx, uint32 k)
+{
+return (k < idx->objs) ? idx->obj[k] : idx->end;
+}
+
+/* Object number at which the tape is positioned, if that is indexed */
+
+static t_bool sim_tape_index_find (const struct tape_index *idx, t_offset pos, uint32 *k)
+{
+*k = sim_tape_index_below (idx->obj, idx->objs, pos);
+return (pos == sim_tape_index_start (idx, *k));
+}
+
+/* Note the record or tape mark just read forward from "start" */
+
+static void sim_tape_index_add (UNIT *uptr, t_addr start, t_stat st, t_mtrlnt bc)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_index *idx = ctx->index;
+t_offset size = sizeof (t_mtrlnt);
+void *p;
+
+if ((t_offset)start != idx->end)                        /* not just beyond the indexed part? */
+    return;
+if (st == MTSE_OK)
+    size = 2 * sizeof (t_mtrlnt) + ((idx->format == MTUF_F_STD) ? ((MTR_L (bc) + 1) & ~1) : MTR_L (bc));
+if ((t_offset)uptr->pos != (t_offset)start + size)      /* gap skipped? */
+    return;
+if (idx->objs == idx->obj_size) {
+    p = realloc (idx->obj, (idx->obj_size ? 2 * (size_t)idx->obj_size : 1024) * sizeof (*idx->obj));
+    if (p == NULL)
+        return;
+    idx->obj = (t_offset *)p;
+    idx->obj_size = idx->obj_size ? 2 * idx->obj_size : 1024;
+    }
+if ((st == MTSE_TMK) && (idx->tmks == idx->tmk_size)) {
+    p = realloc (idx->tmk, (idx->tmk_size ? 2 * (size_t)idx->tmk_size : 64) * sizeof (*idx->tmk));
+    if (p == NULL)
+        return;
+    idx->tmk = (uint32 *)p;
+    idx->tmk_size = idx->tmk_size ? 2 * idx->tmk_size : 64;
+    }
+if (st == MTSE_TMK)
+    idx->tmk[idx->tmks++] = idx->objs;
+idx->obj[idx->objs++] = (t_offset)start;
+idx->end = (t_offset)uptr->pos;
+idx->dirty = TRUE;
+}
+
+/* Drop the objects which a write at "pos" overwrites */
+
+static void sim_tape_index_truncate (UNIT *uptr, t_offset pos)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_index *idx = ctx->index;
+uint32 k;
+
+if (idx == NULL)
+    return;
+idx->written = TRUE;
+idx->complete = FALSE;
+if (pos >= idx->end)
+    return;
+k = sim_tape_index_below (idx->obj, idx->objs, pos + 1);/* objects starting at or before pos */
+if (k > 0)                                              /* the last of those is overwritten too */
+    --k;
+idx->end = idx->obj[k];
+idx->objs = k;
+idx->tmks = sim_tape_index_tmks_below (idx, k);
+idx->dirty = TRUE;
+sim_debug_unit (MTSE_DBG_POS, uptr, "sim_tape_index_truncate(unit=%d, pos=%" LL_FMT "d): %u objects remain\n", (int)(uptr - ctx->dptr->units), pos, k);
+}
+
+/* Space up to "count" records from the index.  Returns MTSE_TMK, with the
+   tape positioned beyond the tape mark, if one is reached, and otherwise
+   MTSE_OK with "skipped" records spaced, which may be fewer than "count"
+   (or none) when the index doesn't cover them. */
+
+static t_stat sim_tape_index_space (UNIT *uptr, uint32 count, uint32 *skipped, t_bool reverse)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_index *idx = ctx->index;
+uint32 k, t, n;
+t_offset target;
+t_stat st = MTSE_OK;
+
+if ((idx == NULL) || (count == 0) || MT_TST_PNU (uptr) ||
+    !sim_tape_index_find (idx, (t_offset)uptr->pos, &k))
+    return MTSE_OK;
+t = sim_tape_index_tmks_below (idx, k);                 /* tape marks before the position */
+if (reverse) {
+    if ((t > 0) && (k - 1 - idx->tmk[t - 1] < count)) {
+        n = k - 1 - idx->tmk[t - 1];
+        target = idx->obj[idx->tmk[t - 1]];
+        st = MTSE_TMK;
+        }
+    else {
+        n = MIN (count, k);
+        target = sim_tape_index_start (idx, k - n);
+        }
+    }
+else {
+    if ((t < idx->tmks) && (idx->tmk[t] - k < count)) {
+        n = idx->tmk[t] - k;
+        target = sim_tape_index_start (idx, idx->tmk[t] + 1);
+        st = MTSE_TMK;
+        }
+    else {
+        n = MIN (count, idx->objs - k);
+        target = sim_tape_index_start (idx, k + n);
+        }
+    if ((uptr->tape_eom > 0) && (target > (t_offset)uptr->tape_eom))
+        return MTSE_OK;
+    }
+if ((n == 0) && (st == MTSE_OK))
+    return MTSE_OK;
+sim_debug_unit (MTSE_DBG_POS, uptr, "sim_tape_index_space(unit=%d, count=%u, %s): %u records%s, pos %" T_ADDR_FMT "u -> %" LL_FMT "d\n",
+                (int)(uptr - ctx->dptr->units), count, reverse ? "reverse" : "forward", n, (st == MTSE_TMK) ? " and a tape mark" : "", uptr->pos, target);
+uptr->pos = (t_addr)target;
+++idx->hits;
+*skipped = n;
+return st;
+}
+
+static void sim_tape_index_name (const char *filename, char *name, size_t size)
+{
+snprintf (name, size, "%s%s", filename, MTSE_IDX_SUFFIX);
+}
+
+static t_bool sim_tape_index_image (const char *filename, t_uint64 *size, t_uint64 *mtime)
+{
+struct stat statb;
+
+if (sim_stat (filename, &statb) != 0)
+    return FALSE;
+*size = (t_uint64)sim_fsize_name_ex (filename);
+*mtime = (t_uint64)statb.st_mtime;
+return TRUE;
+}
+
+/* Use the index file of a just attached image if it still describes it */
+
+static t_bool sim_tape_index_load (UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_index *idx = ctx->index;
+char name[CBUFSIZE + sizeof (MTSE_IDX_SUFFIX)];
+char magic[sizeof (MTSE_IDX_MAGIC) - 1];
+t_uint64 hdr[MTSE_IDX_H_WORDS];
+t_uint64 size, mtime;
+uint32 objs, tmks, i;
+FILE *f;
+t_bool ok;
+
+if ((idx == NULL) || !sim_tape_index_image (uptr->filename, &size, &mtime))
+    return FALSE;
+sim_tape_index_name (uptr->filename, name, sizeof (name));
+f = sim_fopen (name, "rb");
+if (f == NULL)
+    return FALSE;
+ok = (sim_fread (magic, 1, sizeof (magic), f) == sizeof (magic)) &&
+     (memcmp (magic, MTSE_IDX_MAGIC, sizeof (magic)) == 0) &&
+     (sim_fread (hdr, sizeof (hdr[0]), MTSE_IDX_H_WORDS, f) == MTSE_IDX_H_WORDS) &&
+     (hdr[MTSE_IDX_H_FORMAT] == idx->format) &&
+     (hdr[MTSE_IDX_H_SIZE] == size) &&
+     (hdr[MTSE_IDX_H_TIME] == mtime) &&
+     ((ctx->gz != NULL) || (hdr[MTSE_IDX_H_LENGTH] == size)) &&
+     (hdr[MTSE_IDX_H_OBJS] <= hdr[MTSE_IDX_H_LENGTH] / sizeof (t_mtrlnt)) &&
+     (hdr[MTSE_IDX_H_TMKS] <= hdr[MTSE_IDX_H_OBJS]) &&
+     (hdr[MTSE_IDX_H_END] <= hdr[MTSE_IDX_H_LENGTH]);
+if (ok) {
+    objs = (uint32)hdr[MTSE_IDX_H_OBJS];
+    tmks = (uint32)hdr[MTSE_IDX_H_TMKS];
+    idx->obj = (t_offset *)malloc ((objs + 1) * sizeof (*idx->obj));
+    idx->tmk = (uint32 *)malloc ((tmks + 1) * sizeof (*idx->tmk));
+    ok = (idx->obj != NULL) && (idx->tmk != NULL) &&
+         (sim_fread (idx->obj, sizeof (*idx->obj), objs, f) == objs) &&
+         (sim_fread (idx->tmk, sizeof (*idx->tmk), tmks, f) == tmks);
+    for (i = 0; ok && (i < tmks); i++)
+        ok = (idx->tmk[i] < objs) && ((i == 0) || (idx->tmk[i] > idx->tmk[i - 1]));
+    for (i = 0; ok && (i < objs); i++)
+        ok = (idx->obj[i] < (t_offset)hdr[MTSE_IDX_H_END]) && ((i == 0) ? (idx->obj[i] == 0) : (idx->obj[i] > idx->obj[i - 1]));
+    }
+fclose (f);
+if (!ok) {
+    sim_debug_unit (MTSE_DBG_STR, uptr, "sim_tape_index_load(unit=%d): '%s' doesn't match the image\n", (int)(uptr - ctx->dptr->units), name);
+    free (idx->obj);
+    free (idx->tmk);
+    memset (idx, 0, sizeof (*idx));
+    idx->format = MT_GET_FMT (uptr);
+    return FALSE;
+    }
+idx->objs = objs;
+idx->obj_size = objs + 1;
+idx->tmks = tmks;
+idx->tmk_size = tmks + 1;
+idx->end = (t_offset)hdr[MTSE_IDX_H_END];
+idx->complete = idx->loaded = TRUE;
+uptr->tape_eom = (t_addr)idx->end;
+sim_messagef (SCPE_OK, "%s: Tape Image '%s' indexed as %s format by '%s' (%u record%s, %u tapemark%s)\n", sim_uname (uptr),
+                       uptr->filename, _sim_tape_format_name (uptr), name,
+                       objs - tmks, (objs - tmks == 1) ? "" : "s", tmks, (tmks == 1) ? "" : "s");
+return TRUE;
+}
+
+/* Save a complete index beside its image, which has just been closed, or
+   remove an index file that the image was written since */
+
+static void sim_tape_index_close (UNIT *uptr, struct tape_index *idx, const char *filename)
+{
+char name[CBUFSIZE + sizeof (MTSE_IDX_SUFFIX)];
+t_uint64 hdr[MTSE_IDX_H_WORDS];
+FILE *f;
+t_bool ok;
+
+sim_tape_index_name (filename, name, sizeof (name));
+if (!idx->complete) {
+    if (idx->written)
+        (void)remove (name);
+    return;
+    }
+if (!idx->dirty ||
+    !sim_tape_index_image (filename, &hdr[MTSE_IDX_H_SIZE], &hdr[MTSE_IDX_H_TIME]))
+    return;
+hdr[MTSE_IDX_H_FORMAT] = idx->format;
+hdr[MTSE_IDX_H_OBJS] = idx->objs;
+hdr[MTSE_IDX_H_TMKS] = idx->tmks;
+hdr[MTSE_IDX_H_END] = (t_uint64)idx->end;
+hdr[MTSE_IDX_H_LENGTH] = (t_uint64)idx->length;
+f = sim_fopen (name, "wb");
+if (f == NULL)
+    return;
+ok = (sim_fwrite ((void *)MTSE_IDX_MAGIC, 1, sizeof (MTSE_IDX_MAGIC) - 1, f) == sizeof (MTSE_IDX_MAGIC) - 1) &&
+     (sim_fwrite (hdr, sizeof (hdr[0]), MTSE_IDX_H_WORDS, f) == MTSE_IDX_H_WORDS) &&
+     (sim_fwrite (idx->obj, sizeof (*idx->obj), idx->objs, f) == idx->objs) &&
+     (sim_fwrite (idx->tmk, sizeof (*idx->tmk), idx->tmks, f) == idx->tmks);
+if ((fclose (f) == EOF) || !ok) {
+    sim_messagef (SCPE_OK, "%s: Can't save the tape image index '%s'\n", sim_uname (uptr), name);
+    (void)remove (name);
+    }
+}
+
+/* SET <dev|unit> INDEX and NOINDEX */
+
+t_stat sim_tape_set_index (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+struct tape_unit_opts *o;
+uint32 u;
+
+if (DEV_TYPE (dptr) != DEV_TAPE)
+    return sim_messagef (SCPE_NOFNC, "%s is not a tape device\n", sim_dname (dptr));
+if (cptr)
+    return SCPE_ARG;
+for (u = 0; u < dptr->numunits; u++) {
+    UNIT *up = &dptr->units[u];
+
+    if ((flag & MT_INDEX_UNIT) ? (up != uptr) : ((up->flags & UNIT_ATTABLE) == 0))
+        continue;
+    o = _tape_unit_opts (up, (flag & MT_INDEX) != 0);
+    if (o != NULL)
+        o->index = ((flag & MT_INDEX) != 0);
+    else
+        if (flag & MT_INDEX)
+            return SCPE_MEM;
+    if ((up->flags & UNIT_ATT) &&
+        ((flag & MT_INDEX) != (((struct tape_context *)up->tape_ctx)->index != NULL)))
+        sim_messagef (SCPE_OK, "%s: Indexing changes when the unit is next attached\n", sim_uname (up));
+    }
+return SCPE_OK;
+}
+
+static void _sim_tape_show_unit_index (FILE *st, UNIT *uptr)
+{
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+struct tape_index *idx = ((uptr->flags & UNIT_ATT) && (ctx != NULL)) ? ctx->index : NULL;
+
+if (idx == NULL) {
+    if (!sim_tape_index_unit_opt (uptr))
+        fprintf (st, "%s: not indexed\n", sim_uname (uptr));
+    else
+        if (!(uptr->flags & UNIT_ATT))
+            fprintf (st, "%s: indexed when attached\n", sim_uname (uptr));
+        else
+            fprintf (st, "%s: indexed when attached, but %s format images aren't indexed\n", sim_uname (uptr), _sim_tape_format_name (uptr));
+    return;
+    }
+fprintf (st, "%s: %u record%s and %u tapemark%s indexed", sim_uname (uptr),
+             idx->objs - idx->tmks, (idx->objs - idx->tmks == 1) ? "" : "s", idx->tmks, (idx->tmks == 1) ? "" : "s");
+fprintf (st, " through offset %s%s%s\n", sim_fmt_numeric ((double)idx->end),
+             idx->complete ? " (complete" : " (partial", idx->loaded ? ", from the index file)" : ")");
+fprintf (st, "    %u spacing operation%s done from the index\n", idx->hits, (idx->hits == 1) ? "" : "s");
+}
+
+/* SHOW <dev|unit> INDEX */
+
+t_stat sim_tape_show_index (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+
+if (DEV_TYPE (dptr) != DEV_TAPE)
+    return sim_messagef (SCPE_NOFNC, "%s is not a tape device\n", sim_dname (dptr));
+if (flag) {                                             /* unit? */
+    _sim_tape_show_unit_index (st, uptr);
+    return SCPE_OK;
+    }
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) &&
+        ((dptr->units[u].flags & UNIT_DIS) == 0))
+        _sim_tape_show_unit_index (st, &dptr->units[u]);
+    }
+return SCPE_OK;
+}
+
+/* SET <dev|unit> PREFETCH and NOPREFETCH */
+
+t_stat sim_tape_set_prefetch (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+struct tape_unit_opts *o;
+uint32 u;
+
+if (DEV_TYPE (dptr) != DEV_TAPE)
+    return sim_messagef (SCPE_NOFNC, "%s is not a tape device\n", sim_dname (dptr));
+if (cptr)
+    return SCPE_ARG;
+for (u = 0; u < dptr->numunits; u++) {
+    UNIT *up = &dptr->units[u];
+
+    if ((flag & MT_PREFETCH_UNIT) ? (up != uptr) : ((up->flags & UNIT_ATTABLE) == 0))
+        continue;
+    o = _tape_unit_opts (up, (flag & MT_PREFETCH) != 0);
+    if (o != NULL)
+        o->prefetch = ((flag & MT_PREFETCH) != 0);
+    else
+        if (flag & MT_PREFETCH)
+            return SCPE_MEM;
+#if defined (SIM_ASYNCH_IO)
+    if ((up->flags & UNIT_ATT) && (up->tape_ctx != NULL)) {
+        struct tape_context *ctx = (struct tape_context *)up->tape_ctx;
+
+        if (ctx->asynch_io)
+            _tape_q_wait (up);
+        ctx->pf_enabled = ((flag & MT_PREFETCH) != 0);
+        ctx->pf_valid = FALSE;
+        }
+#endif
+    }
+return SCPE_OK;
+}
+
+static void _sim_tape_show_unit_prefetch (FILE *st, UNIT *uptr)
+{
+#if defined (SIM_ASYNCH_IO)
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+#endif
+
+fprintf (st, "%s: read ahead %sabled", sim_uname (uptr), sim_tape_prefetch_unit_opt (uptr) ? "en" : "dis");
+#if defined (SIM_ASYNCH_IO)
+if (!(uptr->flags & UNIT_ATT) || (ctx == NULL)) {
+    fprintf (st, "\n");
+    return;
+    }
+if (!ctx->asynch_io)
+    fprintf (st, ", but asynchronous I/O is disabled (SET ASYNCH)");
+fprintf (st, "\n    %u request%s queued, at most %u outstanding at once\n", ctx->q_requests, (ctx->q_requests == 1) ? "" : "s", ctx->q_max);
+fprintf (st, "    %u record%s read ahead, %u used\n", ctx->pf_reads, (ctx->pf_reads == 1) ? "" : "s", ctx->pf_hits);
+#else
+fprintf (st, ", but this simulator can't perform asynchronous I/O\n");
+#endif
+}
+
+/* SHOW <dev|unit> PREFETCH */
+
+t_stat sim_tape_show_prefetch (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr)
+{
+uint32 u;
+
+if (DEV_TYPE (dptr) != DEV_TAPE)
+    return sim_messagef (SCPE_NOFNC, "%s is not a tape device\n", sim_dname (dptr));
+if (flag) {                                             /* unit? */
+    _sim_tape_show_unit_prefetch (st, uptr);
+    return SCPE_OK;
+    }
+for (u = 0; u < dptr->numunits; u++) {
+    if ((dptr->units[u].flags & UNIT_ATTABLE) &&
+        ((dptr->units[u].flags & UNIT_DIS) == 0))
+        _sim_tape_show_unit_prefetch (st, &dptr->units[u]);
+    }
+return SCPE_OK;
+}
+
+/* Read record length forward (internal routine).
+
+   Inputs:
+        uptr    =       pointer to tape unit
+        bc      =       pointer to returned record length
+
+   Outputs:
+        status  =       operation status
+
+   exit condition       tape position
+   ------------------   -----------------------------------------------------
+   unit unattached      unchanged
+   read error           unchanged, PNU set
+   end of file/medium   updated if a gap precedes, else unchanged and PNU set
+   tape mark            updated
+   tape runaway         updated
+   data record          updated, sim_fread will read record forward
+
+   This routine is called to set up a record read or spacing in the forward
+   direction.  On return, status is MTSE_OK and the tape is positioned at the
+   first data byte if a record was encountered, or status is an MTSE error code
+   giving the reason that the operation did not succeed and the tape position is
+   as indicated above.
+
+   The ANSI standards for magnetic tape recording (X3.22, X3.39, and X3.54) and
+   the equivalent ECMA standard (ECMA-62) specify a maximum erase gap length of
+   25 feet (7.6 meters).  While gaps of any length may be written, gaps longer
+   than this are non-standard and may indicate that an unrecorded or erased tape
+   is being read.
+
+   If the tape density has been set via a previous "sim_tape_set_dens" call,
+   then the length is monitored when skipping over erase gaps.  If the length
+   reaches 25 feet, motion is terminated, and MTSE_RUNAWAY status is returned.
+   Runaway status is also returned if an end-of-medium marker or the physical
+   end of file is encountered while spacing over a gap; however, MTSE_EOM is
+   returned if the tape is positioned at the EOM or EOF on entry.
+
+   If the density has not been set, then a gap of any length is skipped, and
+   MTSE_RUNAWAY status is never returned.  In effect, erase gaps present in the
+   tape image file will be transparent to the caller.
+
+   Erase gaps are currently supported only in SIMH (MTUF_F_STD) tape format.
+   Because gaps may be partially overwritten with data records, gap metadata
+   must be examined marker-by-marker.  To reduce the number of file read calls,
+   a buffer of metadata elements is used.  The buffer size is initially
+   established at 256 elements but may be set to any size desired.  To avoid a
+   large read for the typical case where an erase gap is not present, the first
+   read is of a single metadatum marker.  If that is a gap marker, then
+   additional buffered reads are performed.
+
+   See the notes at "tape_erase_fwd" regarding the erase gap implementation.
+
+
+   Implementation notes:
+
+    1. For programming convenience, erase gap processing is performed for both
+       SIMH standard and E11 tape formats, although the latter will never
+       contain erase gaps, as the "tape_erase_fwd" call takes no action for the
+       E11 format.
+
+    2. The "feof" call cannot return a non-zero value on the first pass through
+       the loop, because the "sim_fseek" call resets the internal end-of-file
+       indicator.  Subsequent passes only occur if an erase gap is present, so
+       a non-zero return indicates an EOF was seen while reading through a gap.
+
+    3. The "runaway_counter" cannot decrement to zero (or below) in the presence
+       of an error that terminates the gap-search loop.  Therefore, the test
+       after the loop exit need not check for error status.
 
     4. The dynamic start/stop test of the HP 3000 magnetic tape diagnostic
        heavily exercises the erase gap scanning code.  Sample test execution
@@ -1291,7 +2546,7 @@ switch (f) {                                       /* otherwise the read method
 
         do {                                            /* loop until a record, gap, or error is seen */
             if (bufcntr == bufcap) {                    /* if the buffer is empty then refill it */
-                if (feof (uptr->fileref)) {             /* if we hit the EOF while reading a gap */
+                if (sim_tape_feof (uptr)) {             /* if we hit the EOF while reading a gap */
                     if (sizeof_gap > 0)                 /*   then if detection is enabled */
                         status = MTSE_RUNAWAY;          /*     then report a tape runaway */
                     else                                /*   otherwise report the physical EOF */
@@ -1306,12 +2561,12 @@ switch (f) {                                       /* otherwise the read method
                     bufcap = sizeof (buffer)            /*   to the full size of the buffer */
                                / sizeof (buffer [0]);
 
-                bufcap = sim_fread (buffer,             /* fill the buffer */
-                                    sizeof (t_mtrlnt),  /*   with tape metadata */
-                                    bufcap,
-                                    uptr->fileref);
+                bufcap = sim_tape_fread (uptr,          /* fill the buffer */
+                                         buffer,        /*   with tape metadata */
+                                         sizeof (t_mtrlnt),
+                                         bufcap);
 
-                if (ferror (uptr->fileref)) {           /* if a file I/O error occurred */
+                if (sim_tape_ferror (uptr)) {           /* if a file I/O error occurred */
                     if (bufcntr == 0)                   /*   then if this is the initial read */
                         MT_SET_PNU (uptr);              /*     then set position not updated */
 
@@ -1394,12 +2649,12 @@ switch (f) {                                       /* otherwise the read method
                 break;
                 }
 
-            (void)sim_fread (&rev_lnt,                  /* get the reverse length */
-                             sizeof (t_mtrlnt),
-                             1,
-                             uptr->fileref);
+            (void)sim_tape_fread (uptr,                 /* get the reverse length */
+                                  &rev_lnt,
+                                  sizeof (t_mtrlnt),
+                                  1);
 
-            if (ferror (uptr->fileref)) {               /* if a file I/O error occurred */
+            if (sim_tape_ferror (uptr)) {               /* if a file I/O error occurred */
                 status = sim_tape_ioerr (uptr);         /* report the error and quit */
                 break;
                 }
@@ -1415,17 +2670,17 @@ switch (f) {                                       /* otherwise the read method
         break;                                          /* otherwise the operation succeeded */
 
     case MTUF_F_TPC:
-        (void)sim_fread (&tpcbc, sizeof (t_tpclnt), 1, uptr->fileref);
+        (void)sim_tape_fread (uptr, &tpcbc, sizeof (t_tpclnt), 1);
         *bc = (t_mtrlnt)tpcbc;                          /* save rec lnt */
 
-        if (ferror (uptr->fileref)) {                   /* error? */
+        if (sim_tape_ferror (uptr)) {                   /* error? */
             MT_SET_PNU (uptr);                          /* pos not upd */
             status = sim_tape_ioerr (uptr);
             }
         else {
-            if ((feof (uptr->fileref)) ||               /* eof? */
+            if ((sim_tape_feof (uptr)) ||               /* eof? */
                 ((tpcbc == TPC_EOM) &&
-                 (sim_fsize (uptr->fileref) == (uint32)sim_ftell (uptr->fileref)))) {
+                 (sim_tape_size (uptr) == sim_tape_ftell (uptr)))) {
                 MT_SET_PNU (uptr);                      /* pos not upd */
                 status = MTSE_EOM;
                 }
@@ -1441,14 +2696,14 @@ switch (f) {                                       /* otherwise the read method
 
     case MTUF_F_P7B:
         for (sbc = 0, all_eof = 1; ; sbc++) {           /* loop thru record */
-            (void)sim_fread (&c, sizeof (uint8), 1, uptr->fileref);
+            (void)sim_tape_fread (uptr, &c, sizeof (uint8), 1);
 
-            if (ferror (uptr->fileref)) {               /* error? */
+            if (sim_tape_ferror (uptr)) {               /* error? */
                 MT_SET_PNU (uptr);                      /* pos not upd */
                 status = sim_tape_ioerr (uptr);
                 break;
                 }
-            else if (feof (uptr->fileref)) {            /* eof? */
+            else if (sim_tape_feof (uptr)) {            /* eof? */
                 if (sbc == 0)                           /* no data? eom */
                     status = MTSE_EOM;
                 break;                                  /* treat like eor */
@@ -1472,13 +2727,13 @@ switch (f) {                                       /* otherwise the read method
 
     case MTUF_F_AWS:
         memset (&awshdr, 0, sizeof (awshdr));
-        rdcnt = sim_fread (&awshdr, sizeof (t_awslnt), 3, uptr->fileref);
-        if (ferror (uptr->fileref)) {           /* error? */
+        rdcnt = sim_tape_fread (uptr, &awshdr, sizeof (t_awslnt), 3);
+        if (sim_tape_ferror (uptr)) {           /* error? */
             MT_SET_PNU (uptr);                  /* pos not upd */
             status = sim_tape_ioerr (uptr);
             break;
             }
-        if ((feof (uptr->fileref)) ||           /* eof? */
+        if ((sim_tape_feof (uptr)) ||           /* eof? */
             (rdcnt < 3)) {
             uptr->tape_eom = uptr->pos;
             MT_SET_PNU (uptr);                  /* pos not upd */
@@ -1502,9 +2757,9 @@ switch (f) {                                       /* otherwise the read method
         *bc = (t_mtrlnt)awshdr.nxtlen;          /* save rec lnt */
         uptr->pos += awshdr.nxtlen;             /* spc over record */
         memset (&awshdr, 0, sizeof (t_awslnt));
-        saved_pos = (t_addr)sim_ftell (uptr->fileref);/* save record data address */
+        saved_pos = (t_addr)sim_tape_ftell (uptr);/* save record data address */
         (void)sim_tape_seek (uptr, uptr->pos); /* for read */
-        rdcnt = sim_fread (&awshdr, sizeof (t_awslnt), 3, uptr->fileref);
+        rdcnt = sim_tape_fread (uptr, &awshdr, sizeof (t_awslnt), 3);
         if ((rdcnt == 3) &&
             ((awshdr.prelen != *bc) || ((awshdr.rectyp != AWS_REC) && (awshdr.rectyp != AWS_TMK)))) {
             status = MTSE_INVRL;
@@ -1541,13 +2796,13 @@ switch (f) {                                       /* otherwise the read method
         if (1) {
             MEMORY_TAPE *tape = (MEMORY_TAPE *)uptr->fileref;
 
-            if (uptr->pos >= tape->record_count)
+            if (!memory_tape_generated (uptr, (uint32)uptr->pos))
                 status = MTSE_EOM;
             else {
-                if (tape->records[uptr->pos]->size == 0)
+                if (tape->records[uptr->pos].size == 0)
                     status = MTSE_TMK;
                 else
-                    *bc = tape->records[uptr->pos]->size;
+                    *bc = tape->records[uptr->pos].size;
                 ++uptr->pos;
                 }
             }
@@ -1563,6 +2818,7 @@ return status;
 static t_stat sim_tape_rdrlfwd (UNIT *uptr, t_mtrlnt *bc)
 {
 struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+t_addr start = uptr->pos;
 t_stat status;
 
 *bc = 0;
@@ -1571,6 +2827,9 @@ if (ctx == NULL)                                        /* if not properly attac
 
 status = sim_tape_rdlntf (uptr, bc);                    /* read the record length */
 
+if ((ctx->index != NULL) && ((status == MTSE_OK) || (status == MTSE_TMK)))
+    sim_tape_index_add (uptr, start, status, *bc);      /* extend the image index */
+
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_STR, uptr, "rd_lntf: st: %d, lnt: %d, pos: %" T_ADDR_FMT "u\n", status, *bc, uptr->pos);
 
 return status;
@@ -1680,10 +2939,10 @@ switch (f) {                                            /* otherwise the read me
                     break;
                     }
 
-                bufcntr = sim_fread (buffer, sizeof (t_mtrlnt), /* fill the buffer */
-                                     bufcap, uptr->fileref);    /*   with tape metadata */
+                bufcntr = sim_tape_fread (uptr, buffer, /* fill the buffer */
+                                          sizeof (t_mtrlnt), bufcap);   /*   with tape metadata */
 
-                if (ferror (uptr->fileref)) {           /* if a file I/O error occurred */
+                if (sim_tape_ferror (uptr)) {           /* if a file I/O error occurred */
                     status = sim_tape_ioerr (uptr);     /*   then report the error and quit */
                     break;
                     }
@@ -1732,12 +2991,12 @@ switch (f) {                                            /* otherwise the read me
     case MTUF_F_TPC:
         ppos = sim_tape_tpc_fnd (uptr, (t_addr *) uptr->filebuf); /* find prev rec */
         (void)sim_tape_seek (uptr, ppos);               /* position */
-        (void)sim_fread (&tpcbc, sizeof (t_tpclnt), 1, uptr->fileref);
+        (void)sim_tape_fread (uptr, &tpcbc, sizeof (t_tpclnt), 1);
         *bc = (t_mtrlnt)tpcbc;                          /* save rec lnt */
 
-        if (ferror (uptr->fileref))                     /* error? */
+        if (sim_tape_ferror (uptr))                     /* error? */
             status = sim_tape_ioerr (uptr);
-        else if (feof (uptr->fileref))                  /* eof? */
+        else if (sim_tape_feof (uptr))                  /* eof? */
             status = MTSE_EOM;
         else {
             uptr->pos = ppos;                           /* spc over record */
@@ -1767,12 +3026,12 @@ switch (f) {                                            /* otherwise the read me
                         buf_offset -= BUF_SZ;
                         }
                     (void)sim_tape_seek (uptr, buf_offset);
-                    bytes_in_buf = sim_fread (buf, sizeof (uint8), read_size, uptr->fileref);
-                    if (ferror (uptr->fileref)) {       /* error? */
+                    bytes_in_buf = sim_tape_fread (uptr, buf, sizeof (uint8), read_size);
+                    if (sim_tape_ferror (uptr)) {       /* error? */
                         status = sim_tape_ioerr (uptr);
                         break;
                         }
-                    if (feof (uptr->fileref)) {         /* eof? */
+                    if (sim_tape_feof (uptr)) {         /* eof? */
                         status = MTSE_EOM;
                         break;
                         }
@@ -1804,14 +3063,14 @@ switch (f) {                                            /* otherwise the read me
                 break;
                 }
             memset (&awshdr, 0, sizeof (awshdr));
-            rdcnt = sim_fread (&awshdr, sizeof (t_awslnt), 3, uptr->fileref);
-            if (ferror (uptr->fileref)) {               /* error? */
+            rdcnt = sim_tape_fread (uptr, &awshdr, sizeof (t_awslnt), 3);
+            if (sim_tape_ferror (uptr)) {               /* error? */
                 status = sim_tape_ioerr (uptr);
                 break;
                 }
-            if (feof (uptr->fileref)) {                 /* eof? */
+            if (sim_tape_feof (uptr)) {                 /* eof? */
                 if ((uptr->pos > sizeof (t_awshdr)) &&
-                    (uptr->pos >= sim_fsize (uptr->fileref))) {
+                    ((t_offset)uptr->pos >= sim_tape_size (uptr))) {
                     uptr->tape_eom = uptr->pos;
                     (void)sim_tape_seek (uptr, uptr->pos - sizeof (t_awshdr));/* position */
                     continue;
@@ -1879,10 +3138,10 @@ switch (f) {                                            /* otherwise the read me
             MEMORY_TAPE *tape = (MEMORY_TAPE *)uptr->fileref;
 
             --uptr->pos;
-            if (tape->records[uptr->pos]->size == 0)
+            if (tape->records[uptr->pos].size == 0)
                 status = MTSE_TMK;
             else
-                *bc = tape->records[uptr->pos]->size;
+                *bc = tape->records[uptr->pos].size;
             }
         break;
 
@@ -1942,6 +3201,7 @@ t_stat st;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_rdrecf(unit=%d, buf=%p, max=%d)\n", (int)(uptr-ctx->dptr->units), buf, max);
+AIO_SYNC (uptr);
 
 if ((uptr->tape_chunk_size) &&
     (ctx->chunk_data_size > ctx->chunk_offset)) {       /* remnant chunk data available? */
@@ -1984,17 +3244,22 @@ if (rbc > max) {                                        /* rec out of range? */
         }
     }
 if (f < MTUF_F_ANSI) {
-    i = (t_mtrlnt) sim_fread (buf, sizeof (uint8), rbc, uptr->fileref); /* read record */
-    if (ferror (uptr->fileref)) {                           /* error? */
+    i = (t_mtrlnt) sim_tape_fread (uptr, buf, sizeof (uint8), rbc); /* read record */
+    if (sim_tape_ferror (uptr)) {                           /* error? */
         MT_SET_PNU (uptr);
         uptr->pos = opos;
         return sim_tape_ioerr (uptr);
         }
     }
 else {
-    MEMORY_TAPE *tape = (MEMORY_TAPE *)uptr->fileref;
+    uint8 *data = memory_tape_record_data ((MEMORY_TAPE *)uptr->fileref, (uint32)(uptr->pos - 1));
 
-    memcpy (buf, tape->records[uptr->pos - 1]->data, rbc);
+    if (data == NULL) {                                     /* host file unreadable? */
+        MT_SET_PNU (uptr);
+        uptr->pos = opos;
+        return MTSE_IOERR;
+        }
+    memcpy (buf, data, rbc);
     i = rbc;
     }
 for ( ; i < rbc; i++)                                   /* fill with 0's */
@@ -2048,6 +3313,7 @@ t_stat st;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_rdrecr(unit=%d, buf=%p, max=%d)\n", (int)(uptr-ctx->dptr->units), buf, max);
+AIO_SYNC (uptr);
 
 ctx->chunk_offset = ctx->chunk_data_size = 0;           /* discard any pending chunking */
 st = sim_tape_rdrlrev (uptr, &tbc);                     /* read rec lnt */
@@ -2059,14 +3325,16 @@ if (st != MTSE_OK) {
 if (rbc > max)                                          /* rec out of range? */
     return MTSE_INVRL;
 if (f < MTUF_F_ANSI) {
-    i = (t_mtrlnt) sim_fread (buf, sizeof (uint8), rbc, uptr->fileref); /* read record */
-    if (ferror (uptr->fileref))                             /* error? */
+    i = (t_mtrlnt) sim_tape_fread (uptr, buf, sizeof (uint8), rbc); /* read record */
+    if (sim_tape_ferror (uptr))                             /* error? */
         return sim_tape_ioerr (uptr);
     }
 else {
-    MEMORY_TAPE *tape = (MEMORY_TAPE *)uptr->fileref;
+    uint8 *data = memory_tape_record_data ((MEMORY_TAPE *)uptr->fileref, (uint32)uptr->pos);
 
-    memcpy (buf, tape->records[uptr->pos]->data, rbc);
+    if (data == NULL)                                       /* host file unreadable? */
+        return MTSE_IOERR;
+    memcpy (buf, data, rbc);
     i = rbc;
     }
 for ( ; i < rbc; i++)                                   /* fill with 0's */
@@ -2113,6 +3381,7 @@ t_stat status = MTSE_OK;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_wrrecf(unit=%d, buf=%p, bc=%d)\n", (int)(uptr-ctx->dptr->units), buf, bc);
+AIO_SYNC (uptr);
 
 sim_tape_data_trace(uptr, buf, bc, "Record Write", (uptr->dctrl | ctx->dptr->dctrl) & MTSE_DBG_DAT, MTSE_DBG_STR);
 MT_CLR_PNU (uptr);
@@ -2131,9 +3400,9 @@ switch (f) {                                            /* case on format */
         sbc = MTR_L ((bc + 1) & ~1);                    /* pad odd length */
         /* fall through into the E11 handler */
     case MTUF_F_E11:                                    /* E11 */
-        (void)sim_fwrite (&bc, sizeof (t_mtrlnt), 1, uptr->fileref);
-        (void)sim_fwrite (buf, sizeof (uint8), sbc, uptr->fileref);
-        (void)sim_fwrite (&bc, sizeof (t_mtrlnt), 1, uptr->fileref);
+        (void)sim_tape_fwrite (uptr, &bc, sizeof (t_mtrlnt), 1);
+        (void)sim_tape_fwrite (uptr, buf, sizeof (uint8), sbc);
+        (void)sim_tape_fwrite (uptr, &bc, sizeof (t_mtrlnt), 1);
         if (ferror (uptr->fileref)) {                   /* error? */
             MT_SET_PNU (uptr);
             return sim_tape_ioerr (uptr);
@@ -2180,6 +3449,8 @@ t_awshdr awshdr;
 size_t   rdcnt;
 t_bool   replacing_record;
 
+if (sim_tape_wrp (uptr))                     /* write prot? */
+    return MTSE_WRP;
 memset (&awshdr, 0, sizeof (t_awshdr));
 if (sim_tape_seek (uptr, uptr->pos))        /* set pos */
     return MTSE_IOERR;
@@ -2230,7 +3501,7 @@ if (ctx == NULL)                                        /* if not properly attac
 if (sim_tape_wrp (uptr))                                /* write prot? */
     return MTSE_WRP;
 (void)sim_tape_seek (uptr, uptr->pos);                  /* set pos */
-(void)sim_fwrite (&dat, sizeof (t_mtrlnt), 1, uptr->fileref);
+(void)sim_tape_fwrite (uptr, &dat, sizeof (t_mtrlnt), 1);
 if (ferror (uptr->fileref)) {                           /* error? */
     MT_SET_PNU (uptr);
     return sim_tape_ioerr (uptr);
@@ -2251,6 +3522,7 @@ struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_wrtmk(unit=%d)\n", (int)(uptr-ctx->dptr->units));
+AIO_SYNC (uptr);
 if (MT_GET_FMT (uptr) == MTUF_F_P7B) {                  /* P7B? */
     uint8 buf = P7B_EOF;                                /* eof mark */
     return sim_tape_wrrecf (uptr, &buf, 1);             /* write char */
@@ -2279,6 +3551,7 @@ struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_wreom(unit=%d)\n", (int)(uptr-ctx->dptr->units));
+AIO_SYNC (uptr);
 if (sim_tape_wrp (uptr))                                /* write prot? */
     return MTSE_WRP;
 if (MT_GET_FMT (uptr) == MTUF_F_P7B)                    /* cant do P7B */
@@ -2315,6 +3588,7 @@ t_stat r;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_wreomrw(unit=%d)\n", (int)(uptr-ctx->dptr->units));
+AIO_SYNC (uptr);
 r = sim_tape_wreom (uptr);
 if (r == MTSE_OK)
     r = sim_tape_rewind (uptr);
@@ -2449,7 +3723,7 @@ else if (sim_tape_wrp (uptr))                           /* otherwise if the unit
 else if (gap_size == 0 || format != MTUF_F_STD)         /* otherwise if zero length or gaps aren't supported */
     return MTSE_OK;                                     /*   then take no action */
 
-file_size = sim_fsize (uptr->fileref);                  /* get the file size */
+file_size = (uint32)sim_tape_size (uptr);               /* get the file size */
 
 if (sim_tape_seek (uptr, uptr->pos)) {                  /* position the tape; if it fails */
     MT_SET_PNU (uptr);                                  /*   then set position not updated */
@@ -2469,7 +3743,7 @@ if (sim_tape_seek (uptr, uptr->pos)) {                  /* position the tape; if
 */
 
 do {
-    xfer = sim_fread (&meta, meta_size, 1, uptr->fileref);  /* read a metadatum */
+    xfer = sim_tape_fread (uptr, &meta, meta_size, 1);  /* read a metadatum */
 
     if (ferror (uptr->fileref)) {                       /* read error? */
         uptr->pos = gap_pos;                            /* restore original position */
@@ -2477,7 +3751,7 @@ do {
         return sim_tape_ioerr (uptr);                   /* translate error */
         }
 
-    else if (xfer != 1 && feof (uptr->fileref) == 0) {  /* otherwise if a partial metadatum was read */
+    else if (xfer != 1 && sim_tape_feof (uptr) == 0) {  /* otherwise if a partial metadatum was read */
         uptr->pos = gap_pos;                            /*   then restore the original position */
         MT_SET_PNU (uptr);                              /* set the position-not-updated flag */
         return MTSE_INVRL;                              /*   and return an invalid record length error */
@@ -2486,7 +3760,7 @@ do {
     else                                                /* otherwise we had a good read */
         uptr->pos = uptr->pos + meta_size;              /*   so move the tape over the datum */
 
-    if (feof (uptr->fileref) || (meta == MTR_EOM)) {    /* at eof or eom? */
+    if (sim_tape_feof (uptr) || (meta == MTR_EOM)) {    /* at eof or eom? */
         gap_alloc = gap_alloc + gap_needed;             /* allocate remainder */
         gap_needed = 0;
         }
@@ -2660,7 +3934,7 @@ if (gap_size == meta_size) {                            /* if the request is for
     if (sim_tape_seek (uptr, uptr->pos))                /* position the tape; if it fails */
         return sim_tape_ioerr (uptr);                   /*   then quit with I/O error status */
 
-    (void)sim_fread (&metadatum, meta_size, 1, uptr->fileref);/* read a metadatum */
+    (void)sim_tape_fread (uptr, &metadatum, meta_size, 1);/* read a metadatum */
 
     if (ferror (uptr->fileref))                             /* if a file I/O error occurred */
         return sim_tape_ioerr (uptr);                       /*   then report the error and quit */
@@ -2672,8 +3946,8 @@ if (gap_size == meta_size) {                            /* if the request is for
         else {                                              /*   otherwise */
             metadatum = MTR_GAP;                            /*     replace it with an erase gap marker */
 
-            xfer = sim_fwrite (&metadatum, meta_size,   /* write the gap marker */
-                               1, uptr->fileref);
+            xfer = sim_tape_fwrite (uptr, &metadatum,   /* write the gap marker */
+                                    meta_size, 1);
 
             if (ferror (uptr->fileref) || (xfer == 0))  /* if a file I/O error occurred */
                 return sim_tape_ioerr (uptr);           /* report the error and quit */
@@ -2748,6 +4022,7 @@ if (ctx == NULL)                                        /* if not properly attac
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_wrgap(unit=%d, gaplen=%u)\n", (int)(uptr-ctx->dptr->units), gaplen);
+AIO_SYNC (uptr);
 
 if (density == 0)                                       /* if the density has not been set */
     return MTSE_IOERR;                                  /*   then report an I/O error */
@@ -2786,6 +4061,7 @@ const t_mtrlnt meta_size = sizeof (t_mtrlnt);           /* the number of bytes p
 const t_mtrlnt gap_size = bc + 2 * meta_size;           /* the requested gap size in bytes */
 
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_errecf(unit=%d, bc=%u)\n", (int)(uptr-(uptr->dptr->units)), bc);
+AIO_SYNC (uptr);
 
 if (bc == 0)                                            /* if a zero-length erase is requested */
     return tape_erase_fwd (uptr, meta_size);            /*   then erase a metadatum marker */
@@ -2815,6 +4091,7 @@ const t_mtrlnt meta_size = sizeof (t_mtrlnt);           /* the number of bytes p
 const t_mtrlnt gap_size = bc + 2 * meta_size;           /* the requested gap size in bytes */
 
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_errecr(unit=%d, bc=%u)\n", (int)(uptr-(uptr->dptr->units)), bc);
+AIO_SYNC (uptr);
 
 if (bc == 0)                                            /* if a zero-length erase is requested */
     return tape_erase_rev (uptr, meta_size);            /*   then erase a metadatum marker */
@@ -2849,6 +4126,7 @@ t_stat st;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_sprecf(unit=%d)\n", (int)(uptr-ctx->dptr->units));
+AIO_SYNC (uptr);
 
 st = sim_tape_rdrlfwd (uptr, bc);                       /* get record length */
 *bc = MTR_L (*bc);
@@ -2893,7 +4171,11 @@ t_mtrlnt tbc;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_sprecsf(unit=%d, count=%d)\n", (int)(uptr-ctx->dptr->units), count);
+AIO_SYNC (uptr);
 
+st = sim_tape_index_space (uptr, count, skipped, FALSE);/* indexed records first */
+if (st != MTSE_OK)
+    return st;
 while (*skipped < count) {                              /* loop */
     st = sim_tape_sprecf (uptr, &tbc);                  /* spc rec */
     if (st != MTSE_OK)
@@ -2940,6 +4222,7 @@ t_stat st;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_sprecr(unit=%d)\n", (int)(uptr-ctx->dptr->units));
+AIO_SYNC (uptr);
 
 if (MT_TST_PNU (uptr)) {
     MT_CLR_PNU (uptr);
@@ -2990,7 +4273,11 @@ t_mtrlnt tbc;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_sprecsr(unit=%d, count=%d)\n", (int)(uptr-ctx->dptr->units), count);
+AIO_SYNC (uptr);
 
+st = sim_tape_index_space (uptr, count, skipped, TRUE); /* indexed records first */
+if (st != MTSE_OK)
+    return st;
 while (*skipped < count) {                              /* loop */
     st = sim_tape_sprecr (uptr, &tbc);                  /* spc rec rev */
     if (st != MTSE_OK)
@@ -3041,6 +4328,7 @@ uint32 filerecsskipped;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_spfilebyrecf(unit=%d, count=%d, check_leot=%d)\n", (int)(uptr-ctx->dptr->units), count, check_leot);
+AIO_SYNC (uptr);
 
 if (check_leot) {
     t_mtrlnt rbc;
@@ -3112,6 +4400,7 @@ uint32 totalrecsskipped;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_spfilef(unit=%d, count=%d)\n", (int)(uptr-ctx->dptr->units), count);
+AIO_SYNC (uptr);
 
 return sim_tape_spfilebyrecf (uptr, count, skipped, &totalrecsskipped, FALSE);
 }
@@ -3157,6 +4446,7 @@ uint32 filerecsskipped;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_spfilebyrecr(unit=%d, count=%d)\n", (int)(uptr-ctx->dptr->units), count);
+AIO_SYNC (uptr);
 
 while (*skipped < count) {                              /* loop */
     while (1) {
@@ -3211,6 +4501,7 @@ uint32 totalrecsskipped;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_spfiler(unit=%d, count=%d)\n", (int)(uptr-ctx->dptr->units), count);
+AIO_SYNC (uptr);
 
 return sim_tape_spfilebyrecr (uptr, count, skipped, &totalrecsskipped);
 }
@@ -3234,6 +4525,7 @@ if (uptr->flags & UNIT_ATT) {
     if (ctx == NULL)                                    /* if not properly attached? */
         return sim_messagef (SCPE_IERR, "Bad Attach\n");/*   that's a problem */
     sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_rewind(unit=%d)\n", (int)(uptr-ctx->dptr->units));
+    AIO_SYNC (uptr);
     }
 uptr->pos = 0;
 if (uptr->flags & UNIT_ATT) {
@@ -3264,6 +4556,7 @@ t_stat r = MTSE_OK;
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API|MTSE_DBG_POS, uptr, "sim_tape_position(unit=%d, flags=0x%X, recs=%d, files=%d)\n", (int)(uptr-ctx->dptr->units), flags, recs, files);
+AIO_SYNC (uptr);
 
 if (flags & MTPOS_M_REW)
     r = sim_tape_rewind (uptr);
@@ -3329,6 +4622,7 @@ if (!(uptr->flags & UNIT_ATT))                          /* attached? */
 if (ctx == NULL)                                        /* if not properly attached? */
     return sim_messagef (SCPE_IERR, "Bad Attach\n");    /*   that's a problem */
 sim_debug_unit (MTSE_DBG_API, uptr, "sim_tape_reset(unit=%d)\n", (int)(uptr-ctx->dptr->units));
+AIO_SYNC (uptr);
 
 _sim_tape_io_flush(uptr);
 AIO_VALIDATE(uptr);
@@ -3356,7 +4650,10 @@ return (uptr->capac && (uptr->pos >= uptr->capac))? TRUE: FALSE;
 
 t_bool sim_tape_wrp (UNIT *uptr)
 {
-return ((uptr->flags & MTUF_WRP) || (uptr->flags & UNIT_RO) || (MT_GET_FMT (uptr) == MTUF_F_TPC))? TRUE: FALSE;
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
+
+return ((uptr->flags & MTUF_WRP) || (uptr->flags & UNIT_RO) || (MT_GET_FMT (uptr) == MTUF_F_TPC) ||
+        ((ctx != NULL) && (ctx->gz != NULL)))? TRUE: FALSE;
 }
 
 /* Process I/O error */
@@ -3429,11 +4726,11 @@ if ((uptr == NULL) || (uptr->fileref == NULL))
     return 0;
 countmap = (uint32 *)calloc (65536, sizeof(*countmap));
 recbuf = (uint8 *)malloc (65536);
-tape_size = (t_addr)sim_fsize (uptr->fileref);
+tape_size = (t_addr)sim_tape_size (uptr);
 sim_debug_unit (MTSE_DBG_STR, uptr, "tpc_map: tape_size: %" T_ADDR_FMT "u\n", tape_size);
 for (objc = 0, sizec = 0, tpos = 0;; ) {
     (void)sim_tape_seek (uptr, tpos);
-    i = sim_fread (&bc, sizeof (bc), 1, uptr->fileref);
+    i = sim_tape_fread (uptr, &bc, sizeof (bc), 1);
     if (i == 0)     /* past or at eof? */
         break;
     if (bc > 65535) /* Range check length value to satisfy Coverity */
@@ -3446,7 +4743,7 @@ for (objc = 0, sizec = 0, tpos = 0;; ) {
     if (bc) {
         sim_debug_unit (MTSE_DBG_STR, uptr, "tpc_map: %d byte count at pos: %" T_ADDR_FMT "u\n", bc, tpos);
         if (map && sim_deb && (dptr->dctrl & MTSE_DBG_STR)) {
-            (void)sim_fread (recbuf, 1, bc, uptr->fileref);
+            (void)sim_tape_fread (uptr, recbuf, 1, bc);
             sim_data_trace(dptr, uptr, (((uptr->dctrl | dptr->dctrl) & MTSE_DBG_DAT) ? recbuf : NULL), "", bc, "Data Record", MTSE_DBG_STR);
             }
         }
@@ -3529,6 +4826,7 @@ return msgbuf;
 
 static t_stat sim_tape_validate_tape (UNIT *uptr)
 {
+struct tape_context *ctx = (struct tape_context *)uptr->tape_ctx;
 t_addr saved_pos = uptr->pos;
 uint32 data_total = 0;
 uint32 tapemark_total = 0;
@@ -3657,6 +4955,9 @@ while (r == SCPE_OK) {
         }
     }
 uptr->tape_eom = uptr->pos;
+if ((r == MTSE_EOM) && (ctx->index != NULL) &&         /* indexed all the way to EOM? */
+    (ctx->index->end == (t_offset)uptr->pos))
+    ctx->index->complete = TRUE;
 if (!stop_cpu) {            /* if SIGINT didn't interrupt the scan */
     sim_messagef (SCPE_OK, "%s: Tape Image %s'%s' scanned as %s format\n", sim_uname (uptr),
                            ((MT_GET_FMT (uptr) >= MTUF_F_ANSI) ? "made from " : ""), uptr->filename,
@@ -4341,51 +5642,762 @@ static struct classify_test {
         {NULL}
     };
 
-static t_stat sim_tape_test_classify_file_contents (UNIT *uptr)
+static t_stat sim_tape_test_classify_file_contents (UNIT *uptr)
+{
+struct classify_test *t;
+FILE *f;
+size_t mrs;
+t_bool lf_lines;
+t_bool crlf_lines;
+
+for (t = classify_tests; t->testname != NULL; t++) {
+    (void)remove (t->testname);
+    f = fopen (t->testname, "wb+");
+    if (f == NULL)
+        return sim_messagef (SCPE_ARG, "Error creating test file '%s' - %s\n", t->testname, strerror (errno));
+    fprintf (f, "%s", t->testdata);
+    tape_classify_file_contents (f, &mrs, &lf_lines, &crlf_lines);
+    fclose (f);
+    if ((mrs != t->expected_mrs) || (lf_lines != t->expected_lf_lines) || (crlf_lines != t->expected_crlf_lines))
+        return sim_messagef (SCPE_ARG, "%s was unexpectedly reported to having MRS=%d, lf_lines=%s, crlf_lines=%s\n",
+                                       t->testname, (int)mrs, lf_lines ? "true" : "false", crlf_lines ? "true" : "false");
+    if (t->success_attach_args) {
+        char args[CBUFSIZE*2];
+        t_stat r;
+
+        snprintf (args, sizeof (args), "%s -v %s %s", sim_uname (uptr), t->success_attach_args, t->testname);
+        r = attach_cmd (0, args);
+        if (r != SCPE_OK)
+            return sim_messagef (r, "ATTACH %s failed\n", args);
+        detach_cmd (0, sim_uname (uptr));
+        }
+    if (t->fail_attach_args) {
+        char args[CBUFSIZE*2];
+        t_stat r;
+
+        snprintf (args, sizeof (args), "%s -v %s %s", sim_uname (uptr), t->fail_attach_args, t->testname);
+        r = attach_cmd (0, args);
+        if (r == SCPE_OK) {
+            detach_cmd (0, sim_uname (uptr));
+            return sim_messagef (r, "** UNEXPECTED ATTACH SUCCESS ** %s\n", args);
+            }
+        }
+    (void)remove (t->testname);
+    }
+return SCPE_OK;
+}
+
+/* Windowed image access: records written through the window, across
+   several window lengths, read back forward, in reverse, after being
+   overwritten in the middle of the tape and in chunks */
+
+#define MTSE_BTEST_RECS 300
+
+static t_mtrlnt _sim_tape_test_buffered_size (uint32 rec)
+{
+return (rec * 2503 + 11) % 8000 + 1;
+}
+
+static t_stat _sim_tape_test_buffered_check (UNIT *uptr, uint8 *buf, uint32 rec, t_mtrlnt bc, t_stat st, uint32 seed)
+{
+t_mtrlnt i;
+
+if ((st != MTSE_OK) || (bc != _sim_tape_test_buffered_size (rec)))
+    return sim_messagef (SCPE_IERR, "Record %u: status %d, %u bytes\n", rec, st, bc);
+for (i = 0; i < bc; i++) {
+    if (buf[i] != (uint8)(rec * seed + i))
+        return sim_messagef (SCPE_IERR, "Record %u: unexpected data at offset %u\n", rec, i);
+    }
+return SCPE_OK;
+}
+
+static t_stat sim_tape_test_buffered (UNIT *uptr)
+{
+const char *filename = "TapeTestBuffered.simh";
+struct tape_context *ctx;
+uint8 *buf = (uint8 *)malloc (8192);
+uint32 rec, fills, skipped;
+t_mtrlnt bc, i, got;
+t_stat r = SCPE_OK, st;
+
+if (buf == NULL)
+    return SCPE_MEM;
+sim_printf ("\n*** Windowed tape image tests\n");
+(void)remove (filename);
+sim_tape_set_fmt (uptr, 0, "SIMH", NULL);
+sim_switches = 0;
+r = sim_tape_attach_ex (uptr, filename, 0, 0);
+if (r != SCPE_OK) {
+    free (buf);
+    return r;
+    }
+ctx = (struct tape_context *)uptr->tape_ctx;
+if (ctx->tbuf == NULL)
+    r = sim_messagef (SCPE_IERR, "Image isn't windowed\n");
+for (rec = 0; (r == SCPE_OK) && (rec < MTSE_BTEST_RECS); rec++) {
+    bc = _sim_tape_test_buffered_size (rec);
+    for (i = 0; i < bc; i++)
+        buf[i] = (uint8)(rec * 7 + i);
+    if (sim_tape_wrrecf (uptr, buf, bc) != MTSE_OK)
+        r = sim_messagef (SCPE_IERR, "Writing record %u failed\n", rec);
+    }
+if ((r == SCPE_OK) && (sim_tape_wrtmk (uptr) != MTSE_OK))
+    r = SCPE_IERR;
+fills = ctx->tbuf_fills;
+sim_tape_rewind (uptr);
+for (rec = 0; (r == SCPE_OK) && (rec < MTSE_BTEST_RECS); rec++) {
+    st = sim_tape_rdrecf (uptr, buf, &bc, 8192);
+    r = _sim_tape_test_buffered_check (uptr, buf, rec, bc, st, 7);
+    }
+if ((r == SCPE_OK) && (sim_tape_rdrecf (uptr, buf, &bc, 8192) != MTSE_TMK))
+    r = sim_messagef (SCPE_IERR, "Missing tape mark\n");
+if (r == SCPE_OK)
+    sim_printf ("%u records (%s bytes) read forward with %u image reads\n", MTSE_BTEST_RECS,
+                sim_fmt_numeric ((double)uptr->pos), ctx->tbuf_fills - fills);
+if ((r == SCPE_OK) && (sim_tape_rdrecr (uptr, buf, &bc, 8192) != MTSE_TMK))
+    r = sim_messagef (SCPE_IERR, "Missing tape mark in reverse\n");
+for (rec = MTSE_BTEST_RECS; (r == SCPE_OK) && (rec-- > 0); ) {
+    st = sim_tape_rdrecr (uptr, buf, &bc, 8192);
+    r = _sim_tape_test_buffered_check (uptr, buf, rec, bc, st, 7);
+    }
+if ((r == SCPE_OK) && !sim_tape_bot (uptr))
+    r = sim_messagef (SCPE_IERR, "Reverse reads didn't end at BOT\n");
+if (r == SCPE_OK) {                                     /* overwrite from record 150 */
+    sim_tape_sprecsf (uptr, 150, &skipped);
+    bc = _sim_tape_test_buffered_size (150);
+    for (i = 0; i < bc; i++)
+        buf[i] = (uint8)(150 * 13 + i);
+    if ((skipped != 150) || (sim_tape_wrrecf (uptr, buf, bc) != MTSE_OK) || (sim_tape_wrtmk (uptr) != MTSE_OK))
+        r = sim_messagef (SCPE_IERR, "Overwriting record 150 failed\n");
+    }
+sim_tape_detach (uptr);                                 /* written data must reach the file */
+sim_tape_set_fmt (uptr, 0, "SIMH", NULL);
+if (r == SCPE_OK) {
+    sim_switches = SWMASK ('R');
+    r = sim_tape_attach_ex (uptr, filename, 0, 0);
+    sim_switches = 0;
+    }
+for (rec = 0; (r == SCPE_OK) && (rec <= 150); rec++) {
+    st = sim_tape_rdrecf (uptr, buf, &bc, 8192);
+    r = _sim_tape_test_buffered_check (uptr, buf, rec, bc, st, (rec == 150) ? 13 : 7);
+    }
+if ((r == SCPE_OK) && (sim_tape_rdrecf (uptr, buf, &bc, 8192) != MTSE_TMK))
+    r = sim_messagef (SCPE_IERR, "Missing tape mark after overwritten record\n");
+if (r == SCPE_OK) {                                     /* chunked reads of record 3 */
+    sim_tape_rewind (uptr);
+    sim_tape_set_chunk_mode (uptr, 512);
+    sim_tape_sprecsf (uptr, 3, &skipped);
+    for (got = 0; (r == SCPE_OK) && (got < _sim_tape_test_buffered_size (3)); got += bc) {
+        st = sim_tape_rdrecf (uptr, buf + got, &bc, 512);
+        if ((st != MTSE_OK) || (bc == 0))
+            r = sim_messagef (SCPE_IERR, "Chunked read failed\n");
+        }
+    if (r == SCPE_OK)
+        r = _sim_tape_test_buffered_check (uptr, buf, 3, got, MTSE_OK, 7);
+    if ((r == SCPE_OK) && ((sim_tape_rdrecf (uptr, buf, &bc, 8192) != MTSE_OK) || (bc != _sim_tape_test_buffered_size (4))))
+        r = sim_messagef (SCPE_IERR, "Read after chunked record failed\n");
+    sim_tape_set_chunk_mode (uptr, 0);
+    }
+sim_printf ("Windowed tape image %s\n", (r == SCPE_OK) ? "OK" : "FAILED");
+sim_tape_detach (uptr);
+(void)remove (filename);
+free (buf);
+return r;
+}
+
+/* Image index tests: spacing through an index built by the attach time
+   scan, through one loaded from the index file, and after a write */
+
+#define MTSE_ITEST_FILES 12
+
+static t_mtrlnt _sim_tape_test_index_size (uint32 file, uint32 rec)
+{
+return ((file + rec) % 4) * 200 + 81;
+}
+
+static uint32 _sim_tape_test_index_recs (uint32 file)
+{
+return (file * 7) % 13 + 1;
+}
+
+static t_stat _sim_tape_test_index_attach (UNIT *uptr, const char *filename)
+{
+sim_tape_set_fmt (uptr, 0, "SIMH", NULL);
+sim_switches = 0;
+return sim_tape_attach_ex (uptr, filename, 0, 0);
+}
+
+static t_stat sim_tape_test_index (UNIT *uptr)
+{
+const char *filename = "TapeTestIndex.simh";
+char idxname[CBUFSIZE];
+t_addr file_start[MTSE_ITEST_FILES + 1];
+struct tape_index *idx;
+DEVICE *dptr = find_dev_from_unit (uptr);
+uint8 buf[1024];
+uint32 file, rec, skipped, recs;
+t_addr pos;
+t_stat r, st;
+
+sim_printf ("\n*** Tape image index tests\n");
+sim_tape_index_name (filename, idxname, sizeof (idxname));
+(void)remove (filename);
+(void)remove (idxname);
+r = sim_tape_set_index (dptr, uptr, MT_INDEX_UNIT | MT_INDEX, NULL);
+if (r != SCPE_OK)
+    return r;
+r = _sim_tape_test_index_attach (uptr, filename);
+for (file = 0; (r == SCPE_OK) && (file < MTSE_ITEST_FILES); file++) {
+    file_start[file] = uptr->pos;
+    for (rec = 0; (r == SCPE_OK) && (rec < _sim_tape_test_index_recs (file)); rec++) {
+        memset (buf, (int)(file + rec), sizeof (buf));
+        if (sim_tape_wrrecf (uptr, buf, _sim_tape_test_index_size (file, rec)) != MTSE_OK)
+            r = SCPE_IERR;
+        }
+    if ((r == SCPE_OK) && (sim_tape_wrtmk (uptr) != MTSE_OK))
+        r = SCPE_IERR;
+    }
+file_start[MTSE_ITEST_FILES] = uptr->pos;
+if ((r == SCPE_OK) && (sim_tape_wrtmk (uptr) != MTSE_OK))
+    r = SCPE_IERR;
+if (r == SCPE_OK) {
+    sim_tape_detach (uptr);                             /* written, so no index file */
+    if (sim_fsize_name_ex (idxname) > 0)
+        r = sim_messagef (SCPE_IERR, "Index file saved for a written image\n");
+    }
+if (r == SCPE_OK)                                       /* the attach time scan indexes the image */
+    r = _sim_tape_test_index_attach (uptr, filename);
+for (recs = 0; (r == SCPE_OK) && (recs < 2); recs++) {  /* built by the scan, then loaded from the file */
+    idx = ((struct tape_context *)uptr->tape_ctx)->index;
+    if ((idx == NULL) || !idx->complete || (idx->loaded != (recs == 1)) || (idx->tmks != MTSE_ITEST_FILES + 1)) {
+        r = sim_messagef (SCPE_IERR, "Unexpected index state\n");
+        break;
+        }
+    for (file = 1; (r == SCPE_OK) && (file <= MTSE_ITEST_FILES); file += 3) {
+        sim_tape_rewind (uptr);
+        st = sim_tape_spfilef (uptr, file, &skipped);
+        if ((st != MTSE_OK) || (skipped != file) || (uptr->pos != file_start[file]))
+            r = sim_messagef (SCPE_IERR, "Spacing %u files forward ended at %" T_ADDR_FMT "u rather than %" T_ADDR_FMT "u\n", file, uptr->pos, file_start[file]);
+        }
+    if (r == SCPE_OK) {                                 /* records within file 7, then back 2 files */
+        sim_tape_rewind (uptr);
+        sim_tape_spfilef (uptr, 7, &skipped);
+        st = sim_tape_sprecsf (uptr, 3, &skipped);
+        pos = file_start[7];
+        for (rec = 0; rec < 3; rec++)
+            pos += 2 * sizeof (t_mtrlnt) + ((_sim_tape_test_index_size (7, rec) + 1) & ~1);
+        if ((st != MTSE_OK) || (skipped != 3) || (uptr->pos != pos))
+            r = sim_messagef (SCPE_IERR, "Spacing 3 records ended at %" T_ADDR_FMT "u rather than %" T_ADDR_FMT "u\n", uptr->pos, pos);
+        st = sim_tape_spfiler (uptr, 2, &skipped);
+        if ((r == SCPE_OK) && ((st != MTSE_OK) || (skipped != 2) || (uptr->pos != file_start[6] - sizeof (t_mtrlnt))))
+            r = sim_messagef (SCPE_IERR, "Spacing 2 files reverse ended at %" T_ADDR_FMT "u\n", uptr->pos);
+        st = sim_tape_sprecsr (uptr, 1000, &skipped);
+        if ((r == SCPE_OK) && ((st != MTSE_TMK) || (skipped != _sim_tape_test_index_recs (5)) || (uptr->pos != file_start[5] - sizeof (t_mtrlnt))))
+            r = sim_messagef (SCPE_IERR, "Spacing records reverse to a tape mark ended at %" T_ADDR_FMT "u\n", uptr->pos);
+        sim_tape_rewind (uptr);
+        sim_tape_sprecsf (uptr, 1, &skipped);
+        st = sim_tape_sprecsr (uptr, 10, &skipped);
+        if ((r == SCPE_OK) && ((st != MTSE_BOT) || (skipped != 1) || (uptr->pos != 0)))
+            r = sim_messagef (SCPE_IERR, "Spacing records reverse to BOT failed\n");
+        }
+    if ((r == SCPE_OK) && (idx->hits == 0))
+        r = sim_messagef (SCPE_IERR, "Index wasn't used\n");
+    if (r == SCPE_OK)
+        sim_printf ("%u records and %u tapemarks %s, %u spacing operations done from the index\n",
+                    idx->objs - idx->tmks, idx->tmks, (recs == 0) ? "indexed at attach" : "loaded", idx->hits);
+    sim_tape_detach (uptr);
+    if ((r == SCPE_OK) && (recs == 0) && (sim_fsize_name_ex (idxname) == 0))
+        r = sim_messagef (SCPE_IERR, "Index file wasn't saved\n");
+    if (r == SCPE_OK)
+        r = _sim_tape_test_index_attach (uptr, filename);
+    }
+if (r == SCPE_OK) {                                     /* overwrite file 3 */
+    idx = ((struct tape_context *)uptr->tape_ctx)->index;
+    sim_tape_rewind (uptr);
+    sim_tape_spfilef (uptr, 3, &skipped);
+    memset (buf, 0xFF, sizeof (buf));
+    if ((sim_tape_wrrecf (uptr, buf, 100) != MTSE_OK) || (sim_tape_wrtmk (uptr) != MTSE_OK))
+        r = SCPE_IERR;
+    if ((r == SCPE_OK) && ((idx->end > (t_offset)file_start[3]) || idx->complete))
+        r = sim_messagef (SCPE_IERR, "Index wasn't truncated by a write\n");
+    sim_tape_rewind (uptr);
+    sim_tape_spfilef (uptr, 3, &skipped);
+    st = sim_tape_sprecsf (uptr, 5, &skipped);
+    if ((r == SCPE_OK) && ((st != MTSE_TMK) || (skipped != 1)))
+        r = sim_messagef (SCPE_IERR, "Spacing the rewritten file found %u records\n", skipped);
+    sim_tape_detach (uptr);
+    if ((r == SCPE_OK) && (sim_fsize_name_ex (idxname) > 0))
+        r = sim_messagef (SCPE_IERR, "Stale index file wasn't removed\n");
+    }
+sim_printf ("Tape image index %s\n", (r == SCPE_OK) ? "OK" : "FAILED");
+if (uptr->flags & UNIT_ATT)
+    sim_tape_detach (uptr);
+sim_tape_set_index (dptr, uptr, MT_INDEX_UNIT, NULL);
+(void)remove (filename);
+(void)remove (idxname);
+return r;
+}
+
+/* Generated tapes: an ANSI and a DOS11 tape made from a text file and a
+   binary file are produced as they are read, read back in reverse from
+   the host files, and detect a host file which changed after attach */
+
+#define MTSE_GTEST_RECS 2000
+
+static t_stat _sim_tape_test_generated_files (uint32 bin_size)
+{
+FILE *f;
+uint32 i, j;
+
+f = fopen ("TapeTestGen1.txt", "wb");
+if (f == NULL)
+    return SCPE_OPENERR;
+for (i = 0; i < 300; i++) {                         /* a 511 byte line puts a DOS11 CR at a block end */
+    for (j = 0; j < ((i == 0) ? 511 : (i * 37) % 600); j++)
+        fputc ('A' + (i + j) % 26, f);
+    fputc ('\n', f);
+    }
+fclose (f);
+f = fopen ("TapeTestGen2.bin", "wb");
+if (f == NULL)
+    return SCPE_OPENERR;
+for (i = 0; i < bin_size; i++)
+    fputc ((int)((i * 7) & 0xFF), f);
+fclose (f);
+return SCPE_OK;
+}
+
+static t_stat sim_tape_test_generated (UNIT *uptr)
+{
+static const char *formats[] = {"ANSI-VMS", "DOS11", NULL};
+uint32 *sums = (uint32 *)calloc (MTSE_GTEST_RECS, sizeof (*sums));
+t_mtrlnt *sizes = (t_mtrlnt *)calloc (MTSE_GTEST_RECS, sizeof (*sizes));
+uint8 *buf = (uint8 *)malloc (MTR_MAXLEN);
+uint32 i, fmt, recs, tmks, sum;
+t_mtrlnt bc;
+MEMORY_TAPE *tape;
+t_stat r = SCPE_OK, st;
+
+sim_printf ("\n*** Generated tape tests\n");
+if ((sums == NULL) || (sizes == NULL) || (buf == NULL))
+    r = SCPE_MEM;
+for (fmt = 0; (r == SCPE_OK) && (formats[fmt] != NULL); fmt++) {
+    r = _sim_tape_test_generated_files (20000);
+    if (r != SCPE_OK)
+        break;
+    sim_tape_set_fmt (uptr, 0, formats[fmt], NULL);
+    sim_switches = 0;
+    r = sim_tape_attach_ex (uptr, "TapeTestGen*", 0, 0);
+    if (r != SCPE_OK)
+        break;
+    tape = (MEMORY_TAPE *)uptr->fileref;
+    if ((tape->record_count > 1) || tape->complete) {
+        r = sim_messagef (SCPE_IERR, "%u records were generated at attach\n", tape->record_count);
+        break;
+        }
+    recs = tmks = 0;
+    while ((r == SCPE_OK) && (recs < MTSE_GTEST_RECS)) {
+        st = sim_tape_rdrecf (uptr, buf, &bc, MTR_MAXLEN);
+        if (st == MTSE_EOM)
+            break;
+        if ((st != MTSE_OK) && (st != MTSE_TMK))
+            r = sim_messagef (SCPE_IERR, "Forward read of record %u returned: %s\n", recs, sim_tape_error_text (st));
+        sizes[recs] = bc;
+        for (i = sums[recs] = 0; i < bc; i++)
+            sums[recs] = sums[recs] * 31 + buf[i];
+        if (st == MTSE_TMK)
+            ++tmks;
+        ++recs;
+        }
+    if ((r == SCPE_OK) && (!tape->complete || (tape->record_count != recs) || (uptr->tape_eom != recs)))
+        r = sim_messagef (SCPE_IERR, "%s tape wasn't completely generated by reading it\n", formats[fmt]);
+    while ((r == SCPE_OK) && (recs > 0)) {              /* reread each record from its host file */
+        --recs;
+        st = sim_tape_rdrecr (uptr, buf, &bc, MTR_MAXLEN);
+        for (i = sum = 0; i < bc; i++)
+            sum = sum * 31 + buf[i];
+        if ((st != ((sizes[recs] == 0) ? MTSE_TMK : MTSE_OK)) || (bc != sizes[recs]) || (sum != sums[recs]))
+            r = sim_messagef (SCPE_IERR, "%s record %u differs when read in reverse\n", formats[fmt], recs);
+        }
+    if (r == SCPE_OK)
+        sim_printf ("%s: %u records and %u tapemarks generated from %u files\n", formats[fmt], tape->record_count - tmks, tmks, tape->file_count);
+    if (r == SCPE_OK) {                                 /* shrink a file behind the tape's back */
+        _sim_tape_test_generated_files (100);
+        sim_tape_rewind (uptr);
+        do
+            st = sim_tape_rdrecf (uptr, buf, &bc, MTR_MAXLEN);
+        while ((st == MTSE_OK) || (st == MTSE_TMK));
+        if (st != MTSE_IOERR)
+            r = sim_messagef (SCPE_IERR, "A changed host file wasn't detected: %s\n", sim_tape_error_text (st));
+        }
+    sim_tape_detach (uptr);
+    }
+sim_tape_set_fmt (uptr, 0, "SIMH", NULL);
+sim_printf ("Generated tape %s\n", (r == SCPE_OK) ? "OK" : "FAILED");
+if (uptr->flags & UNIT_ATT)
+    sim_tape_detach (uptr);
+(void)remove ("TapeTestGen1.txt");
+(void)remove ("TapeTestGen2.bin");
+free (sums);
+free (sizes);
+free (buf);
+return r;
+}
+
+/* Compressed images: SIMH and AWS images written as two concatenated
+   gzip members read the same as the uncompressed image forward, in
+   reverse and when spacing, with decompression restarting at access
+   points */
+
+#if defined (HAVE_ZLIB)
+
+#define MTSE_ZTEST_FILES 6
+#define MTSE_ZTEST_RECS 300
+
+static t_mtrlnt _sim_tape_test_compressed_size (uint32 file, uint32 rec)
+{
+return 1000 + ((file * 31 + rec * 53) % 16000);
+}
+
+static void _sim_tape_test_compressed_data (uint32 file, uint32 rec, uint8 *buf, t_mtrlnt size)
+{
+t_mtrlnt i;
+
+for (i = 0; i < size; i++)
+    buf[i] = (uint8)(((i * (rec + 3)) >> 3) ^ (file * 7 + (i % 251)));
+}
+
+static t_stat _sim_tape_test_compressed_gzip (const char *filename, const char *gzname)
+{
+FILE *f = sim_fopen (filename, "rb");
+t_offset half = sim_fsize_name_ex (filename) / 2, done = 0;
+gzFile gzf = NULL;
+uint8 buf[65536];
+size_t n;
+t_stat r = SCPE_OK;
+
+if (f == NULL)
+    return SCPE_OPENERR;
+while ((r == SCPE_OK) && ((n = fread (buf, 1, (size_t)((gzf == NULL) ? MIN ((t_offset)sizeof (buf), half - done) : sizeof (buf)), f)) > 0)) {
+    if (gzf == NULL)
+        gzf = gzopen (gzname, "wb1");                   /* first member */
+    if ((gzf == NULL) || (gzwrite (gzf, buf, (unsigned)n) != (int)n))
+        r = SCPE_IOERR;
+    done += n;
+    if ((r == SCPE_OK) && (done == half)) {             /* second member */
+        gzclose (gzf);
+        gzf = gzopen (gzname, "ab1");
+        if (gzf == NULL)
+            r = SCPE_OPENERR;
+        half = -1;
+        }
+    }
+if (gzf != NULL)
+    gzclose (gzf);
+fclose (f);
+return r;
+}
+
+/* An index made while reading a compressed image is saved and then used
+   when the image is attached again */
+
+static t_stat _sim_tape_test_compressed_index (UNIT *uptr, const char *gzname)
+{
+DEVICE *dptr = find_dev_from_unit (uptr);
+char idxname[CBUFSIZE];
+struct tape_index *idx;
+uint32 pass;
+t_stat r;
+
+sim_tape_index_name (gzname, idxname, sizeof (idxname));
+(void)remove (idxname);
+r = sim_tape_set_index (dptr, uptr, MT_INDEX_UNIT | MT_INDEX, NULL);
+for (pass = 0; (r == SCPE_OK) && (pass < 2); pass++) {
+    sim_switches = 0;
+    r = sim_tape_attach_ex (uptr, gzname, 0, 0);
+    if (r != SCPE_OK)
+        break;
+    idx = ((struct tape_context *)uptr->tape_ctx)->index;
+    if ((idx == NULL) || !idx->complete || (idx->loaded != (pass == 1)))
+        r = sim_messagef (SCPE_IERR, "Compressed image index %s\n", (pass == 0) ? "wasn't made at attach" : "file wasn't used");
+    sim_tape_detach (uptr);
+    }
+sim_tape_set_index (dptr, uptr, MT_INDEX_UNIT, NULL);
+(void)remove (idxname);
+return r;
+}
+
+static t_stat sim_tape_test_compressed (UNIT *uptr)
+{
+static const char *formats[] = {"SIMH", "AWS", NULL};
+const char *filename = "TapeTestGz.tap";
+const char *gzname = "TapeTestGz.tap.gz";
+t_addr file_start[MTSE_ZTEST_FILES + 1];
+uint8 *buf = (uint8 *)malloc (MTR_MAXLEN);
+uint8 *exp = (uint8 *)malloc (MTR_MAXLEN);
+uint32 fmt, file, rec, skipped;
+t_mtrlnt bc, size;
+struct tape_gz *gz;
+t_stat r = SCPE_OK, st;
+
+sim_printf ("\n*** Compressed tape image tests\n");
+if ((buf == NULL) || (exp == NULL))
+    r = SCPE_MEM;
+for (fmt = 0; (r == SCPE_OK) && (formats[fmt] != NULL); fmt++) {
+    (void)remove (filename);
+    (void)remove (gzname);
+    sim_tape_set_fmt (uptr, 0, formats[fmt], NULL);
+    sim_switches = SWMASK ('N') | SWMASK ('Q');
+    r = sim_tape_attach_ex (uptr, filename, 0, 0);
+    for (file = 0; (r == SCPE_OK) && (file < MTSE_ZTEST_FILES); file++) {
+        file_start[file] = uptr->pos;
+        for (rec = 0; (r == SCPE_OK) && (rec < MTSE_ZTEST_RECS); rec++) {
+            size = _sim_tape_test_compressed_size (file, rec);
+            _sim_tape_test_compressed_data (file, rec, buf, size);
+            if (sim_tape_wrrecf (uptr, buf, size) != MTSE_OK)
+                r = SCPE_IERR;
+            }
+        if ((r == SCPE_OK) && (sim_tape_wrtmk (uptr) != MTSE_OK))
+            r = SCPE_IERR;
+        }
+    file_start[MTSE_ZTEST_FILES] = uptr->pos;
+    if ((r == SCPE_OK) && (sim_tape_wrtmk (uptr) != MTSE_OK))
+        r = SCPE_IERR;
+    if (uptr->flags & UNIT_ATT)
+        sim_tape_detach (uptr);
+    if (r == SCPE_OK)
+        r = _sim_tape_test_compressed_gzip (filename, gzname);
+    if ((r == SCPE_OK) && (strcmp (formats[fmt], "SIMH") == 0))
+        r = _sim_tape_test_compressed_index (uptr, gzname);
+    if (r == SCPE_OK) {
+        sim_switches = 0;
+        r = sim_tape_attach_ex (uptr, gzname, 0, 0);
+        }
+    if (r != SCPE_OK)
+        break;
+    gz = ((struct tape_context *)uptr->tape_ctx)->gz;
+    if ((gz == NULL) || !sim_tape_wrp (uptr) || (sim_tape_wrtmk (uptr) != MTSE_WRP))
+        r = sim_messagef (SCPE_IERR, "%s compressed image wasn't write protected\n", formats[fmt]);
+    for (file = 0; (r == SCPE_OK) && (file < MTSE_ZTEST_FILES); file++) {
+        for (rec = 0; (r == SCPE_OK) && (rec < MTSE_ZTEST_RECS); rec++) {
+            size = _sim_tape_test_compressed_size (file, rec);
+            _sim_tape_test_compressed_data (file, rec, exp, size);
+            st = sim_tape_rdrecf (uptr, buf, &bc, MTR_MAXLEN);
+            if ((st != MTSE_OK) || (bc != size) || (memcmp (buf, exp, size) != 0))
+                r = sim_messagef (SCPE_IERR, "%s forward read of file %u record %u differs: %s\n", formats[fmt], file, rec, sim_tape_error_text (st));
+            }
+        if ((r == SCPE_OK) && (sim_tape_rdrecf (uptr, buf, &bc, MTR_MAXLEN) != MTSE_TMK))
+            r = sim_messagef (SCPE_IERR, "%s tape mark missing after file %u\n", formats[fmt], file);
+        }
+    if ((r == SCPE_OK) && (sim_tape_rdrecr (uptr, buf, &bc, MTR_MAXLEN) != MTSE_TMK))
+        r = SCPE_IERR;
+    for (file = MTSE_ZTEST_FILES; (r == SCPE_OK) && (file > 0); file--) {
+        for (rec = MTSE_ZTEST_RECS; (r == SCPE_OK) && (rec > 0); rec--) {
+            size = _sim_tape_test_compressed_size (file - 1, rec - 1);
+            _sim_tape_test_compressed_data (file - 1, rec - 1, exp, size);
+            st = sim_tape_rdrecr (uptr, buf, &bc, MTR_MAXLEN);
+            if ((st != MTSE_OK) || (bc != size) || (memcmp (buf, exp, size) != 0))
+                r = sim_messagef (SCPE_IERR, "%s reverse read of file %u record %u differs: %s\n", formats[fmt], file - 1, rec - 1, sim_tape_error_text (st));
+            }
+        st = sim_tape_rdrecr (uptr, buf, &bc, MTR_MAXLEN);
+        if ((r == SCPE_OK) && (st != ((file == 1) ? MTSE_BOT : MTSE_TMK)))
+            r = sim_messagef (SCPE_IERR, "%s reverse read before file %u returned: %s\n", formats[fmt], file - 1, sim_tape_error_text (st));
+        }
+    for (file = 1; (r == SCPE_OK) && (file <= MTSE_ZTEST_FILES); file += 2) {
+        sim_tape_rewind (uptr);
+        st = sim_tape_spfilef (uptr, file, &skipped);
+        if ((st != MTSE_OK) || (skipped != file) || (uptr->pos != file_start[file]))
+            r = sim_messagef (SCPE_IERR, "%s spacing %u files forward ended at %" T_ADDR_FMT "u rather than %" T_ADDR_FMT "u\n", formats[fmt], file, uptr->pos, file_start[file]);
+        st = sim_tape_sprecsf (uptr, MTSE_ZTEST_RECS / 2, &skipped);
+        if ((r == SCPE_OK) && (file < MTSE_ZTEST_FILES)) {
+            size = _sim_tape_test_compressed_size (file, MTSE_ZTEST_RECS / 2);
+            _sim_tape_test_compressed_data (file, MTSE_ZTEST_RECS / 2, exp, size);
+            if ((st != MTSE_OK) || (skipped != MTSE_ZTEST_RECS / 2) ||
+                (sim_tape_rdrecf (uptr, buf, &bc, MTR_MAXLEN) != MTSE_OK) || (bc != size) || (memcmp (buf, exp, size) != 0))
+                r = sim_messagef (SCPE_IERR, "%s spacing records in file %u failed\n", formats[fmt], file);
+            }
+        }
+    if ((r == SCPE_OK) && ((gz->pts == 0) || (gz->restarts == 0)))
+        r = sim_messagef (SCPE_IERR, "%s compressed image had %u access points and %u restarts\n", formats[fmt], gz->pts, gz->restarts);
+    if (r == SCPE_OK)
+        sim_printf ("%s: %" LL_FMT "u byte image in %" LL_FMT "u compressed bytes, %u access points, %u restarts\n",
+                    formats[fmt], (t_uint64)gz->size, (t_uint64)sim_fsize_name_ex (gzname), gz->pts, gz->restarts);
+    sim_tape_detach (uptr);
+    }
+sim_tape_set_fmt (uptr, 0, "SIMH", NULL);
+sim_printf ("Compressed tape image %s\n", (r == SCPE_OK) ? "OK" : "FAILED");
+if (uptr->flags & UNIT_ATT)
+    sim_tape_detach (uptr);
+(void)remove (filename);
+(void)remove (gzname);
+free (buf);
+free (exp);
+return r;
+}
+
+#endif /* HAVE_ZLIB */
+
+/* Queued requests: many forward reads outstanding at once complete in
+   order, and one at a time reads use the record read ahead while a
+   reverse read, a write and spacing still see the tape exactly where the
+   completed requests left it */
+
+#if defined (SIM_ASYNCH_IO)
+
+#define MTSE_QTEST_RECS 40
+
+static uint32 sim_tape_queue_test_done;
+static t_stat sim_tape_queue_test_status[MTSE_QTEST_RECS + 2];
+
+static void _sim_tape_queue_test_callback (UNIT *uptr, t_stat status)
 {
-struct classify_test *t;
-FILE *f;
-size_t mrs;
-t_bool lf_lines;
-t_bool crlf_lines;
+if (sim_tape_queue_test_done < MTSE_QTEST_RECS + 2)
+    sim_tape_queue_test_status[sim_tape_queue_test_done] = status;
+++sim_tape_queue_test_done;
+}
 
-for (t = classify_tests; t->testname != NULL; t++) {
-    (void)remove (t->testname);
-    f = fopen (t->testname, "wb+");
-    if (f == NULL)
-        return sim_messagef (SCPE_ARG, "Error creating test file '%s' - %s\n", t->testname, strerror (errno));
-    fprintf (f, "%s", t->testdata);
-    tape_classify_file_contents (f, &mrs, &lf_lines, &crlf_lines);
-    fclose (f);
-    if ((mrs != t->expected_mrs) || (lf_lines != t->expected_lf_lines) || (crlf_lines != t->expected_crlf_lines))
-        return sim_messagef (SCPE_ARG, "%s was unexpectedly reported to having MRS=%d, lf_lines=%s, crlf_lines=%s\n",
-                                       t->testname, (int)mrs, lf_lines ? "true" : "false", crlf_lines ? "true" : "false");
-    if (t->success_attach_args) {
-        char args[CBUFSIZE*2];
-        t_stat r;
+static t_mtrlnt _sim_tape_queue_test_size (uint32 rec)
+{
+return 100 + rec * 37;
+}
 
-        snprintf (args, sizeof (args), "%s -v %s %s", sim_uname (uptr), t->success_attach_args, t->testname);
-        r = attach_cmd (0, args);
-        if (r != SCPE_OK)
-            return sim_messagef (r, "ATTACH %s failed\n", args);
-        detach_cmd (0, sim_uname (uptr));
-        }
-    if (t->fail_attach_args) {
-        char args[CBUFSIZE*2];
-        t_stat r;
+/* Issue one request and wait for it, as a controller would */
 
-        snprintf (args, sizeof (args), "%s -v %s %s", sim_uname (uptr), t->fail_attach_args, t->testname);
-        r = attach_cmd (0, args);
-        if (r == SCPE_OK) {
-            detach_cmd (0, sim_uname (uptr));
-            return sim_messagef (r, "** UNEXPECTED ATTACH SUCCESS ** %s\n", args);
-            }
-        }
-    (void)remove (t->testname);
+static t_stat _sim_tape_queue_test_one (UNIT *uptr, int top, uint8 *buf, t_mtrlnt *bc)
+{
+uint32 skipped;
+
+sim_tape_queue_test_done = 0;
+switch (top) {
+    case TOP_RDRF:
+        sim_tape_rdrecf_a (uptr, buf, bc, MTR_MAXLEN, _sim_tape_queue_test_callback);
+        break;
+    case TOP_RDRR:
+        sim_tape_rdrecr_a (uptr, buf, bc, MTR_MAXLEN, _sim_tape_queue_test_callback);
+        break;
+    case TOP_WREC:
+        sim_tape_wrrecf_a (uptr, buf, *bc, _sim_tape_queue_test_callback);
+        break;
+    case TOP_SPRR:
+        sim_tape_sprecr_a (uptr, &skipped, _sim_tape_queue_test_callback);
+        break;
     }
-return SCPE_OK;
+sim_tape_drain (uptr);
+return (sim_tape_queue_test_done == 1) ? sim_tape_queue_test_status[0] : SCPE_IERR;
+}
+
+static t_stat sim_tape_test_queued (UNIT *uptr)
+{
+const char *filename = "TapeTestQueue.simh";
+int saved_asynch = sim_asynch_enabled;
+t_addr rec_pos[MTSE_QTEST_RECS + 1];
+t_mtrlnt bcs[MTSE_QTEST_RECS + 1];
+uint8 *bufs = (uint8 *)malloc ((MTSE_QTEST_RECS + 1) * 2048);
+uint8 buf[2048];
+DEVICE *dptr = find_dev_from_unit (uptr);
+struct tape_context *ctx;
+uint32 rec, i;
+t_mtrlnt bc;
+t_stat r = SCPE_OK, st;
+
+sim_printf ("\n*** Tape queued request tests\n");
+if (bufs == NULL)
+    return SCPE_MEM;
+(void)remove (filename);
+sim_asynch_enabled = TRUE;
+sim_tape_set_fmt (uptr, 0, "SIMH", NULL);
+sim_switches = SWMASK ('N') | SWMASK ('Q');
+r = sim_tape_attach_ex (uptr, filename, 0, 0);
+for (rec = 0; (r == SCPE_OK) && (rec < MTSE_QTEST_RECS); rec++) {
+    rec_pos[rec] = uptr->pos;
+    memset (buf, (int)(rec + 1), sizeof (buf));
+    if (sim_tape_wrrecf (uptr, buf, _sim_tape_queue_test_size (rec)) != MTSE_OK)
+        r = SCPE_IERR;
+    }
+rec_pos[MTSE_QTEST_RECS] = uptr->pos;
+if ((r == SCPE_OK) && ((sim_tape_wrtmk (uptr) != MTSE_OK) || (sim_tape_wrtmk (uptr) != MTSE_OK)))
+    r = SCPE_IERR;
+if (uptr->flags & UNIT_ATT)
+    sim_tape_detach (uptr);
+if (r == SCPE_OK)
+    r = sim_tape_set_prefetch (dptr, uptr, MT_PREFETCH_UNIT | MT_PREFETCH, NULL);
+if (r == SCPE_OK) {
+    sim_switches = SWMASK ('Q');
+    r = sim_tape_attach_ex (uptr, filename, 0, 0);
+    }
+if (r != SCPE_OK) {
+    sim_tape_set_prefetch (dptr, uptr, MT_PREFETCH_UNIT, NULL);
+    sim_asynch_enabled = saved_asynch;
+    free (bufs);
+    return r;
+    }
+ctx = (struct tape_context *)uptr->tape_ctx;
+if (!ctx->asynch_io)
+    r = sim_messagef (SCPE_IERR, "Asynchronous I/O didn't start\n");
+sim_tape_queue_test_done = 0;                           /* every record and the tape mark at once */
+for (rec = 0; (r == SCPE_OK) && (rec <= MTSE_QTEST_RECS); rec++)
+    r = sim_tape_rdrecf_a (uptr, bufs + rec * 2048, &bcs[rec], MTR_MAXLEN, _sim_tape_queue_test_callback);
+sim_tape_drain (uptr);
+if ((r == SCPE_OK) && ((sim_tape_queue_test_done != MTSE_QTEST_RECS + 1) || (ctx->q_max < 2)))
+    r = sim_messagef (SCPE_IERR, "%u of %u queued reads completed, at most %u outstanding\n", sim_tape_queue_test_done, MTSE_QTEST_RECS + 1, ctx->q_max);
+for (rec = 0; (r == SCPE_OK) && (rec <= MTSE_QTEST_RECS); rec++) {
+    st = sim_tape_queue_test_status[rec];
+    bc = (rec < MTSE_QTEST_RECS) ? _sim_tape_queue_test_size (rec) : 0;
+    if ((st != ((rec < MTSE_QTEST_RECS) ? MTSE_OK : MTSE_TMK)) || (bcs[rec] != bc))
+        r = sim_messagef (SCPE_IERR, "Queued read %u returned %d with %u bytes\n", rec, st, bcs[rec]);
+    for (i = 0; (r == SCPE_OK) && (i < bc); i++)
+        if (bufs[rec * 2048 + i] != (uint8)(rec + 1))
+            r = sim_messagef (SCPE_IERR, "Queued read %u returned the wrong data\n", rec);
+    }
+if (r == SCPE_OK)
+    sim_printf ("%u reads queued at once completed in order\n", MTSE_QTEST_RECS + 1);
+sim_tape_rewind (uptr);                                 /* one at a time, reading ahead */
+for (rec = 0; (r == SCPE_OK) && (rec < MTSE_QTEST_RECS / 2); rec++) {
+    st = _sim_tape_queue_test_one (uptr, TOP_RDRF, buf, &bc);
+    if ((st != MTSE_OK) || (bc != _sim_tape_queue_test_size (rec)) || (buf[0] != (uint8)(rec + 1)) ||
+        (uptr->pos != rec_pos[rec + 1]))
+        r = sim_messagef (SCPE_IERR, "Read %u returned %d with %u bytes at %" T_ADDR_FMT "u\n", rec, st, bc, uptr->pos);
+    }
+if ((r == SCPE_OK) && (ctx->pf_hits == 0))
+    r = sim_messagef (SCPE_IERR, "No record read ahead was used\n");
+if (r == SCPE_OK) {                                     /* change direction after a read ahead */
+    st = _sim_tape_queue_test_one (uptr, TOP_RDRR, buf, &bc);
+    if ((st != MTSE_OK) || (bc != _sim_tape_queue_test_size (rec - 1)) || (buf[0] != (uint8)rec) || (uptr->pos != rec_pos[rec - 1]))
+        r = sim_messagef (SCPE_IERR, "Reverse read after reading ahead returned %d with %u bytes at %" T_ADDR_FMT "u\n", st, bc, uptr->pos);
+    }
+if (r == SCPE_OK) {                                     /* read, then overwrite what was read ahead */
+    st = _sim_tape_queue_test_one (uptr, TOP_RDRF, buf, &bc);
+    memset (buf, 0xEE, sizeof (buf));
+    bc = 50;
+    if ((st != MTSE_OK) || (_sim_tape_queue_test_one (uptr, TOP_WREC, buf, &bc) != MTSE_OK) ||
+        (_sim_tape_queue_test_one (uptr, TOP_SPRR, buf, &bc) != MTSE_OK))
+        r = sim_messagef (SCPE_IERR, "Writing after reading ahead failed\n");
+    st = _sim_tape_queue_test_one (uptr, TOP_RDRF, buf, &bc);
+    if ((r == SCPE_OK) && ((st != MTSE_OK) || (bc != 50) || (buf[0] != 0xEE)))
+        r = sim_messagef (SCPE_IERR, "Read of the written record returned %d with %u bytes of 0x%02X\n", st, bc, buf[0]);
+    }
+if (r == SCPE_OK) {                                     /* rewind while reading ahead */
+    sim_tape_rewind (uptr);
+    st = _sim_tape_queue_test_one (uptr, TOP_RDRF, buf, &bc);
+    if ((st != MTSE_OK) || (bc != _sim_tape_queue_test_size (0)) || (buf[0] != 1) || (uptr->pos != rec_pos[1]))
+        r = sim_messagef (SCPE_IERR, "Read after a rewind returned %d with %u bytes at %" T_ADDR_FMT "u\n", st, bc, uptr->pos);
+    }
+if (r == SCPE_OK)
+    sim_printf ("%u requests queued, %u records read ahead, %u used\n", ctx->q_requests, ctx->pf_reads, ctx->pf_hits);
+sim_tape_drain (uptr);
+AIO_UPDATE_QUEUE;                                       /* collect the completion activations */
+sim_cancel (uptr);
+sim_tape_detach (uptr);
+sim_tape_set_prefetch (dptr, uptr, MT_PREFETCH_UNIT, NULL);
+sim_asynch_enabled = saved_asynch;
+sim_printf ("Tape queued requests %s\n", (r == SCPE_OK) ? "OK" : "FAILED");
+(void)remove (filename);
+free (bufs);
+return r;
 }
 
+#endif /* SIM_ASYNCH_IO */
+
 t_stat sim_tape_test (DEVICE *dptr, const char *cptr)
 {
 int32 saved_switches = sim_switches;
@@ -4456,6 +6468,22 @@ SIM_TEST(sim_tape_test_process_tape_file (dptr->units, "TapeTestFile1", "e11", 0
 sim_switches = saved_switches;
 SIM_TEST(sim_tape_test_process_tape_file (dptr->units, "TapeTestFile1", "simh", 0));
 
+sim_switches = saved_switches;
+SIM_TEST(sim_tape_test_buffered (dptr->units));
+
+sim_switches = saved_switches;
+SIM_TEST(sim_tape_test_index (dptr->units));
+
+SIM_TEST(sim_tape_test_generated (dptr->units));
+
+#if defined (HAVE_ZLIB)
+SIM_TEST(sim_tape_test_compressed (dptr->units));
+#endif
+
+#if defined (SIM_ASYNCH_IO)
+SIM_TEST(sim_tape_test_queued (dptr->units));
+#endif
+
 sim_switches = saved_switches;
 if ((sim_switches & SWMASK ('D')) == 0)
     SIM_TEST(sim_tape_test_remove_tape_files (dptr->units, "TapeTestFile1"));
@@ -4638,27 +6666,48 @@ static void ansi_fill_text_buffer (FILE *f, char *buf, size_t buf_size, size_t r
     free (tmp);
     }
 
-static t_bool memory_tape_add_block (MEMORY_TAPE *tape, uint8 *block, uint32 size)
+static t_bool memory_tape_add_record (MEMORY_TAPE *tape, t_offset offset, uint32 size, uint32 source)
 {
 TAPE_RECORD *rec;
 
-ASSURE((size == 0) == (block == NULL));
-
 if (tape->array_size <= tape->record_count) {
-    TAPE_RECORD **new_records;
-    new_records = (TAPE_RECORD **)realloc (tape->records, (tape->array_size + 1000) * sizeof (*tape->records));
+    TAPE_RECORD *new_records;
+    uint32 new_size = (tape->array_size == 0) ? 1000 : 2 * tape->array_size;
+
+    new_records = (TAPE_RECORD *)realloc (tape->records, new_size * sizeof (*tape->records));
     if (new_records == NULL)
         return TRUE;                /* no memory error */
     tape->records = new_records;
-    memset (tape->records + tape->array_size, 0, 1000 * sizeof (*tape->records));
-    tape->array_size += 1000;
+    tape->array_size = new_size;
     }
-rec = (TAPE_RECORD *)malloc (sizeof (*rec) + size);
-if (rec == NULL)
-    return TRUE;                    /* no memory error */
+rec = &tape->records[tape->record_count++];
+rec->offset = offset;
 rec->size = size;
-memcpy (rec->data, block, size);
-tape->records[tape->record_count++] = rec;
+rec->source = source;
+return FALSE;
+}
+
+/* Add a label record (or a tape mark when size is 0) to the tape */
+
+static t_bool memory_tape_add_block (MEMORY_TAPE *tape, uint8 *block, uint32 size)
+{
+ASSURE((size == 0) == (block == NULL));
+
+if (tape->label_size < tape->label_len + size) {
+    uint8 *new_labels;
+    size_t new_size = 2 * (tape->label_size + size);
+
+    new_labels = (uint8 *)realloc (tape->labels, new_size);
+    if (new_labels == NULL)
+        return TRUE;                /* no memory error */
+    tape->labels = new_labels;
+    tape->label_size = new_size;
+    }
+if (memory_tape_add_record (tape, (t_offset)tape->label_len, size, 0))
+    return TRUE;                    /* no memory error */
+if (size > 0)
+    memcpy (tape->labels + tape->label_len, block, size);
+tape->label_len += size;
 return FALSE;
 }
 
@@ -4669,24 +6718,61 @@ MEMORY_TAPE *tape = (MEMORY_TAPE *)vtape;
 
 if (tape == NULL)
     return;
-for (i = 0; i < tape->record_count; i++) {
-    free (tape->records[i]);
-    tape->records[i] = NULL;
-    }
+if (tape->gen_f != NULL)
+    fclose (tape->gen_f);
+if (tape->read_f != NULL)
+    fclose (tape->read_f);
+for (i = 0; i < tape->file_count; i++)
+    free (tape->sources[i].filename);
+free (tape->sources);
+free (tape->labels);
+free (tape->data);
 free (tape->records);
 free (tape);
 }
 
-MEMORY_TAPE *memory_create_tape (void)
+MEMORY_TAPE *memory_create_tape (uint32 format)
 {
 MEMORY_TAPE *tape = (MEMORY_TAPE *)calloc (1, sizeof (*tape));
 
 if (NULL == tape)
     return tape;
 tape->ansi_type = -1;
+tape->format = format;
+tape->verbose = ((sim_switches & SWMASK ('V')) != 0);
+tape->ebcdic = ((sim_switches & SWMASK ('C')) != 0);
+tape->data_rec = TAPE_NO_REC;
 return tape;
 }
 
+/* Add a host file whose contents will be placed on the tape when
+   generation reaches it */
+
+static t_bool memory_tape_add_source (MEMORY_TAPE *tape, const char *filename, const char *name)
+{
+TAPE_SOURCE *src;
+
+if (tape->source_size <= tape->file_count) {
+    TAPE_SOURCE *new_sources;
+    uint32 new_size = (tape->source_size == 0) ? 16 : 2 * tape->source_size;
+
+    new_sources = (TAPE_SOURCE *)realloc (tape->sources, new_size * sizeof (*tape->sources));
+    if (new_sources == NULL)
+        return TRUE;                /* no memory error */
+    tape->sources = new_sources;
+    tape->source_size = new_size;
+    }
+src = &tape->sources[tape->file_count];
+memset (src, 0, sizeof (*src));
+src->filename = (char *)malloc (strlen (filename) + 1);
+if (src->filename == NULL)
+    return TRUE;                    /* no memory error */
+strcpy (src->filename, filename);
+src->name = src->filename + (name - filename);
+++tape->file_count;
+return FALSE;
+}
+
 static const char rad50[] = " ABCDEFGHIJKLMNOPQRSTUVWXYZ%.%0123456789";
 
 static uint16 dos11_ascR50(char *inbuf)
@@ -4716,70 +6802,46 @@ static void dos11_sanitize(char *buf, int len, const char *inbuf)
     }
 }
 
-static int dos11_copy_ascii_file (FILE *f, MEMORY_TAPE *tape, char *buf, size_t bufSize)
-{
-char ch, tmp[512];
-t_bool crlast = FALSE;
-int error = 0;
-size_t i, data_read, offset = 0;
-
-while (!feof (f) && !error) {
-    data_read = fread (tmp, 1, sizeof (tmp), f);
-    if (data_read > 0)
-        for (i = 0; i < data_read; i++) {
-            ch = tmp[i];
-            if (ch == '\n') {
-                if (!crlast) {
-                    buf[offset++] = '\r';
-                    if (offset == bufSize) {
-                        error = memory_tape_add_block (tape, (uint8 *)buf, bufSize);
-                        offset = 0;
-                        }
-                    }
-                buf[offset++] = ch;
-                if (offset == bufSize) {
-                    error = memory_tape_add_block (tape, (uint8 *)buf, bufSize);
-                    offset = 0;
-                    }
-                crlast = FALSE;
-                }
-            else {
-                crlast = ch == '\r';
+/* Fill a DOS11 block with text, inserting a CR before each bare LF.
+   crlast carries whether the previous character was a CR from one block
+   to the next; when an inserted CR ends a block its LF is left unread so
+   that the next block starts with it. */
 
-                buf[offset++] = ch;
-                if (offset == bufSize) {
-                    error = memory_tape_add_block (tape, (uint8 *)buf, bufSize);
-                    offset = 0;
-                    }
-                }
+static size_t dos11_fill_text_buffer (FILE *f, char *buf, size_t bufSize, t_bool *crlast)
+{
+int ch;
+size_t offset = 0;
+
+while ((offset < bufSize) && (EOF != (ch = fgetc (f)))) {
+    if ((ch == '\n') && !*crlast) {
+        buf[offset++] = '\r';
+        if (offset == bufSize) {
+            ungetc (ch, f);
+            *crlast = TRUE;
+            break;
             }
-    }
-    if (offset > 0) {
-        /* RSTS COPY to a DOS volume pads the last block with zeros     */
-        /* VMS EXCHANGE COPY /RECORD_FORMAT=STREAM and RSX-11 FLX /FA   */
-        /* output to a DOS volume do not                                */
-        /* DOS-11 ignores NULs in ASCII data transfer modes             */
-        memset (buf + offset, 0, bufSize - offset);
-        error = memory_tape_add_block (tape, (uint8 *)buf, bufSize);
         }
-
-return error;
+    buf[offset++] = (char)ch;
+    *crlast = (ch == '\r');
+    }
+if ((offset > 0) && (offset < bufSize)) {
+    /* RSTS COPY to a DOS volume pads the last block with zeros     */
+    /* VMS EXCHANGE COPY /RECORD_FORMAT=STREAM and RSX-11 FLX /FA   */
+    /* output to a DOS volume do not                                */
+    /* DOS-11 ignores NULs in ASCII data transfer modes             */
+    memset (buf + offset, 0, bufSize - offset);
+    offset = bufSize;
+    }
+return offset;
 }
 
-static void sim_tape_add_dos11_entry (const char *directory,
-                                      const char *filename,
-                                      t_offset FileSize,
-                                      const struct stat *filestat,
-                                      void *context)
+/* Start a DOS11 file: classify its contents and add its header record */
+
+static void dos11_start_file (MEMORY_TAPE *tape, TAPE_SOURCE *src, FILE *f)
 {
-MEMORY_TAPE *tape = (MEMORY_TAPE *)context;
-char FullPath[PATH_MAX + 1];
-FILE *f;
 size_t max_record_size;
 t_bool lf_line_endings;
 t_bool crlf_line_endings;
-uint8 *block = NULL;
-int error = 0;
 DOS11_HDR hdr;
 char fname[9], ext[3];
 const char *ptr;
@@ -4793,7 +6855,7 @@ int year;
  * same calendar as the current year but will be in the 20th century so that
  * DOS/BATCH-11 will be able to interpret it correctly.
  */
-filetime = (time_t)filestat->st_ctime;
+filetime = src->ctime;
 tm = localtime (&filetime);
 year = tm->tm_year + 1900;
 while (year >= 2000)
@@ -4801,19 +6863,16 @@ while (year >= 2000)
 
 fileday = 1000 * ((year - 70) % 100) + tm->tm_yday + 1;
 
-sprintf (FullPath, "%s%s", directory, filename);
-f = tape_open_and_check_file (FullPath);
- if (f == NULL)
-    return;
-
 tape_classify_file_contents (f, &max_record_size, &lf_line_endings, &crlf_line_endings);
+src->text = (lf_line_endings || crlf_line_endings);
+src->crlf = crlf_line_endings;
 
 memset (&hdr, 0, sizeof (hdr));
 memset (fname, ' ', sizeof (fname));
 memset (ext, ' ', sizeof (ext));
 
-dos11_sanitize (fname, sizeof (fname), filename);
-ptr = strchr (filename, '.');
+dos11_sanitize (fname, sizeof (fname), src->name);
+ptr = strchr (src->name, '.');
 if (ptr != NULL)
     dos11_sanitize (ext, sizeof (ext), ++ptr);
 
@@ -4824,7 +6883,7 @@ if (ptr != NULL)
 if (fname[0] == ' ') {
   char temp[10];
 
-  sprintf(temp, "%06u   ", tape->file_count % 100000);
+  sprintf(temp, "%06u   ", (uint32)(src - tape->sources) % 100000);
   memcpy(fname, temp, sizeof(fname));
 }
 
@@ -4838,30 +6897,28 @@ hdr.date = fileday;
 hdr.fname3 = dos11_ascR50 (&fname[6]);
 
 memory_tape_add_block (tape, (uint8 *)&hdr, sizeof (hdr));
+}
 
-rewind (f);
-block = (uint8 *)calloc (tape->block_size, 1);
-
-if (lf_line_endings || crlf_line_endings)
-    error = dos11_copy_ascii_file (f, tape, (char *)block, tape->block_size);
-else {
-    size_t data_read;
-
-    while (!feof (f) && !error) {
-        data_read = fread (block, 1, tape->block_size, f);
-        if (data_read > 0)
-            error = memory_tape_add_block (tape, block, data_read);
-        }
-    }
+static void sim_tape_add_dos11_entry (const char *directory,
+                                      const char *filename,
+                                      t_offset FileSize,
+                                      const struct stat *filestat,
+                                      void *context)
+{
+MEMORY_TAPE *tape = (MEMORY_TAPE *)context;
+char FullPath[PATH_MAX + 1];
+FILE *f;
 
+sprintf (FullPath, "%s%s", directory, filename);
+f = tape_open_and_check_file (FullPath);
+if (f == NULL)
+    return;
 fclose (f);
-free (block);
-if (error)
-    sim_messagef (SCPE_IERR, "Error processing input file %s\n", FullPath);
-memory_tape_add_block (tape, NULL, 0); /* Tape Mark */
-++tape->file_count;
+if (memory_tape_add_source (tape, FullPath, FullPath + strlen (directory)))
+    sim_messagef (SCPE_MEM, "Error processing input file %s\n", FullPath);
+else
+    tape->sources[tape->file_count - 1].ctime = (time_t)filestat->st_ctime;
 }
-
 static FILE *tape_open_and_check_file (const char *filename)
 {
 FILE *file = fopen(filename, "rb");
@@ -4952,7 +7009,7 @@ return 0;
 
 MEMORY_TAPE *ansi_create_tape (const char *label, uint32 block_size, uint32 ansi_type)
 {
-MEMORY_TAPE *tape = memory_create_tape ();
+MEMORY_TAPE *tape = memory_create_tape (MTUF_F_ANSI);
 
 if (NULL == tape)
     return tape;
@@ -4963,31 +7020,27 @@ memory_tape_add_block (tape, (uint8 *)&tape->vol1, sizeof (tape->vol1));
 return tape;
 }
 
+/* Check that a host file can be placed on an ANSI tape and add it to the
+   tape's files.  The file contents are read again when generation reaches
+   the file. */
+
 static int ansi_add_file_to_tape (MEMORY_TAPE *tape, const char *filename)
 {
 FILE *f;
 struct ansi_tape_parameters *ansi = &ansi_args[tape->ansi_type];
-uint8 *block = NULL;
+TAPE_SOURCE *src;
 size_t rms_record_size, max_record_size;
 t_bool lf_line_endings, crlf_line_endings;
-char file_sequence[5];
-int block_count = 0;
-char block_count_string[17];
-int error = FALSE;
-HDR1 hdr1;
-HDR2 hdr2;
-HDR3 hdr3;
-HDR4 hdr4;
 
 f = tape_open_and_check_file (filename);
 if (f == NULL)
     return TRUE;
 
 tape_classify_file_contents (f, &rms_record_size, &lf_line_endings, &crlf_line_endings);
+fclose (f);
 if (!lf_line_endings && !crlf_line_endings) {           /* Binary File? */
     if (ansi->record_format == 'D') {                   /* ANSI format forces 'D' Record Format? */
         sim_messagef (SCPE_ARG, "%s format does not support binary files\n", ansi->name);
-        fclose (f);
         return TRUE;
         }
     max_record_size = rms_record_size;
@@ -5012,7 +7065,6 @@ else {                                                  /* Text file */
                                                       1 - ansi->skip_lf_line_endings);
             sim_messagef (SCPE_ARG, "Text file: %s has lines longer (%d) than %s format allows (%d)\n",
                                     filename, (int)rms_record_size, ansi->name, (int)max_allowed);
-            fclose (f);
             return TRUE;
             }
         }
@@ -5021,88 +7073,83 @@ else {                                                  /* Text file */
 if (max_record_size > tape->block_size) {
     sim_messagef (SCPE_ARG, "%s file: %s requires a minimum block size of %d\n",
                             (lf_line_endings || crlf_line_endings) ? "Text" : "Binary", filename, (int)max_record_size);
-    fclose (f);
     return TRUE;
     }
-ansi_make_HDR1 (&hdr1, &tape->vol1, &hdr4, filename, tape->ansi_type);
-sprintf (file_sequence, "%04d", 1 + tape->file_count);
-memcpy (hdr1.file_sequence, file_sequence, sizeof (hdr1.file_sequence));
-ansi_make_HDR2 (&hdr2, !lf_line_endings && !crlf_line_endings, tape->block_size, max_record_size, tape->ansi_type);
+if (memory_tape_add_source (tape, filename, filename)) {
+    sim_messagef (SCPE_MEM, "Error processing input file %s\n", filename);
+    return TRUE;
+    }
+src = &tape->sources[tape->file_count - 1];
+src->text = (lf_line_endings || crlf_line_endings);
+src->crlf = crlf_line_endings;
+src->rms_record_size = rms_record_size;
+src->max_record_size = max_record_size;
+return FALSE;
+}
+
+/* Start an ANSI file: add its header labels and the tape mark which
+   precedes its data */
+
+static void ansi_start_file (MEMORY_TAPE *tape, TAPE_SOURCE *src)
+{
+struct ansi_tape_parameters *ansi = &ansi_args[tape->ansi_type];
+char file_sequence[5];
+
+memset (&tape->hdr3, ' ', sizeof (tape->hdr3));
+ansi_make_HDR1 (&tape->hdr1, &tape->vol1, &tape->hdr4, src->filename, tape->ansi_type);
+snprintf (file_sequence, sizeof (file_sequence), "%04u", (uint32)(1 + (src - tape->sources)) % 10000);
+memcpy (tape->hdr1.file_sequence, file_sequence, sizeof (tape->hdr1.file_sequence));
+ansi_make_HDR2 (&tape->hdr2, !src->text, tape->block_size, src->max_record_size, tape->ansi_type);
 
 if (!(ansi->nohdr3)) {               /* Need HDR3? */
     char size[5];
-    if (!lf_line_endings && !crlf_line_endings)         /* Binary File? */
-        memcpy (&hdr3, ansi->hdr3_fixed, sizeof (hdr3));
+    if (!src->text)                                     /* Binary File? */
+        memcpy (&tape->hdr3, ansi->hdr3_fixed, sizeof (tape->hdr3));
     else {                                              /* Text file */
-        if (lf_line_endings && !(ansi->fixed_text))
-            memcpy (&hdr3, ansi->hdr3_lf_line_endings, sizeof (hdr3));
+        if (!src->crlf && !(ansi->fixed_text))
+            memcpy (&tape->hdr3, ansi->hdr3_lf_line_endings, sizeof (tape->hdr3));
         else
-            memcpy (&hdr3, ansi->hdr3_crlf_line_endings, sizeof (hdr3));
+            memcpy (&tape->hdr3, ansi->hdr3_crlf_line_endings, sizeof (tape->hdr3));
         }
-    sprintf (size, "%04x", (uint16)rms_record_size);
-    memcpy (hdr3.rms_attributes, size, 4);
+    sprintf (size, "%04x", (uint16)src->rms_record_size);
+    memcpy (tape->hdr3.rms_attributes, size, 4);
     }
-memory_tape_add_block (tape, (uint8 *)&hdr1, sizeof (hdr1));
+memory_tape_add_block (tape, (uint8 *)&tape->hdr1, sizeof (tape->hdr1));
 if (!(ansi->nohdr2))
-    memory_tape_add_block (tape, (uint8 *)&hdr2, sizeof (hdr2));
+    memory_tape_add_block (tape, (uint8 *)&tape->hdr2, sizeof (tape->hdr2));
 if (!(ansi->nohdr3))
-    memory_tape_add_block (tape, (uint8 *)&hdr3, sizeof (hdr3));
-if ((0 != memcmp (hdr4.extra_name_used, "00", 2)) && !(ansi->nohdr3) && !(ansi->nohdr2))
-    memory_tape_add_block (tape, (uint8 *)&hdr4, sizeof (hdr4));
+    memory_tape_add_block (tape, (uint8 *)&tape->hdr3, sizeof (tape->hdr3));
+if ((0 != memcmp (tape->hdr4.extra_name_used, "00", 2)) && !(ansi->nohdr3) && !(ansi->nohdr2))
+    memory_tape_add_block (tape, (uint8 *)&tape->hdr4, sizeof (tape->hdr4));
 memory_tape_add_block (tape, NULL, 0);        /* Tape Mark */
-rewind (f);
-block = (uint8 *)calloc (tape->block_size, 1);
-while (!feof (f) && !error) {
-    size_t data_read = tape->block_size;
-
-    if (lf_line_endings || crlf_line_endings)           /* Text file? */
-        ansi_fill_text_buffer (f, (char *)block, tape->block_size,
-                               crlf_line_endings ? ansi->skip_crlf_line_endings : ansi->skip_lf_line_endings,
-                               ansi->fixed_text);
-
-    else {                                              /* Binary file */
-        size_t runt = 0;
-
-        data_read = fread (block, 1, tape->block_size, f);
-        if (max_record_size > 0)                /* always will be true but Xcode thinks otherwise */
-            runt = data_read % max_record_size; /* data_read (=0) % anypositivenumber == 0 */
-        /* Pad short records with zeros */
-        if (runt > 0) {
-            size_t nPad = max_record_size - runt;
-            memset (block + data_read, 0, nPad);
-            data_read += nPad;
-            }
-        }
+}
+
+/* End an ANSI file: add the tape mark which follows its data, its
+   trailer labels and the tape mark after them */
+
+static void ansi_end_file (MEMORY_TAPE *tape)
+{
+struct ansi_tape_parameters *ansi = &ansi_args[tape->ansi_type];
+char block_count_string[17];
 
-    if (data_read > 0) {
-        error = memory_tape_add_block (tape, block, data_read);
-        if (!error)
-            ++block_count;
-        }
-    }
-fclose (f);
-free (block);
 memory_tape_add_block (tape, NULL, 0);        /* Tape Mark */
-memcpy (hdr1.type, "EOF", sizeof (hdr1.type));
-memcpy (hdr2.type, "EOF", sizeof (hdr2.type));
-memcpy (hdr3.type, "EOF", sizeof (hdr3.type));
-memcpy (hdr4.type, "EOF", sizeof (hdr4.type));
-sprintf (block_count_string, "%06d", block_count);
-memcpy (hdr1.block_count, block_count_string, sizeof (hdr1.block_count));
-memory_tape_add_block (tape, (uint8 *)&hdr1, sizeof (hdr1));
+memcpy (tape->hdr1.type, "EOF", sizeof (tape->hdr1.type));
+memcpy (tape->hdr2.type, "EOF", sizeof (tape->hdr2.type));
+memcpy (tape->hdr3.type, "EOF", sizeof (tape->hdr3.type));
+memcpy (tape->hdr4.type, "EOF", sizeof (tape->hdr4.type));
+sprintf (block_count_string, "%06d", (int)tape->gen_blocks);
+memcpy (tape->hdr1.block_count, block_count_string, sizeof (tape->hdr1.block_count));
+memory_tape_add_block (tape, (uint8 *)&tape->hdr1, sizeof (tape->hdr1));
 if (!(ansi->nohdr2))
-    memory_tape_add_block (tape, (uint8 *)&hdr2, sizeof (hdr2));
+    memory_tape_add_block (tape, (uint8 *)&tape->hdr2, sizeof (tape->hdr2));
 if (!(ansi->nohdr3))
-    memory_tape_add_block (tape, (uint8 *)&hdr3, sizeof (hdr3));
-if ((0 != memcmp (hdr4.extra_name_used, "00", 2)) && !(ansi->nohdr3) && !(ansi->nohdr2))
-    memory_tape_add_block (tape, (uint8 *)&hdr4, sizeof (hdr4));
+    memory_tape_add_block (tape, (uint8 *)&tape->hdr3, sizeof (tape->hdr3));
+if ((0 != memcmp (tape->hdr4.extra_name_used, "00", 2)) && !(ansi->nohdr3) && !(ansi->nohdr2))
+    memory_tape_add_block (tape, (uint8 *)&tape->hdr4, sizeof (tape->hdr4));
 memory_tape_add_block (tape, NULL, 0);        /* Tape Mark */
-if (sim_switches & SWMASK ('V'))
-    sim_messagef (SCPE_OK, "%17.17s%62.62s\n\t%d blocks of data\n", hdr1.file_ident, hdr4.extra_name, block_count);
-++tape->file_count;
-return error;
+if (tape->verbose)
+    sim_messagef (SCPE_OK, "%17.17s%62.62s\n\t%d blocks of data\n", tape->hdr1.file_ident, tape->hdr4.extra_name, (int)tape->gen_blocks);
 }
-
 static void sim_tape_add_ansi_entry (const char *directory,
                                      const char *filename,
                                      t_offset FileSize,
@@ -5117,6 +7164,226 @@ sprintf (FullPath, "%s%s", directory, filename);
 (void)ansi_add_file_to_tape (tape, FullPath);
 }
 
+/* Tape generation: records are added to a generated tape only as reads
+   reach them.  Each data record remembers where its data starts in its
+   host file so it can be produced again when it is read. */
+
+static const uint8 ascii2ebcdic[128] = {
+    0000,0001,0002,0003,0067,0055,0056,0057,
+    0026,0005,0045,0013,0014,0015,0016,0017,
+    0020,0021,0022,0023,0074,0075,0062,0046,
+    0030,0031,0077,0047,0034,0035,0036,0037,
+    0100,0117,0177,0173,0133,0154,0120,0175,
+    0115,0135,0134,0116,0153,0140,0113,0141,
+    0360,0361,0362,0363,0364,0365,0366,0367,
+    0370,0371,0172,0136,0114,0176,0156,0157,
+    0174,0301,0302,0303,0304,0305,0306,0307,
+    0310,0311,0321,0322,0323,0324,0325,0326,
+    0327,0330,0331,0342,0343,0344,0345,0346,
+    0347,0350,0351,0112,0340,0132,0137,0155,
+    0171,0201,0202,0203,0204,0205,0206,0207,
+    0210,0211,0221,0222,0223,0224,0225,0226,
+    0227,0230,0231,0242,0243,0244,0245,0246,
+    0247,0250,0251,0300,0152,0320,0241,0007};
+
+/* Produce the data record which starts at the current position of a host
+   file into tape->data.  Returns the record size, 0 if there is none. */
+
+static uint32 memory_tape_produce (MEMORY_TAPE *tape, TAPE_SOURCE *src, FILE *f, t_bool *crlast)
+{
+uint8 *block = tape->data;
+size_t data_read = 0;
+
+switch (tape->format) {
+    case MTUF_F_ANSI:
+        if (src->text) {
+            struct ansi_tape_parameters *ansi = &ansi_args[tape->ansi_type];
+
+            ansi_fill_text_buffer (f, (char *)block, tape->block_size,
+                                   src->crlf ? ansi->skip_crlf_line_endings : ansi->skip_lf_line_endings,
+                                   ansi->fixed_text);
+            data_read = tape->block_size;
+            }
+        else {
+            size_t runt = 0;
+
+            data_read = fread (block, 1, tape->block_size, f);
+            if (src->max_record_size > 0)
+                runt = data_read % src->max_record_size;
+            /* Pad short records with zeros */
+            if (runt > 0) {
+                size_t nPad = src->max_record_size - runt;
+                memset (block + data_read, 0, nPad);
+                data_read += nPad;
+                }
+            }
+        break;
+
+    case MTUF_F_FIXED:
+        if (src->text) {
+            if (fgets ((char *)block, (int)(tape->block_size + 3), f)) {
+                size_t len = strlen ((char *)block);
+
+                while ((len > 0) &&
+                       ((block[len - 1] == '\r') || (block[len - 1] == '\n')))
+                    --len;
+                memset (block + len, ' ', tape->block_size - len);
+                if (tape->ebcdic) {
+                    uint32 i;
+
+                    for (i = 0; i < tape->block_size; i++)
+                        block[i] = ascii2ebcdic[block[i] & 0177];
+                    }
+                data_read = tape->block_size;
+                }
+            }
+        else {
+            data_read = fread (block, 1, tape->block_size, f);
+            if ((data_read != 0) && (data_read != tape->block_size)) {
+                sim_messagef (SCPE_ARG, "Read %u bytes of data when expecting %u bytes\n", (uint32)data_read, (uint32)tape->block_size);
+                data_read = 0;
+                }
+            }
+        break;
+
+    case MTUF_F_DOS11:
+        if (src->text)
+            data_read = dos11_fill_text_buffer (f, (char *)block, tape->block_size, crlast);
+        else
+            data_read = fread (block, 1, tape->block_size, f);
+        break;
+        }
+return (uint32)data_read;
+}
+
+/* Generate the next part of a tape: the labels which start a file, one
+   data record, the labels which end a file or the final tape marks */
+
+static void memory_tape_generate (MEMORY_TAPE *tape)
+{
+TAPE_SOURCE *src;
+uint32 size = 0;
+t_bool error = FALSE;
+
+if (tape->gen_f == NULL) {                              /* between files? */
+    if (tape->gen_source == tape->file_count) {         /* all files done? */
+        /* RT-11 and RSTS write three tape marks at the end of an ANSI or DOS volume */
+        /* RSX-11 and VMS do not, but there is no harm in the extra tape mark       */
+        memory_tape_add_block (tape, NULL, 0);          /* Tape Mark */
+        memory_tape_add_block (tape, NULL, 0);          /* Tape Mark */
+        tape->complete = TRUE;
+        return;
+        }
+    src = &tape->sources[tape->gen_source++];
+    tape->gen_f = tape_open_and_check_file (src->filename);
+    if (tape->gen_f == NULL) {                          /* file gone since attach? */
+        sim_messagef (SCPE_OPENERR, "%s was left off the tape, it can't be opened since the tape was attached\n", src->filename);
+        return;
+        }
+    if (tape->data == NULL) {
+        tape->data = (uint8 *)calloc (tape->block_size + 512 + 3, 1);
+        if (tape->data == NULL) {
+            sim_messagef (SCPE_MEM, "Error processing input file %s\n", src->filename);
+            fclose (tape->gen_f);
+            tape->gen_f = NULL;
+            return;
+            }
+        }
+    tape->gen_crlast = FALSE;
+    tape->gen_blocks = 0;
+    switch (tape->format) {
+        case MTUF_F_ANSI:
+            ansi_start_file (tape, src);
+            break;
+        case MTUF_F_DOS11:
+            dos11_start_file (tape, src, tape->gen_f);
+            break;
+            }
+    return;
+    }
+src = &tape->sources[tape->gen_source - 1];
+while ((size == 0) && !feof (tape->gen_f) && !ferror (tape->gen_f)) {
+    t_offset offset = sim_ftell (tape->gen_f);
+    uint32 state = tape->gen_crlast ? TAPE_SRC_CRLAST : 0;
+
+    tape->data_rec = TAPE_NO_REC;
+    size = memory_tape_produce (tape, src, tape->gen_f, &tape->gen_crlast);
+    if (size > 0) {
+        error = memory_tape_add_record (tape, offset, size, tape->gen_source | state);
+        if (!error) {
+            tape->data_rec = tape->record_count - 1;
+            ++tape->gen_blocks;
+            return;
+            }
+        }
+    }
+if (error || ferror (tape->gen_f))
+    sim_messagef (SCPE_IERR, "Error processing input file %s\n", src->filename);
+fclose (tape->gen_f);
+tape->gen_f = NULL;
+switch (tape->format) {
+    case MTUF_F_ANSI:
+        ansi_end_file (tape);
+        break;
+    case MTUF_F_DOS11:
+        memory_tape_add_block (tape, NULL, 0);          /* Tape Mark */
+        break;
+        }
+}
+
+/* Generate a tape's records up to record rec.  Returns FALSE if the tape
+   ends before it. */
+
+static t_bool memory_tape_generated (UNIT *uptr, uint32 rec)
+{
+MEMORY_TAPE *tape = (MEMORY_TAPE *)uptr->fileref;
+
+while ((rec >= tape->record_count) && !tape->complete)
+    memory_tape_generate (tape);
+if (tape->complete && (uptr->tape_eom == 0))            /* end now known? */
+    uptr->tape_eom = tape->record_count;
+return (rec < tape->record_count);
+}
+
+/* Return the data of record rec, producing it again from its host file
+   unless it is the most recently produced record.  Returns NULL if the
+   host file can no longer produce it. */
+
+static uint8 *memory_tape_record_data (MEMORY_TAPE *tape, uint32 rec)
+{
+TAPE_RECORD *r = &tape->records[rec];
+uint32 source = r->source & TAPE_SRC_MASK;
+t_bool crlast = ((r->source & TAPE_SRC_CRLAST) != 0);
+TAPE_SOURCE *src;
+uint32 size = 0;
+
+if (source == 0)                                        /* label? */
+    return tape->labels + (size_t)r->offset;
+if (rec == tape->data_rec)
+    return tape->data;
+src = &tape->sources[source - 1];
+if ((tape->read_f != NULL) && (tape->read_source != source)) {
+    fclose (tape->read_f);
+    tape->read_f = NULL;
+    }
+if (tape->read_f == NULL) {
+    tape->read_f = fopen (src->filename, "rb");
+    if (tape->read_f == NULL) {
+        sim_printf ("Can't open: %s - %s\n", src->filename, strerror (errno));
+        return NULL;
+        }
+    tape->read_source = source;
+    }
+tape->data_rec = TAPE_NO_REC;
+if (sim_fseeko (tape->read_f, r->offset, SEEK_SET) == 0)
+    size = memory_tape_produce (tape, src, tape->read_f, &crlast);
+if (size != r->size) {
+    sim_printf ("%s has changed since it was put on the tape\n", src->filename);
+    return NULL;
+    }
+tape->data_rec = rec;
+return tape->data;
+}
 /* export an existing tape to a SIMH tape image */
 static t_stat sim_export_tape (UNIT *uptr, const char *export_file)
 {
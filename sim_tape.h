@@ -168,6 +168,16 @@ typedef struct {
 #define MTSE_RUNAWAY    11                              /* tape runaway */
 #define MTSE_MAX_ERR    11
 
+/* Image index (SET <dev> INDEX) */
+
+#define MT_INDEX            1                           /* index the image */
+#define MT_INDEX_UNIT       2                           /* unit rather than device */
+
+/* Read ahead (SET <dev> PREFETCH) */
+
+#define MT_PREFETCH         1                           /* read the next record ahead */
+#define MT_PREFETCH_UNIT    2                           /* unit rather than device */
+
 typedef void (*TAPE_PCALLBACK)(UNIT *unit, t_stat status);
 
 /* Tape Internal Debug flags */
@@ -233,6 +243,11 @@ t_stat sim_tape_set_dens (UNIT *uptr, int32 val, CONST char *cptr, void *desc);
 t_stat sim_tape_show_dens (FILE *st, UNIT *uptr, int32 val, CONST void *desc);
 t_stat sim_tape_density_supported (char *string, size_t string_size, int32 valid_bits);
 t_stat sim_tape_set_chunk_mode (UNIT *uptr, uint32 chunk_size);
+t_stat sim_tape_set_index (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_tape_show_index (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_tape_set_prefetch (DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_tape_show_prefetch (FILE *st, DEVICE *dptr, UNIT *uptr, int32 flag, CONST char *cptr);
+t_stat sim_tape_drain (UNIT *uptr);
 const char *sim_tape_error_text (t_stat stat);
 t_stat sim_tape_set_asynch (UNIT *uptr, int latency);
 t_stat sim_tape_clr_asynch (UNIT *uptr);